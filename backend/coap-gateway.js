@@ -0,0 +1,389 @@
+#!/usr/bin/env node
+/*
+ * CoAP gateway for attendance terminals (coap:// backend URLs)
+ *
+ * Terminals POST the same JSON as over HTTP, as confirmable CoAP requests
+ * authenticated with a truncated HMAC-SHA256 option under a pre-shared key
+ * (see firmware/attendance_terminal/coap_transport.cpp). The gateway:
+ *
+ *   --forward http://localhost:3000   relays each request to the HTTP API and
+ *                                     maps the status back (201 -> 2.01,
+ *                                     429 -> 4.29 with Max-Age = Retry-After)
+ *   (no --forward)                    answers locally as a stand-in server:
+ *                                     in-memory entry/exit toggling per card
+ *                                     and an accepting heartbeat endpoint
+ *
+ * Usage:
+ *   COAP_PSK=attendee-coap-psk node coap-gateway.js [--port 5683] [--forward URL] [--delay MS]
+ *
+ * Only Node built-ins are used, so it runs without npm install.
+ */
+
+const dgram = require('dgram');
+const crypto = require('crypto');
+const http = require('http');
+const https = require('https');
+
+const TYPE_CON = 0;
+const TYPE_NON = 1;
+const TYPE_ACK = 2;
+const TYPE_RST = 3;
+const CODE_POST = 0x02;
+const OPTION_URI_PATH = 11;
+const OPTION_CONTENT_FORMAT = 12;
+const OPTION_MAX_AGE = 14;
+const OPTION_MAC = 65001;
+const FORMAT_JSON = 50;
+const MAC_SIZE = 8;
+
+const ACK_TIMEOUT_MS = 750;
+const MAX_RETRANSMIT = 2;
+const SEPARATE_AFTER_MS = 300;      // Send an empty ACK if the answer takes longer
+const EXCHANGE_LIFETIME_MS = 60000; // How long duplicates are answered from cache
+
+function parseArgs(argv) {
+  const options = { port: 5683, forward: null, delay: 0 };
+  for (let i = 2; i < argv.length; i++) {
+    const value = argv[i + 1];
+    if (argv[i] === '--port') { options.port = parseInt(value, 10); i++; }
+    else if (argv[i] === '--forward') { options.forward = value.replace(/\/$/, ''); i++; }
+    else if (argv[i] === '--delay') { options.delay = parseInt(value, 10); i++; }
+    else {
+      console.error('usage: node coap-gateway.js [--port 5683] [--forward http://host:port] [--delay MS]');
+      process.exit(2);
+    }
+  }
+  return options;
+}
+
+const options = parseArgs(process.argv);
+const psk = Buffer.from(process.env.COAP_PSK || 'attendee-coap-psk');
+
+// ========================================
+// MESSAGE CODEC
+// ========================================
+
+function mac(head, tail) {
+  return crypto.createHmac('sha256', psk).update(head).update(tail).digest().subarray(0, MAC_SIZE);
+}
+
+function decode(buffer) {
+  if (buffer.length < 4 || (buffer[0] >> 6) !== 1) return null;
+  const message = {
+    type: (buffer[0] >> 4) & 0x03,
+    code: buffer[1],
+    messageId: buffer.readUInt16BE(2),
+    token: null,
+    options: [],
+    payload: Buffer.alloc(0),
+    authentic: false
+  };
+  const tokenLength = buffer[0] & 0x0f;
+  if (tokenLength > 8 || 4 + tokenLength > buffer.length) return null;
+  message.token = buffer.subarray(4, 4 + tokenLength);
+
+  let pos = 4 + tokenLength;
+  let number = 0;
+  let macStart = -1;
+  let macEnd = -1;
+  while (pos < buffer.length && buffer[pos] !== 0xff) {
+    const start = pos;
+    let delta = buffer[pos] >> 4;
+    let length = buffer[pos] & 0x0f;
+    pos++;
+    if (delta === 15 || length === 15) return null;
+    // Extended delta/length bytes must be in the datagram (as decodeMessage() checks)
+    if (delta === 13) {
+      if (pos >= buffer.length) return null;
+      delta = 13 + buffer[pos]; pos += 1;
+    } else if (delta === 14) {
+      if (pos + 1 >= buffer.length) return null;
+      delta = 269 + buffer.readUInt16BE(pos); pos += 2;
+    }
+    if (length === 13) {
+      if (pos >= buffer.length) return null;
+      length = 13 + buffer[pos]; pos += 1;
+    } else if (length === 14) {
+      if (pos + 1 >= buffer.length) return null;
+      length = 269 + buffer.readUInt16BE(pos); pos += 2;
+    }
+    if (pos + length > buffer.length) return null;
+    number += delta;
+    if (number === OPTION_MAC && length === MAC_SIZE) {
+      macStart = start;
+      macEnd = pos + length;
+    } else {
+      message.options.push({ number, value: buffer.subarray(pos, pos + length) });
+    }
+    pos += length;
+  }
+  if (pos < buffer.length) {
+    message.payload = buffer.subarray(pos + 1);
+  }
+
+  if (macEnd > 0) {
+    const expected = mac(buffer.subarray(0, macStart), buffer.subarray(macEnd));
+    message.authentic = crypto.timingSafeEqual(expected, buffer.subarray(macEnd - MAC_SIZE, macEnd));
+  }
+  return message;
+}
+
+function optionHeader(delta, length) {
+  const bytes = [0];
+  let deltaNibble = delta;
+  let lengthNibble = length;
+  if (delta >= 269) {
+    deltaNibble = 14;
+    bytes.push((delta - 269) >> 8, (delta - 269) & 0xff);
+  } else if (delta >= 13) {
+    deltaNibble = 13;
+    bytes.push(delta - 13);
+  }
+  if (length >= 13) {
+    lengthNibble = 13;
+    bytes.push(length - 13);
+  }
+  bytes[0] = (deltaNibble << 4) | lengthNibble;
+  return Buffer.from(bytes);
+}
+
+function uintOption(value) {
+  const bytes = [];
+  while (value > 0) {
+    bytes.unshift(value & 0xff);
+    value = Math.floor(value / 256);
+  }
+  return Buffer.from(bytes);
+}
+
+// options: [{ number, value }] in ascending order; the MAC option is appended
+function encode(type, code, messageId, token, options, payload) {
+  const head = Buffer.alloc(4);
+  head[0] = (1 << 6) | (type << 4) | token.length;
+  head[1] = code;
+  head.writeUInt16BE(messageId, 2);
+
+  const parts = [head, token];
+  let last = 0;
+  for (const option of options) {
+    parts.push(optionHeader(option.number - last, option.value.length), option.value);
+    last = option.number;
+  }
+  const unsealed = Buffer.concat(parts);
+  const tail = payload && payload.length ? Buffer.concat([Buffer.from([0xff]), payload]) : Buffer.alloc(0);
+  const macOption = Buffer.concat([optionHeader(OPTION_MAC - last, MAC_SIZE), mac(unsealed, tail)]);
+  return Buffer.concat([unsealed, macOption, tail]);
+}
+
+function toCoapCode(status) {
+  if (status === 201) return (2 << 5) | 1;
+  if (status >= 200 && status < 300) return (2 << 5) | 4;     // 2.04 Changed
+  const codeClass = Math.floor(status / 100);
+  const detail = status % 100;
+  if ((codeClass === 4 || codeClass === 5) && detail < 32) return (codeClass << 5) | detail;
+  return codeClass === 4 ? (4 << 5) : (5 << 5);
+}
+
+// ========================================
+// REQUEST HANDLING
+// ========================================
+
+// Stand-in state: card -> inside?
+const presence = new Map();
+
+function answerLocally(path, body) {
+  if (path.endsWith('/device/heartbeat')) {
+    return { status: 200, body: { success: true, message: 'Heartbeat received' } };
+  }
+  if (path.endsWith('/attendance')) {
+    if (!body || !body.rfidTag) {
+      return { status: 400, body: { message: 'RFID tag is required' } };
+    }
+    const inside = !presence.get(body.rfidTag);
+    presence.set(body.rfidTag, inside);
+    return {
+      status: inside ? 201 : 200,
+      body: {
+        message: inside ? 'Entry time recorded successfully' : 'Exit time recorded successfully',
+        type: inside ? 'entry' : 'exit',
+        attendance: { userName: `Card ${body.rfidTag}` }
+      }
+    };
+  }
+  return { status: 404, body: { message: 'Not found' } };
+}
+
+function forward(path, payload) {
+  return new Promise((resolve) => {
+    const url = new URL(options.forward + path);
+    const client = url.protocol === 'https:' ? https : http;
+    const request = client.request(url, {
+      method: 'POST',
+      headers: { 'Content-Type': 'application/json', 'Content-Length': payload.length },
+      timeout: 10000
+    }, (response) => {
+      const chunks = [];
+      response.on('data', (chunk) => chunks.push(chunk));
+      response.on('end', () => {
+        const retryAfter = parseInt(response.headers['retry-after'], 10);
+        resolve({
+          status: response.statusCode,
+          raw: Buffer.concat(chunks),
+          retryAfter: Number.isFinite(retryAfter) ? retryAfter : null
+        });
+      });
+    });
+    request.on('timeout', () => request.destroy(new Error('upstream timeout')));
+    request.on('error', (err) => {
+      console.error(`⚠️ Forward to ${url} failed: ${err.message}`);
+      resolve({ status: 502, raw: Buffer.from('{"message":"Upstream unavailable"}'), retryAfter: null });
+    });
+    request.end(payload);
+  });
+}
+
+async function handle(path, payload) {
+  if (options.delay > 0) {
+    await new Promise((resolve) => setTimeout(resolve, options.delay));
+  }
+  if (options.forward) {
+    return forward(path, payload);
+  }
+  let body = null;
+  try {
+    body = JSON.parse(payload.toString());
+  } catch (err) {
+    return { status: 400, raw: Buffer.from('{"message":"Invalid JSON"}'), retryAfter: null };
+  }
+  const result = answerLocally(path, body);
+  return { status: result.status, raw: Buffer.from(JSON.stringify(result.body)), retryAfter: null };
+}
+
+// ========================================
+// EXCHANGES
+// ========================================
+
+const socket = dgram.createSocket('udp4');
+const exchanges = new Map();   // "addr:port/mid" -> { reply, acked, separate }
+let nextMessageId = crypto.randomInt(0, 0x10000);
+const stats = { requests: 0, duplicates: 0, rejected: 0, separate: 0 };
+
+function send(buffer, rinfo) {
+  socket.send(buffer, rinfo.port, rinfo.address);
+}
+
+function respond(exchange, message, rinfo, result) {
+  const responseOptions = [{ number: OPTION_CONTENT_FORMAT, value: Buffer.from([FORMAT_JSON]) }];
+  if (result.retryAfter !== null && (result.status === 429 || result.status === 503)) {
+    responseOptions.push({ number: OPTION_MAX_AGE, value: uintOption(result.retryAfter) });
+  }
+  const code = toCoapCode(result.status);
+
+  if (!exchange.acked) {
+    // Piggybacked on the ACK
+    exchange.reply = encode(TYPE_ACK, code, message.messageId, message.token, responseOptions, result.raw);
+    send(exchange.reply, rinfo);
+    return;
+  }
+
+  // Separate response: confirmable, retransmitted until the terminal ACKs it
+  stats.separate++;
+  const messageId = nextMessageId = (nextMessageId + 1) & 0xffff;
+  const reply = encode(TYPE_CON, code, messageId, message.token, responseOptions, result.raw);
+  exchange.separate = { messageId, reply, attempts: 0, timer: null };
+  const attempt = () => {
+    const separate = exchange.separate;
+    if (!separate || separate.attempts > MAX_RETRANSMIT) return;
+    send(separate.reply, rinfo);
+    separate.timer = setTimeout(attempt, ACK_TIMEOUT_MS * (1 << separate.attempts));
+    separate.attempts++;
+  };
+  attempt();
+}
+
+socket.on('message', async (buffer, rinfo) => {
+  let message = null;
+  try {
+    message = decode(buffer);
+  } catch (error) {
+    message = null;             // Malformed datagram: dropped like an unauthenticated one
+  }
+  if (!message || !message.authentic) {
+    stats.rejected++;
+    return;                     // Unauthenticated: silently dropped, as the terminal does
+  }
+
+  const peer = `${rinfo.address}:${rinfo.port}`;
+
+  // ACK for one of our separate responses
+  if (message.type === TYPE_ACK || message.type === TYPE_RST) {
+    for (const exchange of exchanges.values()) {
+      if (exchange.peer === peer && exchange.separate && exchange.separate.messageId === message.messageId) {
+        clearTimeout(exchange.separate.timer);
+        exchange.separate = null;
+      }
+    }
+    return;
+  }
+  if (message.code !== CODE_POST) {
+    if (message.type === TYPE_CON) {
+      send(encode(TYPE_ACK, (4 << 5) | 5, message.messageId, message.token, [], null), rinfo);   // 4.05
+    }
+    return;
+  }
+
+  // Retransmission: answer from the exchange instead of running it twice
+  const key = `${peer}/${message.messageId}`;
+  const known = exchanges.get(key);
+  if (known) {
+    stats.duplicates++;
+    if (known.reply) send(known.reply, rinfo);
+    else if (known.acked) send(encode(TYPE_ACK, 0, message.messageId, Buffer.alloc(0), [], null), rinfo);
+    return;
+  }
+
+  stats.requests++;
+  const exchange = { peer, reply: null, acked: message.type === TYPE_NON, separate: null };
+  exchanges.set(key, exchange);
+  setTimeout(() => {
+    if (exchange.separate) clearTimeout(exchange.separate.timer);
+    exchanges.delete(key);
+  }, EXCHANGE_LIFETIME_MS);
+
+  const path = '/' + message.options
+    .filter((option) => option.number === OPTION_URI_PATH)
+    .map((option) => option.value.toString())
+    .join('/');
+
+  // Slow answer: acknowledge now so the terminal stops retransmitting
+  const ackTimer = setTimeout(() => {
+    exchange.acked = true;
+    exchange.reply = null;
+    send(encode(TYPE_ACK, 0, message.messageId, Buffer.alloc(0), [], null), rinfo);
+  }, SEPARATE_AFTER_MS);
+
+  const result = await handle(path, message.payload);
+  clearTimeout(ackTimer);
+  respond(exchange, message, rinfo, result);
+});
+
+socket.on('listening', () => {
+  const mode = options.forward ? `forwarding to ${options.forward}` : 'stand-in mode (in-memory)';
+  console.log(`🚀 CoAP gateway on udp/${options.port}, ${mode}`);
+});
+
+socket.on('error', (err) => {
+  console.error('❌ CoAP socket error:', err.message);
+  process.exit(1);
+});
+
+process.on('SIGINT', shutdown);
+process.on('SIGTERM', shutdown);
+
+function shutdown() {
+  console.log(`📊 requests ${stats.requests}, duplicates ${stats.duplicates}, ` +
+              `rejected ${stats.rejected}, separate responses ${stats.separate}`);
+  process.exit(0);
+}
+
+socket.bind(options.port);
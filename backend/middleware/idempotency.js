@@ -0,0 +1,76 @@
+const ScanReceipt = require('../models/ScanReceipt');
+
+// Middleware making POST /attendance idempotent for terminal scans.
+// Terminals send { deviceId, seq } with every scan; seq is a persistent,
+// strictly increasing per-device number, so the pair identifies one tap no
+// matter how often the record is re-sent (sync retries after a timeout,
+// online POST that timed out and was then stored offline).
+const idempotentScanMiddleware = async (req, res, next) => {
+  const { deviceId, seq, rfidTag, timestamp } = req.body || {};
+
+  // Older firmware and manual clients: no key, process as before
+  if (!deviceId || !Number.isInteger(seq) || seq <= 0) {
+    return next();
+  }
+
+  try {
+    let receipt;
+    try {
+      receipt = await ScanReceipt.create({ deviceId, seq, rfidTag, timestamp });
+    } catch (error) {
+      if (error.code !== 11000) {
+        throw error;
+      }
+
+      const existing = await ScanReceipt.findOne({ deviceId, seq });
+      if (!existing) {
+        // Expired or released between the insert and the lookup
+        return idempotentScanMiddleware(req, res, next);
+      }
+
+      if (existing.rfidTag === rfidTag && existing.timestamp === timestamp) {
+        if (existing.state === 'done') {
+          res.set('Idempotent-Replay', 'true');
+          return res.status(existing.statusCode).json(existing.response);
+        }
+        // First attempt still in flight; the terminal keeps the record and retries
+        return res.status(409).json({ error: 'Scan is already being processed' });
+      }
+
+      // Same key, different scan: the device lost its sequence file (flash
+      // erased) and started over. Treat it as a new scan.
+      console.warn(`Sequence restart detected for device ${deviceId} at seq ${seq}`);
+      existing.rfidTag = rfidTag;
+      existing.timestamp = timestamp;
+      existing.state = 'pending';
+      existing.statusCode = undefined;
+      existing.response = undefined;
+      receipt = await existing.save();
+    }
+
+    // Record the outcome before it goes out, so a retry that races the
+    // response sees the stored result. Server errors release the key.
+    const sendJson = res.json.bind(res);
+    res.json = (body) => {
+      const statusCode = res.statusCode;
+      const settle = statusCode >= 500
+        ? ScanReceipt.deleteOne({ _id: receipt._id })
+        : ScanReceipt.updateOne(
+            { _id: receipt._id },
+            { state: 'done', statusCode, response: JSON.parse(JSON.stringify(body)) }
+          );
+      return settle
+        .catch(error => console.error('Scan receipt update failed:', error))
+        .then(() => sendJson(body));
+    };
+
+    next();
+  } catch (error) {
+    console.error('Idempotency check failed:', error);
+    res.status(500).json({ error: error.message });
+  }
+};
+
+module.exports = {
+  idempotentScanMiddleware
+};
@@ -0,0 +1,17 @@
+const mongoose = require('mongoose');
+
+// Named monotonic counters, advanced atomically with $inc (e.g. the roster
+// version handed to terminals)
+const CounterSchema = new mongoose.Schema({
+  _id: {
+    type: String
+  },
+  seq: {
+    type: Number,
+    default: 0
+  }
+}, {
+  versionKey: false
+});
+
+module.exports = mongoose.model('Counter', CounterSchema);
@@ -0,0 +1,28 @@
+const mongoose = require('mongoose');
+
+// Append-only log of card roster changes. Each change gets the next roster
+// version, so a terminal holding version V asks for every change after V
+// instead of downloading all members again.
+const RosterChangeSchema = new mongoose.Schema({
+  version: {
+    type: Number,
+    required: true,
+    unique: true
+  },
+  rfidTag: {
+    type: String,
+    required: true
+  },
+  name: {
+    type: String,
+    default: ''
+  }, // as shown on the terminal LCD
+  removed: {
+    type: Boolean,
+    default: false
+  } // card deleted, deactivated or reassigned
+}, {
+  timestamps: true
+});
+
+module.exports = mongoose.model('RosterChange', RosterChangeSchema);
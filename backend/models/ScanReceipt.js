@@ -0,0 +1,40 @@
+const mongoose = require('mongoose');
+
+// One receipt per terminal scan, keyed by the device's persistent sequence
+// number. Lets POST /attendance answer re-sent records with the original
+// response instead of toggling entry/exit a second time.
+const ScanReceiptSchema = new mongoose.Schema({
+  deviceId: {
+    type: String,
+    required: true
+  },
+  seq: {
+    type: Number,
+    required: true
+  },
+  rfidTag: {
+    type: String
+  },
+  timestamp: {
+    type: String
+  }, // as sent by the firmware, to spot a device whose sequence restarted
+  state: {
+    type: String,
+    enum: ['pending', 'done'],
+    default: 'pending'
+  },
+  statusCode: {
+    type: Number
+  },
+  response: {
+    type: mongoose.Schema.Types.Mixed
+  }
+}, {
+  timestamps: true
+});
+
+ScanReceiptSchema.index({ deviceId: 1, seq: 1 }, { unique: true });
+// Offline backlogs are uploaded within days; keep receipts for 30
+ScanReceiptSchema.index({ createdAt: 1 }, { expireAfterSeconds: 30 * 24 * 60 * 60 });
+
+module.exports = mongoose.model('ScanReceipt', ScanReceiptSchema);
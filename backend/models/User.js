@@ -1,5 +1,6 @@
 const mongoose = require('mongoose');
 const bcrypt = require('bcrypt');
+const rosterService = require('../services/rosterService');
 
 const UserSchema = new mongoose.Schema({
   name: { 
@@ -72,6 +73,45 @@ UserSchema.pre('save', async function(next) {
   }
 });
 
+// Note roster-relevant changes before saving; a changed card also removes
+// the old tag from the terminals' rosters
+UserSchema.pre('save', async function(next) {
+  this.$locals.rosterChanged = this.isNew || this.isModified('name') ||
+    this.isModified('rfidTag') || this.isModified('status');
+  this.$locals.previousRfidTag = null;
+  if (!this.isNew && this.isModified('rfidTag')) {
+    try {
+      const previous = await this.constructor.findById(this._id).select('rfidTag').lean();
+      this.$locals.previousRfidTag = previous ? previous.rfidTag : null;
+    } catch (error) {
+      return next(error);
+    }
+  }
+  next();
+});
+
+UserSchema.post('save', async function(doc) {
+  if (!doc.$locals.rosterChanged) return;
+  try {
+    if (doc.$locals.previousRfidTag && doc.$locals.previousRfidTag !== doc.rfidTag) {
+      await rosterService.recordRemoval(doc.$locals.previousRfidTag);
+    }
+    await rosterService.recordMember(doc);
+  } catch (error) {
+    // The save itself succeeded; terminals miss this change until the member is saved again
+    console.error('❌ Roster change not recorded:', error.message);
+  }
+});
+
+UserSchema.post('findOneAndDelete', async function(doc) {
+  if (!doc) return;
+  try {
+    await rosterService.recordRemoval(doc.rfidTag);
+  } catch (error) {
+    console.error('❌ Roster removal not recorded:', error.message);
+  }
+});
+
 // Compare password method
 UserSchema.methods.comparePassword = async function(candidatePassword) {
   try {
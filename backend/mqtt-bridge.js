@@ -0,0 +1,182 @@
+#!/usr/bin/env node
+/*
+ * MQTT bridge for attendance terminals (mqtt:// backend URLs)
+ *
+ * Terminals publish the same JSON as over HTTP, at QoS 1, on one persistent
+ * session each (see firmware/attendance_terminal/mqtt_transport.h). For
+ * device D under the topic prefix P the bridge:
+ *
+ *   P/D/attendance, P/D/device/heartbeat
+ *       POSTs the payload to the HTTP API (--forward + /attendance, ...)
+ *   P/D/reply/<endpoint>
+ *       publishes the API's JSON answer plus "status" and the request's
+ *       "seq", so a waiting terminal can show entry/exit
+ *   P/D/commands
+ *       publishes heartbeat instructions (syncLogs, nextHeartbeatIn); the
+ *       broker queues them for terminals that are offline
+ *
+ * A message is acknowledged to the broker only once the API has answered
+ * with something other than 5xx/429, so the broker keeps it (and redelivers
+ * it after a bridge restart) while the API is down or throttling.
+ *
+ * Usage:
+ *   node mqtt-bridge.js [--broker mqtt://localhost:1883] [--prefix api]
+ *                       [--forward http://localhost:3000]
+ * MQTT_USERNAME / MQTT_PASSWORD log in to the broker when set.
+ */
+
+const http = require('http');
+const https = require('https');
+const mqtt = require('mqtt');
+
+const RETRY_MIN_MS = 1000;
+const RETRY_MAX_MS = 60000;
+const COMMAND_KEYS = ['syncLogs', 'nextHeartbeatIn'];
+
+function parseArgs(argv) {
+  const options = { broker: 'mqtt://localhost:1883', prefix: 'api', forward: 'http://localhost:3000' };
+  for (let i = 2; i < argv.length; i++) {
+    const value = argv[i + 1];
+    if (argv[i] === '--broker') { options.broker = value; i++; }
+    else if (argv[i] === '--prefix') { options.prefix = value.replace(/^\/+|\/+$/g, ''); i++; }
+    else if (argv[i] === '--forward') { options.forward = value.replace(/\/$/, ''); i++; }
+    else {
+      console.error('usage: node mqtt-bridge.js [--broker mqtt://host:1883] [--prefix api] [--forward http://host:port]');
+      process.exit(2);
+    }
+  }
+  return options;
+}
+
+const options = parseArgs(process.argv);
+const stats = { requests: 0, retries: 0, replies: 0, commands: 0 };
+
+function topicOf(deviceId, suffix) {
+  return options.prefix ? `${options.prefix}/${deviceId}/${suffix}` : `${deviceId}/${suffix}`;
+}
+
+// "P/D/device/heartbeat" -> { deviceId: "D", endpoint: "device/heartbeat" }
+function parseTopic(topic) {
+  const rest = options.prefix ? topic.slice(options.prefix.length + 1) : topic;
+  const slash = rest.indexOf('/');
+  if (slash <= 0) {
+    return null;
+  }
+  return { deviceId: rest.slice(0, slash), endpoint: rest.slice(slash + 1) };
+}
+
+function forward(endpoint, payload) {
+  return new Promise((resolve) => {
+    const url = new URL(`${options.forward}/${endpoint}`);
+    const client = url.protocol === 'https:' ? https : http;
+    const request = client.request(url, {
+      method: 'POST',
+      headers: { 'Content-Type': 'application/json', 'Content-Length': payload.length },
+      timeout: 10000
+    }, (response) => {
+      const chunks = [];
+      response.on('data', (chunk) => chunks.push(chunk));
+      response.on('end', () => {
+        const retryAfter = parseInt(response.headers['retry-after'], 10);
+        resolve({
+          status: response.statusCode,
+          raw: Buffer.concat(chunks),
+          retryAfter: Number.isFinite(retryAfter) ? retryAfter : null
+        });
+      });
+    });
+    request.on('timeout', () => request.destroy(new Error('upstream timeout')));
+    request.on('error', (err) => {
+      console.error(`⚠️ Forward to ${url} failed: ${err.message}`);
+      resolve({ status: 502, raw: Buffer.alloc(0), retryAfter: null });
+    });
+    request.end(payload);
+  });
+}
+
+// Retries until the API gives a final answer (anything but 5xx/429)
+async function forwardUntilAnswered(endpoint, payload) {
+  let delay = RETRY_MIN_MS;
+  for (;;) {
+    const result = await forward(endpoint, payload);
+    if (result.status < 500 && result.status !== 429) {
+      return result;
+    }
+    stats.retries++;
+    const wait = result.retryAfter !== null ? result.retryAfter * 1000 : delay;
+    await new Promise((resolve) => setTimeout(resolve, Math.min(wait, RETRY_MAX_MS)));
+    delay = Math.min(delay * 2, RETRY_MAX_MS);
+  }
+}
+
+function parseJson(raw) {
+  try {
+    const value = JSON.parse(raw.toString());
+    return value && typeof value === 'object' && !Array.isArray(value) ? value : {};
+  } catch (err) {
+    return {};
+  }
+}
+
+async function handle(topic, payload) {
+  const target = parseTopic(topic);
+  if (!target) {
+    return;
+  }
+  stats.requests++;
+  const request = parseJson(payload);
+  const result = await forwardUntilAnswered(target.endpoint, payload);
+  const answer = parseJson(result.raw);
+
+  // Replies are matched on seq; requests without one are not waited for
+  if (request.seq !== undefined) {
+    const reply = Object.assign({}, answer, { status: result.status, seq: request.seq });
+    client.publish(topicOf(target.deviceId, `reply/${target.endpoint}`), JSON.stringify(reply), { qos: 1 });
+    stats.replies++;
+  }
+
+  const command = {};
+  for (const key of COMMAND_KEYS) {
+    if (answer[key] !== undefined) {
+      command[key] = answer[key];
+    }
+  }
+  if (Object.keys(command).length > 0) {
+    client.publish(topicOf(target.deviceId, 'commands'), JSON.stringify(command), { qos: 1 });
+    stats.commands++;
+  }
+}
+
+const client = mqtt.connect(options.broker, {
+  clientId: 'attendee-mqtt-bridge',
+  clean: false,                        // Keep queued requests across bridge restarts
+  username: process.env.MQTT_USERNAME || undefined,
+  password: process.env.MQTT_PASSWORD || undefined
+});
+
+// PUBACK to the broker only after the API has answered
+client.handleMessage = (packet, done) => {
+  handle(packet.topic, packet.payload)
+    .catch((err) => console.error(`⚠️ ${packet.topic}: ${err.message}`))
+    .then(() => done());
+};
+
+client.on('connect', (connack) => {
+  console.log(`🚀 MQTT bridge on ${options.broker} (prefix "${options.prefix}"), forwarding to ${options.forward}`);
+  if (!connack.sessionPresent) {
+    client.subscribe([topicOf('+', 'attendance'), topicOf('+', 'device/heartbeat')], { qos: 1 });
+  }
+});
+
+client.on('error', (err) => {
+  console.error('❌ MQTT error:', err.message);
+});
+
+process.on('SIGINT', shutdown);
+process.on('SIGTERM', shutdown);
+
+function shutdown() {
+  console.log(`📊 requests ${stats.requests}, upstream retries ${stats.retries}, ` +
+              `replies ${stats.replies}, commands ${stats.commands}`);
+  client.end(false, () => process.exit(0));
+}
@@ -2,6 +2,8 @@ const express = require('express');
 const User = require('../models/User');
 const Attendance = require('../models/Attendance');
 const { authMiddleware, adminOrMentorMiddleware, optionalAuthMiddleware } = require('../middleware/auth');
+const { idempotentScanMiddleware } = require('../middleware/idempotency');
+const { decodeSegment } = require('../services/segmentDecoder');
 
 const router = express.Router();
 
@@ -40,12 +42,19 @@ function parseISTTimestamp(timestamp) {
 }
 
 // POST /attendance - Record attendance with entry/exit logic (multiple sessions support)
-router.post('/', async (req, res) => {
+// Re-sent terminal scans (same deviceId + seq) get the original response back
+const recordScan = async (req, res) => {
   try {
-    const { rfidTag, timestamp } = req.body;
+    const { rfidTag, timestamp, direction } = req.body;
     
     console.log('RFID Tag: ', rfidTag);
     
+    // Terminals with separate entry and exit readers send the direction;
+    // without it the scan toggles between entry and exit as before
+    if (direction !== undefined && !['entry', 'exit'].includes(direction)) {
+      return res.status(400).json({ error: 'Direction must be either "entry" or "exit"' });
+    }
+    
     // Parse timestamp as IST FIRST (firmware sends IST timestamps)
     const currentTime = parseISTTimestamp(timestamp);
     console.log('Parsed time for RFID', rfidTag, ':', currentTime.toISOString(), '(from', timestamp, ')');
@@ -76,6 +85,27 @@ router.post('/', async (req, res) => {
       date: dateOnly
     });
     
+    // A directed scan that matches the current state (entry while a session
+    // is open, exit while none is) changes nothing. It is answered with 200
+    // so the terminal does not keep it in its offline backlog.
+    const lastSession = attendance && attendance.sessions.length > 0
+      ? attendance.sessions[attendance.sessions.length - 1]
+      : null;
+    const inside = Boolean(lastSession && !lastSession.exitTime);
+    if ((direction === 'entry' && inside) || (direction === 'exit' && !inside)) {
+      return res.status(200).json({
+        message: direction === 'entry' ? 'Already checked in' : 'No open session to exit',
+        type: direction,
+        unchanged: true,
+        attendance: {
+          userId: user._id,
+          userName: user.name,
+          userRole: user.role,
+          date: dateOnly
+        }
+      });
+    }
+    
     if (!attendance) {
       // No record exists - create new entry with first session
       attendance = new Attendance({
@@ -111,9 +141,7 @@ router.post('/', async (req, res) => {
     } 
     else {
       // Record exists - check last session
-      const lastSession = attendance.sessions[attendance.sessions.length - 1];
-      
-      if (!lastSession.exitTime) {
+      if (inside) {
         // Last session has no exit - record exit
         lastSession.exitTime = currentTime;
         lastSession.autoExitSet = false; // Manual exit
@@ -164,6 +192,61 @@ router.post('/', async (req, res) => {
     console.error('Attendance recording error:', error);
     res.status(500).json({ error: error.message });
   }
+};
+router.post('/', idempotentScanMiddleware, recordScan);
+
+// One scan through the same middleware and handler as POST /attendance,
+// answered in-process; resolves with the status and body
+const recordScanInProcess = (body) => new Promise((resolve) => {
+  const res = {
+    statusCode: 200,
+    set() { return this; },
+    status(code) { this.statusCode = code; return this; },
+    json(payload) { resolve({ status: this.statusCode, body: payload }); return this; }
+  };
+  const req = { body };
+  idempotentScanMiddleware(req, res, () => recordScan(req, res));
+});
+
+// POST /attendance/segment - A compressed segment of a terminal's offline
+// backlog: { deviceId, segment: base64 }. Its scans are recorded in order,
+// as if posted one by one. Unknown or inactive cards are rejected and
+// reported by their index in the segment; a server error or a scan still in flight (409) stops the
+// segment with 503 so the terminal resends it, and the scans already
+// recorded replay from their receipts.
+router.post('/segment', async (req, res) => {
+  const { deviceId, segment } = req.body || {};
+  if (typeof segment !== 'string' || segment.length === 0) {
+    return res.status(400).json({ error: 'segment (base64) is required' });
+  }
+
+  let scans;
+  try {
+    scans = decodeSegment(Buffer.from(segment, 'base64'));
+  } catch (error) {
+    console.warn(`Rejected segment from ${deviceId || 'unknown device'}: ${error.message}`);
+    return res.status(400).json({ error: error.message });
+  }
+
+  let recorded = 0;
+  const rejected = [];
+  for (const [index, scan] of scans.entries()) {
+    const result = await recordScanInProcess(scan);
+    if (result.status >= 500 || result.status === 409) {
+      return res.status(503).json({
+        error: result.body && result.body.error ? result.body.error : 'Scan not recorded',
+        records: scans.length,
+        recorded
+      });
+    }
+    if (result.status >= 400) {
+      rejected.push({ index, rfidTag: scan.rfidTag, seq: scan.seq, status: result.status });
+    } else {
+      recorded++;
+    }
+  }
+
+  res.status(200).json({ records: scans.length, recorded, rejected });
 });
 
 // POST /attendance/manual - Manual attendance recording with session support
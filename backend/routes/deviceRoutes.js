@@ -0,0 +1,53 @@
+const express = require('express');
+const rosterService = require('../services/rosterService');
+
+const router = express.Router();
+
+// Terminal heartbeat. The answer carries the current roster version so a
+// terminal that is up to date skips the roster request altogether.
+router.post('/heartbeat', async (req, res) => {
+  try {
+    const { deviceId, rosterVersion } = req.body || {};
+    const current = await rosterService.getVersion();
+    if (deviceId && rosterVersion !== undefined && rosterVersion !== current) {
+      console.log(`📇 ${deviceId} holds roster v${rosterVersion}, current v${current}`);
+    }
+    res.json({
+      success: true,
+      message: 'Heartbeat received',
+      rosterVersion: current
+    });
+  } catch (error) {
+    console.error('Heartbeat error:', error);
+    res.status(500).json({ error: 'Server error' });
+  }
+});
+
+// Card roster pages for terminals, in the text format of
+// firmware/attendance_terminal/roster.h:
+//   ?since=V[&limit=N]           changes after version V
+//   ?since=0[&after=TAG][&limit=N]  snapshot of active members after TAG
+// If-None-Match "V" with V current answers 304 without touching the log.
+router.get('/roster', async (req, res) => {
+  try {
+    const since = Math.max(0, parseInt(req.query.since, 10) || 0);
+    const limit = parseInt(req.query.limit, 10) || undefined;
+    const after = typeof req.query.after === 'string' ? req.query.after : '';
+
+    const current = await rosterService.getVersion();
+    const etag = `"${current}"`;
+    res.set('ETag', etag);
+    res.set('Cache-Control', 'no-cache');
+    if (since > 0 && since === current && req.get('If-None-Match') === etag) {
+      return res.status(304).end();
+    }
+
+    const page = await rosterService.getPage({ since, after, limit });
+    res.type('text/plain').send(page.body);
+  } catch (error) {
+    console.error('Roster error:', error);
+    res.status(500).json({ error: 'Server error' });
+  }
+});
+
+module.exports = router;
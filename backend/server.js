@@ -8,6 +8,7 @@ require('dotenv').config();
 const authRoutes = require('./routes/authRoutes');
 const userRoutes = require('./routes/userRoutes');
 const attendanceRoutes = require('./routes/attendanceRoutes');
+const deviceRoutes = require('./routes/deviceRoutes');
 
 // Import models
 const User = require('./models/User');
@@ -46,6 +47,7 @@ mongoose.connect(process.env.MONGODB_URI || 'mongodb://localhost:27017/attendanc
 app.use('/auth', authRoutes);
 app.use('/users', userRoutes);
 app.use('/attendance', attendanceRoutes);
+app.use('/device', deviceRoutes);
 
 // Health check endpoint
 app.get('/health', (req, res) => {
@@ -87,6 +89,7 @@ app.get('/', (req, res) => {
       },
       attendance: {
         'POST /attendance': 'Record attendance (RFID) - handles entry/exit logic',
+        'POST /attendance/segment': 'Record a terminal\'s compressed offline segment (RFID scans in order)',
         'POST /attendance/manual': 'Manual attendance recording (admin/mentor) - specify entry/exit',
         'GET /attendance/today': 'Get today\'s attendance with entry/exit times',
         'GET /attendance/my': 'Get current user\'s attendance records',
@@ -97,6 +100,10 @@ app.get('/', (req, res) => {
         'POST /attendance/auto-exit': 'Trigger automatic cleanup of incomplete sessions',
         'POST /attendance/check-low-attendance': 'Check for low attendance and send notifications'
       },
+      device: {
+        'POST /device/heartbeat': 'Terminal heartbeat, answers with the current roster version',
+        'GET /device/roster': 'Card roster changes since a version (or a snapshot) for terminals'
+      },
       legacy: {
         'GET /health': 'Health check',
         'GET /': 'API information'
@@ -0,0 +1,128 @@
+const Counter = require('../models/Counter');
+const RosterChange = require('../models/RosterChange');
+
+// Card roster served to terminals (GET /device/roster).
+//
+// Every change to a member's card, name or status is appended to the
+// RosterChange log under the next roster version. Terminals send the version
+// they hold and get the changes after it, oldest first, in pages. A terminal
+// that is new, or older than the oldest retained change, gets a snapshot of
+// all active members instead, paged by tag.
+
+const ROSTER_COUNTER = 'roster';
+const RETAINED_CHANGES = 5000;   // Older terminals fall back to a snapshot
+const PRUNE_EVERY = 100;         // Versions between log trims
+const MAX_TAG_LENGTH = 20;       // Firmware ROSTER_TAG_MAX
+const MAX_NAME_LENGTH = 26;      // Firmware ROSTER_NAME_MAX
+const DEFAULT_PAGE = 32;         // Firmware ROSTER_PAGE_MAX
+const ROSTER_TAG = /^[0-9A-Za-z]{1,20}$/;
+
+async function getVersion() {
+  const counter = await Counter.findById(ROSTER_COUNTER).lean();
+  return counter ? counter.seq : 0;
+}
+
+async function nextVersion() {
+  const counter = await Counter.findByIdAndUpdate(
+    ROSTER_COUNTER,
+    { $inc: { seq: 1 } },
+    { new: true, upsert: true }
+  );
+  return counter.seq;
+}
+
+// The LCD has no glyphs beyond ASCII: fold accents, drop the rest
+function displayName(name) {
+  return String(name || '')
+    .normalize('NFKD')
+    .replace(/[^\x20-\x7e]/g, '')
+    .replace(/\s+/g, ' ')
+    .trim()
+    .slice(0, MAX_NAME_LENGTH);
+}
+
+// Tags the terminal could never scan are left out of the roster
+function isRosterTag(tag) {
+  return typeof tag === 'string' && ROSTER_TAG.test(tag);
+}
+
+async function appendChange(rfidTag, name, removed) {
+  if (!isRosterTag(rfidTag)) {
+    return null;
+  }
+  const version = await nextVersion();
+  await RosterChange.create({ version, rfidTag, name: removed ? '' : displayName(name), removed });
+  if (version % PRUNE_EVERY === 0) {
+    await RosterChange.deleteMany({ version: { $lte: version - RETAINED_CHANGES } });
+  }
+  return version;
+}
+
+// Current state of a member: on the roster while active
+function recordMember(user) {
+  return appendChange(user.rfidTag, user.name, user.status !== 'active');
+}
+
+function recordRemoval(rfidTag) {
+  return appendChange(rfidTag, '', true);
+}
+
+function formatHeader(version, kind, more) {
+  return `roster ${version} ${kind} ${more ? 'more' : 'end'}\n`;
+}
+
+// One page in the terminal's text format (firmware/attendance_terminal/roster.h)
+async function getPage({ since = 0, after = '', limit = DEFAULT_PAGE } = {}) {
+  const User = require('../models/User');
+  const pageSize = Math.max(1, Math.min(limit || DEFAULT_PAGE, DEFAULT_PAGE));
+  const current = await getVersion();
+
+  if (since > 0 && since <= current) {
+    const oldest = await RosterChange.findOne().sort({ version: 1 }).select('version').lean();
+    if (since === current || (oldest && oldest.version <= since + 1)) {
+      const changes = await RosterChange.find({ version: { $gt: since } })
+        .sort({ version: 1 })
+        .limit(pageSize + 1)
+        .lean();
+      // Stop at a gap: a version whose change is still being written
+      const included = [];
+      for (const change of changes.slice(0, pageSize)) {
+        if (change.version !== since + included.length + 1) {
+          break;
+        }
+        included.push(change);
+      }
+      const more = changes.length > pageSize && included.length === pageSize;
+      const version = included.length > 0 ? included[included.length - 1].version : since;
+      const lines = included.map((change) =>
+        change.removed ? `-${change.rfidTag}` : `+${change.rfidTag} ${change.name}`);
+      return { version: current, body: formatHeader(version, 'delta', more) + lines.map((l) => l + '\n').join('') };
+    }
+  }
+
+  // Snapshot: the version is read first, so changes made while paging are
+  // delivered again as deltas afterwards. Unusable tags are filtered in the
+  // query, so a page cut at pageSize + 1 users never ends up empty: the
+  // terminal cannot continue from a "more" page without lines.
+  const query = { status: 'active', rfidTag: { $regex: ROSTER_TAG } };
+  if (after) {
+    query.rfidTag.$gt = after;
+  }
+  const users = await User.find(query)
+    .sort({ rfidTag: 1 })
+    .limit(pageSize + 1)
+    .select('rfidTag name')
+    .lean();
+  const more = users.length > pageSize;
+  const lines = users.slice(0, pageSize)
+    .map((user) => `+${user.rfidTag} ${displayName(user.name)}\n`);
+  return { version: current, body: formatHeader(current, 'full', more) + lines.join('') };
+}
+
+module.exports = {
+  getVersion,
+  recordMember,
+  recordRemoval,
+  getPage,
+  displayName
+};
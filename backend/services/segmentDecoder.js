@@ -0,0 +1,142 @@
+// Compressed offline segments uploaded by terminals (POST /attendance/segment).
+//
+// A terminal seals the oldest records of its offline backlog into a binary
+// segment (firmware/attendance_terminal/offline_segments.h has the format):
+//
+//   "ASG1"  u16 LE length  varint count  varint baseTime  varint baseSeq
+//   u8 len + deviceId  u8 len + firmware
+//   varint dictCount, each u8 len + UID bytes
+//   per record: varint (uidIndex << 2 | kind)
+//     kind 0-2 (toggle/entry/exit): varint zigzag time delta, varint zigzag (seq delta - 1)
+//     (seq arithmetic is mod 2^32, as on the terminal: the base seq may be 0)
+//     kind 3 (raw):                 varint length + the stored JSON line
+//   u32 LE CRC-32 of everything before it
+//
+// Times are seconds since 2000-01-01 in the terminal's local time. Decoding
+// gives back the scan bodies the terminal would have sent one by one.
+
+const MAGIC = 'ASG1';
+const KIND_RAW = 3;
+const DIRECTIONS = [undefined, 'entry', 'exit'];
+const EPOCH_2000_MS = Date.UTC(2000, 0, 1);
+
+const CRC_TABLE = (() => {
+  const table = new Uint32Array(256);
+  for (let n = 0; n < 256; n++) {
+    let c = n;
+    for (let k = 0; k < 8; k++) {
+      c = c & 1 ? 0xEDB88320 ^ (c >>> 1) : c >>> 1;
+    }
+    table[n] = c >>> 0;
+  }
+  return table;
+})();
+
+function crc32(buffer, end) {
+  let crc = 0xFFFFFFFF;
+  for (let i = 0; i < end; i++) {
+    crc = CRC_TABLE[(crc ^ buffer[i]) & 0xFF] ^ (crc >>> 8);
+  }
+  return (crc ^ 0xFFFFFFFF) >>> 0;
+}
+
+class SegmentReader {
+  constructor(buffer, end) {
+    this.buffer = buffer;
+    this.end = end;
+    this.pos = 0;
+  }
+
+  varint() {
+    let value = 0;
+    let scale = 1;
+    while (this.pos < this.end && scale <= 2 ** 49) {
+      const byte = this.buffer[this.pos++];
+      value += (byte & 0x7F) * scale;
+      if (!(byte & 0x80)) {
+        return value;
+      }
+      scale *= 128;
+    }
+    throw new Error('Truncated varint');
+  }
+
+  zigzag() {
+    const value = this.varint();
+    return value % 2 ? -(value + 1) / 2 : value / 2;
+  }
+
+  bytes(length) {
+    if (this.pos + length > this.end) {
+      throw new Error('Truncated segment');
+    }
+    const out = this.buffer.subarray(this.pos, this.pos + length);
+    this.pos += length;
+    return out;
+  }
+
+  string() {
+    return this.bytes(this.bytes(1)[0]).toString('latin1');
+  }
+}
+
+// "YYYY-MM-DDTHH:MM:SS" as the terminal formats it
+function formatSeconds(seconds) {
+  return new Date(EPOCH_2000_MS + seconds * 1000).toISOString().slice(0, 19);
+}
+
+// Returns the scan bodies in the order they were recorded; throws on a
+// corrupt segment
+function decodeSegment(buffer) {
+  if (buffer.length < 10 || buffer.toString('latin1', 0, 4) !== MAGIC) {
+    throw new Error('Not a segment');
+  }
+  if (buffer.readUInt16LE(4) !== buffer.length) {
+    throw new Error('Segment length mismatch');
+  }
+  const end = buffer.length - 4;
+  if (crc32(buffer, end) !== buffer.readUInt32LE(end)) {
+    throw new Error('Segment checksum mismatch');
+  }
+
+  const reader = new SegmentReader(buffer, end);
+  reader.pos = 6;
+  const count = reader.varint();
+  let lastTime = reader.varint();
+  let lastSeq = (reader.varint() - 1) >>> 0;
+  const deviceId = reader.string();
+  const firmware = reader.string();
+  const dictionary = [];
+  for (let i = reader.varint(); i > 0; i--) {
+    dictionary.push(reader.bytes(reader.bytes(1)[0]).toString('hex').toUpperCase());
+  }
+
+  const scans = [];
+  for (let i = 0; i < count; i++) {
+    const head = reader.varint();
+    const kind = head % 4;
+    if (kind === KIND_RAW) {
+      scans.push(JSON.parse(reader.bytes(reader.varint()).toString('utf8')));
+      continue;
+    }
+    const rfidTag = dictionary[Math.floor(head / 4)];
+    if (rfidTag === undefined) {
+      throw new Error('UID index out of range');
+    }
+    lastTime += reader.zigzag();
+    lastSeq = (lastSeq + reader.zigzag() + 1) >>> 0;
+    const scan = { rfidTag, timestamp: formatSeconds(lastTime), deviceId, firmware };
+    if (lastSeq > 0) {
+      scan.seq = lastSeq;
+    }
+    if (DIRECTIONS[kind]) {
+      scan.direction = DIRECTIONS[kind];
+    }
+    scans.push(scan);
+  }
+  return scans;
+}
+
+module.exports = {
+  decodeSegment
+};
@@ -0,0 +1,861 @@
+/*
+ * Portable attendance core for Attendee Attendance Terminal v2.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "attendance_core.h"
+
+// ========================================
+// RECORD ENCODING
+// ========================================
+
+size_t formatUidHex(const uint8_t* uid, size_t uidLength, char* out, size_t outSize) {
+  static const char hexDigits[] = "0123456789ABCDEF";
+  size_t pos = 0;
+  for (size_t i = 0; i < uidLength && pos + 2 < outSize; i++) {
+    out[pos++] = hexDigits[uid[i] >> 4];
+    out[pos++] = hexDigits[uid[i] & 0x0F];
+  }
+  if (outSize > 0) {
+    out[pos] = 0;
+  }
+  return pos;
+}
+
+size_t formatIsoTimestamp(const TerminalDateTime& dt, char* out, size_t outSize) {
+  int len = snprintf(out, outSize, "%04d-%02d-%02dT%02d:%02d:%02d",
+                     dt.year, dt.month, dt.day, dt.hour, dt.minute, dt.second);
+  if (len < 0) {
+    return 0;
+  }
+  return (size_t)len < outSize ? (size_t)len : outSize - 1;
+}
+
+static int64_t daysFromCivil(int year, int month, int day) {
+  year -= month <= 2;
+  int64_t era = (year >= 0 ? year : year - 399) / 400;
+  int64_t yoe = year - era * 400;
+  int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 730425;   // 730425: days from 0000-03-01 to 2000-01-01
+}
+
+static bool parseDigits(const char* s, int count, int& value) {
+  value = 0;
+  for (int i = 0; i < count; i++) {
+    if (s[i] < '0' || s[i] > '9') return false;
+    value = value * 10 + (s[i] - '0');
+  }
+  return true;
+}
+
+bool parseIsoTimestamp(const char* ts, uint32_t& seconds) {
+  TerminalDateTime dt;
+  if (strlen(ts) != ATTENDANCE_TIMESTAMP_SIZE - 1 || ts[4] != '-' || ts[7] != '-' ||
+      ts[10] != 'T' || ts[13] != ':' || ts[16] != ':' ||
+      !parseDigits(ts, 4, dt.year) || !parseDigits(ts + 5, 2, dt.month) ||
+      !parseDigits(ts + 8, 2, dt.day) || !parseDigits(ts + 11, 2, dt.hour) ||
+      !parseDigits(ts + 14, 2, dt.minute) || !parseDigits(ts + 17, 2, dt.second)) {
+    return false;
+  }
+  if (dt.year < 2000 || dt.month < 1 || dt.month > 12 || dt.day < 1 || dt.day > 31 ||
+      dt.hour > 23 || dt.minute > 59 || dt.second > 59) {
+    return false;
+  }
+  int64_t value = daysFromCivil(dt.year, dt.month, dt.day) * 86400 +
+                  dt.hour * 3600 + dt.minute * 60 + dt.second;
+  if (value > 0xFFFFFFFFLL) {
+    return false;
+  }
+  seconds = (uint32_t)value;
+  return true;
+}
+
+// Date from days since 2000-01-01 (the inverse of daysFromCivil())
+static void civilFromDays(int64_t days, TerminalDateTime& dt) {
+  days += 730425;
+  int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+  int64_t doe = days - era * 146097;
+  int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  int64_t mp = (5 * doy + 2) / 153;
+  dt.day = (int)(doy - (153 * mp + 2) / 5 + 1);
+  dt.month = (int)(mp < 10 ? mp + 3 : mp - 9);
+  dt.year = (int)(yoe + era * 400 + (dt.month <= 2));
+}
+
+size_t formatIsoSeconds(uint32_t seconds, char* out, size_t outSize) {
+  TerminalDateTime dt;
+  civilFromDays(seconds / 86400, dt);
+  uint32_t rest = seconds % 86400;
+  dt.hour = (int)(rest / 3600);
+  dt.minute = (int)(rest / 60 % 60);
+  dt.second = (int)(rest % 60);
+  return formatIsoTimestamp(dt, out, outSize);
+}
+
+// Appends a JSON string literal with the same escaping ArduinoJson uses
+static bool appendJsonString(char* out, size_t outSize, size_t& pos, const char* value) {
+  if (pos >= outSize) return false;
+  out[pos++] = '"';
+  for (const char* p = value; *p; p++) {
+    char c = *p;
+    const char* escape = NULL;
+    switch (c) {
+      case '"':  escape = "\\\""; break;
+      case '\\': escape = "\\\\"; break;
+      case '\b': escape = "\\b"; break;
+      case '\f': escape = "\\f"; break;
+      case '\n': escape = "\\n"; break;
+      case '\r': escape = "\\r"; break;
+      case '\t': escape = "\\t"; break;
+    }
+    if (escape) {
+      size_t n = strlen(escape);
+      if (pos + n >= outSize) return false;
+      memcpy(&out[pos], escape, n);
+      pos += n;
+    } else if ((unsigned char)c < 0x20) {
+      if (pos + 6 >= outSize) return false;
+      pos += snprintf(&out[pos], outSize - pos, "\\u%04x", (unsigned char)c);
+    } else {
+      if (pos + 1 >= outSize) return false;
+      out[pos++] = c;
+    }
+  }
+  if (pos + 1 >= outSize) return false;
+  out[pos++] = '"';
+  return true;
+}
+
+static bool appendRaw(char* out, size_t outSize, size_t& pos, const char* text) {
+  size_t n = strlen(text);
+  if (pos + n >= outSize) return false;
+  memcpy(&out[pos], text, n);
+  pos += n;
+  return true;
+}
+
+size_t buildAttendancePayload(const char* rfidTag, const char* timestamp,
+                              const char* deviceId, const char* firmware, uint32_t seq,
+                              const char* direction, char* out, size_t outSize) {
+  char seqField[20];
+  seqField[0] = 0;
+  if (seq > 0) {
+    snprintf(seqField, sizeof(seqField), ",\"seq\":%lu", (unsigned long)seq);
+  }
+
+  size_t pos = 0;
+  bool ok = appendRaw(out, outSize, pos, "{\"rfidTag\":") &&
+            appendJsonString(out, outSize, pos, rfidTag) &&
+            appendRaw(out, outSize, pos, ",\"timestamp\":") &&
+            appendJsonString(out, outSize, pos, timestamp) &&
+            appendRaw(out, outSize, pos, ",\"deviceId\":") &&
+            appendJsonString(out, outSize, pos, deviceId) &&
+            appendRaw(out, outSize, pos, ",\"firmware\":") &&
+            appendJsonString(out, outSize, pos, firmware) &&
+            appendRaw(out, outSize, pos, seqField) &&
+            (!direction || (appendRaw(out, outSize, pos, ",\"direction\":") &&
+                            appendJsonString(out, outSize, pos, direction))) &&
+            appendRaw(out, outSize, pos, "}");
+  if (!ok) {
+    if (outSize > 0) out[0] = 0;
+    return 0;
+  }
+  out[pos] = 0;
+  return pos;
+}
+
+// ========================================
+// MINIMAL JSON READER
+// ========================================
+// Just enough JSON to pull a few fields out of small backend responses
+// without building a document tree.
+
+#define JSON_MAX_DEPTH 16
+
+struct JsonCursor {
+  const char* p;
+  const char* end;
+};
+
+static void skipWhitespace(JsonCursor& c) {
+  while (c.p < c.end && (*c.p == ' ' || *c.p == '\t' || *c.p == '\n' || *c.p == '\r')) {
+    c.p++;
+  }
+}
+
+static bool consume(JsonCursor& c, char expected) {
+  skipWhitespace(c);
+  if (c.p < c.end && *c.p == expected) {
+    c.p++;
+    return true;
+  }
+  return false;
+}
+
+static int hexValue(char h) {
+  if (h >= '0' && h <= '9') return h - '0';
+  if (h >= 'a' && h <= 'f') return h - 'a' + 10;
+  if (h >= 'A' && h <= 'F') return h - 'A' + 10;
+  return -1;
+}
+
+static bool readHex4(JsonCursor& c, uint32_t& value) {
+  if (c.end - c.p < 4) return false;
+  value = 0;
+  for (int i = 0; i < 4; i++) {
+    int v = hexValue(c.p[i]);
+    if (v < 0) return false;
+    value = (value << 4) | (uint32_t)v;
+  }
+  c.p += 4;
+  return true;
+}
+
+// Writes one byte if room remains; output is silently truncated
+static void putByte(char* out, size_t outSize, size_t& pos, char b) {
+  if (out && pos + 1 < outSize) {
+    out[pos++] = b;
+  }
+}
+
+static void putCodepoint(char* out, size_t outSize, size_t& pos, uint32_t cp) {
+  // Drop the whole sequence if it would not fit, never emit half a character
+  size_t need = cp < 0x80 ? 1 : cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4;
+  if (!out || pos + need >= outSize) {
+    return;
+  }
+  if (need == 1) {
+    out[pos++] = (char)cp;
+  } else if (need == 2) {
+    out[pos++] = (char)(0xC0 | (cp >> 6));
+    out[pos++] = (char)(0x80 | (cp & 0x3F));
+  } else if (need == 3) {
+    out[pos++] = (char)(0xE0 | (cp >> 12));
+    out[pos++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[pos++] = (char)(0x80 | (cp & 0x3F));
+  } else {
+    out[pos++] = (char)(0xF0 | (cp >> 18));
+    out[pos++] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[pos++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[pos++] = (char)(0x80 | (cp & 0x3F));
+  }
+}
+
+// Parses a string literal; out may be NULL to skip it
+static bool readString(JsonCursor& c, char* out, size_t outSize) {
+  size_t pos = 0;
+  if (!consume(c, '"')) return false;
+
+  while (c.p < c.end) {
+    char ch = *c.p++;
+    if (ch == '"') {
+      if (out && outSize > 0) out[pos] = 0;
+      return true;
+    }
+    if (ch != '\\') {
+      putByte(out, outSize, pos, ch);
+      continue;
+    }
+    if (c.p >= c.end) return false;
+    char esc = *c.p++;
+    switch (esc) {
+      case '"':  putByte(out, outSize, pos, '"'); break;
+      case '\\': putByte(out, outSize, pos, '\\'); break;
+      case '/':  putByte(out, outSize, pos, '/'); break;
+      case 'b':  putByte(out, outSize, pos, '\b'); break;
+      case 'f':  putByte(out, outSize, pos, '\f'); break;
+      case 'n':  putByte(out, outSize, pos, '\n'); break;
+      case 'r':  putByte(out, outSize, pos, '\r'); break;
+      case 't':  putByte(out, outSize, pos, '\t'); break;
+      case 'u': {
+        uint32_t cp;
+        if (!readHex4(c, cp)) return false;
+        // Combine UTF-16 surrogate pairs
+        if (cp >= 0xD800 && cp <= 0xDBFF && c.end - c.p >= 6 && c.p[0] == '\\' && c.p[1] == 'u') {
+          JsonCursor look = { c.p + 2, c.end };
+          uint32_t low;
+          if (readHex4(look, low) && low >= 0xDC00 && low <= 0xDFFF) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            c.p = look.p;
+          }
+        }
+        putCodepoint(out, outSize, pos, cp);
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+  return false;
+}
+
+// Copies a number/true/false/null token as text
+static bool readLiteral(JsonCursor& c, char* out, size_t outSize) {
+  skipWhitespace(c);
+  const char* start = c.p;
+  while (c.p < c.end) {
+    char ch = *c.p;
+    bool literalChar = (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') ||
+                       ch == '-' || ch == '+' || ch == '.' || ch == 'E';
+    if (!literalChar) break;
+    c.p++;
+  }
+  size_t len = c.p - start;
+  if (len == 0) return false;
+  if (out && outSize > 0) {
+    size_t n = len < outSize - 1 ? len : outSize - 1;
+    memcpy(out, start, n);
+    out[n] = 0;
+  }
+  return true;
+}
+
+static bool skipValue(JsonCursor& c, int depth);
+
+static bool skipContainer(JsonCursor& c, char close, bool isObject, int depth) {
+  if (depth > JSON_MAX_DEPTH) return false;
+  if (consume(c, close)) return true;
+  do {
+    if (isObject) {
+      if (!readString(c, NULL, 0) || !consume(c, ':')) return false;
+    }
+    if (!skipValue(c, depth + 1)) return false;
+  } while (consume(c, ','));
+  return consume(c, close);
+}
+
+static bool skipValue(JsonCursor& c, int depth) {
+  skipWhitespace(c);
+  if (c.p >= c.end) return false;
+  switch (*c.p) {
+    case '"': return readString(c, NULL, 0);
+    case '{': c.p++; return skipContainer(c, '}', true, depth);
+    case '[': c.p++; return skipContainer(c, ']', false, depth);
+    default:  return readLiteral(c, NULL, 0);
+  }
+}
+
+// Reads a scalar as text. Sets isNull for null/false so callers can mirror
+// ArduinoJson truthiness checks.
+static bool readScalar(JsonCursor& c, char* out, size_t outSize, bool& isNull) {
+  skipWhitespace(c);
+  isNull = false;
+  if (c.p < c.end && *c.p == '"') {
+    return readString(c, out, outSize);
+  }
+  if (c.p < c.end && (*c.p == '{' || *c.p == '[')) {
+    isNull = true;   // Not a scalar; treat as absent
+    if (out && outSize > 0) out[0] = 0;
+    return skipValue(c, 1);
+  }
+  if (!readLiteral(c, out, outSize)) return false;
+  if (out && (strcmp(out, "null") == 0 || strcmp(out, "false") == 0)) {
+    isNull = true;
+    out[0] = 0;
+  }
+  return true;
+}
+
+static bool keyEquals(const char* key, const char* expected) {
+  return strcmp(key, expected) == 0;
+}
+
+bool parseAttendanceResponse(const char* json, size_t length, AttendanceResponse& out) {
+  memset(&out, 0, sizeof(out));
+  out.kind = ATTENDANCE_KIND_UNKNOWN;
+
+  JsonCursor c = { json, json + length };
+  if (!consume(c, '{')) return false;
+  if (consume(c, '}')) return true;
+
+  char key[24];
+  do {
+    if (!readString(c, key, sizeof(key)) || !consume(c, ':')) return false;
+    bool isNull;
+
+    if (keyEquals(key, "message")) {
+      if (!readScalar(c, out.message, sizeof(out.message), isNull)) return false;
+      out.hasMessage = !isNull;
+    } else if (keyEquals(key, "type")) {
+      if (!readScalar(c, out.type, sizeof(out.type), isNull)) return false;
+    } else if (keyEquals(key, "unchanged")) {
+      char flag[8];
+      if (!readScalar(c, flag, sizeof(flag), isNull)) return false;
+      out.unchanged = !isNull && keyEquals(flag, "true");
+    } else if (keyEquals(key, "attendance")) {
+      skipWhitespace(c);
+      if (c.p < c.end && *c.p == '{') {
+        c.p++;
+        if (!consume(c, '}')) {
+          char innerKey[24];
+          do {
+            if (!readString(c, innerKey, sizeof(innerKey)) || !consume(c, ':')) return false;
+            if (keyEquals(innerKey, "userName")) {
+              if (!readScalar(c, out.userName, sizeof(out.userName), isNull)) return false;
+            } else if (!skipValue(c, 2)) {
+              return false;
+            }
+          } while (consume(c, ','));
+          if (!consume(c, '}')) return false;
+        }
+      } else if (!skipValue(c, 1)) {
+        return false;
+      }
+    } else if (!skipValue(c, 1)) {
+      return false;
+    }
+  } while (consume(c, ','));
+
+  if (!consume(c, '}')) return false;
+
+  if (keyEquals(out.type, "entry")) {
+    out.kind = ATTENDANCE_KIND_ENTRY;
+  } else if (keyEquals(out.type, "exit")) {
+    out.kind = ATTENDANCE_KIND_EXIT;
+  } else if (keyEquals(out.type, "complete")) {
+    out.kind = ATTENDANCE_KIND_COMPLETE;
+  }
+  return true;
+}
+
+bool isPermanentRejection(int httpCode, bool jsonReply) {
+  return jsonReply && httpCode >= 400 && httpCode < 500 &&
+         httpCode != 408 && httpCode != 409 && httpCode != 429;
+}
+
+bool findJsonScalar(const char* json, size_t length, const char* key, char* out, size_t outSize) {
+  JsonCursor c = { json, json + length };
+  if (!consume(c, '{')) return false;
+  if (consume(c, '}')) return false;
+
+  char currentKey[32];
+  do {
+    if (!readString(c, currentKey, sizeof(currentKey)) || !consume(c, ':')) return false;
+    if (keyEquals(currentKey, key)) {
+      bool isNull;
+      return readScalar(c, out, outSize, isNull) && !isNull;
+    }
+    if (!skipValue(c, 1)) return false;
+  } while (consume(c, ','));
+  return false;
+}
+
+// ========================================
+// OFFLINE BACKLOG QUEUE
+// ========================================
+
+OfflineQueue::OfflineQueue(TerminalStorage& storage, const char* path, const char* tempPath)
+  : _storage(storage), _path(path), _tempPath(tempPath), _count(0),
+    _commitBytes(0), _commitAgeMs(0), _bufferLength(0), _staged(0), _oldestMs(0),
+    _appends(0), _writes(0) {
+}
+
+void OfflineQueue::setGroupCommit(uint16_t maxBytes, uint32_t maxAgeMs) {
+  flush();
+  _commitBytes = maxBytes > OFFLINE_COMMIT_BUFFER_SIZE ? OFFLINE_COMMIT_BUFFER_SIZE : maxBytes;
+  _commitAgeMs = maxAgeMs;
+}
+
+bool OfflineQueue::append(const char* record, size_t length, uint32_t nowMs) {
+  _appends++;
+  if (_commitBytes == 0 || length + 1 > _commitBytes) {
+    // Write-through, or a record that could never be staged
+    if (!flush()) {
+      return false;
+    }
+    _writes++;
+    if (!_storage.appendLine(_path, record, length)) {
+      return false;
+    }
+    _count++;
+    return true;
+  }
+
+  if (_bufferLength + length + 1 > _commitBytes && !flush()) {
+    return false;
+  }
+  if (_staged == 0) {
+    _oldestMs = nowMs;
+  }
+  memcpy(_buffer + _bufferLength, record, length);
+  _bufferLength += length;
+  _buffer[_bufferLength++] = '\n';
+  _staged++;
+
+  // Staged either way; a failed flush is retried by the next flushIfDue()
+  if (_bufferLength == _commitBytes) {
+    flush();
+  }
+  return true;
+}
+
+// appendLine() adds the final newline itself, so the staged records cost
+// one file open (one metadata commit on flash) instead of one each
+bool OfflineQueue::flush() {
+  if (_staged == 0) {
+    return true;
+  }
+  _writes++;
+  if (!_storage.appendLine(_path, _buffer, _bufferLength - 1)) {
+    return false;
+  }
+  _count += _staged;
+  _staged = 0;
+  _bufferLength = 0;
+  return true;
+}
+
+bool OfflineQueue::flushIfDue(uint32_t nowMs) {
+  if (_staged == 0 || nowMs - _oldestMs < _commitAgeMs) {
+    return true;
+  }
+  return flush();
+}
+
+bool OfflineQueue::clear() {
+  bool dropped = _staged > 0;
+  _staged = 0;
+  _bufferLength = 0;
+  bool removed = _storage.remove(_path);
+  _count = 0;
+  return removed || dropped;
+}
+
+static bool countLine(const char*, size_t, void* context) {
+  (*(int*)context)++;
+  return true;
+}
+
+int OfflineQueue::recoverCount() {
+  flush();
+  _count = 0;
+  if (_storage.exists(_path)) {
+    _storage.forEachLine(_path, countLine, &_count);
+  }
+  return count();
+}
+
+struct DrainContext {
+  TerminalStorage* storage;
+  const char* tempPath;
+  RecordUploader* uploader;
+  DrainResult result;
+  bool aborted;
+  bool stopped;
+};
+
+static bool drainLine(const char* line, size_t len, void* context) {
+  DrainContext& ctx = *(DrainContext*)context;
+  if (!ctx.stopped && !ctx.uploader->shouldContinue()) {
+    ctx.stopped = true;
+    if (ctx.result.uploaded == 0) {
+      // Nothing consumed yet: leave the backlog file untouched
+      ctx.aborted = true;
+      return false;
+    }
+  }
+  if (!ctx.stopped && ctx.uploader->upload(line, len)) {
+    ctx.result.uploaded++;
+    ctx.result.bytesUploaded += len;
+    return true;
+  }
+  // Keep the record for the next pass
+  if (!ctx.storage->appendLine(ctx.tempPath, line, len)) {
+    ctx.aborted = true;
+    return false;
+  }
+  ctx.result.remaining++;
+  return true;
+}
+
+DrainResult OfflineQueue::drain(RecordUploader& uploader) {
+  DrainContext ctx = { &_storage, _tempPath, &uploader, { 0, 0, 0 }, false, false };
+
+  flush();
+  if (!_storage.exists(_path)) {
+    _count = 0;
+    return ctx.result;
+  }
+
+  _storage.remove(_tempPath);
+  _storage.forEachLine(_path, drainLine, &ctx);
+  if (!ctx.aborted && !uploader.commit()) {
+    ctx.aborted = true;
+  }
+  return finishDrain(ctx.aborted, ctx.result);
+}
+
+DrainResult OfflineQueue::finishDrain(bool aborted, DrainResult result) {
+  if (aborted) {
+    // Could not persist a failed record (or stopped before consuming any);
+    // keep the original backlog intact. Already-uploaded records will be
+    // offered again on the next pass.
+    _storage.remove(_tempPath);
+    result.remaining = count();
+    return result;
+  }
+
+  _storage.remove(_path);
+  if (result.remaining > 0) {
+    _storage.rename(_tempPath, _path);
+  }
+  _count = result.remaining;
+  return result;
+}
+
+// ----- Pipelined drain -----
+
+enum WindowEntryState {
+  ENTRY_IN_FLIGHT,
+  ENTRY_ACCEPTED,
+  ENTRY_KEPT                 // Failed, or not sent in this pass
+};
+
+#define PIPELINE_FAILED_TAGS 8
+
+struct PipelineContext {
+  TerminalStorage* storage;
+  const char* tempPath;
+  PipelinedUploader* uploader;
+  UploadWindowEntry* entries;  // Ring of UPLOAD_WINDOW_MAX, oldest at head
+  uint8_t window;
+  uint8_t head;
+  uint8_t size;
+  bool slotBusy[UPLOAD_WINDOW_MAX];
+  char failedTags[PIPELINE_FAILED_TAGS][ATTENDANCE_UID_HEX_SIZE];
+  uint8_t failedCount;
+  uint16_t started;
+  DrainResult result;
+  bool aborted;
+  bool stopped;
+};
+
+static bool tagFailed(const PipelineContext& ctx, const char* tag) {
+  for (uint8_t i = 0; i < ctx.failedCount; i++) {
+    if (strcmp(ctx.failedTags[i], tag) == 0) return true;
+  }
+  return false;
+}
+
+static void markTagFailed(PipelineContext& ctx, const char* tag) {
+  if (!tag[0] || tagFailed(ctx, tag)) {
+    return;
+  }
+  if (ctx.failedCount == PIPELINE_FAILED_TAGS) {
+    // Cannot keep per-card order for any more cards; send nothing further
+    ctx.stopped = true;
+    return;
+  }
+  strcpy(ctx.failedTags[ctx.failedCount++], tag);
+}
+
+static UploadWindowEntry& windowEntry(PipelineContext& ctx, uint8_t offset) {
+  return ctx.entries[(ctx.head + offset) % UPLOAD_WINDOW_MAX];
+}
+
+static uint8_t countInFlight(PipelineContext& ctx, const char* tag) {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < ctx.size; i++) {
+    UploadWindowEntry& entry = windowEntry(ctx, i);
+    if (entry.state == ENTRY_IN_FLIGHT && (!tag || strcmp(entry.tag, tag) == 0)) n++;
+  }
+  return n;
+}
+
+// Collects finished uploads, then acknowledges from the head in file order.
+// Returns false when nothing moved.
+static bool pollWindow(PipelineContext& ctx) {
+  bool progress = false;
+  for (uint8_t i = 0; i < ctx.size; i++) {
+    UploadWindowEntry& entry = windowEntry(ctx, i);
+    bool accepted = false;
+    if (entry.state == ENTRY_IN_FLIGHT && ctx.uploader->poll(entry.slot, accepted)) {
+      ctx.slotBusy[entry.slot] = false;
+      entry.state = accepted ? ENTRY_ACCEPTED : ENTRY_KEPT;
+      if (!accepted) markTagFailed(ctx, entry.tag);
+      progress = true;
+    }
+  }
+
+  while (ctx.size > 0 && ctx.entries[ctx.head].state != ENTRY_IN_FLIGHT) {
+    UploadWindowEntry& entry = ctx.entries[ctx.head];
+    if (entry.state == ENTRY_ACCEPTED) {
+      ctx.result.uploaded++;
+      ctx.result.bytesUploaded += entry.length;
+    } else if (!ctx.aborted) {
+      if (ctx.storage->appendLine(ctx.tempPath, entry.record, entry.length)) {
+        ctx.result.remaining++;
+      } else {
+        ctx.aborted = true;
+      }
+    }
+    ctx.head = (ctx.head + 1) % UPLOAD_WINDOW_MAX;
+    ctx.size--;
+    progress = true;
+  }
+  return progress;
+}
+
+static void waitWindow(PipelineContext& ctx) {
+  if (!pollWindow(ctx)) {
+    ctx.uploader->idle();
+  }
+}
+
+static bool pipelineLine(const char* line, size_t len, void* context) {
+  PipelineContext& ctx = *(PipelineContext*)context;
+  if (!ctx.stopped && !ctx.uploader->shouldContinue()) {
+    ctx.stopped = true;
+    if (ctx.started == 0) {
+      // Nothing consumed yet: leave the backlog file untouched
+      ctx.aborted = true;
+      return false;
+    }
+  }
+  if (len >= ATTENDANCE_RECORD_LINE_MAX) {
+    len = ATTENDANCE_RECORD_LINE_MAX - 1;
+  }
+
+  // Records without a readable tag carry no ordering constraint
+  char tag[ATTENDANCE_UID_HEX_SIZE];
+  if (ctx.stopped || !findJsonScalar(line, len, "rfidTag", tag, sizeof(tag))) {
+    tag[0] = 0;
+  }
+
+  // The backend toggles entry/exit in arrival order, so a card's earlier
+  // scan must be settled before the next one goes out
+  while (!ctx.aborted && tag[0] && countInFlight(ctx, tag) > 0) {
+    waitWindow(ctx);
+  }
+  bool send = !ctx.stopped && !tagFailed(ctx, tag);
+  while (!ctx.aborted && (ctx.size == UPLOAD_WINDOW_MAX || (send && countInFlight(ctx, NULL) >= ctx.window))) {
+    waitWindow(ctx);
+    send = send && !ctx.stopped && !tagFailed(ctx, tag);
+  }
+  if (ctx.aborted) {
+    return false;
+  }
+  if (send && !ctx.uploader->shouldContinue()) {
+    ctx.stopped = true;
+    send = false;
+  }
+
+  UploadWindowEntry& entry = windowEntry(ctx, ctx.size);
+  memcpy(entry.record, line, len);
+  entry.record[len] = 0;
+  entry.length = (uint16_t)len;
+  strcpy(entry.tag, tag);
+  entry.state = ENTRY_KEPT;
+  ctx.size++;
+
+  if (send) {
+    uint8_t slot = 0;
+    while (ctx.slotBusy[slot]) slot++;
+    ctx.started++;
+    if (ctx.uploader->start(slot, entry.record, entry.length)) {
+      entry.slot = slot;
+      entry.state = ENTRY_IN_FLIGHT;
+      ctx.slotBusy[slot] = true;
+    } else {
+      markTagFailed(ctx, tag);
+    }
+  }
+
+  pollWindow(ctx);
+  return !ctx.aborted;
+}
+
+DrainResult OfflineQueue::drainPipelined(PipelinedUploader& uploader, UploadWindow& window) {
+  PipelineContext ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.storage = &_storage;
+  ctx.tempPath = _tempPath;
+  ctx.uploader = &uploader;
+  ctx.entries = window.entries;
+  ctx.window = uploader.getWindow();
+  if (ctx.window < 1) ctx.window = 1;
+  if (ctx.window > UPLOAD_WINDOW_MAX) ctx.window = UPLOAD_WINDOW_MAX;
+
+  flush();
+  if (!_storage.exists(_path)) {
+    _count = 0;
+    return ctx.result;
+  }
+
+  _storage.remove(_tempPath);
+  _storage.forEachLine(_path, pipelineLine, &ctx);
+
+  // Let the tail of the window finish; after an abort only to free the slots
+  while (ctx.size > 0) {
+    waitWindow(ctx);
+  }
+  return finishDrain(ctx.aborted, ctx.result);
+}
+
+// ========================================
+// SCAN SEQUENCE NUMBERS
+// ========================================
+
+SequenceAllocator::SequenceAllocator(TerminalStorage& storage, const char* path, const char* tempPath,
+                                     uint32_t blockSize)
+  : _storage(storage), _path(path), _tempPath(tempPath), _blockSize(blockSize ? blockSize : 1),
+    _next(1), _reserved(0), _reservations(0) {
+}
+
+static bool maxNumberLine(const char* line, size_t len, void* context) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < len && line[i] >= '0' && line[i] <= '9'; i++) {
+    value = value * 10 + (uint32_t)(line[i] - '0');
+  }
+  uint32_t& highest = *(uint32_t*)context;
+  if (value > highest) highest = value;
+  return true;
+}
+
+void SequenceAllocator::begin() {
+  // A crash between writing the temp file and the rename leaves the newer
+  // mark in the temp file; taking the larger of the two covers it
+  uint32_t reserved = 0;
+  if (_storage.exists(_path)) {
+    _storage.forEachLine(_path, maxNumberLine, &reserved);
+  }
+  if (_storage.exists(_tempPath)) {
+    _storage.forEachLine(_tempPath, maxNumberLine, &reserved);
+  }
+  _reserved = reserved;
+  _next = reserved + 1;
+}
+
+uint32_t SequenceAllocator::allocate() {
+  if (_next > _reserved) {
+    uint32_t upTo = _next + _blockSize - 1;
+    if (upTo < _next) upTo = 0xFFFFFFFFUL;
+    if (!reserve(upTo)) {
+      return 0;
+    }
+  }
+  return _next++;
+}
+
+bool SequenceAllocator::reserve(uint32_t upTo) {
+  char line[12];
+  int len = snprintf(line, sizeof(line), "%lu", (unsigned long)upTo);
+
+  _storage.remove(_tempPath);
+  if (!_storage.appendLine(_tempPath, line, (size_t)len)) {
+    return false;
+  }
+  if (!_storage.rename(_tempPath, _path)) {
+    // Filesystems that refuse to rename over an existing file
+    _storage.remove(_path);
+    if (!_storage.rename(_tempPath, _path)) {
+      return false;
+    }
+  }
+  _reserved = upTo;
+  _reservations++;
+  return true;
+}
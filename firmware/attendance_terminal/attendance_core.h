@@ -0,0 +1,226 @@
+/*
+ * Portable attendance core for Attendee Attendance Terminal v2.0
+ *
+ * Record encoding, backend response parsing and the offline backlog queue,
+ * written against terminal_hal.h only. Everything works on caller-provided
+ * fixed buffers, so nothing here allocates. Shared by the firmware and the
+ * Linux host build (fleet simulator, benchmarks, load generator).
+ */
+
+#ifndef ATTENDANCE_CORE_H
+#define ATTENDANCE_CORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "terminal_hal.h"
+
+#define ATTENDANCE_UID_MAX_BYTES   10      // ISO 14443 triple-size UID
+#define ATTENDANCE_UID_HEX_SIZE    21      // 20 hex chars + NUL
+#define ATTENDANCE_TIMESTAMP_SIZE  20      // "YYYY-MM-DDTHH:MM:SS" + NUL
+#define ATTENDANCE_PAYLOAD_SIZE    200     // Matches StaticJsonDocument<200> budget
+#define ATTENDANCE_RECORD_LINE_MAX 256     // Longest offline record accepted back from storage
+
+// ========================================
+// RECORD ENCODING
+// ========================================
+
+// Uppercase hex, two digits per byte ("04A1B2C3"). Returns length written.
+size_t formatUidHex(const uint8_t* uid, size_t uidLength, char* out, size_t outSize);
+
+// ISO 8601 local time without zone ("2025-08-16T09:30:00"). Returns length written.
+size_t formatIsoTimestamp(const TerminalDateTime& dt, char* out, size_t outSize);
+
+// Inverse of formatIsoTimestamp() as seconds since 2000-01-01, for dates
+// from 2000 on. Returns false for anything else.
+bool parseIsoTimestamp(const char* timestamp, uint32_t& seconds);
+
+// Seconds since 2000-01-01 back to an ISO timestamp. Returns length written.
+size_t formatIsoSeconds(uint32_t seconds, char* out, size_t outSize);
+
+// {"rfidTag":..,"timestamp":..,"deviceId":..,"firmware":..,"seq":N,
+// "direction":..}. seq 0 and a NULL direction leave those fields out, giving
+// the record the firmware has always sent. direction is "entry"/"exit" from
+// a reader with a fixed role. Returns length, or 0 when it does not fit.
+size_t buildAttendancePayload(const char* rfidTag, const char* timestamp,
+                              const char* deviceId, const char* firmware, uint32_t seq,
+                              const char* direction, char* out, size_t outSize);
+
+// ========================================
+// RESPONSE PARSING
+// ========================================
+
+enum AttendanceKind {
+  ATTENDANCE_KIND_UNKNOWN,   // No/unrecognised "type"
+  ATTENDANCE_KIND_ENTRY,
+  ATTENDANCE_KIND_EXIT,
+  ATTENDANCE_KIND_COMPLETE
+};
+
+struct AttendanceResponse {
+  bool hasMessage;           // "message" present and not null/false
+  char message[64];
+  char type[16];             // Raw "type" value, empty if absent
+  char userName[48];         // attendance.userName, empty if absent
+  AttendanceKind kind;
+  bool unchanged;            // "unchanged": true, a repeated entry/exit the backend ignored
+};
+
+// Extracts message, type, unchanged and attendance.userName from a backend
+// response.
+// Returns false on malformed JSON or a non-object top level.
+bool parseAttendanceResponse(const char* json, size_t length, AttendanceResponse& out);
+
+// A backend answer that resending cannot change: a 4xx other than 408
+// (timeout), 409 (scan still in flight) and 429 (throttled), carrying the
+// backend's own JSON error. A 404 page from a proxy or a missing route is
+// not one, so a misconfigured URL never empties the backlog.
+bool isPermanentRejection(int httpCode, bool jsonReply);
+
+// Generic helper: copy a top-level string or number field into out.
+// Returns false when absent, null or not a scalar.
+bool findJsonScalar(const char* json, size_t length, const char* key, char* out, size_t outSize);
+
+// ========================================
+// OFFLINE BACKLOG QUEUE
+// ========================================
+
+// Uploads one stored record; returns true once the backend has accepted it.
+// shouldContinue() returning false ends the pass early; the records not yet
+// offered stay queued.
+class RecordUploader {
+public:
+  virtual ~RecordUploader() {}
+  virtual bool upload(const char* record, size_t length) = 0;
+  virtual bool shouldContinue() { return true; }
+
+  // Called once every record has been offered, before the backlog is
+  // rewritten; returning false keeps the backlog as it was
+  virtual bool commit() { return true; }
+};
+
+struct DrainResult {
+  int uploaded;
+  int remaining;
+  uint32_t bytesUploaded;
+};
+
+#define UPLOAD_WINDOW_MAX 4        // Upper bound on requests in flight
+
+// Non-blocking uploads for drainPipelined(). Each slot is an independent
+// connection carrying one record at a time. start() hands a record to an
+// idle slot (the record stays valid until the slot finishes); poll()
+// returns true once it has, with accepted set when the backend took it.
+class PipelinedUploader {
+public:
+  virtual ~PipelinedUploader() {}
+  virtual uint8_t getWindow() = 0;    // Slots usable this pass, 1..UPLOAD_WINDOW_MAX
+  virtual bool start(uint8_t slot, const char* record, size_t length) = 0;
+  virtual bool poll(uint8_t slot, bool& accepted) = 0;
+  virtual bool shouldContinue() { return true; }
+  virtual void idle() {}              // A poll sweep made no progress
+};
+
+struct UploadWindowEntry {
+  char record[ATTENDANCE_RECORD_LINE_MAX];
+  char tag[ATTENDANCE_UID_HEX_SIZE];
+  uint16_t length;
+  uint8_t slot;
+  uint8_t state;
+};
+
+// Records between the read cursor and the last acknowledged one, in file
+// order. About 1 KB, so keep it in static storage rather than on the stack.
+struct UploadWindow {
+  UploadWindowEntry entries[UPLOAD_WINDOW_MAX];
+};
+
+#define OFFLINE_COMMIT_BUFFER_SIZE 768    // Largest group commit staged in RAM (the default size)
+
+// One JSON record per line. Draining streams the backlog and writes records
+// that failed to upload to a side file, so RAM use is independent of size.
+//
+// Group commit: with setGroupCommit(), appended records are staged in RAM
+// and written to storage together, once maxBytes are staged or the oldest
+// staged record is maxAgeMs old (flushIfDue()). A power cut loses at most
+// maxAgeMs of scans; in exchange a queue of taps costs one file write
+// instead of one per scan. Staged records count as queued, and drain(),
+// clear() and flush() see them. maxBytes 0 (the default) writes through.
+class OfflineQueue {
+public:
+  OfflineQueue(TerminalStorage& storage, const char* path, const char* tempPath);
+
+  void setGroupCommit(uint16_t maxBytes, uint32_t maxAgeMs);
+
+  bool append(const char* record, size_t length, uint32_t nowMs);
+  bool flush();                       // Commit staged records now
+  bool flushIfDue(uint32_t nowMs);    // Commit once the age threshold is reached; call every loop pass
+  bool clear();                       // Drop the backlog, staged records included
+  int recoverCount();                 // Recount from storage after boot
+  DrainResult drain(RecordUploader& uploader);
+
+  // drain() with up to getWindow() uploads in flight. Completions are
+  // acknowledged in file order, so records kept back stay in sequence, and
+  // two scans of the same card are never in flight together (nor is one
+  // sent after an earlier scan of that card failed in this pass).
+  DrainResult drainPipelined(PipelinedUploader& uploader, UploadWindow& window);
+  int count() const { return _count + _staged; }
+  int getStaged() const { return _staged; }
+  uint32_t getAppendCount() const { return _appends; }
+  uint32_t getWriteCount() const { return _writes; }  // Storage writes for appends
+
+private:
+  DrainResult finishDrain(bool aborted, DrainResult result);
+
+  TerminalStorage& _storage;
+  const char* _path;
+  const char* _tempPath;
+  int _count;                         // In storage
+
+  uint16_t _commitBytes;
+  uint32_t _commitAgeMs;
+  char _buffer[OFFLINE_COMMIT_BUFFER_SIZE];
+  uint16_t _bufferLength;
+  int _staged;
+  uint32_t _oldestMs;
+
+  uint32_t _appends;
+  uint32_t _writes;
+};
+
+// ========================================
+// SCAN SEQUENCE NUMBERS
+// ========================================
+
+// Strictly increasing per-device scan numbers that survive reboots. Together
+// with the device ID they form the idempotency key the backend uses to drop
+// re-sent records, so uploads can be retried at-least-once.
+//
+// Numbers are handed out from a block reserved ahead in storage: the file
+// holds the highest number that may have been issued, and is rewritten only
+// when a block runs out (one flash write per blockSize scans). A reboot
+// skips the rest of the block; gaps are fine, reuse is not.
+class SequenceAllocator {
+public:
+  SequenceAllocator(TerminalStorage& storage, const char* path, const char* tempPath,
+                    uint32_t blockSize);
+
+  void begin();                       // Load the reserved mark after boot
+  uint32_t allocate();                // 0 when no block could be reserved
+
+  uint32_t peekNext() const { return _next; }
+  uint32_t getReserved() const { return _reserved; }
+  uint32_t getReservationCount() const { return _reservations; }
+
+private:
+  bool reserve(uint32_t upTo);
+
+  TerminalStorage& _storage;
+  const char* _path;
+  const char* _tempPath;
+  uint32_t _blockSize;
+  uint32_t _next;
+  uint32_t _reserved;
+  uint32_t _reservations;
+};
+
+#endif // ATTENDANCE_CORE_H
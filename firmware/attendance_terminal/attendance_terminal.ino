@@ -47,6 +47,37 @@
  * • utils.h                    - Header file declaring utility functions
  *                               Function prototypes and external declarations
  * 
+ * • event_stream.cpp/.h        - Live Server-Sent Events stream for local admin tools
+ *                               Bounded per-client buffers with drop accounting
+ * 
+ * • metrics.cpp/.h             - Prometheus-style counters and fixed-bucket histograms
+ *                               Instrumented WiFi clients for DNS/connect/TLS timing
+ * 
+ * • trace.cpp/.h               - Fixed-size RAM ring of hot-path trace points
+ *                               Compiled out entirely when TRACE_ENABLED is false
+ * 
+ * • logger.cpp/.h              - Leveled printf-style logger (LOG_E/W/I/D, formats in flash)
+ *                               Buffered UART output that never blocks the scan path
+ * 
+ * • terminal_hal.h             - Hardware abstraction interfaces (storage, transport, connection, datagram, reader, clock)
+ * • attendance_core.cpp/.h     - Portable record encoding, response parsing, offline queue
+ * • offline_segments.cpp/.h    - Delta/varint compressed segments sealed from the offline backlog
+ * • backlog_compactor.cpp/.h   - Drops repeat taps from the offline backlog, with a persistent audit count
+ * • history_store.cpp/.h       - Synced scans kept per day on flash, with a sparse time index
+ * • daily_tally.cpp/.h         - Today's occupancy, unique cards and hourly entries/exits, kept as scans commit
+ *                               Builds unchanged on Linux for the host simulator (../host)
+ * • hal_esp8266.cpp/.h         - LittleFS, HTTPClient, WiFiClient and RTC implementations of the HAL
+ * • sync_pacing.cpp/.h         - Jittered heartbeat/sync scheduling, AIMD backlog pacing
+ * • upload_pipeline.cpp/.h     - Windowed backlog upload over non-blocking keep-alive connections
+ * • coap_transport.cpp/.h      - Confirmable CoAP over UDP with a PSK message MAC (coap:// backends)
+ * • mqtt_transport.cpp/.h      - MQTT 3.1.1 QoS 1 client with a persistent session (mqtt:// backends)
+ * • roster.cpp/.h              - Member names on flash, kept current by versioned delta pages
+ * • endpoint_selector.cpp/.h   - Backend URL list with /health RTT probing, sticky selection, failover
+ * • rfid_tuning.cpp/.h         - First-tap read statistics and adaptive antenna gain
+ * • rfid_poller.cpp/.h         - Adaptive card detect cadence and detect latency bound
+ * • rfid_readers.cpp/.h        - Entry/exit readers on one SPI bus: time-sliced polls, per-reader dedupe and health
+ * • power_budget.cpp/.h        - Energy estimate from time spent in each power state
+ * 
  * Configuration Files:
  * ------------------
  * • config.h                   - Hardware pin definitions and system constants
@@ -65,6 +96,10 @@
  *                               Backend URL, device ID, settings persistence
  * 
  * • /offline_logs.txt          - Offline attendance records in LittleFS
+ * • /seg_NNNNN.bin             - Older offline records, sealed into compressed segments
+ * • /compaction.txt            - Totals of redundant offline records dropped before upload
+ * • /hist_NNNNN.txt/.idx       - Scans the backend accepted, one file and time index per day
+ * • /today.txt                 - Journal of today's tallied scans, replayed after a reboot
  *                               JSON-formatted attendance data for sync
  * 
  * Web API Endpoints:
@@ -73,6 +108,10 @@
  * • POST /api/config           - Update device configuration
  * • GET  /api/status           - Get comprehensive device status
  * • GET  /api/logs             - Get offline logs information
+ * • GET  /api/logs/export      - Paginated, filtered offline log export (JSON-lines or binary)
+ * • GET  /api/history          - Accepted scans in a time range, from the on-device history
+ * • GET  /api/today            - Today's occupancy, unique cards and hourly entries/exits
+ * • GET  /api/events           - Live scan/sync/connectivity/error event stream (SSE)
  * • POST /api/actions/sync     - Force sync offline logs
  * • POST /api/actions/heartbeat - Force send heartbeat to backend
  * • POST /api/actions/reset-wifi - Reset WiFi credentials
@@ -80,6 +119,8 @@
  * • POST /api/actions/switch-network - Switch WiFi network with credentials
  * • GET  /api/firmware/list    - Get list of firmware files
  * • GET  /api/firmware/download - Download specific firmware file
+ * • GET  /metrics              - Prometheus text exposition (latency histograms, counters)
+ * • GET  /api/trace            - Dump hot-path trace ring (convert with tools/trace_to_chrome.js)
  * 
  * Backend API Endpoints (Expected):
  * ---------------------------------
@@ -131,10 +172,32 @@
 #include <FS.h>
 #include <string.h>
 #include <math.h>
+#include <memory>
+#include <new>
 
 // Include configuration and utilities
 #include "config.h"
 #include "utils.h"
+#include "event_stream.h"
+#include "metrics.h"
+#include "trace.h"
+#include "logger.h"
+#include "attendance_core.h"
+#include "offline_segments.h"
+#include "backlog_compactor.h"
+#include "history_store.h"
+#include "daily_tally.h"
+#include "hal_esp8266.h"
+#include "sync_pacing.h"
+#include "upload_pipeline.h"
+#include "coap_transport.h"
+#include "mqtt_transport.h"
+#include "roster.h"
+#include "endpoint_selector.h"
+#include "rfid_tuning.h"
+#include "rfid_poller.h"
+#include "rfid_readers.h"
+#include "power_budget.h"
 
 // Web server for configuration endpoints
 ESP8266WebServer configServer(80);
@@ -149,25 +212,58 @@ void initializeWiFi();
 void loadConfiguration();
 void performEEPROMMigration();
 void loadOfflineLogsCount();
+void commitOfflineLogs(bool force);
+void sealOfflineLogs();
+void compactOfflineLogs();
 void setupConfigurationEndpoints();
 
 // ----- Network and Connectivity -----
 void checkWiFiConnection();
 void sendHeartbeat();
 void warmupHTTPSConnection();
+void probeBackendEndpoint();
+bool reportEndpointResult(int httpResponseCode);
 
 // ----- RFID and Attendance Processing -----
 void handleRFIDScan();
+void maintainRFIDReader();
+void resetRFIDReader(uint8_t reader, MetricCounter reason, const char* why);
 String scanRFIDCard();
-void processOnlineAttendance(String rfidTag, String timestamp);
-void processOfflineAttendance(String rfidTag, String timestamp);
-void handleSuccessfulAttendance(String response, String timestamp);
+void processOnlineAttendance(String rfidTag, String timestamp, uint32_t seq, const char* direction);
+int postAttendance(const char* payload, size_t payloadLength, uint32_t timeoutMs, String& response);
+int postAttendanceHttp(const String& attendanceUrl, const char* payload, size_t payloadLength,
+                       uint32_t timeoutMs, String& response);
+int postAttendanceMessage(TerminalTransport& transport, const String& attendanceUrl,
+                          const char* payload, size_t payloadLength, String& response);
+void processOfflineAttendance(String rfidTag, String timestamp, uint32_t seq, const char* direction);
+AttendanceKind handleSuccessfulAttendance(String response, String timestamp);
+void tallyScan(const String& rfidTag, const String& timestamp, const char* direction, AttendanceKind answer);
 void handleBadRequestAttendance(String response);
 void handleAttendanceError(String error);
+void handleAttendanceResult(int httpResponseCode, String response, String rfidTag, String timestamp, uint32_t seq,
+                            const char* direction);
+String rosterDisplayName(const String& rfidTag, const char* fallback);
 
 // ----- Data Sync and Logging -----
+enum SegmentSyncResult {
+  SEGMENT_SYNC_OK,
+  SEGMENT_SYNC_REJECTED,                // Refused for good: resending cannot help
+  SEGMENT_SYNC_RETRY
+};
 void syncOfflineLogs();
-bool syncSingleLog(String logEntry);
+bool syncSingleLog(const char* record, size_t length);
+void dropRejectedRecord(int httpResponseCode, const char* record, size_t length);
+int syncOfflineSegments();
+SegmentSyncResult syncSingleSegment(const uint8_t* segment, size_t length);
+void addSegmentToHistory(const uint8_t* segment, size_t length, const uint8_t* rejected);
+std::unique_ptr<uint8_t[]> allocateSegmentBuffer();
+TerminalTransport* messageTransport();
+int postMessage(TerminalTransport& transport, const String& url, const char* body, size_t len,
+                char* response, size_t responseSize);
+void serviceBackendSession();
+void applyBackendInstructions(const String& instructions);
+void syncRosterStep();
+void scheduleSpreadSync();
 
 // ----- Display Management -----
 void updateDisplay();
@@ -192,35 +288,128 @@ void handleResetWiFi();
 void handleRestartDevice();
 void handleSwitchNetwork();
 void handleGetLogsInfo();
+void handleExportLogs();
+void handleGetHistory();
+void handleGetToday();
 void handleGetFirmwareList();
 void handleDownloadFirmware();
+void handleEventStream();
+void handleGetMetrics();
+void handleGetTrace();
+void handleGetRfidStats();
 void handleNotFound();
 
+// ----- Live Event Stream -----
+void publishScanEvent(String rfidTag, String timestamp, uint8_t reader);
+void publishSyncEvent(int syncedCount, int remainingCount);
+void publishConnectivityEvent();
+void publishErrorEvent(String error);
+
 // ========================================
 // GLOBAL OBJECTS - UPDATED FOR MFRC522v2
 // ========================================
 
-// RFID setup with proper pin configuration
+// RFID setup with proper pin configuration; extra readers share the SPI
+// bus behind their own chip select
 MFRC522DriverPinSimple ss_pin(RFID_SS_PIN);
 MFRC522DriverSPI driver(ss_pin);
 MFRC522 mfrc522(driver);
+#if RFID_READER_COUNT > 1
+MFRC522DriverPinSimple exitSsPin(RFID_SS_PIN_2);
+MFRC522DriverSPI exitDriver(exitSsPin);
+MFRC522 mfrc522Exit(exitDriver);
+MFRC522* rfidReaders[RFID_READER_COUNT] = { &mfrc522, &mfrc522Exit };
+MFRC522DriverSPI* rfidDrivers[RFID_READER_COUNT] = { &driver, &exitDriver };
+#else
+MFRC522* rfidReaders[RFID_READER_COUNT] = { &mfrc522 };
+MFRC522DriverSPI* rfidDrivers[RFID_READER_COUNT] = { &driver };
+#endif
+// In low-power mode the idle poll interval is the whole detect-latency
+// budget, less the field settle time after waking the reader
+#define RFID_EFFECTIVE_IDLE_MS (LOW_POWER_MODE ? LOW_POWER_MAX_DETECT_MS - RFID_FIELD_SETTLE_MS : RFID_POLL_IDLE_MS)
+// Longest a presented card waits for a poll; the settle time only applies
+// to a reader woken from power-down
+#define RFID_MAX_DETECT_MS (LOW_POWER_MODE ? LOW_POWER_MAX_DETECT_MS : RFID_POLL_IDLE_MS)
+RfidReaderSet rfidReaderSet(RFID_POLL_FAST_MS, RFID_EFFECTIVE_IDLE_MS, RFID_POLL_FAST_WINDOW_MS);
+RfidGainTuner rfidGainTuner(RFID_GAIN_MIN, RFID_GAIN_MAX, RFID_DEFAULT_GAIN);
+
+// Energy estimate: component 0 is the MCU, readers follow from 1
+EnergyMeter energyMeter(POWER_WINDOW_MS, POWER_BASE_UA, POWER_SUPPLY_MV);
+#define ENERGY_MCU 0
+#define ENERGY_READER(reader) (1 + (reader))
 
 // Other hardware objects
 LiquidCrystal_I2C lcd(LCD_ADDRESS, LCD_COLS, LCD_ROWS);
 RTC_DS3231 rtc;
-WiFiClient wifiClient;        // For HTTP connections
-WiFiClientSecure wifiClientSecure;  // For HTTPS connections
+TimedWiFiClient wifiClient;        // For HTTP connections (records DNS/connect metrics)
+TimedWiFiClientSecure wifiClientSecure;  // For HTTPS connections (records DNS/TLS metrics)
 HTTPClient http;
 
 // Connection optimization flags
 bool sslSessionValid = false;
 
+// Portable attendance core on top of the ESP8266 HAL
+LittleFsStorage flashStorage;
+HttpClientTransport backendTransport(http, wifiClient, wifiClientSecure);
+OfflineQueue offlineQueue(flashStorage, OFFLINE_LOGS_FILE, OFFLINE_LOGS_TEMP_FILE);
+SequenceAllocator scanSequence(flashStorage, SCAN_SEQUENCE_FILE, SCAN_SEQUENCE_TEMP_FILE,
+                               SCAN_SEQUENCE_BLOCK);
+RtcClock terminalClock(rtc);
+
+// Compressed segments sealed from the offline backlog. The encoder and the
+// segment buffer are taken from the heap for one seal, upload or export
+// pass only (allocateSegmentBuffer()).
+SegmentStore offlineSegments(flashStorage, OFFLINE_SEGMENT_PREFIX, OFFLINE_SEGMENTS_FILE,
+                             OFFLINE_SEGMENTS_TEMP_FILE, OFFLINE_SEGMENT_FILE_BYTES, OFFLINE_SEGMENTS_MAX);
+bool segmentUploadSupported = true;     // Cleared when the backend lacks /attendance/segment
+
+// Repeat taps dropped from the backlog before it is sealed or uploaded; the
+// compactor's card table is taken from the heap for each pass
+CompactionAudit compactionAudit(flashStorage, COMPACTION_AUDIT_FILE, COMPACTION_AUDIT_TEMP_FILE);
+
+// Scans the backend accepted, kept per day for GET /api/history
+HistoryStore attendanceHistory(flashStorage, HISTORY_PREFIX, HISTORY_FILE, HISTORY_TEMP_FILE,
+                               HISTORY_RETENTION_DAYS, HISTORY_DAY_RECORDS, HISTORY_STAGE_MAX_AGE_MS);
+
+// Today's running figures for GET /api/today, updated as each scan commits
+DailyTally dailyTally(flashStorage, TALLY_FILE, TALLY_STAGE_MAX_AGE_MS);
+
+// CoAP transport for coap:// backends (no TCP/TLS state between requests)
+WiFiDatagram coapSocket;
+CoapTransport coapTransport(coapSocket, terminalClock, COAP_PSK);
+
+// MQTT transport for mqtt:// backends: one persistent session carries every
+// request, and the backend pushes instructions down it
+class BackendMqttClient : public MqttClient {
+public:
+  BackendMqttClient(TerminalConnection& connection) : MqttClient(connection, terminalClock) {}
+
+  void idle() override {
+    delay(1);                           // Let the WiFi stack deliver acknowledgements
+  }
+};
+WiFiConnection mqttConnection;
+BackendMqttClient mqttClient(mqttConnection);
+MqttTransport mqttTransport(mqttClient, terminalClock, MQTT_USERNAME, MQTT_PASSWORD);
+
+// Card roster for naming scans locally; one page is fetched per loop() pass
+Roster roster(flashStorage, ROSTER_FILE, ROSTER_TEMP_FILE);
+RosterPage rosterPage;
+
+// Pipelined backlog upload slots (one keep-alive connection each)
+static_assert(UPLOAD_WINDOW_MAX == 4, "uploadSlots lists one connection per slot");
+WiFiConnection uploadConnections[UPLOAD_WINDOW_MAX];
+TerminalConnection* const uploadSlots[UPLOAD_WINDOW_MAX] = {
+  &uploadConnections[0], &uploadConnections[1], &uploadConnections[2], &uploadConnections[3]
+};
+
 // ========================================
 // GLOBAL VARIABLES
 // ========================================
 
 // ----- Configuration Variables -----
-String backendUrl = DEFAULT_BACKEND_URL;
+String backendUrl = DEFAULT_BACKEND_URL;             // First (preferred) entry of backendEndpoints
+EndpointSelector backendEndpoints(BACKEND_PROBE_INTERVAL_MS, BACKEND_STICKY_PERCENT, BACKEND_STICKY_MIN_MS);
 String deviceId = "";
 
 // ----- Attendance Tracking Variables -----
@@ -230,20 +419,89 @@ String lastScannedMessage = "";
 int offlineLogsCount = 0;
 unsigned long lastCardScan = 0;
 
-// ----- RFID Watchdog/Maintenance Variables -----
-unsigned long lastRFIDMaintenance = 0;   // last periodic re-init
-unsigned long lastRFIDActivity = 0;      // updated on each detection/read
-int consecutiveRFIDReadFailures = 0;     // to trigger soft reset on repeated failures
-
 // ----- Network and Communication Variables -----
 bool isOnline = false;
 unsigned long lastHeartbeat = 0;
 unsigned long lastSyncAttempt = 0;
+unsigned long heartbeatDelay = HEARTBEAT_INTERVAL;   // Jittered/hinted gap to the next heartbeat
+unsigned long syncDelay = SYNC_RETRY_INTERVAL;       // Jittered/paced gap to the next sync pass
+SyncPacer syncPacer(SYNC_BATCH_INITIAL, SYNC_BATCH_MAX, SYNC_BATCH_INCREASE,
+                    SYNC_BACKOFF_MIN_MS, SYNC_BACKOFF_MAX_MS);
+bool rosterSyncPending = false;      // Set by heartbeats; cleared by a 304 or the last page
 // Track whether configServer has been started after connecting to WiFi
 bool configServerStarted = false;
 // Track periodic reconnect attempts when running offline
 unsigned long lastPeriodicReconnectAttempt = 0;
 
+// ========================================
+// BACKLOG UPLOADERS
+// ========================================
+
+// Feeds offline records from the queue to the backend one at a time.
+// Fallback for backend URLs the pipeline cannot take (too long).
+class BackendSyncUploader : public RecordUploader {
+public:
+  bool upload(const char* record, size_t length) override {
+    return syncSingleLog(record, length);
+  }
+
+  bool shouldContinue() override {
+    return syncPacer.allowUpload();
+  }
+};
+
+// Keeps up to UPLOAD_WINDOW records in flight; results feed the same
+// metrics and pacer as syncSingleLog()
+class BackendPipelineUploader : public HttpPipelineUploader {
+public:
+  BackendPipelineUploader() : HttpPipelineUploader(uploadSlots, UPLOAD_WINDOW_MAX, terminalClock) {}
+
+  bool shouldContinue() override {
+    return syncPacer.allowUpload();
+  }
+
+  void idle() override {
+    delay(1);                           // Let the WiFi stack deliver responses
+  }
+
+  // The record stays valid until its slot finishes, so accepted ones can
+  // go to the history as they complete
+  bool start(uint8_t slot, const char* record, size_t length) override {
+    _records[slot] = record;
+    _lengths[slot] = length;
+    return HttpPipelineUploader::start(slot, record, length);
+  }
+
+  bool poll(uint8_t slot, bool& accepted) override {
+    if (!HttpPipelineUploader::poll(slot, accepted)) {
+      return false;
+    }
+    int code = getResult(slot);
+    if (accepted && (code == 200 || code == 201)) {
+      attendanceHistory.addRecord(_records[slot], _lengths[slot], millis());
+    } else if (accepted) {
+      dropRejectedRecord(code, _records[slot], _lengths[slot]);
+    }
+    return true;
+  }
+
+protected:
+  void onResult(int code, uint32_t retryAfterMs, uint32_t elapsedMs) override {
+    incrementMetric(CTR_HTTP_REQUESTS);
+    observeMetric(HIST_HTTP_TOTAL_MS, elapsedMs);
+    TRACE_EVENT(TRACE_SYNC_RECORD, code);
+    syncPacer.onResult(code, retryAfterMs);
+    if (code != 200 && code != 201) {
+      incrementMetric(CTR_HTTP_ERRORS);
+      LOG_D("Failed to sync log, HTTP code: %d", code);
+    }
+  }
+
+private:
+  const char* _records[UPLOAD_WINDOW_MAX];
+  size_t _lengths[UPLOAD_WINDOW_MAX];
+};
+
 // ========================================
 // NOTE: ARCHIVED FEATURES
 // ========================================
@@ -279,44 +537,44 @@ unsigned long configModeStartTime = 0;
 
 void setup() {
   Serial.begin(DEBUG_BAUD_RATE);
-  Serial.println();
-  Serial.println("=== Attendee Attendance Terminal v2.0 ===");
-  Serial.println("Firmware Version: " + String(FIRMWARE_VERSION));
-  Serial.println("Updated for MFRC522v2 library");
+  Serial.println();                     // End the boot ROM's output line
+  LOG_I("=== Attendee Attendance Terminal v2.0 ===");
+  LOG_I("Firmware Version: %s", FIRMWARE_VERSION);
+  LOG_I("Updated for MFRC522v2 library");
   
   systemStartTime = millis();
   
   // Initialize hardware in correct order
   if (!initializeHardware()) {
-    Serial.println("CRITICAL: Hardware initialization failed!");
+    LOG_E("Hardware initialization failed");
     setLCDState(LCD_ERROR, "Hardware Error");
     return;
   }
 
   // Initialize file system with LittleFS
-  Serial.println("Initializing file system (LittleFS)...");
+  LOG_I("Initializing file system (LittleFS)...");
   if (!LittleFS.begin()) {
-    Serial.println("LittleFS initialization failed, attempting format...");
+    LOG_W("LittleFS initialization failed, attempting format...");
     if (LittleFS.format()) {
-      Serial.println("LittleFS formatted successfully");
+      LOG_I("LittleFS formatted");
       if (!LittleFS.begin()) {
-        Serial.println("CRITICAL: LittleFS initialization failed after format!");
+        LOG_E("LittleFS initialization failed after format");
         
         // Show error on LCD
         setLCDState(LCD_FS_ERROR);
         delay(2000);
       } else {
-        Serial.println("LittleFS initialized successfully after format");
+        LOG_I("LittleFS initialized after format");
       }
     } else {
-      Serial.println("CRITICAL: LittleFS format failed!");
+      LOG_E("LittleFS format failed");
       
       // Show error on LCD
       setLCDState(LCD_FS_ERROR);
       delay(2000);
     }
   } else {
-    Serial.println("LittleFS initialized successfully");
+    LOG_I("LittleFS initialized");
   }
   
   // Show boot screen
@@ -330,7 +588,8 @@ void setup() {
   // Load configuration from LittleFS only
   loadConfiguration();
   // Check for reset requests during startup
-  Serial.println("Press 'y' for WiFi reset or 'c' for config reset within 2 seconds...");
+  LOG_I("Press 'y' for WiFi reset or 'c' for config reset within 2 seconds...");
+  flushLogOutput();                     // The prompt must be out before the window opens
   setLCDState(LCD_BOOT_SCREEN, "reset_prompt");
   
   unsigned long startTime = millis();
@@ -342,12 +601,12 @@ void setup() {
       char input = Serial.read();
       if (input == 'y' || input == 'Y') {
         resetWiFi = true;
-        Serial.println("WiFi reset requested!");
+        LOG_I("WiFi reset requested");
         setLCDState(LCD_WIFI_RESET);
         break;
       } else if (input == 'c' || input == 'C') {
         resetConfig = true;
-        Serial.println("Config reset requested!");
+        LOG_I("Config reset requested");
         setLCDState(LCD_CONFIG_UPDATE, "Resetting");
         break;
       }
@@ -356,7 +615,7 @@ void setup() {
   }
   
   if (resetWiFi) {
-    Serial.println("Clearing WiFi credentials...");
+    LOG_I("Clearing WiFi credentials...");
     WiFi.disconnect(true); // Clear stored WiFi credentials
     delay(1000);
     
@@ -365,29 +624,30 @@ void setup() {
     wifiManager.resetSettings();
     delay(1000);
     
-    Serial.println("WiFi settings cleared. Starting fresh setup...");
+    LOG_I("WiFi settings cleared, starting fresh setup");
   }
   
   if (resetConfig) {
-    Serial.println("Resetting configuration to defaults...");
+    LOG_I("Resetting configuration to defaults...");
     
     // Delete existing config file
     if (LittleFS.exists("/config.json")) {
       LittleFS.remove("/config.json");
-      Serial.println("Existing config.json deleted");
+      LOG_I("Existing config.json deleted");
     }
     
     // Reset to defaults
     backendUrl = DEFAULT_BACKEND_URL;
+    setBackendEndpoints(&backendUrl, 1);
     deviceId = "ESP_" + formatMacAddress(WiFi.macAddress());
     
     // Save default configuration
     if (saveConfiguration()) {
-      Serial.println("Default configuration saved");
-      Serial.println("Backend URL reset to: " + backendUrl);
-      Serial.println("Device ID reset to: " + deviceId);
+      LOG_I("Default configuration saved");
+      LOG_I("Backend URL reset to: %s", backendUrl.c_str());
+      LOG_I("Device ID reset to: %s", deviceId.c_str());
     } else {
-      Serial.println("Warning: Failed to save default configuration");
+      LOG_W("Failed to save default configuration");
     }
     
 
@@ -396,6 +656,16 @@ void setup() {
   
   // Initialize WiFi
   initializeWiFi();
+  if (LOW_POWER_MODE) {
+    // Modem off between beacons; the CPU light-sleeps through idle delays
+    WiFi.setSleepMode(WIFI_LIGHT_SLEEP, LOW_POWER_LISTEN_INTERVAL);
+    LOG_I("Low-power mode: max detect latency %d ms", LOW_POWER_MAX_DETECT_MS);
+  }
+  energyMeter.addComponent(POWER_MCU_ACTIVE_UA, LOW_POWER_MODE ? POWER_MCU_LIGHT_SLEEP_UA : POWER_MCU_IDLE_UA,
+                           true, millis());
+  for (uint8_t reader = 0; reader < rfidReaderSet.getCount(); reader++) {
+    energyMeter.addComponent(POWER_READER_ON_UA, POWER_READER_DOWN_UA, true, millis());
+  }
 
   //Dispaly Update
   updateDisplay();
@@ -409,18 +679,33 @@ void setup() {
     setLED(false, true); // Red LED for offline
   }
   
-  // Load offline logs count
+  // Load offline logs count, the scan sequence high-water mark and the roster
   loadOfflineLogsCount();
+  scanSequence.begin();
+  attendanceHistory.begin();
+  dailyTally.begin();
+  cleanupOldLogs();
+  LOG_I("History: %u days, %lu scans", attendanceHistory.getPartitionCount(),
+        (unsigned long)attendanceHistory.getRecordCount());
+  LOG_I("Tally: %u inside, %u cards today", dailyTally.getOccupancy(), dailyTally.getUniqueCards());
+  roster.begin();
+  LOG_I("Roster v%lu, %lu members", (unsigned long)roster.getVersion(), (unsigned long)roster.getCount());
+  coapTransport.setRetransmission(COAP_ACK_TIMEOUT_MS, COAP_MAX_RETRANSMIT, COAP_EXCHANGE_TIMEOUT_MS);
+  coapTransport.setSeed(ESP.random());
+  mqttClient.setTimeout(MQTT_ACK_TIMEOUT_MS);
+  mqttTransport.setKeepAlive(MQTT_KEEPALIVE_S);
+  mqttTransport.setReplyTimeout(MQTT_REPLY_TIMEOUT_MS);
+  mqttTransport.setReconnectBackoff(MQTT_RECONNECT_MIN_MS, MQTT_RECONNECT_MAX_MS);
   
   // Setup web-based configuration endpoints (replaces admin menu)
   if (WiFi.status() == WL_CONNECTED) {
     setupConfigurationEndpoints();
     configServerStarted = true;
-    Serial.println("Configuration API available at: http://" + WiFi.localIP().toString() + "/api/config");
+    LOG_I("Configuration API available at: http://%s/api/config", WiFi.localIP().toString().c_str());
     
     // Pre-warm HTTPS connection for faster first attendance submission
-    if (backendUrl.startsWith("https://")) {
-      Serial.println("Pre-warming HTTPS connection for faster performance...");
+    if (getEffectiveBackendUrl().startsWith("https://")) {
+      LOG_I("Pre-warming HTTPS connection for faster performance...");
       warmupHTTPSConnection();
     }
   }
@@ -429,10 +714,13 @@ void setup() {
   updateDisplay();
   
   systemInitialized = true;
-  Serial.println("Setup complete. Ready for operation.");
-  Serial.println("System ready at: " + String(millis()) + "ms");
+  LOG_I("Setup complete. Ready for operation.");
+  LOG_I("System ready at: %lu ms", millis());
   
-  syncOfflineLogs();
+  // Random phase offsets: a site-wide power cut boots every terminal at once
+  scheduleSpreadSync();
+  lastHeartbeat = millis();
+  heartbeatDelay = randomPhase(HEARTBEAT_INTERVAL, ESP.random());
 
   // Play startup sound
   if (BUZZER_ENABLED) {
@@ -450,10 +738,15 @@ void loop() {
     return;
   }
   
+  unsigned long loopStartMicros = micros();
+  energyMeter.setActive(ENERGY_MCU, true, millis());
+  
   // Handle configuration server requests
   if (WiFi.status() == WL_CONNECTED) {
     configServer.handleClient();
+    serviceEventStream();
   }
+  serviceLogOutput();
   
   // Check WiFi connection periodically
   static unsigned long lastWiFiCheck = 0;
@@ -465,7 +758,7 @@ void loop() {
   // Periodically try to reconnect WiFi and sync when running offline
   if (!isOnline && (millis() - lastPeriodicReconnectAttempt > WIFI_PERIODIC_RECONNECT_INTERVAL)) {
     lastPeriodicReconnectAttempt = millis();
-    Serial.println("Periodic WiFi reconnect attempt...");
+    LOG_I("Periodic WiFi reconnect attempt...");
     setLCDState(LCD_CONNECTION_PROGRESS, "Retry WiFi");
 
     // Try to connect using stored credentials
@@ -480,21 +773,21 @@ void loop() {
     if (WiFi.status() == WL_CONNECTED) {
       isOnline = true;
       setLEDState(LED_GREEN);
-      Serial.println("Reconnected to WiFi during periodic attempt. IP: " + WiFi.localIP().toString());
+      LOG_I("Reconnected to WiFi during periodic attempt. IP: %s", WiFi.localIP().toString().c_str());
+      publishConnectivityEvent();
       syncTimeWithNTP();
 
       // Start config server if not started yet
       if (!configServerStarted) {
         setupConfigurationEndpoints();
         configServerStarted = true;
-        Serial.println("Configuration API available at: http://" + WiFi.localIP().toString() + "/api/config");
+        LOG_I("Configuration API available at: http://%s/api/config", WiFi.localIP().toString().c_str());
       }
 
-      // Immediately try syncing offline logs
+      // Sync offline logs soon, spread so a site-wide WiFi recovery
+      // does not have the whole fleet draining at the same instant
       if (offlineLogsCount > 0) {
-        setLCDState(LCD_SYNC_PROGRESS);
-        syncOfflineLogs();
-        setLCDState(LCD_SYNC_COMPLETE);
+        scheduleSpreadSync();
       }
 
       delay(1000);
@@ -503,7 +796,7 @@ void loop() {
       // Remain offline
       isOnline = false;
       setLEDState(LED_RED);
-      Serial.println("WiFi reconnect failed. Staying offline.");
+      LOG_W("WiFi reconnect failed. Staying offline.");
       delay(1000);
       updateDisplay();
     }
@@ -511,20 +804,25 @@ void loop() {
   
   // Handle RFID scanning - MAIN FUNCTION
   handleRFIDScan();
-
-  // RFID maintenance watchdog: periodic soft reset and idle recovery
-  unsigned long nowMillis = millis();
-  if (nowMillis - lastRFIDMaintenance > RFID_MAINTENANCE_INTERVAL_MS) {
-    Serial.println("RFID maintenance: periodic re-init");
-    softResetRFID();
-    lastRFIDMaintenance = nowMillis;
-  }
-  if (lastRFIDActivity > 0 && (nowMillis - lastRFIDActivity > RFID_REINIT_IF_IDLE_MS)) {
-    Serial.println("RFID maintenance: idle too long, forcing re-init");
-    softResetRFID();
-    lastRFIDActivity = nowMillis;
-    lastRFIDMaintenance = nowMillis;
+  
+  // Commit staged offline records once the oldest reaches the loss window
+  commitOfflineLogs(false);
+  
+  // Compress the oldest backlog records once there are enough for a segment
+  sealOfflineLogs();
+  
+  // Append staged history and tally lines; once a minute drop history days
+  // past retention and start a new tally after midnight
+  attendanceHistory.flushIfDue(millis());
+  dailyTally.flushIfDue(millis());
+  static unsigned long lastHistoryCleanup = 0;
+  if (millis() - lastHistoryCleanup > HISTORY_CLEANUP_INTERVAL_MS) {
+    cleanupOldLogs();
+    lastHistoryCleanup = millis();
   }
+
+  // RFID maintenance watchdog: probe in idle slots, reset only on failure
+  maintainRFIDReader();
   
   // Update LED state
   updateLED();
@@ -534,15 +832,33 @@ void loop() {
   
   // Sync offline logs if available and online
   if (isOnline && offlineLogsCount > 0 && 
-      (millis() - lastSyncAttempt > SYNC_RETRY_INTERVAL)) {
+      (millis() - lastSyncAttempt > syncDelay)) {
     syncOfflineLogs();
   }
   
-  // Send heartbeat ping to backend every 30 minutes
-  if (isOnline && (millis() - lastHeartbeat > HEARTBEAT_INTERVAL)) {
+  // Send heartbeat ping to backend (jittered HEARTBEAT_INTERVAL or server hint)
+  if (isOnline && (millis() - lastHeartbeat > heartbeatDelay)) {
     sendHeartbeat();
   }
   
+  // Persistent backend session (MQTT): keep-alive, reconnect, pushed commands
+  if (isOnline) {
+    serviceBackendSession();
+  }
+  
+  // Backend endpoint health probes (only with more than one endpoint). A
+  // probe blocks for up to BACKEND_PROBE_TIMEOUT_MS, so only in a quiet
+  // moment: no card activity for a while and no backlog sync due.
+  bool syncDue = offlineLogsCount > 0 && (millis() - lastSyncAttempt > syncDelay);
+  if (isOnline && !syncDue && rfidReaderSet.isQuiet(millis(), BACKEND_PROBE_QUIET_MS)) {
+    probeBackendEndpoint();
+  }
+  
+  // Roster changes announced by the last heartbeat, one page per pass
+  if (isOnline && rosterSyncPending) {
+    syncRosterStep();
+  }
+  
   // Update display periodically
   static unsigned long lastDisplayUpdate = 0;
   if (millis() - lastDisplayUpdate > 1000) { // Update every second
@@ -552,7 +868,16 @@ void loop() {
     lastDisplayUpdate = millis();
   }
   
-  delay(100);  // Small delay to prevent excessive CPU usage
+  sampleHeapMetrics();
+  observeMetric(HIST_LOOP_US, micros() - loopStartMicros);
+  
+  // Idle until the next RFID poll is due, at most 100 ms (the detect
+  // latency budget in low-power mode, where the delay is light sleep)
+  const unsigned long maxIdleMs = LOW_POWER_MODE ? LOW_POWER_MAX_DETECT_MS : 100;
+  unsigned long idleMs = rfidReaderSet.msUntilDue(millis());
+  energyMeter.update(millis());
+  energyMeter.setActive(ENERGY_MCU, false, millis());
+  delay(idleMs < maxIdleMs ? idleMs : maxIdleMs);
 }
 
 // ========================================
@@ -560,34 +885,46 @@ void loop() {
 // ========================================
 
 bool initializeHardware() {
-  Serial.println("Initializing hardware...");
+  LOG_I("Initializing hardware...");
   
   // Initialize SPI for RFID first
   SPI.begin();
-  Serial.println("SPI initialized");
+  LOG_D("SPI initialized");
   
-  initializeRFID();
-  Serial.println("RFID initialized successfully");
+  // One reader toggles entry/exit; a pair is a fixed entry and exit reader
+  if (RFID_READER_COUNT > 1) {
+    rfidReaderSet.add(RFID_ROLE_ENTRY);
+    rfidReaderSet.add(RFID_ROLE_EXIT);
+  } else {
+    rfidReaderSet.add(RFID_ROLE_TOGGLE);
+  }
+  for (uint8_t reader = 0; reader < rfidReaderSet.getCount(); reader++) {
+    initializeRFID(reader);
+  }
+  if (RFID_IRQ_PIN >= 0 && rfidReaderSet.getCount() == 1) {
+    enableRFIDIrq(RFID_IRQ_PIN);
+  }
+  LOG_I("RFID initialized (%u reader(s))", rfidReaderSet.getCount());
   
   // Initialize I2C for LCD and RTC
   Wire.begin(SDA_PIN, SCL_PIN);
-  Serial.println("I2C initialized on SDA:" + String(SDA_PIN) + ", SCL:" + String(SCL_PIN));
+  LOG_D("I2C initialized on SDA:%d, SCL:%d", SDA_PIN, SCL_PIN);
   
   // Initialize LCD
   lcd.init();
   lcd.backlight();
   setLCDState(LCD_INITIALIZING);
-  Serial.println("LCD initialized");
+  LOG_D("LCD initialized");
   
   // Initialize RTC
   if (!rtc.begin()) {
-    Serial.println("RTC initialization failed!");
+    LOG_E("RTC initialization failed");
     setLCDState(LCD_BOOT_SCREEN, "error");
     delay(2000);
     return false;
   }
 
-  Serial.println("RTC initialized");
+  LOG_D("RTC initialized");
   
   // Initialize output pins
   pinMode(GREEN_LED, OUTPUT);
@@ -603,7 +940,7 @@ bool initializeHardware() {
   digitalWrite(GREEN_LED, LOW);
   digitalWrite(RED_LED, LOW);
   
-  Serial.println("All hardware initialized successfully");
+  LOG_I("All hardware initialized");
   return true;
 }
 
@@ -612,22 +949,22 @@ bool initializeHardware() {
 // ========================================
 
 void loadConfiguration() {
-  Serial.println("Loading configuration from LittleFS...");
+  LOG_I("Loading configuration from LittleFS...");
   
   // Always initialize with defaults first
   backendUrl = DEFAULT_BACKEND_URL;
   if (deviceId.length() == 0) {
     deviceId = "ESP_" + formatMacAddress(WiFi.macAddress());
-    Serial.println("Generated new device ID: " + deviceId);
+    LOG_I("Generated new device ID: %s", deviceId.c_str());
   }
   
   // Try to load from JSON configuration file
   if (loadJsonConfiguration()) {
-    Serial.println("Backend URL: " + backendUrl);
-    Serial.println("Device ID: " + deviceId);
-    Serial.println("Configuration loaded from JSON successfully");
+    LOG_I("Backend URL: %s", backendUrl.c_str());
+    LOG_I("Device ID: %s", deviceId.c_str());
+    LOG_I("Configuration loaded from JSON");
   } else {
-    Serial.println("No valid configuration found, using defaults");
+    LOG_W("No valid configuration found, using defaults");
     // Save the default configuration for future use
     saveConfiguration();
   }
@@ -640,18 +977,18 @@ void loadConfiguration() {
 void saveBackendUrl() {
   // Save to LittleFS JSON configuration only
   if (saveConfiguration()) {
-    Serial.println("Backend URL saved to LittleFS: " + backendUrl);
+    LOG_I("Backend URL saved to LittleFS: %s", backendUrl.c_str());
   } else {
-    Serial.println("Failed to save backend URL to LittleFS");
+    LOG_E("Failed to save backend URL to LittleFS");
   }
 }
 
 void saveDeviceId() {
   // Save to LittleFS JSON configuration only  
   if (saveConfiguration()) {
-    Serial.println("Device ID saved to LittleFS: " + deviceId);
+    LOG_I("Device ID saved to LittleFS: %s", deviceId.c_str());
   } else {
-    Serial.println("Failed to save device ID to LittleFS");
+    LOG_E("Failed to save device ID to LittleFS");
   }
 }
 
@@ -660,7 +997,7 @@ void saveDeviceId() {
 // ========================================
 
 void initializeWiFi() {
-  Serial.println("Initializing WiFi...");
+  LOG_I("Initializing WiFi...");
   
   setLCDState(LCD_WIFI_SETUP);
   
@@ -674,7 +1011,7 @@ void initializeWiFi() {
   
   // Try to connect with saved credentials, else briefly open portal
   if (!wifiManager.autoConnect(apName.c_str())) {
-    Serial.println("WiFi not configured or unavailable. Continuing in offline mode.");
+    LOG_W("WiFi not configured or unavailable. Continuing in offline mode.");
     isOnline = false;
     setLEDState(LED_RED);
     updateDisplay();
@@ -682,13 +1019,8 @@ void initializeWiFi() {
     return;
   }
   
-  Serial.println("WiFi connected successfully");
-  Serial.print("IP Address: ");
-  Serial.println(WiFi.localIP());
-  Serial.print("MAC Address: ");
-  Serial.println(WiFi.macAddress());
-  Serial.print("Signal Strength: ");
-  Serial.println(WiFi.RSSI());
+  LOG_I("WiFi connected: IP %s, MAC %s, RSSI %d dBm", WiFi.localIP().toString().c_str(),
+        WiFi.macAddress().c_str(), (int)WiFi.RSSI());
 }
 
 void checkWiFiConnection() {
@@ -696,20 +1028,22 @@ void checkWiFiConnection() {
   isOnline = (WiFi.status() == WL_CONNECTED);
   
   if (!wasOnline && isOnline) {
-    Serial.println("WiFi reconnected");
+    LOG_I("WiFi reconnected");
     syncTimeWithNTP();
     setLEDState(LED_GREEN);
     logInfo("WiFi reconnected - IP: " + WiFi.localIP().toString());
+    publishConnectivityEvent();
     // Ensure config server is started on first connection
     if (!configServerStarted) {
       setupConfigurationEndpoints();
       configServerStarted = true;
-      Serial.println("Configuration API available at: http://" + WiFi.localIP().toString() + "/api/config");
+      LOG_I("Configuration API available at: http://%s/api/config", WiFi.localIP().toString().c_str());
     }
   } else if (wasOnline && !isOnline) {
-    Serial.println("WiFi disconnected");
+    LOG_W("WiFi disconnected");
     setLEDState(LED_RED);
     logError("WiFi disconnected");
+    publishConnectivityEvent();
   }
 }
 
@@ -720,51 +1054,105 @@ void checkWiFiConnection() {
 // ========================================
 
 void handleRFIDScan() {
-  // Check for new card with improved error handling
-  if (!mfrc522.PICC_IsNewCardPresent()) {
+  // Check for new card on the adaptive poll cadence, one reader per pass,
+  // or take the reader's IRQ when one is wired (the poll then only re-arms
+  // the request)
+  unsigned long pollAt = millis();
+  int readerIndex = -1;
+  bool cardPresent = false;
+  if (isRFIDIrqEnabled() && takeRFIDIrq()) {
+    readerIndex = 0;
+    cardPresent = true;
+  } else {
+    readerIndex = rfidReaderSet.nextDue(pollAt);
+    if (readerIndex < 0) {
+      return;
+    }
+    unsigned long busStart = micros();
+    if (TRACE_POLLS) {
+      TRACE_EVENT(TRACE_POLL_BEGIN, readerIndex);
+    }
+    if (isRFIDIrqEnabled()) {
+      armRFIDIrq();
+    } else {
+      if (isRFIDReaderAsleep(readerIndex)) {
+        wakeRFIDReader(readerIndex);
+        energyMeter.setActive(ENERGY_READER(readerIndex), true, millis());
+      }
+      cardPresent = rfidReaders[readerIndex]->PICC_IsNewCardPresent();
+      // Low power: power the reader down until its next poll, unless cards
+      // are arriving (fast cadence), where the wake-up would cost more
+      if (!cardPresent && LOW_POWER_MODE &&
+          rfidReaderSet.getPoller(readerIndex).getInterval(pollAt) > RFID_POLL_FAST_MS) {
+        sleepRFIDReader(readerIndex);
+        energyMeter.setActive(ENERGY_READER(readerIndex), false, millis());
+      }
+    }
+    observeMetric(HIST_SPI_US, micros() - busStart);
+    if (TRACE_POLLS) {
+      TRACE_EVENT(TRACE_POLL_END, cardPresent);
+    }
+    rfidReaderSet.getPoller(readerIndex).onPoll(pollAt);
+    incrementMetric(CTR_RFID_POLLS);
+  }
+  if (!cardPresent) {
     return;
   }
-  lastRFIDActivity = millis();
-  
-  if (!mfrc522.PICC_ReadCardSerial()) {
-    consecutiveRFIDReadFailures++;
-    if (consecutiveRFIDReadFailures >= 5) {
-      Serial.println("RFID warning: consecutive read failures, soft resetting reader");
-      softResetRFID();
-      consecutiveRFIDReadFailures = 0;
-    }
+  uint8_t reader = (uint8_t)readerIndex;
+  MFRC522& rfid = *rfidReaders[reader];
+  unsigned long detectedAt = millis();
+  observeMetric(HIST_RFID_DETECT_MS, rfidReaderSet.onDetect(reader, detectedAt));
+  TRACE_EVENT(TRACE_SCAN_BEGIN, reader);
+  rfidGainTuner.onDetect(detectedAt);
+  
+  unsigned long busStart = micros();
+  bool cardRead = rfid.PICC_ReadCardSerial();
+  observeMetric(HIST_SPI_US, micros() - busStart);
+  rfidGainTuner.onRead(cardRead, millis());
+  if (rfidGainTuner.evaluate(millis())) {
+    setRFIDGain(rfidGainTuner.getGain());
+    incrementMetric(CTR_RFID_GAIN_CHANGES);
+    LOG_I("RFID gain -> %u (first-tap reads %u%%)", rfidGainTuner.getGain(),
+          rfidGainTuner.getLastFirstTapPercent());
+  }
+  if (rfidReaderSet.onRead(reader, cardRead, millis(), RFID_RESET_READ_FAILURES)) {
+    resetRFIDReader(reader, CTR_RFID_RESETS_READ_FAILURES, "read failures");
+  }
+  if (!cardRead) {
+    incrementMetric(CTR_SCAN_READ_FAILURES);
+    TRACE_EVENT(TRACE_SCAN_END, -1);
     return;
   }
-  consecutiveRFIDReadFailures = 0;
-  lastRFIDActivity = millis();
+  TRACE_EVENT(TRACE_UID_READ, rfid.uid.size);
+
+  // Build RFID tag string
+  char uidHex[ATTENDANCE_UID_HEX_SIZE];
+  formatUidHex(rfid.uid.uidByte, rfid.uid.size, uidHex, sizeof(uidHex));
+  String rfidTag = uidHex;
 
-  // Prevent duplicate reads
+  // Prevent duplicate reads: the same card at the same reader
   unsigned long currentTime = millis();
-  if (currentTime - lastCardScan < CARD_READ_DELAY) {
-    mfrc522.PICC_HaltA();
+  if (rfidReaderSet.isRepeat(reader, uidHex, currentTime, CARD_READ_DELAY)) {
+    rfid.PICC_HaltA();
     // Stop crypto to ensure clean next transaction
     #ifdef MFRC522_h
-    mfrc522.PCD_StopCrypto1();
+    rfid.PCD_StopCrypto1();
     #endif
+    TRACE_EVENT(TRACE_SCAN_END, 0);
     return;
   }
   lastCardScan = currentTime;
-
-  // Build RFID tag string
-  String rfidTag = "";
-  for (byte i = 0; i < mfrc522.uid.size; i++) {
-    if (mfrc522.uid.uidByte[i] < 0x10) rfidTag += "0";
-    rfidTag += String(mfrc522.uid.uidByte[i], HEX);
-  }
-  rfidTag.toUpperCase();
+  incrementMetric(CTR_SCANS);
+  const char* direction = rfidRoleDirection(rfidReaderSet.getRole(reader));
 
   // ===== STAGE 1: IMMEDIATE CARD DETECTION FEEDBACK =====
-  Serial.println("RFID Tag scanned: " + rfidTag);
-  logInfo("RFID scanned: " + rfidTag);
+  LOG_I("RFID scanned: %s (reader %u)", rfidTag.c_str(), reader);
   
   // Immediate feedback: Card detected
   playCardDetectedBeep();               // Instant audio feedback
   setLEDState(LED_BLINK_GREEN);         // Quick green blink to show card detected
+  observeMetric(HIST_SCAN_FEEDBACK_MS, millis() - detectedAt);
+  TRACE_EVENT(TRACE_FEEDBACK, 0);
   
   // Show immediate "Card Detected" feedback on LCD
   lastScannedName = "Card Detected";
@@ -778,42 +1166,124 @@ void handleRFIDScan() {
   // Get current timestamp
   String timestamp = getCurrentTimestamp();
 
+  // Idempotency key for this scan; the offline fallback reuses it so a
+  // POST that timed out after the backend committed is not counted twice
+  uint32_t seq = scanSequence.allocate();
+  if (seq == 0) {
+    LOG_W("Scan sequence not persisted, sending without idempotency key");
+  }
+
   // Process attendance
   if (isOnline) {
-    processOnlineAttendance(rfidTag, timestamp);
+    processOnlineAttendance(rfidTag, timestamp, seq, direction);
   } else {
-    processOfflineAttendance(rfidTag, timestamp);
+    processOfflineAttendance(rfidTag, timestamp, seq, direction);
   }
+  observeMetric(HIST_SCAN_RESULT_MS, millis() - detectedAt);
+  publishScanEvent(rfidTag, timestamp, reader);
 
   // Halt communication with card and stop crypto
-  mfrc522.PICC_HaltA();
+  rfid.PICC_HaltA();
   #ifdef MFRC522_h
-  mfrc522.PCD_StopCrypto1();
+  rfid.PCD_StopCrypto1();
   #endif
+  TRACE_EVENT(TRACE_SCAN_END, 1);
   delay(50);
 }
 
+// Runs a liveness probe on each reader once per RFID_PROBE_INTERVAL_MS, but
+// only when that reader has seen no card for RFID_PROBE_QUIET_MS, so it never
+// lands inside a tap. A healthy reader is left alone; the reset (and its
+// ~40 ms of delays) only happens when the probe shows the reader has stalled
+// or lost its setup.
+void maintainRFIDReader() {
+  int reader = rfidReaderSet.nextProbe(millis(), RFID_PROBE_INTERVAL_MS, RFID_PROBE_QUIET_MS);
+  if (reader < 0) {
+    return;
+  }
+  
+  unsigned long busStart = micros();
+  RfidProbeResult result = probeRFIDReader(reader);
+  observeMetric(HIST_SPI_US, micros() - busStart);
+  incrementMetric(CTR_RFID_PROBES);
+  
+  if (result == RFID_PROBE_NO_RESPONSE) {
+    resetRFIDReader(reader, CTR_RFID_RESETS_NO_RESPONSE, "no response");
+  } else if (result == RFID_PROBE_CONFIG_LOST) {
+    resetRFIDReader(reader, CTR_RFID_RESETS_CONFIG_LOST, "config lost");
+  }
+}
+
+void resetRFIDReader(uint8_t reader, MetricCounter reason, const char* why) {
+  LOG_W("RFID reader %u reset: %s", reader, why);
+  softResetRFID(reader);
+  energyMeter.setActive(ENERGY_READER(reader), true, millis());
+  incrementMetric(reason);
+  rfidReaderSet.onReset(reader, why, millis());
+}
+
 // ========================================
 // ATTENDANCE PROCESSING
 // ========================================
 
-void processOnlineAttendance(String rfidTag, String timestamp) {
-  Serial.println("Backend URL: " + backendUrl);
+void processOnlineAttendance(String rfidTag, String timestamp, uint32_t seq, const char* direction) {
+  // Create JSON payload
+  char payload[ATTENDANCE_PAYLOAD_SIZE];
+  size_t payloadLength = buildAttendancePayload(rfidTag.c_str(), timestamp.c_str(), deviceId.c_str(),
+                                                FIRMWARE_VERSION, seq, direction, payload, sizeof(payload));
   
-  // Get effective URL (may be modified for testing)
-  String effectiveUrl = getEffectiveBackendUrl();
-  String attendanceUrl = getAttendanceEndpointUrl();
+  // ===== STAGE 2: PROCESSING INDICATION =====
+  // Update LCD with the member's name from the roster, or "Sending..."
+  lastScannedName = rosterDisplayName(rfidTag, "Sending...");
+  lastScannedMessage = "Please wait";
+  updateDisplay();
+  
+  playProcessingBeep(); // Indicate that we're sending the request
+  
+  // A dead or failing endpoint hands the scan to the next one straight
+  // away; the retries share what is left of the scan's request timeout
+  unsigned long scanStartTime = millis();
+  uint32_t timeoutMs = SCAN_REQUEST_TIMEOUT_MS;
+  String response;
+  int httpResponseCode = 0;
+  for (uint8_t attempt = 0; attempt < max((uint8_t)1, backendEndpoints.getCount()); attempt++) {
+    httpResponseCode = postAttendance(payload, payloadLength, timeoutMs, response);
+    if (!reportEndpointResult(httpResponseCode)) {
+      break;
+    }
+    uint32_t elapsed = millis() - scanStartTime;
+    timeoutMs = elapsed < SCAN_REQUEST_TIMEOUT_MS - BACKEND_FAILOVER_MIN_MS
+      ? SCAN_REQUEST_TIMEOUT_MS - elapsed : BACKEND_FAILOVER_MIN_MS;
+  }
   
-  Serial.println("Effective URL: " + effectiveUrl);
-  Serial.println("Full attendance URL: " + attendanceUrl);
+  if (httpResponseCode == 200 || httpResponseCode == 201 || httpResponseCode == MQTT_ACCEPTED) {
+    attendanceHistory.addRecord(payload, payloadLength, millis());
+  }
+  handleAttendanceResult(httpResponseCode, response, rfidTag, timestamp, seq, direction);
+}
+
+// One attempt at the selected endpoint over whichever transport its URL asks for
+int postAttendance(const char* payload, size_t payloadLength, uint32_t timeoutMs, String& response) {
+  String attendanceUrl = getAttendanceEndpointUrl();
+  LOG_D("Attendance URL: %s", attendanceUrl.c_str());
   
+  TerminalTransport* transport = messageTransport();
+  if (transport) {
+    return postAttendanceMessage(*transport, attendanceUrl, payload, payloadLength, response);
+  }
+  return postAttendanceHttp(attendanceUrl, payload, payloadLength, timeoutMs, response);
+}
+
+int postAttendanceHttp(const String& attendanceUrl, const char* payload, size_t payloadLength,
+                       uint32_t timeoutMs, String& response) {
   // Determine if we need HTTPS or HTTP
-  bool isHTTPS = effectiveUrl.startsWith("https://");
+  bool isHTTPS = attendanceUrl.startsWith("https://");
+  TRACE_EVENT(TRACE_HTTP_BEGIN, isHTTPS ? 1 : 0);
   
   if (isHTTPS) {
     // Configure WiFiClientSecure for HTTPS with aggressive speed optimizations
     wifiClientSecure.setInsecure(); // Skip SSL certificate verification for testing
-    wifiClientSecure.setTimeout(5000); // Reduced timeout for faster failure detection
+    wifiClientSecure.setTimeout(timeoutMs); // Reduced timeout for faster failure detection
     
     // Aggressive optimization for ESP8266 HTTPS performance
     wifiClientSecure.setBufferSizes(512, 512); // Minimal buffers for fastest processing
@@ -821,93 +1291,134 @@ void processOnlineAttendance(String rfidTag, String timestamp) {
     // Network optimizations for lower latency
     wifiClientSecure.setNoDelay(true); // Disable Nagle's algorithm for lower latency
     
-    Serial.println("Using HTTPS connection with speed optimizations");
-    Serial.println("Free heap before HTTPS: " + String(ESP.getFreeHeap()));
+    LOG_D("Using HTTPS, free heap: %u", (unsigned)ESP.getFreeHeap());
     
     unsigned long sslStartTime = millis();
-    if (!http.begin(wifiClientSecure, getAttendanceEndpointUrl())) {
-      Serial.println("Failed to initialize HTTPS connection");
-      handleAttendanceError("HTTPS init failed");
-      return;
+    if (!http.begin(wifiClientSecure, attendanceUrl)) {
+      LOG_E("Failed to initialize HTTPS connection");
+      TRACE_EVENT(TRACE_HTTP_END, -1);
+      response = "";
+      return HTTPC_ERROR_CONNECTION_FAILED;
     }
     unsigned long sslConnectTime = millis() - sslStartTime;
-    Serial.println("SSL connection time: " + String(sslConnectTime) + "ms");
+    LOG_D("HTTPS client setup time: %lums", sslConnectTime);
   } else {
     // Use regular WiFiClient for HTTP
-    Serial.println("Using HTTP connection");
-    if (!http.begin(wifiClient, getAttendanceEndpointUrl())) {
-      Serial.println("Failed to initialize HTTP connection");
-      handleAttendanceError("HTTP init failed");
-      return;
+    LOG_D("Using HTTP connection");
+    if (!http.begin(wifiClient, attendanceUrl)) {
+      LOG_E("Failed to initialize HTTP connection");
+      TRACE_EVENT(TRACE_HTTP_END, -1);
+      response = "";
+      return HTTPC_ERROR_CONNECTION_FAILED;
     }
   }
   
   http.addHeader("Content-Type", "application/json");
   http.addHeader("User-Agent", "ESP8266-Attendance-Terminal/2.0");
-  http.setTimeout(5000); // Reduced HTTP timeout for faster response
-  
-  // Create JSON payload
-  StaticJsonDocument<200> doc;
-  doc["rfidTag"] = rfidTag;
-  doc["timestamp"] = timestamp;
-  doc["deviceId"] = deviceId;
-  doc["firmware"] = FIRMWARE_VERSION;
+  http.setTimeout(timeoutMs); // Reduced HTTP timeout for faster response
   
-  String payload;
-  serializeJson(doc, payload);
-  
-  // ===== STAGE 2: PROCESSING INDICATION =====
-  Serial.println("Sending attendance: " + payload);
+  LOG_D("Sending attendance: %s", payload);
   
-  // Update LCD to show "Sending..." 
-  lastScannedName = "Sending...";
-  lastScannedMessage = "Please wait";
-  updateDisplay();
+  unsigned long requestStartTime = millis();
+  uint32_t requestStartMicros = micros();
+  incrementMetric(CTR_HTTP_REQUESTS);
+  TRACE_EVENT(TRACE_POST_START, payloadLength);
+  int httpResponseCode = http.POST((uint8_t*)payload, payloadLength);
+  TRACE_EVENT(TRACE_RESPONSE, httpResponseCode);
   
-  playProcessingBeep(); // Indicate that we're sending the request
+  // Time to first byte is measured from the end of connect (or request start if reused)
+  uint32_t connectedMicros = getLastConnectMicros();
+  if ((int32_t)(connectedMicros - requestStartMicros) < 0) {
+    connectedMicros = requestStartMicros;
+  }
+  observeMetric(HIST_HTTP_TTFB_MS, (micros() - connectedMicros) / 1000);
   
-  unsigned long requestStartTime = millis();
-  int httpResponseCode = http.POST(payload);
+  response = http.getString();
+  TRACE_EVENT(TRACE_BODY_READ, response.length());
   unsigned long requestTime = millis() - requestStartTime;
+  observeMetric(HIST_HTTP_TOTAL_MS, requestTime);
+  if (httpResponseCode < 200 || httpResponseCode >= 300) {
+    incrementMetric(CTR_HTTP_ERRORS);
+  }
   
-  String response = http.getString();
-  
-  Serial.println("HTTP Response Code: " + String(httpResponseCode));
-  Serial.println("Request time: " + String(requestTime) + "ms");
-  Serial.println("HTTP Response Body: " + response);
-  Serial.println("Free heap after request: " + String(ESP.getFreeHeap()));
+  LOG_I("HTTP %d in %lums, free heap: %u", httpResponseCode, requestTime, (unsigned)ESP.getFreeHeap());
+  LOG_D("HTTP response body: %s", response.c_str());
   
   // Mark SSL session as valid for faster future connections (HTTPS only)
   if (isHTTPS && httpResponseCode > 0) {
     sslSessionValid = true;
-    Serial.println("SSL session established for reuse");
   }
   
   // Enhanced error reporting for SSL/connection issues
   if (httpResponseCode == -1) {
-    Serial.println("Connection failed - possible causes:");
-    Serial.println("1. SSL/TLS handshake failure");
-    Serial.println("2. DNS resolution failed");
-    Serial.println("3. Network timeout");
-    Serial.println("4. Insufficient memory for SSL");
-    Serial.println("WiFi status: " + String(WiFi.status()));
-    Serial.println("WiFi RSSI: " + String(WiFi.RSSI()));
+    LOG_W("Connection failed (TLS handshake, DNS, timeout or low memory) - WiFi status: %d, RSSI: %d",
+          WiFi.status(), WiFi.RSSI());
+  }
+  
+  http.end();
+  TRACE_EVENT(TRACE_HTTP_END, httpResponseCode);
+  return httpResponseCode;
+}
+
+// Same request over CoAP (one datagram each way) or MQTT (the standing
+// session): no per-request connection or TLS setup
+int postAttendanceMessage(TerminalTransport& transport, const String& attendanceUrl,
+                          const char* payload, size_t payloadLength, String& response) {
+  bool coap = (&transport == &coapTransport);
+  const char* via = coap ? "CoAP" : "MQTT";
+  TRACE_EVENT(TRACE_HTTP_BEGIN, coap ? 2 : 3);
+  
+  LOG_D("Sending attendance (%s): %s", via, payload);
+  
+  unsigned long requestStartTime = millis();
+  incrementMetric(CTR_HTTP_REQUESTS);
+  TRACE_EVENT(TRACE_POST_START, payloadLength);
+  char reply[320];                     // Attendance replies are well under this
+  int httpResponseCode = postMessage(transport, attendanceUrl, payload, payloadLength, reply, sizeof(reply));
+  TRACE_EVENT(TRACE_RESPONSE, httpResponseCode);
+  
+  unsigned long requestTime = millis() - requestStartTime;
+  observeMetric(HIST_HTTP_TOTAL_MS, requestTime);
+  if (httpResponseCode < 200 || httpResponseCode >= 300) {
+    incrementMetric(CTR_HTTP_ERRORS);
   }
   
+  LOG_I("%s %d in %lums, free heap: %u", via, httpResponseCode, requestTime, (unsigned)ESP.getFreeHeap());
+  LOG_D("%s response body: %s", via, reply);
+  
+  response = reply;
+  TRACE_EVENT(TRACE_HTTP_END, httpResponseCode);
+  return httpResponseCode;
+}
+
+void handleAttendanceResult(int httpResponseCode, String response, String rfidTag, String timestamp, uint32_t seq,
+                            const char* direction) {
   if (httpResponseCode == 200 || httpResponseCode == 201) {
-    handleSuccessfulAttendance(response, timestamp);
+    AttendanceKind kind = handleSuccessfulAttendance(response, timestamp);
+    tallyScan(rfidTag, timestamp, direction, kind);
+  } else if (httpResponseCode == MQTT_ACCEPTED) {
+    // Held by the broker; the bridge's reply did not arrive in time, so the
+    // entry/exit decision is the backend's to show later
+    lastScannedName = "Scan sent";
+    lastScannedTime = timestamp.substring(11, 16);
+    lastScannedMessage = "Recorded";
+    setLEDState(LED_GREEN);
+    playSuccessBeep();
+    ledBlinkTimer = millis();
+    LOG_I("Attendance accepted by broker, no reply yet");
+    tallyScan(rfidTag, timestamp, direction, ATTENDANCE_KIND_UNKNOWN);
   } else if (httpResponseCode == 400) {
     handleBadRequestAttendance(response);
   } else {
     // HTTP error - store offline
-    Serial.println("HTTP Error: " + String(httpResponseCode));
-    Serial.println("Response: " + response);
+    LOG_E("HTTP error %d: %s", httpResponseCode, response.c_str());
     
     // Provide more specific error messages
     String errorMsg;
     if (httpResponseCode == -1) {
       errorMsg = "Connection failed (SSL/Network)";
-    } else if (httpResponseCode == 0) {
+    } else if (httpResponseCode == 0 || httpResponseCode == COAP_ERROR_TIMEOUT ||
+               httpResponseCode == MQTT_ERROR_TIMEOUT) {  // Same code as HTTPC_ERROR_READ_TIMEOUT
       errorMsg = "Timeout";
     } else if (response.length() > 0 && response != "null") {
       errorMsg = "HTTP " + String(httpResponseCode) + ": " + response;
@@ -919,86 +1430,103 @@ void processOnlineAttendance(String rfidTag, String timestamp) {
     
     // Only store offline if it's a real network/server error, not a client error
     if (httpResponseCode >= 500 || httpResponseCode <= 0) {
-      processOfflineAttendance(rfidTag, timestamp);
+      processOfflineAttendance(rfidTag, timestamp, seq, direction);
     }
   }
-  
-  http.end();
 }
 
-void handleSuccessfulAttendance(String response, String timestamp) {
-  Serial.println("Processing successful response: " + response);
-  
-  StaticJsonDocument<400> responseDoc;
-  DeserializationError error = deserializeJson(responseDoc, response);
+// Returns the backend's entry/exit decision, ATTENDANCE_KIND_COMPLETE when it
+// changed nothing, ATTENDANCE_KIND_UNKNOWN when the reply does not say
+AttendanceKind handleSuccessfulAttendance(String response, String timestamp) {
+  AttendanceResponse parsed;
   
-  if (error) {
-    Serial.println("JSON parsing error: " + String(error.c_str()));
-    handleAttendanceError("JSON parse error: " + String(error.c_str()));
-    return;
+  if (!parseAttendanceResponse(response.c_str(), response.length(), parsed)) {
+    LOG_E("JSON parsing error: %s", response.c_str());
+    handleAttendanceError("JSON parse error");
+    return ATTENDANCE_KIND_UNKNOWN;
   }
   
-  if (responseDoc["message"]) {
-    String message = responseDoc["message"].as<String>();
-    String attendanceType = responseDoc["type"] | "unknown";
-    
+  if (parsed.hasMessage) {
     // Extract user name
-    String userName = "Unknown";
-    if (responseDoc["attendance"]["userName"]) {
-      userName = responseDoc["attendance"]["userName"].as<String>();
-    }
+    String userName = parsed.userName[0] ? parsed.userName : "Unknown";
     
     // Update display based on attendance type
     lastScannedName = userName;
     lastScannedTime = timestamp.substring(11, 16);  // Extract time HH:MM
     
-    if (attendanceType == "entry") {
+    if (parsed.unchanged) {
+      // Repeat tap on a fixed-role reader: nothing was logged
+      lastScannedMessage = parsed.kind == ATTENDANCE_KIND_EXIT ? "Not checked in" : "Already in";
+      setLEDState(LED_YELLOW);
+      playDuplicateBeep();
+      ledBlinkTimer = millis();
+      LOG_I("Unchanged %s: %s", parsed.type, userName.c_str());
+      return ATTENDANCE_KIND_COMPLETE;            // Tallied like a duplicate
+    } else if (parsed.kind == ATTENDANCE_KIND_ENTRY) {
       lastScannedMessage = "Entry logged";
       setLEDState(LED_GREEN);
       playSuccessBeep();
-      logInfo("Entry: " + userName);
-    } else if (attendanceType == "exit") {
+      LOG_I("Entry: %s", userName.c_str());
+    } else if (parsed.kind == ATTENDANCE_KIND_EXIT) {
       lastScannedMessage = "Exit logged";
       setLEDState(LED_GREEN);
       playSuccessBeep();
-      logInfo("Exit: " + userName);
-    } else if (attendanceType == "complete") {
+      LOG_I("Exit: %s", userName.c_str());
+    } else if (parsed.kind == ATTENDANCE_KIND_COMPLETE) {
       lastScannedMessage = "Already logged";
       setLEDState(LED_YELLOW);
       playDuplicateBeep();      // Use specific duplicate beep pattern
-      logInfo("Already complete: " + userName);
+      LOG_I("Already complete: %s", userName.c_str());
     } else {
       lastScannedMessage = "Attendance OK";
       setLEDState(LED_GREEN);
       playSuccessBeep();
-      logInfo("Attendance: " + userName);
+      LOG_I("Attendance: %s", userName.c_str());
     }
     
     ledBlinkTimer = millis();
-  } else {
-    handleAttendanceError("Unknown response format");
+    return parsed.kind;
+  }
+  handleAttendanceError("Unknown response format");
+  return ATTENDANCE_KIND_UNKNOWN;
+}
+
+// Counts a committed scan in today's tally. The backend's answer decides
+// entry or exit, then the reader's fixed role; otherwise the tally toggles.
+void tallyScan(const String& rfidTag, const String& timestamp, const char* direction, AttendanceKind answer) {
+  uint32_t time;
+  if (!parseIsoTimestamp(timestamp.c_str(), time)) {
+    return;
   }
+  uint8_t kind = TALLY_TOGGLE;
+  if (answer == ATTENDANCE_KIND_ENTRY) {
+    kind = TALLY_ENTRY;
+  } else if (answer == ATTENDANCE_KIND_EXIT) {
+    kind = TALLY_EXIT;
+  } else if (answer == ATTENDANCE_KIND_COMPLETE) {
+    kind = TALLY_SEEN;
+  } else if (direction) {
+    kind = strcmp(direction, "exit") == 0 ? TALLY_EXIT : TALLY_ENTRY;
+  }
+  dailyTally.add(rfidTag.c_str(), time, kind, millis());
 }
 
 void handleBadRequestAttendance(String response) {
-  Serial.println("Processing bad request response: " + response);
+  LOG_D("Bad request response: %s", response.c_str());
   
-  StaticJsonDocument<300> responseDoc;
-  DeserializationError error = deserializeJson(responseDoc, response);
-  
-  if (error) {
-    Serial.println("JSON parsing error in bad request: " + String(error.c_str()));
+  AttendanceResponse parsed;
+  if (!parseAttendanceResponse(response.c_str(), response.length(), parsed)) {
+    LOG_E("JSON parsing error in bad request: %s", response.c_str());
     handleAttendanceError("Bad request - JSON parse error");
     return;
   }
   
-  String errorMsg = responseDoc["message"].as<String>();
+  String errorMsg = parsed.message;
   if (errorMsg.length() == 0) {
     errorMsg = "Bad request";
   }
-  String attendanceType = responseDoc["type"] | "error";
   
-  if (attendanceType == "complete") {
+  if (parsed.kind == ATTENDANCE_KIND_COMPLETE) {
     lastScannedName = "Already logged";
     lastScannedMessage = "Complete today";
     setLEDState(LED_YELLOW);
@@ -1009,39 +1537,40 @@ void handleBadRequestAttendance(String response) {
   }
 }
 
-void processOfflineAttendance(String rfidTag, String timestamp) {
+void processOfflineAttendance(String rfidTag, String timestamp, uint32_t seq, const char* direction) {
+  TRACE_EVENT(TRACE_OFFLINE_STORE_BEGIN, offlineLogsCount);
   // ===== STAGE 2: PROCESSING INDICATION FOR OFFLINE =====
-  // Update LCD to show "Storing offline..." 
-  lastScannedName = "Offline Mode";
+  // Update LCD to show "Storing offline..." under the member's name when the
+  // roster knows the card. Unknown cards are still stored: the backend decides.
+  String displayName = rosterDisplayName(rfidTag, roster.isLoaded() ? "Unknown card" : "Offline Mode");
+  lastScannedName = displayName;
   lastScannedMessage = "Storing...";
   updateDisplay();
   
   playProcessingBeep(); // Same processing sound as online
   delay(100); // Brief processing delay for visual feedback
   
-  // Check if we have space for more logs
-  if (offlineLogsCount >= MAX_OFFLINE_LOGS) {
+  // Check if we have space for more logs (sealed segments are counted apart)
+  if (offlineQueue.count() >= MAX_OFFLINE_LOGS) {
     handleAttendanceError("Storage full");
+    TRACE_EVENT(TRACE_OFFLINE_STORE_END, -1);
     return;
   }
   
   // Store attendance record in LittleFS
-  File file = LittleFS.open(OFFLINE_LOGS_FILE, "a");
-  if (file) {
-    StaticJsonDocument<200> doc;
-    doc["rfidTag"] = rfidTag;
-    doc["timestamp"] = timestamp;
-    doc["deviceId"] = deviceId;
-    doc["firmware"] = FIRMWARE_VERSION;
-    
-    String jsonLine;
-    serializeJson(doc, jsonLine);
-    file.println(jsonLine);
-    file.close();
-    
-    offlineLogsCount++;
+  char record[ATTENDANCE_PAYLOAD_SIZE];
+  size_t recordLength = buildAttendancePayload(rfidTag.c_str(), timestamp.c_str(), deviceId.c_str(),
+                                               FIRMWARE_VERSION, seq, direction, record, sizeof(record));
+  unsigned long appendStart = micros();
+  uint32_t writesBefore = offlineQueue.getWriteCount();
+  bool stored = recordLength > 0 && offlineQueue.append(record, recordLength, millis());
+  observeMetric(HIST_OFFLINE_APPEND_US, micros() - appendStart);
+  incrementMetric(CTR_OFFLINE_FLASH_WRITES, offlineQueue.getWriteCount() - writesBefore);
+  if (stored) {
+    offlineLogsCount = offlineQueue.count() + offlineSegments.getRecordCount();
+    incrementMetric(CTR_OFFLINE_STORED);
     
-    lastScannedName = "Offline Mode";
+    lastScannedName = displayName;
     lastScannedTime = timestamp.substring(11, 16);
     lastScannedMessage = "Stored locally";
     
@@ -1050,10 +1579,21 @@ void processOfflineAttendance(String rfidTag, String timestamp) {
     ledBlinkTimer = millis();
     playOfflineBeep();
     
-    logInfo("Stored offline: " + rfidTag);
+    LOG_I("Stored offline: %s", rfidTag.c_str());
+    tallyScan(rfidTag, timestamp, direction, ATTENDANCE_KIND_UNKNOWN);
   } else {
     handleAttendanceError("Failed to store offline");
   }
+  TRACE_EVENT(TRACE_OFFLINE_STORE_END, offlineLogsCount);
+}
+
+// Roster name for a card, or the fallback when it is not on the roster
+String rosterDisplayName(const String& rfidTag, const char* fallback) {
+  char name[ROSTER_NAME_MAX + 1];
+  if (roster.lookup(rfidTag.c_str(), name, sizeof(name))) {
+    return String(name);
+  }
+  return String(fallback);
 }
 
 void handleAttendanceError(String error) {
@@ -1072,7 +1612,8 @@ void handleAttendanceError(String error) {
     playErrorBeep();
   }
   
-  logError("Attendance error: " + error);
+  LOG_E("Attendance error: %s", error.c_str());
+  publishErrorEvent(error);
 }
 
 // ========================================
@@ -1081,107 +1622,486 @@ void handleAttendanceError(String error) {
 
 void syncOfflineLogs() {
   lastSyncAttempt = millis();
+  unsigned long syncStartTime = millis();
+  TRACE_EVENT(TRACE_SYNC_BEGIN, offlineLogsCount);
+  commitOfflineLogs(true);
+  compactOfflineLogs();
   
-  File file = LittleFS.open(OFFLINE_LOGS_FILE, "r");
-  if (!file) {
+  if (offlineSegments.getSegmentCount() == 0 && !LittleFS.exists(OFFLINE_LOGS_FILE)) {
     offlineLogsCount = 0;
+    syncDelay = jitterInterval(SYNC_RETRY_INTERVAL, SCHEDULE_JITTER_PERCENT, ESP.random());
+    TRACE_EVENT(TRACE_SYNC_END, 0);
     return;
   }
   
-  Serial.println("Syncing " + String(offlineLogsCount) + " offline logs...");
+  LOG_I("Syncing %d offline logs (batch %d)...", offlineLogsCount, syncPacer.getBatch());
   
-  String tempContent = "";
-  int successCount = 0;
+  // Sealed segments hold the oldest records, so they go first. Then the
+  // backlog streams with several uploads in flight; records that fail or
+  // fall outside this pass's batch stay queued for the next pass.
+  syncPacer.beginPass();
+  int segmentRecords = syncOfflineSegments();
+  DrainResult result = { 0, offlineQueue.count(), 0 };
+  if (offlineSegments.getSegmentCount() > 0) {
+    LOG_D("Segment upload stopped, newer records wait for it");
+  } else {
+    // The pipeline and its window (about 3 KB) live for this pass only
+    std::unique_ptr<BackendPipelineUploader> pipeline(new (std::nothrow) BackendPipelineUploader());
+    std::unique_ptr<UploadWindow> window(new (std::nothrow) UploadWindow());
+    if (pipeline && window && pipeline->setTarget(getAttendanceEndpointUrl().c_str())) {
+      bool secure = getEffectiveBackendUrl().startsWith("https://");
+      pipeline->setWindow(secure ? UPLOAD_WINDOW_TLS : UPLOAD_WINDOW);
+      pipeline->setTimeout(UPLOAD_TIMEOUT_MS);
+      for (uint8_t i = 0; i < UPLOAD_WINDOW_MAX; i++) {
+        uploadConnections[i].setTimeout(UPLOAD_TIMEOUT_MS);
+      }
+      result = offlineQueue.drainPipelined(*pipeline, *window);
+      pipeline->closeAll();
+    } else {
+      // URL too long for the pipeline, or no heap for it
+      BackendSyncUploader uploader;
+      result = offlineQueue.drain(uploader);
+    }
+  }
+  int successCount = segmentRecords + result.uploaded;
+  offlineLogsCount = offlineQueue.count() + offlineSegments.getRecordCount();
+  incrementMetric(CTR_SYNC_RECORDS, successCount);
+  incrementMetric(CTR_SYNC_BYTES, result.bytesUploaded);
+  
+  // Throttled: back off (at least Retry-After). Backlog left: continue in
+  // paced batches. Otherwise: back to the jittered regular interval.
+  bool throttled = syncPacer.wasThrottled();
+  unsigned long pacedDelay = syncPacer.endPass(offlineLogsCount > 0, SYNC_CONTINUE_DELAY_MS);
+  syncDelay = pacedDelay ? pacedDelay : jitterInterval(SYNC_RETRY_INTERVAL, SCHEDULE_JITTER_PERCENT, ESP.random());
+  if (throttled) {
+    incrementMetric(CTR_SYNC_THROTTLED);
+    LOG_W("Sync throttled by backend, next pass in %lu ms (batch %d)", syncDelay, syncPacer.getBatch());
+  } else if (successCount == 0 && offlineLogsCount > 0) {
+    reportEndpointResult(-1);           // Nothing got through: try the next endpoint
+  }
+  
+  observeMetric(HIST_SYNC_DURATION_MS, millis() - syncStartTime);
+  TRACE_EVENT(TRACE_SYNC_END, successCount);
+  LOG_I("Synced %d/%d logs", successCount, successCount + offlineLogsCount);
+  publishSyncEvent(successCount, offlineLogsCount);
+}
+
+bool syncSingleLog(const char* record, size_t length) {
+  backendTransport.setTimeout(3000); // Reduced timeout for sync operations
   
-  while (file.available()) {
-    String line = file.readStringUntil('\n');
-    line.trim();
+  TerminalTransport* messaging = messageTransport();
+  
+  unsigned long requestStartTime = millis();
+  incrementMetric(CTR_HTTP_REQUESTS);
+  char reply[64] = "";                 // Only to tell the backend's own errors from others
+  int httpResponseCode = messaging
+    ? postMessage(*messaging, getAttendanceEndpointUrl(), record, length, reply, sizeof(reply))
+    : backendTransport.postJson(getAttendanceEndpointUrl().c_str(), record, length, reply, sizeof(reply));
+  observeMetric(HIST_HTTP_TOTAL_MS, millis() - requestStartTime);
+  TRACE_EVENT(TRACE_SYNC_RECORD, httpResponseCode);
+  syncPacer.onResult(httpResponseCode, messaging ? messaging->getLastRetryAfterMs()
+                                                 : backendTransport.getLastRetryAfterMs());
+  reportEndpointResult(httpResponseCode);
+  // 202: PUBACK from the broker, which now owns delivery
+  bool success = (httpResponseCode >= 200 && httpResponseCode < 300);
+  
+  if (success) {
+    attendanceHistory.addRecord(record, length, millis());
+    return true;
+  }
+  incrementMetric(CTR_HTTP_ERRORS);
+  if (isPermanentRejection(httpResponseCode, reply[0] == '{')) {
+    dropRejectedRecord(httpResponseCode, record, length);
+    return true;                        // Consumed: must not hold up the backlog
+  }
+  LOG_D("Failed to sync log, HTTP code: %d", httpResponseCode);
+  return false;
+}
+
+// A record the backend will never take (unknown or inactive card, bad
+// record) leaves the backlog; it is logged so it can still be looked into
+void dropRejectedRecord(int httpResponseCode, const char* record, size_t length) {
+  incrementMetric(CTR_SYNC_REJECTED);
+  LOG_W("Backend refused offline record (HTTP %d), dropped: %.*s", httpResponseCode, (int)length, record);
+}
+
+// Uploads sealed segments, oldest first, while the pacer allows. Returns
+// the records uploaded; stops at the first segment that does not get through
+// for now. A segment the backend refuses for good is dropped.
+int syncOfflineSegments() {
+  int uploaded = 0;
+  if (offlineSegments.getSegmentCount() == 0) {
+    return uploaded;
+  }
+  std::unique_ptr<uint8_t[]> segmentBuffer = allocateSegmentBuffer();
+  if (!segmentBuffer) {
+    return uploaded;
+  }
+  while (offlineSegments.getSegmentCount() > 0 && syncPacer.allowUpload()) {
+    int length = offlineSegments.readOldest(segmentBuffer.get(), SEGMENT_MAX_BYTES);
+    SegmentDecoder decoder;
+    if (length <= 0 || !decoder.open(segmentBuffer.get(), length)) {
+      // Corrupt on flash: resending cannot help
+      LOG_E("Dropping unreadable offline segment (%d bytes)", length);
+      if (!offlineSegments.removeOldest()) {
+        break;
+      }
+      continue;
+    }
+    SegmentSyncResult result = syncSingleSegment(segmentBuffer.get(), length);
+    if (result == SEGMENT_SYNC_RETRY) {
+      break;
+    }
+    if (result == SEGMENT_SYNC_REJECTED) {
+      LOG_E("Offline segment refused (%u records), dropped", decoder.getCount());
+      incrementMetric(CTR_SYNC_REJECTED, decoder.getCount());
+    } else {
+      uploaded += decoder.getCount();
+    }
+    offlineSegments.removeOldest();
+  }
+  return uploaded;
+}
+
+// One segment in one request to /attendance/segment. Message transports
+// (512-byte messages) and backends without the route get its records one at
+// a time; a partly sent segment is resent whole, and the backend's
+// idempotent scan receipts absorb the repeats. Records refused for good
+// (isPermanentRejection()) are skipped in either case. A segment that does
+// not decode to its last record counts as refused.
+SegmentSyncResult syncSingleSegment(const uint8_t* segment, size_t length) {
+  TerminalTransport* messaging = messageTransport();
+  if (!messaging && segmentUploadSupported) {
+    const size_t bodySize = 32 + SEGMENT_FIELD_MAX + (SEGMENT_MAX_BYTES + 2) / 3 * 4 + 3;
+    std::unique_ptr<char[]> bodyBuffer(new (std::nothrow) char[bodySize]);
+    std::unique_ptr<char[]> reply(new (std::nothrow) char[SEGMENT_REPLY_MAX]);
+    if (!bodyBuffer || !reply) {
+      LOG_E("No heap for a %u-byte segment upload", (unsigned)(bodySize + SEGMENT_REPLY_MAX));
+      return SEGMENT_SYNC_RETRY;
+    }
+    reply[0] = 0;
+    char* body = bodyBuffer.get();
+    int prefix = snprintf(body, bodySize, "{\"deviceId\":\"%.*s\",\"segment\":\"",
+                          SEGMENT_FIELD_MAX, deviceId.c_str());
+    size_t encoded = encodeBase64(segment, length, body + prefix, bodySize - prefix - 2);
+    if (encoded == 0) {
+      return SEGMENT_SYNC_RETRY;
+    }
+    size_t bodyLength = prefix + encoded;
+    body[bodyLength++] = '"';
+    body[bodyLength++] = '}';
     
-    if (line.length() > 0) {
-      if (syncSingleLog(line)) {
-        successCount++;
+    backendTransport.setTimeout(UPLOAD_TIMEOUT_MS);
+    unsigned long requestStartTime = millis();
+    incrementMetric(CTR_HTTP_REQUESTS);
+    int httpResponseCode = backendTransport.postJson((getAttendanceEndpointUrl() + "/segment").c_str(),
+                                                     body, bodyLength, reply.get(), SEGMENT_REPLY_MAX);
+    observeMetric(HIST_HTTP_TOTAL_MS, millis() - requestStartTime);
+    TRACE_EVENT(TRACE_SYNC_RECORD, httpResponseCode);
+    syncPacer.onResult(httpResponseCode, backendTransport.getLastRetryAfterMs());
+    reportEndpointResult(httpResponseCode);
+    if (httpResponseCode >= 200 && httpResponseCode < 300) {
+      incrementMetric(CTR_SEGMENTS_UPLOADED);
+      incrementMetric(CTR_SYNC_BYTES, bodyLength);
+      uint8_t rejected[SEGMENT_REJECTED_BYTES];
+      if (parseSegmentRejections(reply.get(), rejected)) {
+        addSegmentToHistory(segment, length, rejected);
       } else {
-        tempContent += line + "\n";
+        LOG_W("Segment reply does not list its rejected records, history not updated");
       }
+      return SEGMENT_SYNC_OK;
     }
+    incrementMetric(CTR_HTTP_ERRORS);
+    if (httpResponseCode != 404 && httpResponseCode != 405) {
+      if (isPermanentRejection(httpResponseCode, reply[0] == '{')) {
+        return SEGMENT_SYNC_REJECTED;   // E.g. 400: the backend cannot decode it
+      }
+      LOG_D("Failed to sync segment, HTTP code: %d", httpResponseCode);
+      return SEGMENT_SYNC_RETRY;
+    }
+    LOG_W("Backend has no segment upload, sending records one by one");
+    segmentUploadSupported = false;
   }
-  file.close();
   
-  // Rewrite file with failed logs
-  if (tempContent.length() > 0) {
-    file = LittleFS.open(OFFLINE_LOGS_FILE, "w");
-    if (file) {
-      file.print(tempContent);
-      file.close();
+  SegmentDecoder decoder;
+  if (!decoder.open(segment, length)) {
+    return SEGMENT_SYNC_RETRY;
+  }
+  char record[ATTENDANCE_RECORD_LINE_MAX];   // Raw records are stored lines
+  size_t recordLength;
+  uint16_t sent = 0;
+  while ((recordLength = decoder.next(record, sizeof(record))) > 0) {
+    if (!syncSingleLog(record, recordLength)) {
+      return SEGMENT_SYNC_RETRY;
     }
-    offlineLogsCount -= successCount;
-  } else {
-    LittleFS.remove(OFFLINE_LOGS_FILE);
-    offlineLogsCount = 0;
+    incrementMetric(CTR_SYNC_BYTES, recordLength);
+    sent++;
+  }
+  if (sent != decoder.getCount()) {
+    // next() hit a format error: decoding it again stops at the same record
+    LOG_E("Offline segment unreadable after %u of %u records", sent, decoder.getCount());
+    return SEGMENT_SYNC_REJECTED;
+  }
+  return SEGMENT_SYNC_OK;
+}
+
+// Records of an uploaded segment, for the history; those the backend
+// refused (bits of rejected, parseSegmentRejections()) are left out
+void addSegmentToHistory(const uint8_t* segment, size_t length, const uint8_t* rejected) {
+  SegmentDecoder decoder;
+  if (!decoder.open(segment, length)) {
+    return;
+  }
+  char record[ATTENDANCE_RECORD_LINE_MAX];
+  size_t recordLength;
+  uint16_t index = 0;
+  while ((recordLength = decoder.next(record, sizeof(record))) > 0) {
+    if (rejected[index / 8] & (1 << (index % 8))) {
+      incrementMetric(CTR_SYNC_REJECTED);
+      LOG_W("Backend refused offline record in a segment: %.*s", (int)recordLength, record);
+    } else {
+      attendanceHistory.addRecord(record, recordLength, millis());
+    }
+    index++;
+  }
+  if (index != decoder.getCount()) {
+    LOG_W("History misses %u records of an uploaded segment", decoder.getCount() - index);
+  }
+}
+
+// One segment's worth of heap for a seal, upload or export pass; empty
+// (and logged) when the heap is short
+std::unique_ptr<uint8_t[]> allocateSegmentBuffer() {
+  std::unique_ptr<uint8_t[]> buffer(new (std::nothrow) uint8_t[SEGMENT_MAX_BYTES]);
+  if (!buffer) {
+    LOG_E("No heap for a %u-byte segment buffer", (unsigned)SEGMENT_MAX_BYTES);
+  }
+  return buffer;
+}
+
+// Transport for coap:// and mqtt:// backends, NULL for HTTP(S), which keeps
+// its own HTTPClient paths
+TerminalTransport* messageTransport() {
+  String url = getEffectiveBackendUrl();
+  if (isCoapUrl(url.c_str())) {
+    return &coapTransport;
+  }
+  if (isMqttUrl(url.c_str())) {
+    mqttTransport.setBroker(url.c_str(), deviceId.c_str());
+    return &mqttTransport;
+  }
+  return NULL;
+}
+
+// POST over a message transport; CoAP retransmissions and MQTT reconnects go
+// to the metrics so lossy links show up
+int postMessage(TerminalTransport& transport, const String& url, const char* body, size_t len,
+                char* response, size_t responseSize) {
+  uint32_t retransmits = coapTransport.getRetransmitCount();
+  uint32_t connects = mqttTransport.getConnectCount();
+  int code = transport.postJson(url.c_str(), body, len, response, responseSize);
+  incrementMetric(CTR_COAP_RETRANSMITS, coapTransport.getRetransmitCount() - retransmits);
+  incrementMetric(CTR_MQTT_CONNECTS, mqttTransport.getConnectCount() - connects);
+  return code;
+}
+
+// Keeps the MQTT session alive between requests and applies instructions the
+// backend pushed (the same JSON a heartbeat response carries)
+void serviceBackendSession() {
+  TerminalTransport* transport = messageTransport();
+  if (transport != &mqttTransport) {
+    if (mqttClient.isConnected()) {
+      mqttClient.disconnect();          // Backend switched away from MQTT
+    }
+    return;
   }
   
-  Serial.println("Synced " + String(successCount) + " logs successfully");
-  logInfo("Synced " + String(successCount) + "/" + String(successCount + (offlineLogsCount)) + " logs");
+  uint32_t connects = mqttTransport.getConnectCount();
+  char command[MQTT_COMMAND_MAX];
+  bool pushed = mqttTransport.pollCommand(command, sizeof(command));
+  if (mqttTransport.getConnectCount() != connects) {
+    incrementMetric(CTR_MQTT_CONNECTS);
+    LOG_I("MQTT session up");
+  }
+  if (pushed) {
+    incrementMetric(CTR_BACKEND_COMMANDS);
+    LOG_I("Backend command: %s", command);
+    applyBackendInstructions(String(command));
+  }
 }
 
-bool syncSingleLog(String logEntry) {
-  // Determine if we need HTTPS or HTTP
-  bool isHTTPS = backendUrl.startsWith("https://");
+// Health probe of the backend endpoint that is due, if any. Only http(s)
+// endpoints are probed; CoAP/MQTT ones are judged by their requests.
+void probeBackendEndpoint() {
+  int index = backendEndpoints.nextProbe(millis());
+  if (index < 0) {
+    return;
+  }
+  String url = backendEndpoints.getEndpoint(index).url;
+  if (!url.startsWith("http://") && !url.startsWith("https://")) {
+    return;
+  }
+  if (url.endsWith("/")) {
+    url = url.substring(0, url.length() - 1);
+  }
+  url += "/health";
   
-  if (isHTTPS) {
-    wifiClientSecure.setInsecure(); // Skip SSL certificate verification
-    http.begin(wifiClientSecure, getAttendanceEndpointUrl());
+  if (url.startsWith("https://")) {
+    wifiClientSecure.setInsecure();
+    http.begin(wifiClientSecure, url);
   } else {
-    http.begin(wifiClient, getAttendanceEndpointUrl());
+    http.begin(wifiClient, url);
   }
+  http.setTimeout(BACKEND_PROBE_TIMEOUT_MS);
+  unsigned long probeStartTime = millis();
+  int httpResponseCode = http.GET();
+  uint32_t rttMs = millis() - probeStartTime;
+  http.end();
   
-  http.addHeader("Content-Type", "application/json");
-  http.setTimeout(3000); // Reduced timeout for sync operations
-  
-  int httpResponseCode = http.POST(logEntry);
-  bool success = (httpResponseCode == 200 || httpResponseCode == 201);
-  
-  if (!success) {
-    logDebug("Failed to sync log, HTTP code: " + String(httpResponseCode));
+  bool ok = (httpResponseCode == 200);
+  if (ok) {
+    observeMetric(HIST_BACKEND_PROBE_MS, rttMs);
+  } else {
+    incrementMetric(CTR_BACKEND_PROBE_ERRORS);
+    LOG_W("Backend probe %s: HTTP %d", url.c_str(), httpResponseCode);
   }
   
-  http.end();
-  return success;
+  uint8_t selected = backendEndpoints.getSelected();
+  backendEndpoints.onProbe(index, ok, rttMs);
+  if (backendEndpoints.getSelected() != selected) {
+    LOG_I("Backend endpoint switched to %s", backendEndpoints.getSelectedUrl());
+  }
+}
+
+// Health bookkeeping for a request to the selected endpoint. A failure
+// moves the selection on at once; true when there is another endpoint to
+// retry on.
+bool reportEndpointResult(int httpResponseCode) {
+  uint8_t endpoint = backendEndpoints.getSelected();
+  if (!isEndpointFailure(httpResponseCode)) {
+    backendEndpoints.onSuccess(endpoint, millis());
+    return false;
+  }
+  if (!backendEndpoints.onFailure(endpoint)) {
+    return false;
+  }
+  incrementMetric(CTR_BACKEND_FAILOVERS);
+  LOG_W("Backend %d failed (%d), failing over to %s", endpoint, httpResponseCode,
+        backendEndpoints.getSelectedUrl());
+  return true;
+}
+
+// First sync pass at a random point within SYNC_STARTUP_SPREAD_MS
+void scheduleSpreadSync() {
+  lastSyncAttempt = millis();
+  syncDelay = randomPhase(SYNC_STARTUP_SPREAD_MS, ESP.random());
 }
 
 void loadOfflineLogsCount() {
-  File file = LittleFS.open(OFFLINE_LOGS_FILE, "r");
-  if (file) {
-    offlineLogsCount = 0;
-    while (file.available()) {
-      String line = file.readStringUntil('\n');
-      line.trim();
-      if (line.length() > 0) {
-        offlineLogsCount++;
-      }
-    }
-    file.close();
-    Serial.println("Loaded " + String(offlineLogsCount) + " offline logs");
+  offlineQueue.setGroupCommit(OFFLINE_COMMIT_MAX_BYTES, OFFLINE_COMMIT_MAX_AGE_MS);
+  offlineSegments.begin();
+  compactionAudit.load();
+  offlineLogsCount = offlineQueue.recoverCount() + offlineSegments.getRecordCount();
+  LOG_I("Loaded %d offline logs (%d sealed in %d segments)", offlineLogsCount,
+        (int)offlineSegments.getRecordCount(), offlineSegments.getSegmentCount());
+}
+
+// Group commit of staged offline records: when due, or now (force) before
+// the backlog file is read directly or the device restarts
+void commitOfflineLogs(bool force) {
+  if (offlineQueue.getStaged() == 0) {
+    return;
   }
+  uint32_t writesBefore = offlineQueue.getWriteCount();
+  unsigned long commitStart = micros();
+  bool ok = force ? offlineQueue.flush() : offlineQueue.flushIfDue(millis());
+  if (offlineQueue.getWriteCount() != writesBefore) {
+    observeMetric(HIST_OFFLINE_APPEND_US, micros() - commitStart);
+    incrementMetric(CTR_OFFLINE_FLASH_WRITES, offlineQueue.getWriteCount() - writesBefore);
+  }
+  if (!ok) {
+    LOG_E("Offline commit failed, %d records still staged", offlineQueue.getStaged());
+  }
+}
+
+// Seals the oldest backlog records into one compressed segment once there
+// are OFFLINE_SEGMENT_SEAL_RECORDS of them; the drain then rewrites the
+// backlog without them. When the segment store is full the backlog grows
+// uncompressed up to MAX_OFFLINE_LOGS. A crash between the two leaves the
+// records in both; the backend's idempotent receipts drop the repeats.
+void sealOfflineLogs() {
+  static unsigned long lastSealFailure = 0;
+  if (offlineQueue.count() < OFFLINE_SEGMENT_SEAL_RECORDS || offlineSegments.isFull() ||
+      (lastSealFailure != 0 && millis() - lastSealFailure < SYNC_RETRY_INTERVAL)) {
+    return;
+  }
+  compactOfflineLogs();
+  if (offlineQueue.count() < OFFLINE_SEGMENT_SEAL_RECORDS) {
+    return;
+  }
+  std::unique_ptr<SegmentEncoder> encoder(new (std::nothrow) SegmentEncoder());
+  std::unique_ptr<uint8_t[]> segmentBuffer = allocateSegmentBuffer();
+  if (!encoder || !segmentBuffer) {
+    lastSealFailure = millis();
+    LOG_E("No heap for sealing an offline segment");
+    return;
+  }
+  SegmentSealer sealer(*encoder, offlineSegments, segmentBuffer.get(), SEGMENT_MAX_BYTES);
+  DrainResult result = offlineQueue.drain(sealer);
+  offlineLogsCount = offlineQueue.count() + offlineSegments.getRecordCount();
+  if (sealer.getSealedBytes() == 0) {
+    // Each attempt rereads the backlog, so do not retry every loop() pass
+    lastSealFailure = millis();
+    LOG_E("Sealing offline segment failed");
+    return;
+  }
+  lastSealFailure = 0;
+  incrementMetric(CTR_SEGMENTS_SEALED);
+  LOG_I("Sealed %d offline logs into %u bytes (was %lu)", result.uploaded,
+        (unsigned)sealer.getSealedBytes(), (unsigned long)result.bytesUploaded);
+}
+
+// Drops repeat taps from the JSON backlog (backlog_compactor.h). A dry run
+// comes first so a backlog with nothing to drop is not rewritten, and a
+// backlog with no new records since the last pass is not read at all:
+// compacting a compacted backlog drops nothing.
+void compactOfflineLogs() {
+  static uint32_t compactedAppends = UINT32_MAX;
+  commitOfflineLogs(true);
+  if (offlineQueue.getAppendCount() == compactedAppends) {
+    return;
+  }
+  std::unique_ptr<BacklogCompactor> compactor(
+      new (std::nothrow) BacklogCompactor(OFFLINE_COMPACT_BURST_S, OFFLINE_COMPACT_DAY_SESSIONS));
+  if (!compactor) {
+    LOG_E("No heap for compacting offline logs");
+    return;                             // Tried again on the next pass
+  }
+  compactedAppends = offlineQueue.getAppendCount();
+  if (countCompactable(flashStorage, OFFLINE_LOGS_FILE, *compactor) == 0) {
+    return;
+  }
+  
+  CompactionPass pass(*compactor);
+  offlineQueue.drain(pass);
+  offlineLogsCount = offlineQueue.count() + offlineSegments.getRecordCount();
+  if (pass.getDroppedTotal() == 0) {
+    return;
+  }
+  incrementMetric(CTR_OFFLINE_COMPACTED, pass.getDroppedTotal());
+  if (!compactionAudit.add(pass)) {
+    LOG_E("Compaction audit not saved");
+  }
+  LOG_I("Compacted offline logs: dropped %lu (burst %lu, repeated %lu, past day limit %lu)",
+        (unsigned long)pass.getDroppedTotal(), (unsigned long)pass.getDropped(COMPACT_BURST),
+        (unsigned long)pass.getDropped(COMPACT_REDUNDANT), (unsigned long)pass.getDropped(COMPACT_DAY));
 }
 
 void sendHeartbeat() {
   lastHeartbeat = millis();
+  TRACE_EVENT(TRACE_HEARTBEAT_BEGIN, 0);
   
-  Serial.println("Sending heartbeat to backend...");
-  
-  // Determine if we need HTTPS or HTTP
-  bool isHTTPS = backendUrl.startsWith("https://");
-  
-  if (isHTTPS) {
-    wifiClientSecure.setInsecure(); // Skip SSL certificate verification
-    http.begin(wifiClientSecure, getHeartbeatEndpointUrl());
-  } else {
-    http.begin(wifiClient, getHeartbeatEndpointUrl());
-  }
-  
-  http.addHeader("Content-Type", "application/json");
-  http.setTimeout(10000); // 10 second timeout for heartbeat
+  LOG_D("Sending heartbeat to backend...");
   
   // Create comprehensive heartbeat payload
   StaticJsonDocument<512> heartbeat;
@@ -1191,6 +2111,8 @@ void sendHeartbeat() {
   heartbeat["uptime"] = millis() - systemStartTime;
   heartbeat["freeHeap"] = ESP.getFreeHeap();
   heartbeat["offlineLogsCount"] = offlineLogsCount;
+  heartbeat["compactedRecords"] = compactionAudit.getTotal();
+  heartbeat["rosterVersion"] = roster.getVersion();
   
   // WiFi status
   JsonObject wifi = heartbeat.createNestedObject("wifi");
@@ -1208,38 +2130,169 @@ void sendHeartbeat() {
   system["lastCardScan"] = lastCardScan;
   system["chipId"] = ESP.getChipId();
   
+  // Power mode and energy estimate
+  JsonObject power = heartbeat.createNestedObject("power");
+  power["lowPower"] = LOW_POWER_MODE;
+  power["maxDetectMs"] = RFID_MAX_DETECT_MS;
+  power["mwhPerHour"] = energyMeter.getMwhPerHourX10() / 10.0;
+  
   String payload;
   serializeJson(heartbeat, payload);
   
-  int httpResponseCode = http.POST(payload);
+  incrementMetric(CTR_HTTP_REQUESTS);
+  int httpResponseCode;
+  uint32_t retryAfterMs;
+  String response;
+  
+  TerminalTransport* messaging = messageTransport();
+  if (messaging) {
+    char messageResponse[256];
+    httpResponseCode = postMessage(*messaging, getHeartbeatEndpointUrl(), payload.c_str(), payload.length(),
+                                   messageResponse, sizeof(messageResponse));
+    retryAfterMs = messaging->getLastRetryAfterMs();
+    response = messageResponse;
+  } else {
+    // Determine if we need HTTPS or HTTP
+    bool isHTTPS = getEffectiveBackendUrl().startsWith("https://");
+    
+    if (isHTTPS) {
+      wifiClientSecure.setInsecure(); // Skip SSL certificate verification
+      http.begin(wifiClientSecure, getHeartbeatEndpointUrl());
+    } else {
+      http.begin(wifiClient, getHeartbeatEndpointUrl());
+    }
+    
+    http.addHeader("Content-Type", "application/json");
+    http.setTimeout(10000); // 10 second timeout for heartbeat
+    const char* hintHeaders[] = { "Retry-After" };
+    http.collectHeaders(hintHeaders, 1);
+    
+    httpResponseCode = http.POST(payload);
+    retryAfterMs = parseRetryAfterMs(http.header("Retry-After").c_str());
+    if (httpResponseCode == 200 || httpResponseCode == 201) {
+      response = http.getString();
+    }
+    http.end();
+  }
   
-  if (httpResponseCode == 200 || httpResponseCode == 201) {
-    Serial.println("Heartbeat sent successfully");
-    logInfo("Heartbeat successful - sent device status to backend");
+  reportEndpointResult(httpResponseCode);
+  
+  // Next heartbeat: jittered interval unless the backend asks otherwise
+  heartbeatDelay = jitterInterval(HEARTBEAT_INTERVAL, SCHEDULE_JITTER_PERCENT, ESP.random());
+  
+  // 202 over MQTT: the broker has it; any instructions arrive as commands
+  if (httpResponseCode >= 200 && httpResponseCode < 300) {
+    LOG_I("Heartbeat successful - sent device status to backend");
+    
+    // Check the roster after every heartbeat; a 304 makes that one round trip.
+    // A "rosterVersion" hint in the response settles it without the request.
+    rosterSyncPending = true;
     
     // Parse response if needed for any backend instructions
-    String response = http.getString();
     if (response.length() > 0) {
-      StaticJsonDocument<256> responseDoc;
-      if (deserializeJson(responseDoc, response) == DeserializationError::Ok) {
-        // Handle any backend instructions in the response
-        if (responseDoc.containsKey("syncLogs") && responseDoc["syncLogs"].as<bool>()) {
-          Serial.println("Backend requested log sync");
-          if (offlineLogsCount > 0) {
-            syncOfflineLogs();
-          }
-        }
-      }
+      applyBackendInstructions(response);
     }
   } else {
-    Serial.println("Heartbeat failed: HTTP " + String(httpResponseCode));
-    logError("Heartbeat failed: HTTP " + String(httpResponseCode));
+    incrementMetric(CTR_HTTP_ERRORS);
+    LOG_E("Heartbeat failed: HTTP %d", httpResponseCode);
     
     // If heartbeat fails, we might be having connectivity issues
     // But don't set offline immediately - let the WiFi check handle that
   }
   
+  // Retry-After (typically with 429/503) always wins over the regular schedule
+  if (retryAfterMs > 0) {
+    heartbeatDelay = min(max((uint32_t)heartbeatDelay, retryAfterMs), (uint32_t)HEARTBEAT_HINT_MAX_MS);
+    LOG_I("Heartbeat deferred by Retry-After: %lu ms", heartbeatDelay);
+  }
+  
+  TRACE_EVENT(TRACE_HEARTBEAT_END, httpResponseCode);
+}
+
+// Backend instructions, from a heartbeat response or pushed over MQTT
+void applyBackendInstructions(const String& instructions) {
+  StaticJsonDocument<256> responseDoc;
+  if (deserializeJson(responseDoc, instructions) != DeserializationError::Ok) {
+    return;
+  }
+  
+  // Server-chosen interval (seconds), jittered so hinted terminals stay spread
+  if (responseDoc.containsKey("nextHeartbeatIn")) {
+    uint32_t hintMs = constrain(responseDoc["nextHeartbeatIn"].as<uint32_t>() * 1000UL,
+                                (uint32_t)HEARTBEAT_HINT_MIN_MS, (uint32_t)HEARTBEAT_HINT_MAX_MS);
+    heartbeatDelay = jitterInterval(hintMs, SCHEDULE_JITTER_PERCENT, ESP.random());
+  }
+  
+  // Handle any backend instructions in the response
+  if (responseDoc.containsKey("syncLogs") && responseDoc["syncLogs"].as<bool>()) {
+    LOG_I("Backend requested log sync");
+    if (offlineLogsCount > 0) {
+      syncOfflineLogs();
+    }
+  }
+  
+  // Current roster version: fetch only when ours differs
+  if (responseDoc.containsKey("rosterVersion")) {
+    uint32_t version = responseDoc["rosterVersion"].as<uint32_t>();
+    rosterSyncPending = (version != roster.getVersion()) || roster.isSnapshotting();
+  }
+}
+
+// Fetches and applies one roster page. Deltas since our version are asked
+// for with If-None-Match, so an unchanged roster costs a bodyless 304; a
+// snapshot continues after the last tag received. Scans are served between
+// pages, and lookups keep using the committed roster until a page is applied.
+void syncRosterStep() {
+  if (messageTransport()) {
+    rosterSyncPending = false;          // HTTP(S) backends only
+    return;
+  }
+  
+  String url = getRosterEndpointUrl();
+  if (roster.isSnapshotting()) {
+    url += "?since=0&after=" + String(roster.getSnapshotCursor());
+  } else {
+    url += "?since=" + String(roster.getVersion());
+  }
+  url += "&limit=" + String(ROSTER_PAGE_MAX);
+  
+  if (url.startsWith("https://")) {
+    wifiClientSecure.setInsecure();
+    http.begin(wifiClientSecure, url);
+  } else {
+    http.begin(wifiClient, url);
+  }
+  http.setTimeout(ROSTER_SYNC_TIMEOUT_MS);
+  if (roster.isLoaded() && !roster.isSnapshotting()) {
+    http.addHeader("If-None-Match", "\"" + String(roster.getVersion()) + "\"");
+  }
+  
+  incrementMetric(CTR_HTTP_REQUESTS);
+  unsigned long requestStartTime = millis();
+  int httpResponseCode = http.GET();
+  
+  if (httpResponseCode == 304) {
+    incrementMetric(CTR_ROSTER_NOT_MODIFIED);
+    rosterSyncPending = false;
+  } else if (httpResponseCode == 200) {
+    String body = http.getString();
+    if (parseRosterPage(body.c_str(), body.length(), rosterPage) && roster.apply(rosterPage)) {
+      incrementMetric(CTR_ROSTER_CHANGES, rosterPage.count);
+      rosterSyncPending = rosterPage.more;
+      LOG_I("Roster %s page v%lu: %u entries%s", rosterPage.full ? "snapshot" : "delta",
+            (unsigned long)rosterPage.version, rosterPage.count, rosterPage.more ? ", more" : "");
+    } else {
+      LOG_W("Roster page rejected (%u bytes)", body.length());
+      roster.abortSnapshot();
+      rosterSyncPending = false;        // Retried after the next heartbeat
+    }
+  } else {
+    incrementMetric(CTR_HTTP_ERRORS);
+    LOG_W("Roster sync failed: HTTP %d", httpResponseCode);
+    rosterSyncPending = false;
+  }
   http.end();
+  observeMetric(HIST_HTTP_TOTAL_MS, millis() - requestStartTime);
 }
 
 // ========================================
@@ -1253,7 +2306,7 @@ void sendHeartbeat() {
 // ========================================
 
 void setupConfigurationEndpoints() {
-  Serial.println("Setting up configuration endpoints...");
+  LOG_D("Setting up configuration endpoints...");
   
   // Enable CORS for all requests
   configServer.on("/api/config", HTTP_OPTIONS, []() {
@@ -1288,17 +2341,38 @@ void setupConfigurationEndpoints() {
   // GET /api/logs - Get offline logs info
   configServer.on("/api/logs", HTTP_GET, handleGetLogsInfo);
   
+  // GET /api/logs/export - Stream a filtered page of offline logs
+  configServer.on("/api/logs/export", HTTP_GET, handleExportLogs);
+  
+  // GET /api/history - Accepted scans in a time range, from the on-device history
+  configServer.on("/api/history", HTTP_GET, handleGetHistory);
+  
+  // GET /api/today - Today's running occupancy, unique cards and hourly entries/exits
+  configServer.on("/api/today", HTTP_GET, handleGetToday);
+  
   // GET /api/firmware/list - Get list of firmware files
   configServer.on("/api/firmware/list", HTTP_GET, handleGetFirmwareList);
   
   // GET /api/firmware/download - Download specific firmware file
   configServer.on("/api/firmware/download", HTTP_GET, handleDownloadFirmware);
   
+  // GET /api/events - Live event stream (Server-Sent Events)
+  configServer.on("/api/events", HTTP_GET, handleEventStream);
+  
+  // GET /metrics - Prometheus scrape endpoint
+  configServer.on("/metrics", HTTP_GET, handleGetMetrics);
+  
+  // GET /api/trace - Dump the hot-path trace ring (?clear=1 empties it afterwards)
+  configServer.on("/api/trace", HTTP_GET, handleGetTrace);
+  
+  // GET /api/rfid - Tap statistics and adaptive antenna gain
+  configServer.on("/api/rfid", HTTP_GET, handleGetRfidStats);
+  
   // 404 handler
   configServer.onNotFound(handleNotFound);
   
   configServer.begin();
-  Serial.println("Configuration server started on port 80");
+  LOG_I("Configuration server started on port 80");
 }
 
 void sendCORSHeaders() {
@@ -1313,6 +2387,10 @@ void handleGetConfiguration() {
   StaticJsonDocument<512> response;
   response["deviceId"] = deviceId;
   response["backendUrl"] = backendUrl;
+  JsonArray backendUrls = response.createNestedArray("backendUrls");
+  for (uint8_t i = 0; i < backendEndpoints.getCount(); i++) {
+    backendUrls.add(backendEndpoints.getEndpoint(i).url);
+  }
   response["firmwareVersion"] = FIRMWARE_VERSION;
   response["isOnline"] = isOnline;
   response["offlineLogsCount"] = offlineLogsCount;
@@ -1349,7 +2427,7 @@ void handleUpdateConfiguration() {
   }
   
   String body = configServer.arg("plain");
-  StaticJsonDocument<512> doc;
+  StaticJsonDocument<768> doc;   // Room for a full backendUrls list
   DeserializationError error = deserializeJson(doc, body);
   
   if (error) {
@@ -1360,11 +2438,38 @@ void handleUpdateConfiguration() {
   bool configChanged = false;
   String changes = "";
   
-  // Update backend URL if provided
+  // Update the backend endpoint list if provided (most preferred first)
+  if (doc.containsKey("backendUrls")) {
+    JsonArray list = doc["backendUrls"].as<JsonArray>();
+    String urls[ENDPOINT_MAX];
+    uint8_t count = 0;
+    for (JsonVariant url : list) {
+      if (count >= ENDPOINT_MAX || !isValidUrl(url.as<String>())) {
+        configServer.send(400, "application/json",
+                          "{\"error\":\"backendUrls takes up to " + String(ENDPOINT_MAX) + " valid URLs\"}");
+        return;
+      }
+      urls[count++] = url.as<String>();
+    }
+    if (count > 0) {
+      setBackendEndpoints(urls, count);
+      saveBackendUrl();
+      configChanged = true;
+      changes += "Backend URLs updated; ";
+    }
+  }
+  
+  // Update backend URL if provided: replaces the first endpoint only
   if (doc.containsKey("backendUrl")) {
     String newUrl = doc["backendUrl"].as<String>();
     if (newUrl != backendUrl && newUrl.length() > 0) {
-      backendUrl = newUrl;
+      String urls[ENDPOINT_MAX];
+      uint8_t count = backendEndpoints.getCount();
+      for (uint8_t i = 1; i < count; i++) {
+        urls[i] = backendEndpoints.getEndpoint(i).url;
+      }
+      urls[0] = newUrl;
+      setBackendEndpoints(urls, max((uint8_t)1, count));
       saveBackendUrl();
       configChanged = true;
       changes += "Backend URL updated; ";
@@ -1398,7 +2503,7 @@ void handleUpdateConfiguration() {
 void handleGetDeviceStatus() {
   sendCORSHeaders();
   
-  StaticJsonDocument<1024> response;
+  StaticJsonDocument<1536> response;
   
   // Device information
   response["deviceId"] = deviceId;
@@ -1424,14 +2529,89 @@ void handleGetDeviceStatus() {
   // Heartbeat information
   JsonObject heartbeat = response.createNestedObject("heartbeat");
   heartbeat["lastHeartbeat"] = lastHeartbeat;
-  heartbeat["heartbeatInterval"] = HEARTBEAT_INTERVAL;
-  heartbeat["nextHeartbeat"] = lastHeartbeat + HEARTBEAT_INTERVAL;
+  heartbeat["heartbeatInterval"] = heartbeatDelay;
+  heartbeat["nextHeartbeat"] = lastHeartbeat + heartbeatDelay;
   heartbeat["timeSinceLastHeartbeat"] = millis() - lastHeartbeat;
   
+  // Offline sync scheduling and pacing
+  JsonObject sync = response.createNestedObject("sync");
+  sync["lastSync"] = lastSyncAttempt;
+  sync["nextSync"] = lastSyncAttempt + syncDelay;
+  sync["batch"] = syncPacer.getBatch();
+  sync["backoffMs"] = syncPacer.getBackoffMs();
+  sync["throttled"] = syncPacer.getThrottleCount();
+  sync["nextSeq"] = scanSequence.peekNext();
+  sync["seqReserved"] = scanSequence.getReserved();
+  sync["seqWrites"] = scanSequence.getReservationCount();
+  
+  // Backend endpoints: probe RTT, health and the current selection
+  JsonObject backend = response.createNestedObject("backend");
+  backend["selected"] = backendEndpoints.getSelectedUrl();
+  backend["switches"] = backendEndpoints.getSwitchCount();
+  JsonArray endpoints = backend.createNestedArray("endpoints");
+  for (uint8_t i = 0; i < backendEndpoints.getCount(); i++) {
+    const BackendEndpoint& endpoint = backendEndpoints.getEndpoint(i);
+    JsonObject entry = endpoints.createNestedObject();
+    entry["url"] = endpoint.url;
+    entry["rttMs"] = endpoint.rttMs;
+    entry["healthy"] = backendEndpoints.isHealthy(i);
+    entry["errors"] = endpoint.errorCount;
+  }
+  
+  // Local card roster
+  JsonObject rosterStatus = response.createNestedObject("roster");
+  rosterStatus["version"] = roster.getVersion();
+  rosterStatus["members"] = roster.getCount();
+  rosterStatus["syncing"] = rosterSyncPending || roster.isSnapshotting();
+  
+  // Offline group commit: staged records, flash writes per stored scan
+  JsonObject offline = response.createNestedObject("offline");
+  offline["staged"] = offlineQueue.getStaged();
+  offline["maxLossMs"] = OFFLINE_COMMIT_MAX_AGE_MS;
+  uint32_t storedScans = getMetricCount(CTR_OFFLINE_STORED);
+  offline["flashWritesPerScan"] = storedScans ? (float)getMetricCount(CTR_OFFLINE_FLASH_WRITES) / storedScans : 0;
+  offline["appendP99Us"] = getMetricPercentile(HIST_OFFLINE_APPEND_US, 99);
+  offline["segments"] = offlineSegments.getSegmentCount();
+  offline["sealedRecords"] = offlineSegments.getRecordCount();
+  JsonObject compacted = offline.createNestedObject("compacted");
+  compacted["burst"] = compactionAudit.get(COMPACT_BURST);
+  compacted["repeated"] = compactionAudit.get(COMPACT_REDUNDANT);
+  compacted["pastDayLimit"] = compactionAudit.get(COMPACT_DAY);
+  
+  // On-device history of accepted scans
+  JsonObject history = response.createNestedObject("history");
+  history["days"] = attendanceHistory.getPartitionCount();
+  history["scans"] = attendanceHistory.getRecordCount();
+  history["notKept"] = attendanceHistory.getDropped();
+  
+  // Power mode and energy estimate
+  JsonObject power = response.createNestedObject("power");
+  power["lowPower"] = LOW_POWER_MODE;
+  power["maxDetectMs"] = RFID_MAX_DETECT_MS;
+  power["mwhPerHour"] = energyMeter.getMwhPerHourX10() / 10.0;
+  power["mwhTotal"] = energyMeter.getTotalMwhX10() / 10.0;
+  power["mcuActivePercent"] = energyMeter.getActivePercent(ENERGY_MCU);
+  
   // RFID status
   JsonObject rfid = response.createNestedObject("rfid");
   rfid["initialized"] = true; // Assume initialized if we got this far
   rfid["lastScan"] = lastCardScan;
+  rfid["gain"] = rfidGainTuner.getGain();
+  rfid["firstTapPercent"] = rfidGainTuner.getLastFirstTapPercent();
+  rfid["readers"] = rfidReaderSet.getCount();
+  rfid["resets"] = rfidReaderSet.getTotalResets();
+  rfid["detectMode"] = isRFIDIrqEnabled() ? "irq" : "poll";
+  uint32_t pollsPerSecondX10 = 0;
+  for (uint8_t i = 0; i < rfidReaderSet.getCount(); i++) {
+    pollsPerSecondX10 += rfidReaderSet.getPoller(i).getPollsPerSecondX10();
+  }
+  rfid["pollsPerSecond"] = pollsPerSecondX10 / 10.0;
+  
+  // Live event stream status
+  JsonObject events = response.createNestedObject("events");
+  events["clients"] = getEventStreamClientCount();
+  events["published"] = getEventStreamPublishedCount();
+  events["dropped"] = getEventStreamDroppedCount();
   
   // Return status only (no sync here)
   String responseString;
@@ -1491,6 +2671,10 @@ void handleResetWiFi() {
   delay(1000);
   
   logInfo("WiFi settings reset via API - restarting");
+  commitOfflineLogs(true);
+  attendanceHistory.flush();
+  dailyTally.flush();
+  flushLogOutput();
   ESP.restart();
 }
 
@@ -1503,6 +2687,10 @@ void handleRestartDevice() {
   
   delay(1000);
   logInfo("Device restart triggered via API");
+  commitOfflineLogs(true);
+  attendanceHistory.flush();
+  dailyTally.flush();
+  flushLogOutput();
   ESP.restart();
 }
 
@@ -1617,6 +2805,285 @@ void handleGetLogsInfo() {
   configServer.send(200, "application/json", responseString);
 }
 
+// Binary export: "ATL1" header, then per record
+// [uint32 LE unix time][uint8 uid length][uid bytes]. Stored timestamps are
+// RTC local time (IST, as set from NTP), so the offset is taken off for UTC.
+static size_t encodeBinaryLogRecord(const char* rfidTag, const char* timestamp, uint8_t* out) {
+  uint32_t unixTime = DateTime(timestamp).unixtime() - IST_OFFSET;
+  out[0] = unixTime & 0xFF;
+  out[1] = (unixTime >> 8) & 0xFF;
+  out[2] = (unixTime >> 16) & 0xFF;
+  out[3] = (unixTime >> 24) & 0xFF;
+  
+  size_t uidLen = 0;
+  for (size_t i = 0; rfidTag[i] && rfidTag[i + 1] && uidLen < MAX_RFID_TAG_LENGTH / 2; i += 2) {
+    char hex[3] = { rfidTag[i], rfidTag[i + 1], 0 };
+    out[5 + uidLen++] = (uint8_t)strtoul(hex, NULL, 16);
+  }
+  out[4] = uidLen;
+  return 5 + uidLen;
+}
+
+// Filter, paging and output buffer of one export; records come from the
+// sealed segments first, then the JSON backlog, in storage order
+struct LogExport {
+  bool binary;
+  String since;
+  String until;
+  String uidFilter;
+  long offset;
+  long limit;
+  long skipped;
+  long emitted;
+  char out[LOG_EXPORT_CHUNK_SIZE];
+  size_t outLen;
+};
+
+// Filters one stored record into the output buffer; false once the limit is reached
+static bool exportLogRecord(LogExport& exp, const char* line, size_t len) {
+  if (exp.emitted >= exp.limit) {
+    return false;
+  }
+  StaticJsonDocument<256> doc;
+  if (deserializeJson(doc, line, len) != DeserializationError::Ok) {
+    return true;
+  }
+  const char* rfidTag = doc["rfidTag"] | "";
+  const char* timestamp = doc["timestamp"] | "";
+  
+  if (exp.since.length() > 0 && strcmp(timestamp, exp.since.c_str()) < 0) return true;
+  if (exp.until.length() > 0 && strcmp(timestamp, exp.until.c_str()) >= 0) return true;
+  if (exp.uidFilter.length() > 0 && strcasecmp(rfidTag, exp.uidFilter.c_str()) != 0) return true;
+  if (exp.skipped < exp.offset) {
+    exp.skipped++;
+    return true;
+  }
+  
+  // Largest possible record: the raw line plus newline, or a binary record
+  size_t needed = exp.binary ? (5 + MAX_RFID_TAG_LENGTH / 2) : (len + 1);
+  if (exp.outLen + needed > sizeof(exp.out)) {
+    configServer.sendContent(exp.out, exp.outLen);
+    exp.outLen = 0;
+  }
+  
+  if (exp.binary) {
+    exp.outLen += encodeBinaryLogRecord(rfidTag, timestamp, (uint8_t*)&exp.out[exp.outLen]);
+  } else {
+    // Stored lines are already JSON objects; pass them through untouched
+    memcpy(&exp.out[exp.outLen], line, len);
+    exp.outLen += len;
+    exp.out[exp.outLen++] = '\n';
+  }
+  exp.emitted++;
+  return true;
+}
+
+void handleExportLogs() {
+  sendCORSHeaders();
+  
+  String format = configServer.hasArg("format") ? configServer.arg("format") : "jsonl";
+  LogExport exp;
+  exp.binary = (format == "binary");
+  if (!exp.binary && format != "jsonl") {
+    configServer.send(400, "application/json", "{\"error\":\"format must be jsonl or binary\"}");
+    return;
+  }
+  
+  // Timestamps are fixed-width ISO 8601, so plain string comparison orders them
+  exp.since = configServer.arg("since");
+  exp.until = configServer.arg("until");
+  exp.uidFilter = configServer.arg("uid");
+  exp.uidFilter.toUpperCase();
+  
+  exp.offset = configServer.hasArg("offset") ? configServer.arg("offset").toInt() : 0;
+  exp.limit = configServer.hasArg("limit") ? configServer.arg("limit").toInt() : LOG_EXPORT_DEFAULT_LIMIT;
+  if (exp.offset < 0) exp.offset = 0;
+  if (exp.limit <= 0) {
+    configServer.send(400, "application/json", "{\"error\":\"limit must be a positive number\"}");
+    return;
+  }
+  if (exp.limit > LOG_EXPORT_MAX_LIMIT) exp.limit = LOG_EXPORT_MAX_LIMIT;
+  std::unique_ptr<uint8_t[]> segmentBuffer;
+  if (offlineSegments.getSegmentCount() > 0 && !(segmentBuffer = allocateSegmentBuffer())) {
+    configServer.send(503, "application/json", "{\"error\":\"Not enough memory\"}");
+    return;
+  }
+  exp.skipped = 0;
+  exp.emitted = 0;
+  exp.outLen = 0;
+  
+  commitOfflineLogs(true);
+  
+  configServer.sendHeader("X-Export-Offset", String(exp.offset));
+  configServer.sendHeader("X-Export-Limit", String(exp.limit));
+  configServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  configServer.send(200, exp.binary ? "application/octet-stream" : "application/x-ndjson", "");
+  
+  if (exp.binary) {
+    memcpy(exp.out, "ATL1", 4);
+    exp.outLen = 4;
+  }
+  
+  char line[LOG_EXPORT_LINE_MAX];
+  
+  // Sealed segments, decoded back to the lines they were sealed from
+  SegmentCursor cursor = offlineSegments.first();
+  int segmentLength;
+  bool more = true;
+  while (more && segmentBuffer &&
+         (segmentLength = offlineSegments.next(cursor, segmentBuffer.get(), SEGMENT_MAX_BYTES)) > 0) {
+    SegmentDecoder decoder;
+    if (!decoder.open(segmentBuffer.get(), segmentLength)) {
+      continue;
+    }
+    size_t len;
+    while (more && (len = decoder.next(line, sizeof(line))) > 0) {
+      more = exportLogRecord(exp, line, len);
+    }
+  }
+  
+  File file = LittleFS.open(OFFLINE_LOGS_FILE, "r");
+  while (more && file && file.available()) {
+    size_t len = file.readBytesUntil('\n', line, sizeof(line) - 1);
+    if (len == sizeof(line) - 1) {
+      if (file.peek() == '\n') {
+        file.read();                    // Exactly full: the newline is still unread
+      } else {
+        // Longer than any record we write: skip the whole line, not pieces of it
+        while (file.available() && file.read() != '\n') {
+        }
+        LOG_W("Export: skipped a stored line over %u bytes", (unsigned)(sizeof(line) - 1));
+        continue;
+      }
+    }
+    while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' ')) {
+      len--;
+    }
+    line[len] = 0;
+    if (len == 0) {
+      continue;
+    }
+    more = exportLogRecord(exp, line, len);
+  }
+  
+  if (file) {
+    file.close();
+  }
+  if (exp.outLen > 0) {
+    configServer.sendContent(exp.out, exp.outLen);
+  }
+  configServer.sendContent(""); // Terminate chunked response
+  
+  logInfo("Exported " + String(exp.emitted) + " offline logs (" + format + ")");
+}
+
+// Output buffer of one history response
+struct HistoryExport {
+  long limit;
+  long emitted;
+  char out[LOG_EXPORT_CHUNK_SIZE];
+  size_t outLen;
+};
+
+// One history entry as a JSON line, shaped like the record that was synced;
+// false once the limit is reached
+static bool exportHistoryEntry(const HistoryEntry& entry, void* context) {
+  HistoryExport& exp = *(HistoryExport*)context;
+  char timestamp[ATTENDANCE_TIMESTAMP_SIZE];
+  formatIsoSeconds(entry.time, timestamp, sizeof(timestamp));
+  char line[96];
+  int len = snprintf(line, sizeof(line), "{\"rfidTag\":\"%s\",\"timestamp\":\"%s\"%s%s}\n", entry.tag, timestamp,
+                     entry.kind == HISTORY_TOGGLE ? "" : ",\"direction\":",
+                     entry.kind == HISTORY_ENTRY ? "\"entry\"" : entry.kind == HISTORY_EXIT ? "\"exit\"" : "");
+  if (exp.outLen + len > sizeof(exp.out)) {
+    configServer.sendContent(exp.out, exp.outLen);
+    exp.outLen = 0;
+  }
+  memcpy(&exp.out[exp.outLen], line, len);
+  exp.outLen += len;
+  return ++exp.emitted < exp.limit;
+}
+
+// ?from=..&to=.. (ISO timestamps) or ?date=YYYY-MM-DD; today so far by
+// default. Entries come day by day, each day in the order it was synced.
+void handleGetHistory() {
+  sendCORSHeaders();
+  
+  String now = getCurrentTimestamp();
+  String fromArg = configServer.arg("from");
+  String toArg = configServer.arg("to");
+  if (configServer.hasArg("date")) {
+    fromArg = configServer.arg("date") + "T00:00:00";
+    toArg = configServer.arg("date") + "T23:59:59";
+  }
+  if (fromArg.length() == 0) fromArg = now.substring(0, 10) + "T00:00:00";
+  if (toArg.length() == 0) toArg = now;
+  uint32_t from, to;
+  if (!parseIsoTimestamp(fromArg.c_str(), from) || !parseIsoTimestamp(toArg.c_str(), to)) {
+    configServer.send(400, "application/json",
+                      "{\"error\":\"from/to must be YYYY-MM-DDTHH:MM:SS, date YYYY-MM-DD\"}");
+    return;
+  }
+  
+  HistoryExport exp;
+  exp.limit = configServer.hasArg("limit") ? configServer.arg("limit").toInt() : HISTORY_QUERY_DEFAULT_LIMIT;
+  if (exp.limit <= 0) {
+    configServer.send(400, "application/json", "{\"error\":\"limit must be a positive number\"}");
+    return;
+  }
+  if (exp.limit > HISTORY_QUERY_MAX_LIMIT) exp.limit = HISTORY_QUERY_MAX_LIMIT;
+  exp.emitted = 0;
+  exp.outLen = 0;
+  
+  configServer.sendHeader("X-History-Limit", String(exp.limit));
+  configServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  configServer.send(200, "application/x-ndjson", "");
+  
+  unsigned long queryStart = millis();
+  HistoryQueryStats stats = attendanceHistory.query(from, to, exportHistoryEntry, &exp);
+  if (exp.outLen > 0) {
+    configServer.sendContent(exp.out, exp.outLen);
+  }
+  configServer.sendContent(""); // Terminate chunked response
+  
+  LOG_D("History %s..%s: %ld scans, %u days, %u blocks read, %u skipped, %lu ms", fromArg.c_str(),
+        toArg.c_str(), exp.emitted, stats.partitions, stats.blocksRead, stats.blocksSkipped,
+        millis() - queryStart);
+}
+
+// Running figures only: no storage reads, whatever the day's traffic
+void handleGetToday() {
+  sendCORSHeaders();
+  
+  uint32_t now;
+  if (isTimeValid() && parseIsoTimestamp(getCurrentTimestamp().c_str(), now)) {
+    dailyTally.startDay((uint16_t)(now / 86400));  // Zeros right after midnight
+  }
+  
+  StaticJsonDocument<1536> response;              // 48 hourly buckets
+  char date[ATTENDANCE_TIMESTAMP_SIZE];
+  formatIsoSeconds((uint32_t)dailyTally.getDay() * 86400, date, sizeof(date));
+  date[10] = '\0';                                // YYYY-MM-DD
+  response["date"] = date;
+  response["occupancy"] = dailyTally.getOccupancy();
+  response["uniqueCards"] = dailyTally.getUniqueCards();
+  response["scans"] = dailyTally.getScans();
+  response["entries"] = dailyTally.getTotalEntries();
+  response["exits"] = dailyTally.getTotalExits();
+  response["exact"] = dailyTally.isExact();
+  
+  JsonArray entries = response.createNestedArray("entriesByHour");
+  JsonArray exits = response.createNestedArray("exitsByHour");
+  for (uint8_t hour = 0; hour < 24; hour++) {
+    entries.add(dailyTally.getEntries(hour));
+    exits.add(dailyTally.getExits(hour));
+  }
+  
+  String responseString;
+  serializeJson(response, responseString);
+  configServer.send(200, "application/json", responseString);
+}
+
 void handleGetFirmwareList() {
   sendCORSHeaders();
   
@@ -1732,6 +3199,195 @@ void handleDownloadFirmware() {
   configServer.send(200, "application/json", responseString);
 }
 
+void handleEventStream() {
+  WiFiClient client = configServer.client();
+  
+  if (!addEventStreamClient(client)) {
+    sendCORSHeaders();
+    configServer.send(503, "application/json", "{\"error\":\"Too many event stream clients\"}");
+    return;
+  }
+  
+  // Headers are queued by the stream; push them out before the server drops its reference
+  serviceEventStream();
+  logInfo("Event stream client connected from " + client.remoteIP().toString());
+}
+
+void handleGetMetrics() {
+  sendCORSHeaders();
+  sendMetrics(configServer);
+}
+
+// Current and last tap window, per-gain scores, the gain in use and the
+// health and poll cadence of each reader
+void handleGetRfidStats() {
+  sendCORSHeaders();
+  
+  StaticJsonDocument<1024> response;
+  response["gain"] = rfidGainTuner.getGain();
+  response["gainMin"] = RFID_GAIN_MIN;
+  response["gainMax"] = RFID_GAIN_MAX;
+  response["gainChanges"] = rfidGainTuner.getGainChanges();
+  response["windows"] = rfidGainTuner.getWindowCount();
+  response["targetPercent"] = RFID_TUNE_TARGET_PERCENT;
+  response["firstTapPercent"] = rfidGainTuner.getLastFirstTapPercent();
+  
+  response["detectMode"] = isRFIDIrqEnabled() ? "irq" : "poll";
+  
+  // Per reader: role, health probe and resets, detection cadence
+  JsonArray readers = response.createNestedArray("readers");
+  for (uint8_t i = 0; i < rfidReaderSet.getCount(); i++) {
+    const RfidReaderHealth& health = rfidReaderSet.getHealth(i);
+    const RfidPollScheduler& poller = rfidReaderSet.getPoller(i);
+    const char* direction = rfidRoleDirection(rfidReaderSet.getRole(i));
+    JsonObject reader = readers.createNestedObject();
+    reader["role"] = direction ? direction : "toggle";
+    reader["version"] = getRFIDVersion(i);
+    reader["readerGain"] = getRFIDGain(i);
+    reader["scans"] = health.scans;
+    reader["readFailures"] = health.readFailures;
+    reader["resets"] = health.resets;
+    reader["lastResetReason"] = health.lastResetReason;
+    reader["lastResetAgoMs"] = health.resets > 0 ? millis() - health.lastResetMs : 0;
+    reader["pollIntervalMs"] = poller.getInterval(millis());
+    reader["pollsPerSecond"] = poller.getPollsPerSecondX10() / 10.0;
+    reader["polls"] = poller.getPollCount();
+  }
+  
+  const RfidTapWindow* windows[] = { &rfidGainTuner.getWindow(), &rfidGainTuner.getLastWindow() };
+  const char* names[] = { "window", "lastWindow" };
+  for (uint8_t i = 0; i < 2; i++) {
+    JsonObject window = response.createNestedObject(names[i]);
+    window["detects"] = windows[i]->detects;
+    window["reads"] = windows[i]->reads;
+    window["readFailures"] = windows[i]->readFailures;
+    window["taps"] = windows[i]->taps;
+    window["firstTapReads"] = windows[i]->firstTapReads;
+    window["retries"] = windows[i]->retries;
+  }
+  
+  // Smoothed first-tap percent per gain level, -1 where not measured
+  JsonArray scores = response.createNestedArray("scores");
+  for (uint8_t gain = 0; gain < RFID_GAIN_LEVELS; gain++) {
+    scores.add(rfidGainTuner.getScore(gain));
+  }
+  
+  String responseString;
+  serializeJson(response, responseString);
+  configServer.send(200, "application/json", responseString);
+}
+
+void handleGetTrace() {
+  sendCORSHeaders();
+  
+#if TRACE_ENABLED
+  configServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  configServer.send(200, "application/json", "");
+  
+  char chunk[512];
+  int len = snprintf(chunk, sizeof(chunk),
+                     "{\"deviceId\":\"%s\",\"firmware\":\"%s\",\"nowMicros\":%lu,"
+                     "\"overwritten\":%lu,\"events\":[",
+                     deviceId.c_str(), FIRMWARE_VERSION, (unsigned long)micros(),
+                     (unsigned long)getTraceOverwrittenCount());
+  
+  uint16_t count = getTraceRecordCount();
+  for (uint16_t i = 0; i < count; i++) {
+    const TraceRecord& record = getTraceRecord(i);
+    char entry[80];
+    int entryLen = snprintf(entry, sizeof(entry), "%s{\"t\":%lu,\"n\":\"%s\",\"ph\":\"%c\",\"a\":%d}",
+                            i == 0 ? "" : ",", (unsigned long)record.micros,
+                            getTraceEventName(record.id), getTraceEventPhase(record.id), record.arg);
+    if (len + entryLen >= (int)sizeof(chunk)) {
+      configServer.sendContent(chunk, len);
+      len = 0;
+    }
+    memcpy(&chunk[len], entry, entryLen);
+    len += entryLen;
+  }
+  configServer.sendContent(chunk, len);
+  configServer.sendContent("]}");
+  configServer.sendContent("");
+  
+  if (configServer.arg("clear") == "1") {
+    clearTrace();
+  }
+#else
+  configServer.send(404, "application/json", "{\"error\":\"Tracing disabled in this build\"}");
+#endif
+}
+
+// ========================================
+// LIVE EVENT STREAM PUBLISHERS
+// ========================================
+
+void publishScanEvent(String rfidTag, String timestamp, uint8_t reader) {
+  if (getEventStreamClientCount() == 0) {
+    return;
+  }
+  
+  StaticJsonDocument<192> doc;
+  doc["uid"] = rfidTag;
+  doc["reader"] = reader;
+  doc["timestamp"] = timestamp;
+  doc["online"] = isOnline;
+  doc["name"] = lastScannedName;
+  doc["result"] = lastScannedMessage;
+  doc["uptime"] = millis() - systemStartTime;
+  
+  char data[EVENT_STREAM_MAX_FRAME - 48];
+  serializeJson(doc, data, sizeof(data));
+  publishEvent(EVENT_SCAN, data);
+}
+
+void publishSyncEvent(int syncedCount, int remainingCount) {
+  if (getEventStreamClientCount() == 0) {
+    return;
+  }
+  
+  StaticJsonDocument<96> doc;
+  doc["synced"] = syncedCount;
+  doc["remaining"] = remainingCount;
+  doc["uptime"] = millis() - systemStartTime;
+  
+  char data[EVENT_STREAM_MAX_FRAME - 48];
+  serializeJson(doc, data, sizeof(data));
+  publishEvent(EVENT_SYNC, data);
+}
+
+void publishConnectivityEvent() {
+  if (getEventStreamClientCount() == 0) {
+    return;
+  }
+  
+  StaticJsonDocument<128> doc;
+  doc["online"] = isOnline;
+  doc["wifiConnected"] = (WiFi.status() == WL_CONNECTED);
+  if (WiFi.status() == WL_CONNECTED) {
+    doc["ip"] = WiFi.localIP().toString();
+    doc["rssi"] = WiFi.RSSI();
+  }
+  doc["uptime"] = millis() - systemStartTime;
+  
+  char data[EVENT_STREAM_MAX_FRAME - 48];
+  serializeJson(doc, data, sizeof(data));
+  publishEvent(EVENT_CONNECTIVITY, data);
+}
+
+void publishErrorEvent(String error) {
+  if (getEventStreamClientCount() == 0) {
+    return;
+  }
+  
+  StaticJsonDocument<192> doc;
+  doc["message"] = error.substring(0, 120);
+  doc["uptime"] = millis() - systemStartTime;
+  
+  char data[EVENT_STREAM_MAX_FRAME - 48];
+  serializeJson(doc, data, sizeof(data));
+  publishEvent(EVENT_ERROR, data);
+}
+
 void handleNotFound() {
   sendCORSHeaders();
   configServer.send(404, "application/json", "{\"error\":\"Endpoint not found\"}");
@@ -1772,16 +3428,31 @@ String getHeartbeatEndpointUrl() {
   return effectiveUrl + "/device/heartbeat";
 }
 
+String getRosterEndpointUrl() {
+  String effectiveUrl = getEffectiveBackendUrl();
+  
+  // Remove trailing slash if present
+  if (effectiveUrl.endsWith("/")) {
+    effectiveUrl = effectiveUrl.substring(0, effectiveUrl.length() - 1);
+  }
+  
+  // Add the roster endpoint
+  return effectiveUrl + "/device/roster";
+}
+
+// Selected endpoint (see probeBackendEndpoint()), backendUrl before the
+// endpoint list is loaded
 String getEffectiveBackendUrl() {
+  String selectedUrl = backendEndpoints.getCount() > 0 ? String(backendEndpoints.getSelectedUrl()) : backendUrl;
   #ifdef FORCE_HTTP_FOR_TESTING
-  if (backendUrl.startsWith("https://")) {
-    String httpUrl = backendUrl;
+  if (selectedUrl.startsWith("https://")) {
+    String httpUrl = selectedUrl;
     httpUrl.replace("https://", "http://");
-    Serial.println("FORCE_HTTP_FOR_TESTING: Using " + httpUrl + " instead of " + backendUrl);
+    LOG_D("FORCE_HTTP_FOR_TESTING: Using %s instead of %s", httpUrl.c_str(), selectedUrl.c_str());
     return httpUrl;
   }
   #endif
-  return backendUrl;
+  return selectedUrl;
 }
 
 // ========================================
@@ -1989,6 +3660,8 @@ void updateLCDState() {
 }
 
 void updateLCDDisplay() {
+  TRACE_EVENT(TRACE_DISPLAY_BEGIN, currentLcdState);
+  unsigned long busStart = micros();
   lcd.clear();
   
   switch (currentLcdState) {
@@ -2153,6 +3826,9 @@ void updateLCDDisplay() {
       }
       break;
   }
+  
+  observeMetric(HIST_I2C_US, micros() - busStart);
+  TRACE_EVENT(TRACE_DISPLAY_END, 0);
 }
 
 // ========================================
@@ -2207,7 +3883,7 @@ void handleForceHeartbeat() {
 // ========================================
 
 bool testHTTPSConnection(String url) {
-  Serial.println("Testing HTTPS connection to: " + url);
+  LOG_D("Testing HTTPS connection to: %s", url.c_str());
   
   wifiClientSecure.setInsecure();
   wifiClientSecure.setTimeout(10000);
@@ -2215,7 +3891,7 @@ bool testHTTPSConnection(String url) {
   
   HTTPClient testHttp;
   if (!testHttp.begin(wifiClientSecure, url)) {
-    Serial.println("HTTPS test: Failed to initialize connection");
+    LOG_E("HTTPS test: Failed to initialize connection");
     testHttp.end();
     return false;
   }
@@ -2223,15 +3899,14 @@ bool testHTTPSConnection(String url) {
   testHttp.setTimeout(10000);
   int responseCode = testHttp.GET();
   
-  Serial.println("HTTPS test response code: " + String(responseCode));
-  Serial.println("Free heap during test: " + String(ESP.getFreeHeap()));
+  LOG_D("HTTPS test response code: %d, free heap: %u", responseCode, (unsigned)ESP.getFreeHeap());
   
   testHttp.end();
   return (responseCode > 0);
 }
 
 void processOnlineAttendanceWithFallback(String rfidTag, String timestamp) {
-  Serial.println("Backend URL: " + backendUrl);
+  LOG_I("Backend URL: %s", backendUrl.c_str());
   
   // Determine if we need HTTPS or HTTP
   bool isHTTPS = backendUrl.startsWith("https://");
@@ -2239,18 +3914,14 @@ void processOnlineAttendanceWithFallback(String rfidTag, String timestamp) {
   
   // For HTTPS, test connection first
   if (isHTTPS) {
-    Serial.println("Testing HTTPS connectivity...");
+    LOG_D("Testing HTTPS connectivity...");
     if (!testHTTPSConnection(backendUrl + "/health")) {
-      Serial.println("HTTPS test failed. You may want to:");
-      Serial.println("1. Check if your ESP8266 has enough memory");
-      Serial.println("2. Verify the SSL certificate");
-      Serial.println("3. Try using HTTP for testing");
-      Serial.println("4. Check network connectivity");
+      LOG_W("HTTPS test failed: check free heap, the SSL certificate and the network, or try HTTP");
     }
   }
   
   // Proceed with the actual request
-  processOnlineAttendance(rfidTag, timestamp);
+  processOnlineAttendance(rfidTag, timestamp, scanSequence.allocate(), NULL);
 }
 
 // ========================================
@@ -2258,7 +3929,7 @@ void processOnlineAttendanceWithFallback(String rfidTag, String timestamp) {
 // ========================================
 
 void warmupHTTPSConnection() {
-  Serial.println("Warming up HTTPS connection...");
+  LOG_D("Warming up HTTPS connection...");
   
   // Configure SSL client with same optimizations
   wifiClientSecure.setInsecure();
@@ -2278,14 +3949,14 @@ void warmupHTTPSConnection() {
     if (responseCode > 0) {
       // Mark session as established for reuse
       sslSessionValid = true;
-      Serial.println("HTTPS warmup successful: " + String(warmupTime) + "ms (session established)");
+      LOG_I("HTTPS warmup successful: %lu ms (session established)", warmupTime);
     } else {
-      Serial.println("HTTPS warmup failed: " + String(responseCode));
+      LOG_W("HTTPS warmup failed: %d", responseCode);
     }
     
     warmupHttp.end();
   } else {
-    Serial.println("HTTPS warmup connection failed");
+    LOG_W("HTTPS warmup connection failed");
   }
   }
   
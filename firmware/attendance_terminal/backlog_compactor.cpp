@@ -0,0 +1,216 @@
+/*
+ * Offline backlog compaction for Attendee Attendance Terminal v2.0
+ */
+
+#include "backlog_compactor.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// ========================================
+// COMPACTOR
+// ========================================
+
+BacklogCompactor::BacklogCompactor(uint32_t burstSeconds, uint8_t daySessions)
+  : _burstSeconds(burstSeconds), _daySessions(daySessions), _used(0) {
+}
+
+void BacklogCompactor::reset() {
+  _used = 0;
+}
+
+BacklogCompactor::Card* BacklogCompactor::find(const char* tag) {
+  for (uint8_t i = 0; i < _used; i++) {
+    if (strcmp(_cards[i].tag, tag) == 0) {
+      return &_cards[i];
+    }
+  }
+  return NULL;
+}
+
+CompactVerdict BacklogCompactor::check(const char* record, size_t length) {
+  char tag[ATTENDANCE_UID_HEX_SIZE];
+  char timestamp[ATTENDANCE_TIMESTAMP_SIZE + 1];
+  char direction[8];
+  uint32_t seconds;
+  if (!findJsonScalar(record, length, "rfidTag", tag, sizeof(tag)) || tag[0] == 0 ||
+      !findJsonScalar(record, length, "timestamp", timestamp, sizeof(timestamp)) ||
+      !parseIsoTimestamp(timestamp, seconds)) {
+    return COMPACT_KEEP;
+  }
+  uint8_t kind = 0;
+  if (findJsonScalar(record, length, "direction", direction, sizeof(direction))) {
+    if (strcmp(direction, "entry") == 0) {
+      kind = 1;
+    } else if (strcmp(direction, "exit") == 0) {
+      kind = 2;
+    } else {
+      return COMPACT_KEEP;              // Let the backend reject it
+    }
+  }
+  uint16_t day = (uint16_t)(seconds / 86400);
+
+  Card* card = find(tag);
+  if (card && card->day == day) {
+    if (kind != 0 && card->lastDirection == kind) {
+      return COMPACT_REDUNDANT;
+    }
+    if (_burstSeconds > 0 && kind == card->lastKind && seconds >= card->lastTime &&
+        seconds - card->lastTime < _burstSeconds) {
+      return COMPACT_BURST;
+    }
+    if (_daySessions > 0 && card->dayScans >= 2 * (uint16_t)_daySessions) {
+      return COMPACT_DAY;
+    }
+  }
+
+  // Kept: it is now the card's reference
+  bool fresh = !card;
+  if (fresh) {
+    if (_used < COMPACT_CARDS_MAX) {
+      card = &_cards[_used++];
+    } else {
+      card = &_cards[0];                // Forget the card kept longest ago
+      for (uint8_t i = 1; i < _used; i++) {
+        if (_cards[i].lastTime < card->lastTime) {
+          card = &_cards[i];
+        }
+      }
+    }
+    strcpy(card->tag, tag);
+  }
+  if (fresh || card->day != day) {
+    card->day = day;
+    card->dayScans = 0;
+    card->lastDirection = 0;
+  }
+  card->lastTime = seconds;
+  card->lastKind = kind;
+  card->lastDirection = kind;
+  card->dayScans++;
+  return COMPACT_KEEP;
+}
+
+// ========================================
+// PASS
+// ========================================
+
+CompactionPass::CompactionPass(BacklogCompactor& compactor) : _compactor(compactor) {
+  memset(_dropped, 0, sizeof(_dropped));
+  _compactor.reset();
+}
+
+bool CompactionPass::upload(const char* record, size_t length) {
+  CompactVerdict verdict = _compactor.check(record, length);
+  if (verdict == COMPACT_KEEP) {
+    return false;                       // drain() writes it back
+  }
+  _dropped[verdict]++;
+  return true;
+}
+
+uint32_t CompactionPass::getDroppedTotal() const {
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < COMPACT_VERDICTS; i++) {
+    total += _dropped[i];
+  }
+  return total;
+}
+
+struct CountContext {
+  BacklogCompactor* compactor;
+  uint32_t dropped;
+};
+
+static bool countLine(const char* line, size_t len, void* context) {
+  CountContext& ctx = *(CountContext*)context;
+  if (ctx.compactor->check(line, len) != COMPACT_KEEP) {
+    ctx.dropped++;
+  }
+  return true;
+}
+
+uint32_t countCompactable(TerminalStorage& storage, const char* path, BacklogCompactor& compactor) {
+  CountContext ctx = { &compactor, 0 };
+  compactor.reset();
+  if (storage.exists(path)) {
+    storage.forEachLine(path, countLine, &ctx);
+  }
+  return ctx.dropped;
+}
+
+// ========================================
+// AUDIT
+// ========================================
+
+CompactionAudit::CompactionAudit(TerminalStorage& storage, const char* path, const char* tempPath)
+  : _storage(storage), _path(path), _tempPath(tempPath) {
+  memset(_totals, 0, sizeof(_totals));
+}
+
+// Keeps the larger of each total: they only ever grow
+static bool maxTotalsLine(const char* line, size_t len, void* context) {
+  uint32_t* totals = (uint32_t*)context;
+  uint32_t value = 0;
+  uint8_t field = COMPACT_BURST;
+  for (size_t i = 0; i <= len && field < COMPACT_VERDICTS; i++) {
+    if (i < len && line[i] >= '0' && line[i] <= '9') {
+      value = value * 10 + (uint32_t)(line[i] - '0');
+      continue;
+    }
+    if (value > totals[field]) {
+      totals[field] = value;
+    }
+    value = 0;
+    field++;
+    if (i < len && line[i] != ' ') {
+      break;
+    }
+  }
+  return false;
+}
+
+void CompactionAudit::load() {
+  memset(_totals, 0, sizeof(_totals));
+  // A crash between writing the temp file and the rename leaves the newer
+  // totals in the temp file
+  if (_storage.exists(_path)) {
+    _storage.forEachLine(_path, maxTotalsLine, _totals);
+  }
+  if (_storage.exists(_tempPath)) {
+    _storage.forEachLine(_tempPath, maxTotalsLine, _totals);
+  }
+}
+
+bool CompactionAudit::add(const CompactionPass& pass) {
+  if (pass.getDroppedTotal() == 0) {
+    return true;
+  }
+  for (uint8_t i = COMPACT_BURST; i < COMPACT_VERDICTS; i++) {
+    _totals[i] += pass.getDropped((CompactVerdict)i);
+  }
+
+  char line[40];
+  int len = snprintf(line, sizeof(line), "%lu %lu %lu", (unsigned long)_totals[COMPACT_BURST],
+                     (unsigned long)_totals[COMPACT_REDUNDANT], (unsigned long)_totals[COMPACT_DAY]);
+  _storage.remove(_tempPath);
+  if (!_storage.appendLine(_tempPath, line, (size_t)len)) {
+    return false;
+  }
+  if (!_storage.rename(_tempPath, _path)) {
+    // Filesystems that refuse to rename over an existing file
+    _storage.remove(_path);
+    if (!_storage.rename(_tempPath, _path)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint32_t CompactionAudit::getTotal() const {
+  uint32_t total = 0;
+  for (uint8_t i = COMPACT_BURST; i < COMPACT_VERDICTS; i++) {
+    total += _totals[i];
+  }
+  return total;
+}
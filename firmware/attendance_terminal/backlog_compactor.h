@@ -0,0 +1,114 @@
+/*
+ * Offline backlog compaction for Attendee Attendance Terminal v2.0
+ *
+ * While offline people tap several times, and CARD_READ_DELAY only blocks
+ * re-reads within 2 s, so an outage backlog is full of repeats the backend
+ * would collapse anyway. Before the backlog is sealed or uploaded, a
+ * compaction pass drops:
+ *
+ *   burst      the same card, the same kind of scan (toggle, entry or exit)
+ *              within burstSeconds of the last kept scan of that card
+ *   redundant  an entry or exit repeating the card's last kept directed
+ *              scan of the day: the backend answers it "unchanged"
+ *   day        scans of a card that already has daySessions entry/exit
+ *              pairs kept that day (0 = no limit: the backend records any
+ *              number of sessions)
+ *
+ * All rules compare with scans kept on the same day, and only kept scans
+ * update the table, so running a pass again over its own output drops
+ * nothing more. Each pass therefore starts from an empty table and needs no
+ * state across reboots. Beyond COMPACT_CARDS_MAX cards in one pass the card
+ * kept longest ago is forgotten, which can only keep more, never drop more.
+ * Records without a card tag or a parsable timestamp are always kept.
+ *
+ * CompactionAudit keeps the totals dropped per rule on storage, so the
+ * count survives reboots and can be reported with every heartbeat.
+ *
+ * Portable (no Arduino includes); storage comes from the HAL.
+ */
+
+#ifndef BACKLOG_COMPACTOR_H
+#define BACKLOG_COMPACTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "attendance_core.h"
+#include "terminal_hal.h"
+
+#define COMPACT_CARDS_MAX      64       // Cards tracked in one pass
+
+enum CompactVerdict {
+  COMPACT_KEEP,
+  COMPACT_BURST,
+  COMPACT_REDUNDANT,
+  COMPACT_DAY,
+  COMPACT_VERDICTS
+};
+
+class BacklogCompactor {
+public:
+  BacklogCompactor(uint32_t burstSeconds, uint8_t daySessions);
+
+  void reset();                         // Start of a pass
+
+  // Decides on the next record in backlog order; a kept record becomes the
+  // reference for the card's later ones
+  CompactVerdict check(const char* record, size_t length);
+
+private:
+  struct Card {
+    char tag[ATTENDANCE_UID_HEX_SIZE];
+    uint32_t lastTime;                  // Seconds since 2000-01-01
+    uint8_t lastKind;                   // 0 toggle, 1 entry, 2 exit
+    uint8_t lastDirection;              // Last kept entry/exit today, 0 none
+    uint16_t day;                       // Days since 2000-01-01
+    uint16_t dayScans;                  // Kept scans that day
+  };
+
+  Card* find(const char* tag);
+
+  uint32_t _burstSeconds;
+  uint8_t _daySessions;
+  Card _cards[COMPACT_CARDS_MAX];
+  uint8_t _used;
+};
+
+// OfflineQueue::drain() pass that removes what the compactor drops; the
+// other records are written back in order
+class CompactionPass : public RecordUploader {
+public:
+  explicit CompactionPass(BacklogCompactor& compactor);
+
+  bool upload(const char* record, size_t length) override;
+
+  uint32_t getDropped(CompactVerdict verdict) const { return _dropped[verdict]; }
+  uint32_t getDroppedTotal() const;
+
+private:
+  BacklogCompactor& _compactor;
+  uint32_t _dropped[COMPACT_VERDICTS];
+};
+
+// Dry run over a backlog file: records a pass would drop. Lets the caller
+// skip rewriting a backlog that has nothing to drop.
+uint32_t countCompactable(TerminalStorage& storage, const char* path, BacklogCompactor& compactor);
+
+// Totals dropped per rule, one line on storage ("burst redundant day")
+class CompactionAudit {
+public:
+  CompactionAudit(TerminalStorage& storage, const char* path, const char* tempPath);
+
+  void load();
+  bool add(const CompactionPass& pass);
+
+  uint32_t get(CompactVerdict verdict) const { return _totals[verdict]; }
+  uint32_t getTotal() const;
+
+private:
+  TerminalStorage& _storage;
+  const char* _path;
+  const char* _tempPath;
+  uint32_t _totals[COMPACT_VERDICTS];
+};
+
+#endif // BACKLOG_COMPACTOR_H
@@ -0,0 +1,540 @@
+/*
+ * CoAP transport for Attendee Attendance Terminal v2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "coap_transport.h"
+
+#define COAP_VERSION        1
+#define COAP_TYPE_CON       0
+#define COAP_TYPE_NON       1
+#define COAP_TYPE_ACK       2
+#define COAP_TYPE_RST       3
+#define COAP_CODE_EMPTY     0x00
+#define COAP_CODE_POST      0x02
+#define COAP_OPTION_URI_PATH        11
+#define COAP_OPTION_CONTENT_FORMAT  12
+#define COAP_OPTION_MAX_AGE         14
+#define COAP_FORMAT_JSON    50
+#define COAP_TOKEN_SIZE     4
+
+// ========================================
+// SHA-256 / HMAC (FIPS 180-4, RFC 2104)
+// ========================================
+
+static const uint32_t SHA256_K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+struct Sha256 {
+  uint32_t state[8];
+  uint64_t length;
+  uint8_t block[64];
+  size_t used;
+};
+
+static inline uint32_t rotr(uint32_t x, uint8_t n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+static void sha256Compress(Sha256& ctx, const uint8_t* block) {
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++) {
+    w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+           ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+  }
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32_t a = ctx.state[0], b = ctx.state[1], c = ctx.state[2], d = ctx.state[3];
+  uint32_t e = ctx.state[4], f = ctx.state[5], g = ctx.state[6], h = ctx.state[7];
+  for (int i = 0; i < 64; i++) {
+    uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+    uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+  ctx.state[0] += a; ctx.state[1] += b; ctx.state[2] += c; ctx.state[3] += d;
+  ctx.state[4] += e; ctx.state[5] += f; ctx.state[6] += g; ctx.state[7] += h;
+}
+
+static void sha256Init(Sha256& ctx) {
+  static const uint32_t initial[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+  memcpy(ctx.state, initial, sizeof(initial));
+  ctx.length = 0;
+  ctx.used = 0;
+}
+
+static void sha256Update(Sha256& ctx, const uint8_t* data, size_t length) {
+  ctx.length += length;
+  while (length > 0) {
+    size_t take = 64 - ctx.used;
+    if (take > length) take = length;
+    memcpy(ctx.block + ctx.used, data, take);
+    ctx.used += take;
+    data += take;
+    length -= take;
+    if (ctx.used == 64) {
+      sha256Compress(ctx, ctx.block);
+      ctx.used = 0;
+    }
+  }
+}
+
+static void sha256Final(Sha256& ctx, uint8_t out[32]) {
+  uint64_t bits = ctx.length * 8;
+  uint8_t pad = 0x80;
+  sha256Update(ctx, &pad, 1);
+  pad = 0;
+  while (ctx.used != 56) {
+    sha256Update(ctx, &pad, 1);
+  }
+  uint8_t lengthBytes[8];
+  for (int i = 0; i < 8; i++) {
+    lengthBytes[i] = (uint8_t)(bits >> (56 - i * 8));
+  }
+  sha256Update(ctx, lengthBytes, 8);
+  for (int i = 0; i < 8; i++) {
+    out[i * 4] = (uint8_t)(ctx.state[i] >> 24);
+    out[i * 4 + 1] = (uint8_t)(ctx.state[i] >> 16);
+    out[i * 4 + 2] = (uint8_t)(ctx.state[i] >> 8);
+    out[i * 4 + 3] = (uint8_t)ctx.state[i];
+  }
+}
+
+// HMAC over head || tail, so a message can be authenticated around its
+// MAC option without copying it
+static void hmacSha256Parts(const uint8_t* key, size_t keyLength, const uint8_t* head, size_t headLength,
+                            const uint8_t* tail, size_t tailLength, uint8_t out[32]) {
+  uint8_t pad[64];
+  uint8_t keyDigest[32];
+  Sha256 ctx;
+
+  if (keyLength > 64) {
+    sha256Init(ctx);
+    sha256Update(ctx, key, keyLength);
+    sha256Final(ctx, keyDigest);
+    key = keyDigest;
+    keyLength = 32;
+  }
+
+  memset(pad, 0x36, sizeof(pad));
+  for (size_t i = 0; i < keyLength; i++) pad[i] ^= key[i];
+  sha256Init(ctx);
+  sha256Update(ctx, pad, sizeof(pad));
+  sha256Update(ctx, head, headLength);
+  sha256Update(ctx, tail, tailLength);
+  uint8_t inner[32];
+  sha256Final(ctx, inner);
+
+  memset(pad, 0x5c, sizeof(pad));
+  for (size_t i = 0; i < keyLength; i++) pad[i] ^= key[i];
+  sha256Init(ctx);
+  sha256Update(ctx, pad, sizeof(pad));
+  sha256Update(ctx, inner, sizeof(inner));
+  sha256Final(ctx, out);
+}
+
+void hmacSha256(const uint8_t* key, size_t keyLength, const uint8_t* data, size_t length,
+                uint8_t out[32]) {
+  hmacSha256Parts(key, keyLength, data, length, NULL, 0, out);
+}
+
+// ========================================
+// MESSAGE ENCODING
+// ========================================
+
+bool isCoapUrl(const char* url) {
+  return url && strncmp(url, "coap://", 7) == 0;
+}
+
+static size_t encodeOptionHeader(uint16_t delta, size_t length, uint8_t* out) {
+  uint8_t* p = out + 1;
+  uint8_t deltaNibble, lengthNibble;
+
+  if (delta < 13) {
+    deltaNibble = (uint8_t)delta;
+  } else if (delta < 269) {
+    deltaNibble = 13;
+    *p++ = (uint8_t)(delta - 13);
+  } else {
+    deltaNibble = 14;
+    *p++ = (uint8_t)((delta - 269) >> 8);
+    *p++ = (uint8_t)(delta - 269);
+  }
+
+  if (length < 13) {
+    lengthNibble = (uint8_t)length;
+  } else {
+    lengthNibble = 13;
+    *p++ = (uint8_t)(length - 13);   // Options here are always < 269 bytes
+  }
+
+  out[0] = (uint8_t)((deltaNibble << 4) | lengthNibble);
+  return p - out;
+}
+
+static bool appendOption(uint8_t* out, size_t outSize, size_t& pos, uint16_t& last,
+                         uint16_t number, const uint8_t* value, size_t length) {
+  if (length >= 269 || pos + 5 + length > outSize) {
+    return false;
+  }
+  pos += encodeOptionHeader(number - last, length, out + pos);
+  memcpy(out + pos, value, length);
+  pos += length;
+  last = number;
+  return true;
+}
+
+// MAC over the message without the MAC option. It has the highest option
+// number, so it is always encoded last and removing it leaves the rest of
+// the encoding unchanged.
+static void computeMac(const char* psk, const uint8_t* head, size_t headLength,
+                       const uint8_t* tail, size_t tailLength, uint8_t mac[COAP_MAC_SIZE]) {
+  uint8_t digest[32];
+  hmacSha256Parts((const uint8_t*)psk, strlen(psk), head, headLength, tail, tailLength, digest);
+  memcpy(mac, digest, COAP_MAC_SIZE);
+}
+
+// Append the MAC option after the last option and before the payload
+static size_t sealMessage(const char* psk, uint8_t* out, size_t outSize, size_t optionsEnd,
+                          uint16_t lastOption, size_t length) {
+  uint8_t mac[COAP_MAC_SIZE];
+  computeMac(psk, out, optionsEnd, out + optionsEnd, length - optionsEnd, mac);
+
+  uint8_t header[4];
+  size_t headerLength = encodeOptionHeader(COAP_OPTION_MAC - lastOption, COAP_MAC_SIZE, header);
+  size_t added = headerLength + COAP_MAC_SIZE;
+  if (length + added > outSize) {
+    return 0;
+  }
+  memmove(out + optionsEnd + added, out + optionsEnd, length - optionsEnd);
+  memcpy(out + optionsEnd, header, headerLength);
+  memcpy(out + optionsEnd + headerLength, mac, COAP_MAC_SIZE);
+  return length + added;
+}
+
+struct CoapMessage {
+  uint8_t type;
+  uint8_t code;
+  uint16_t messageId;
+  uint8_t token[8];
+  uint8_t tokenLength;
+  bool hasMaxAge;
+  uint32_t maxAge;
+  const uint8_t* payload;
+  size_t payloadLength;
+};
+
+static bool decodeMessage(const char* psk, const uint8_t* data, size_t length, CoapMessage& out) {
+  if (length < 4 || (data[0] >> 6) != COAP_VERSION) {
+    return false;
+  }
+  out.type = (data[0] >> 4) & 0x03;
+  out.tokenLength = data[0] & 0x0f;
+  out.code = data[1];
+  out.messageId = (uint16_t)((data[2] << 8) | data[3]);
+  out.hasMaxAge = false;
+  out.maxAge = 0;
+  out.payload = NULL;
+  out.payloadLength = 0;
+  if (out.tokenLength > 8 || 4u + out.tokenLength > length) {
+    return false;
+  }
+  memcpy(out.token, data + 4, out.tokenLength);
+
+  size_t pos = 4 + out.tokenLength;
+  uint32_t number = 0;
+  size_t macStart = 0, macEnd = 0;
+  while (pos < length && data[pos] != 0xff) {
+    size_t optionStart = pos;
+    uint32_t delta = data[pos] >> 4;
+    uint32_t optionLength = data[pos] & 0x0f;
+    pos++;
+    if (delta == 15 || optionLength == 15) {
+      return false;
+    }
+    if (delta == 13) {
+      if (pos >= length) return false;
+      delta = 13 + data[pos++];
+    } else if (delta == 14) {
+      if (pos + 1 >= length) return false;
+      delta = 269 + ((uint32_t)data[pos] << 8) + data[pos + 1];
+      pos += 2;
+    }
+    if (optionLength == 13) {
+      if (pos >= length) return false;
+      optionLength = 13 + data[pos++];
+    } else if (optionLength == 14) {
+      if (pos + 1 >= length) return false;
+      optionLength = 269 + ((uint32_t)data[pos] << 8) + data[pos + 1];
+      pos += 2;
+    }
+    if (pos + optionLength > length) {
+      return false;
+    }
+
+    number += delta;
+    if (number == COAP_OPTION_MAX_AGE && optionLength <= 4) {
+      out.hasMaxAge = true;
+      for (uint32_t i = 0; i < optionLength; i++) {
+        out.maxAge = (out.maxAge << 8) | data[pos + i];
+      }
+    } else if (number == COAP_OPTION_MAC && optionLength == COAP_MAC_SIZE) {
+      macStart = optionStart;
+      macEnd = pos + optionLength;
+    }
+    pos += optionLength;
+  }
+  if (pos < length) {
+    pos++;                            // Payload marker
+    out.payload = data + pos;
+    out.payloadLength = length - pos;
+  }
+
+  // Unauthenticated messages are dropped as if never received
+  if (macEnd == 0) {
+    return false;
+  }
+  uint8_t expected[COAP_MAC_SIZE];
+  computeMac(psk, data, macStart, data + macEnd, length - macEnd, expected);
+  uint8_t diff = 0;
+  for (int i = 0; i < COAP_MAC_SIZE; i++) {
+    diff |= expected[i] ^ data[macEnd - COAP_MAC_SIZE + i];
+  }
+  return diff == 0;
+}
+
+static int toHttpStatus(uint8_t code) {
+  int codeClass = code >> 5;
+  int detail = code & 0x1f;
+  if (codeClass == 2) {
+    return detail == 1 ? 201 : 200;   // 2.01 Created; 2.04 Changed/2.05 Content are plain success
+  }
+  return codeClass * 100 + detail;    // 4.00 -> 400, 4.29 -> 429, 5.03 -> 503
+}
+
+// ========================================
+// TRANSPORT
+// ========================================
+
+CoapTransport::CoapTransport(TerminalDatagram& socket, TerminalClock& clock, const char* psk)
+  : _socket(socket), _clock(clock), _psk(psk), _port(0), _open(false), _messageId(0),
+    _tokenCounter(0), _ackTimeoutMs(750), _maxRetransmit(2), _totalTimeoutMs(5000),
+    _retryAfterMs(0), _retransmits(0) {
+  _host[0] = 0;
+}
+
+void CoapTransport::setRetransmission(uint32_t ackTimeoutMs, uint8_t maxRetransmit, uint32_t totalTimeoutMs) {
+  _ackTimeoutMs = ackTimeoutMs ? ackTimeoutMs : 1;
+  _maxRetransmit = maxRetransmit;
+  _totalTimeoutMs = totalTimeoutMs;
+}
+
+bool CoapTransport::openTarget(const char* url, const char** path) {
+  if (!isCoapUrl(url)) {
+    return false;
+  }
+  const char* hostStart = url + 7;
+  const char* pathStart = strchr(hostStart, '/');
+  const char* authorityEnd = pathStart ? pathStart : hostStart + strlen(hostStart);
+  const char* colon = (const char*)memchr(hostStart, ':', authorityEnd - hostStart);
+  const char* hostEnd = colon ? colon : authorityEnd;
+
+  size_t hostLength = hostEnd - hostStart;
+  if (hostLength == 0 || hostLength >= sizeof(_host)) {
+    return false;
+  }
+  uint16_t port = COAP_DEFAULT_PORT;
+  if (colon) {
+    unsigned long parsed = strtoul(colon + 1, NULL, 10);
+    if (parsed == 0 || parsed > 65535) {
+      return false;
+    }
+    port = (uint16_t)parsed;
+  }
+  *path = pathStart ? pathStart : "/";
+
+  // Keep the socket while the backend stays the same
+  if (_open && port == _port && strlen(_host) == hostLength && memcmp(_host, hostStart, hostLength) == 0) {
+    return true;
+  }
+  memcpy(_host, hostStart, hostLength);
+  _host[hostLength] = 0;
+  _port = port;
+  _open = _socket.open(_host, _port);
+  return _open;
+}
+
+size_t CoapTransport::encodeRequest(const char* path, const char* body, size_t len, uint16_t messageId,
+                                    const uint8_t* token, uint8_t* out, size_t outSize) {
+  out[0] = (uint8_t)((COAP_VERSION << 6) | (COAP_TYPE_CON << 4) | COAP_TOKEN_SIZE);
+  out[1] = COAP_CODE_POST;
+  out[2] = (uint8_t)(messageId >> 8);
+  out[3] = (uint8_t)messageId;
+  memcpy(out + 4, token, COAP_TOKEN_SIZE);
+  size_t pos = 4 + COAP_TOKEN_SIZE;
+  uint16_t last = 0;
+
+  // One Uri-Path option per segment
+  const char* segment = path;
+  while (*segment) {
+    while (*segment == '/') segment++;
+    const char* end = segment;
+    while (*end && *end != '/' && *end != '?') end++;
+    if (end > segment &&
+        !appendOption(out, outSize, pos, last, COAP_OPTION_URI_PATH, (const uint8_t*)segment, end - segment)) {
+      return 0;
+    }
+    if (*end == '?') break;
+    segment = end;
+  }
+
+  uint8_t format = COAP_FORMAT_JSON;
+  if (!appendOption(out, outSize, pos, last, COAP_OPTION_CONTENT_FORMAT, &format, 1)) {
+    return 0;
+  }
+
+  size_t optionsEnd = pos;
+  if (len > 0) {
+    if (pos + 1 + len > outSize) {
+      return 0;
+    }
+    out[pos++] = 0xff;
+    memcpy(out + pos, body, len);
+    pos += len;
+  }
+  return sealMessage(_psk, out, outSize, optionsEnd, last, pos);
+}
+
+int CoapTransport::postJson(const char* url, const char* body, size_t len,
+                            char* response, size_t responseSize) {
+  _retryAfterMs = 0;
+  if (response && responseSize > 0) {
+    response[0] = 0;
+  }
+
+  const char* path;
+  if (!openTarget(url, &path)) {
+    return COAP_ERROR_CONNECT;
+  }
+
+  uint8_t request[COAP_MAX_MESSAGE];
+  uint16_t messageId = ++_messageId;
+  uint32_t tokenValue = ++_tokenCounter * 2654435761UL;
+  uint8_t token[COAP_TOKEN_SIZE] = {
+    (uint8_t)(tokenValue >> 24), (uint8_t)(tokenValue >> 16), (uint8_t)(tokenValue >> 8), (uint8_t)tokenValue
+  };
+  size_t requestLength = encodeRequest(path, body, len, messageId, token, request, sizeof(request));
+  if (requestLength == 0) {
+    return COAP_ERROR_SEND;
+  }
+  if (!_socket.send(request, requestLength)) {
+    _open = false;
+    return COAP_ERROR_SEND;
+  }
+
+  uint32_t started = _clock.millis();
+  uint32_t timeout = _ackTimeoutMs;
+  uint32_t lastSend = started;
+  uint8_t retransmits = 0;
+  bool acknowledged = false;        // Empty ACK seen: separate response follows
+  uint8_t reply[COAP_MAX_MESSAGE];
+
+  while (true) {
+    uint32_t now = _clock.millis();
+    uint32_t elapsed = now - started;
+    if (elapsed >= _totalTimeoutMs) {
+      return COAP_ERROR_TIMEOUT;
+    }
+
+    uint32_t wait = _totalTimeoutMs - elapsed;
+    if (!acknowledged) {
+      uint32_t untilResend = now - lastSend >= timeout ? 0 : timeout - (now - lastSend);
+      if (untilResend < wait) wait = untilResend;
+    }
+
+    int received = wait ? _socket.receive(reply, sizeof(reply), wait) : 0;
+    if (received < 0) {
+      _open = false;                // ICMP unreachable and the like
+      return COAP_ERROR_CONNECT;
+    }
+    if (received == 0) {
+      if (!acknowledged && _clock.millis() - lastSend >= timeout) {
+        if (retransmits >= _maxRetransmit) {
+          // Out of retransmissions; a late ACK may still arrive within the total budget
+          acknowledged = true;
+          continue;
+        }
+        if (!_socket.send(request, requestLength)) {
+          _open = false;
+          return COAP_ERROR_SEND;
+        }
+        retransmits++;
+        _retransmits++;
+        lastSend = _clock.millis();
+        timeout *= 2;
+      }
+      continue;
+    }
+
+    CoapMessage message;
+    if (!decodeMessage(_psk, reply, (size_t)received, message)) {
+      continue;
+    }
+
+    if (message.type == COAP_TYPE_RST && message.messageId == messageId) {
+      return COAP_ERROR_CONNECT;
+    }
+    if (message.type == COAP_TYPE_ACK && message.messageId == messageId && message.code == COAP_CODE_EMPTY) {
+      acknowledged = true;
+      continue;
+    }
+
+    bool tokenMatches = message.tokenLength == COAP_TOKEN_SIZE &&
+                        memcmp(message.token, token, COAP_TOKEN_SIZE) == 0;
+    bool isResponse = (message.type == COAP_TYPE_ACK && message.messageId == messageId) ||
+                      message.type == COAP_TYPE_CON || message.type == COAP_TYPE_NON;
+    if (!tokenMatches || !isResponse || (message.code >> 5) < 2) {
+      continue;
+    }
+
+    if (message.type == COAP_TYPE_CON) {
+      // Separate response: acknowledge it so the server stops resending
+      uint8_t ack[4 + 4 + COAP_MAC_SIZE];
+      ack[0] = (uint8_t)((COAP_VERSION << 6) | (COAP_TYPE_ACK << 4));
+      ack[1] = COAP_CODE_EMPTY;
+      ack[2] = (uint8_t)(message.messageId >> 8);
+      ack[3] = (uint8_t)message.messageId;
+      size_t ackLength = sealMessage(_psk, ack, sizeof(ack), 4, 0, 4);
+      if (ackLength > 0) {
+        _socket.send(ack, ackLength);
+      }
+    }
+
+    if (response && responseSize > 0) {
+      size_t copy = message.payloadLength < responseSize - 1 ? message.payloadLength : responseSize - 1;
+      memcpy(response, message.payload, copy);
+      response[copy] = 0;
+    }
+
+    int status = toHttpStatus(message.code);
+    if ((status == 429 || status == 503) && message.hasMaxAge) {
+      _retryAfterMs = message.maxAge > 86400 ? 86400000UL : message.maxAge * 1000UL;
+    }
+    return status;
+  }
+}
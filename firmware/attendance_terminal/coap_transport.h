@@ -0,0 +1,79 @@
+/*
+ * CoAP transport for Attendee Attendance Terminal v2.0
+ *
+ * Confirmable CoAP (RFC 7252) POSTs over UDP behind the same
+ * TerminalTransport interface as the HTTP client: no connection setup,
+ * no headers and no TLS session, so a scan event is one ~120 byte datagram
+ * and its piggybacked ACK. Requests and responses carry a truncated
+ * HMAC-SHA256 over the whole message under a pre-shared key, so a forged
+ * or altered ACK cannot make the terminal drop a record.
+ *
+ * Backend URLs of the form coap://host[:port]/path select it; the stand-in
+ * server (backend/coap-gateway.js) answers locally or forwards to the
+ * HTTP backend.
+ *
+ * Portable (no Arduino includes); the datagram socket comes from the HAL.
+ */
+
+#ifndef COAP_TRANSPORT_H
+#define COAP_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "terminal_hal.h"
+
+#define COAP_DEFAULT_PORT   5683
+#define COAP_MAX_MESSAGE    512         // Request or response datagram
+#define COAP_OPTION_MAC     65001       // Experimental range, critical: servers must understand it
+#define COAP_MAC_SIZE       8           // Truncated HMAC-SHA256
+
+// Transport failures, as SocketTransport reports them
+#define COAP_ERROR_CONNECT   -1         // Bad URL or socket
+#define COAP_ERROR_SEND      -2
+#define COAP_ERROR_MALFORMED -3         // Undecodable or unauthenticated reply
+#define COAP_ERROR_TIMEOUT   -11
+
+void hmacSha256(const uint8_t* key, size_t keyLength, const uint8_t* data, size_t length,
+                uint8_t out[32]);
+
+bool isCoapUrl(const char* url);
+
+class CoapTransport : public TerminalTransport {
+public:
+  // psk must outlive the transport
+  CoapTransport(TerminalDatagram& socket, TerminalClock& clock, const char* psk);
+
+  // ACK_TIMEOUT and MAX_RETRANSMIT of RFC 7252, tightened for interactive
+  // use; the exchange gives up after totalTimeoutMs either way
+  void setRetransmission(uint32_t ackTimeoutMs, uint8_t maxRetransmit, uint32_t totalTimeoutMs);
+  void setSeed(uint32_t seed) { _messageId = (uint16_t)seed; _tokenCounter = seed; }
+
+  // Maps the CoAP response code onto the HTTP status the callers already
+  // handle (2.01 -> 201, 4.04 -> 404, 5.03 -> 503, ...)
+  int postJson(const char* url, const char* body, size_t len,
+               char* response, size_t responseSize) override;
+  uint32_t getLastRetryAfterMs() const override { return _retryAfterMs; }
+
+  uint32_t getRetransmitCount() const { return _retransmits; }
+
+private:
+  size_t encodeRequest(const char* path, const char* body, size_t len, uint16_t messageId,
+                       const uint8_t* token, uint8_t* out, size_t outSize);
+  bool openTarget(const char* url, const char** path);
+
+  TerminalDatagram& _socket;
+  TerminalClock& _clock;
+  const char* _psk;
+  char _host[64];
+  uint16_t _port;
+  bool _open;
+  uint16_t _messageId;
+  uint32_t _tokenCounter;
+  uint32_t _ackTimeoutMs;
+  uint8_t _maxRetransmit;
+  uint32_t _totalTimeoutMs;
+  uint32_t _retryAfterMs;
+  uint32_t _retransmits;
+};
+
+#endif // COAP_TRANSPORT_H
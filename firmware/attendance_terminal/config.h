@@ -17,6 +17,12 @@
 // RFID RC522 Pins (SPI Interface)
 #define RFID_SS_PIN     15    // D8 - SPI SS (Slave Select)
 #define RFID_RST_PIN    0     // D3 - Reset pin (optional, can be -1 if not used)
+#define RFID_IRQ_PIN    -1    // IRQ line (optional, -1 = adaptive polling; e.g. 3/RX if serial input is unused)
+
+// Second reader on the same SPI bus (entry on RFID_SS_PIN, exit on RFID_SS_PIN_2).
+// With two readers the IRQ line is not used; both are polled in turn.
+#define RFID_READER_COUNT 1           // 1 = single reader, backend toggles entry/exit; 2 = entry + exit
+#define RFID_SS_PIN_2   3     // RX - SS of the exit reader (serial input unavailable)
 
 // I2C Pins (LCD & RTC) - MOVED TO AVOID SPI CONFLICT
 #define SDA_PIN         4     // D2 - I2C SDA (was conflicting with MISO)
@@ -76,6 +82,41 @@
 #define IST_OFFSET   (5*3600 + 30*60) // IST offset in seconds
 #define DAYLIGHT_OFFSET_SEC 0       // 24 hours in seconds
 
+// CoAP transport, selected by a coap://host[:port]/api backend URL (coap_transport.cpp)
+#define COAP_PSK "attendee-coap-psk"    // Shared with backend/coap-gateway.js (COAP_PSK); change per site
+#define COAP_ACK_TIMEOUT_MS 750         // First retransmit; doubles on each retry
+#define COAP_MAX_RETRANSMIT 2           // Retransmissions before giving up on the ACK
+#define COAP_EXCHANGE_TIMEOUT_MS 5000   // Whole request/response budget, including a separate response
+
+// MQTT transport, selected by an mqtt[s]://host[:port]/prefix backend URL (mqtt_transport.cpp)
+#define MQTT_USERNAME ""                // Broker login; empty for none
+#define MQTT_PASSWORD ""
+#define MQTT_KEEPALIVE_S 60             // PINGREQ at half this when idle
+#define MQTT_ACK_TIMEOUT_MS 5000        // CONNACK/SUBACK/PUBACK wait before dropping the connection
+#define MQTT_REPLY_TIMEOUT_MS 1500      // Wait for the bridge's reply to a live scan; 202 after that
+#define MQTT_RECONNECT_MIN_MS 2000      // Reconnect backoff, doubling up to the max
+#define MQTT_RECONNECT_MAX_MS 60000
+
+// ========================================
+// LOCAL API CONFIGURATION
+// ========================================
+
+// Live event stream (GET /api/events, Server-Sent Events)
+#define EVENT_STREAM_MAX_CLIENTS    2       // Concurrent subscribers (each holds a TCP socket)
+#define EVENT_STREAM_CLIENT_BUFFER  1024    // Pending bytes per subscriber before events are dropped
+#define EVENT_STREAM_MAX_FRAME      256     // Largest single SSE frame
+#define EVENT_STREAM_KEEPALIVE_MS   15000   // Comment ping on idle streams
+
+// Offline backlog export (GET /api/logs/export)
+#define LOG_EXPORT_DEFAULT_LIMIT    200     // Records per page when no limit is given
+#define LOG_EXPORT_MAX_LIMIT        1000    // Hard cap on records per request
+#define LOG_EXPORT_LINE_MAX         256     // Longest offline record line accepted
+#define LOG_EXPORT_CHUNK_SIZE       512     // Output batching before each chunk is sent
+
+// Attendance history queries (GET /api/history)
+#define HISTORY_QUERY_DEFAULT_LIMIT 200     // Entries per response when no limit is given
+#define HISTORY_QUERY_MAX_LIMIT     1000    // Hard cap on entries per request
+
 // ========================================
 // TIMING CONFIGURATION
 // ========================================
@@ -88,6 +129,36 @@
 #define BUZZER_ERROR_DURATION 500       // Error beep duration
 #define BUZZER_OFFLINE_DURATION 300     // Offline beep duration
 
+// Fleet scheduling: spread heartbeats/syncs so terminals that boot together
+// do not hit the backend in lockstep (sync_pacing.cpp)
+#define SCHEDULE_JITTER_PERCENT 20      // +/- spread applied to every heartbeat/sync interval
+#define SYNC_STARTUP_SPREAD_MS 60000    // First sync after boot/reconnect lands in [0, this)
+#define HEARTBEAT_HINT_MIN_MS 60000     // Clamp for server "nextHeartbeatIn" hints
+#define HEARTBEAT_HINT_MAX_MS 3600000
+
+// Backend endpoint list: /health probing and sticky selection (endpoint_selector.cpp)
+#define BACKEND_PROBE_INTERVAL_MS 60000 // Per endpoint; unhealthy ones every quarter of this
+#define BACKEND_PROBE_TIMEOUT_MS 2000
+#define BACKEND_PROBE_QUIET_MS 10000    // Probe only this long after the last card activity
+#define BACKEND_STICKY_PERCENT 30       // A faster endpoint must win by this much...
+#define BACKEND_STICKY_MIN_MS 20        // ...and by at least this many ms
+#define BACKEND_FAILOVER_MIN_MS 1500    // Timeout floor for a scan retried on the next endpoint
+
+// Roster delta sync, checked after each heartbeat (roster.cpp)
+#define ROSTER_SYNC_TIMEOUT_MS 5000     // Per roster page request
+
+// AIMD pacing of offline backlog drains on 429/503
+#define SYNC_BATCH_INITIAL 10           // Records per sync pass to start with
+#define SYNC_BATCH_MAX 100              // Upper bound after additive increase
+#define SYNC_BATCH_INCREASE 5           // Added after each clean full pass
+#define SYNC_BACKOFF_MIN_MS 5000        // First backoff after throttling
+#define SYNC_BACKOFF_MAX_MS 600000      // Backoff ceiling (also caps Retry-After)
+#define SYNC_CONTINUE_DELAY_MS 2000     // Gap between passes while backlog remains
+#define UPLOAD_WINDOW 4                 // Backlog records in flight per sync pass (max UPLOAD_WINDOW_MAX)
+#define UPLOAD_WINDOW_TLS 1             // Same over https; each TLS session needs ~5 KB of its own buffers
+#define UPLOAD_TLS_MIN_HEAP 12000       // Free heap required to open another TLS upload slot
+#define UPLOAD_TIMEOUT_MS 3000          // Per-record timeout while syncing
+
 // ========================================
 // AUDIO FEEDBACK CONFIGURATION - ENHANCED
 // ========================================
@@ -125,7 +196,8 @@
 // See archived_features.h for the complete admin menu implementation
 // ========================================
 
-// Maximum number of offline logs to store
+// Maximum number of offline logs to store uncompressed (older records are
+// sealed into compressed segments, see OFFLINE_SEGMENTS_MAX)
 #define MAX_OFFLINE_LOGS 1000
 
 // RFID read timeout and retry settings
@@ -138,9 +210,24 @@
 #define RFID_GAIN_MIN       0x01        // Minimum antenna gain
 #define RFID_DEFAULT_GAIN   RFID_GAIN_AVG
 
-// Periodic RFID maintenance to recover from reader stalls
-#define RFID_MAINTENANCE_INTERVAL_MS (5UL * 60UL * 1000UL)   // Re-init every 5 minutes
-#define RFID_REINIT_IF_IDLE_MS       (15UL * 60UL * 1000UL)  // If idle >15 minutes, force re-init
+// Adaptive gain: stepped between RFID_GAIN_MIN and RFID_GAIN_MAX for the
+// best first-tap read rate (rfid_tuning.cpp)
+#define RFID_TUNE_WINDOW_MS 600000      // Statistics window per gain decision
+#define RFID_TUNE_MIN_TAPS 20           // Taps a window needs before it counts
+#define RFID_TUNE_TARGET_PERCENT 95     // First-tap success rate that needs no tuning
+#define RFID_TAP_GAP_MS 1500            // Detects closer than this are one tap
+
+// Card detection cadence (rfid_poller.cpp): fast right after activity,
+// backing off to the idle interval; also how often an IRQ-mode REQA is re-armed
+#define RFID_POLL_FAST_MS 25            // Poll interval while cards are arriving
+#define RFID_POLL_IDLE_MS 200           // Poll interval once the door is quiet
+#define RFID_POLL_FAST_WINDOW_MS 15000  // Quiet time before each backoff step
+
+// RFID health probe: a few register reads in idle slots; the reader is only
+// reset when the probe (or a run of read failures) shows it has stalled
+#define RFID_PROBE_INTERVAL_MS 30000    // Time between liveness probes
+#define RFID_PROBE_QUIET_MS 3000        // Skip the probe this soon after card activity
+#define RFID_RESET_READ_FAILURES 5      // Consecutive failed UID reads that force a reset
 
 // ========================================
 // STORAGE CONFIGURATION - LITTLEFS ONLY
@@ -159,6 +246,56 @@
 
 // LittleFS file paths - Primary storage system
 #define OFFLINE_LOGS_FILE "/offline_logs.txt"
+#define OFFLINE_LOGS_TEMP_FILE "/offline_logs.tmp"   // Records kept back during a sync pass
+#define SCAN_SEQUENCE_FILE "/scan_seq.txt"            // Highest reserved scan sequence number
+#define SCAN_SEQUENCE_TEMP_FILE "/scan_seq.tmp"
+#define SCAN_SEQUENCE_BLOCK 256         // Sequence numbers reserved per flash write
+
+// Offline backlog group commit: records are staged in RAM and appended in one
+// write once OFFLINE_COMMIT_MAX_BYTES are staged or the oldest is
+// OFFLINE_COMMIT_MAX_AGE_MS old. The age is the most a power cut can lose;
+// 0 bytes writes every record through as before.
+#define OFFLINE_COMMIT_MAX_BYTES 768    // Up to OFFLINE_COMMIT_BUFFER_SIZE (~4 records)
+#define OFFLINE_COMMIT_MAX_AGE_MS 10000 // Data-loss window on power failure
+
+// Compressed offline segments (offline_segments.cpp): once the JSON backlog
+// holds OFFLINE_SEGMENT_SEAL_RECORDS records the oldest are sealed into a
+// ~1 KB segment (~7 bytes a record instead of ~120). Segments are packed
+// into files of one LittleFS block and uploaded before the JSON backlog.
+#define OFFLINE_SEGMENT_PREFIX "/seg_"                // + 5-digit number + ".bin"
+#define OFFLINE_SEGMENTS_FILE "/segments.txt"         // Oldest segment file and offset
+#define OFFLINE_SEGMENTS_TEMP_FILE "/segments.tmp"
+#define OFFLINE_SEGMENT_SEAL_RECORDS 150  // Backlog records that trigger sealing
+#define OFFLINE_SEGMENT_FILE_BYTES 7680   // Below the 8 KB LittleFS block
+#define OFFLINE_SEGMENTS_MAX 512          // ~512 KB, about 70,000 records
+#define SEGMENT_REPLY_MAX 1024            // Segment upload reply kept; lists ~15 rejected records
+
+// Backlog compaction (backlog_compactor.cpp): before the backlog is sealed
+// or uploaded, repeat taps are dropped and counted in the audit file
+#define OFFLINE_COMPACT_BURST_S 60        // Same card, same kind of scan: one per window (0 = off)
+#define OFFLINE_COMPACT_DAY_SESSIONS 0    // Entry/exit pairs kept per card and day (0 = all)
+#define COMPACTION_AUDIT_FILE "/compaction.txt"       // Dropped totals: burst, repeated, past day limit
+#define COMPACTION_AUDIT_TEMP_FILE "/compaction.tmp"
+
+// Attendance history (history_store.cpp): every scan the backend accepted is
+// kept for HISTORY_RETENTION_DAYS days, one partition per day with a sparse
+// time index, and served by GET /api/history. Retention drops whole days
+// (cleanupOldLogs()); each kept day costs two LittleFS files.
+#define HISTORY_PREFIX "/hist_"                       // + 5-digit day + ".txt" (lines) / ".idx" (index)
+#define HISTORY_FILE "/history.txt"                   // Days kept
+#define HISTORY_TEMP_FILE "/history.tmp"
+#define HISTORY_RETENTION_DAYS 7          // Days kept, today included (up to HISTORY_PARTITIONS_MAX)
+#define HISTORY_DAY_RECORDS 2048          // Scans kept per day, 64 KB (later ones are not kept)
+#define HISTORY_STAGE_MAX_AGE_MS 30000    // Staged history lines are appended after at most this
+#define HISTORY_CLEANUP_INTERVAL_MS 60000 // Retention and tally day check (a day rolls over at RTC midnight)
+
+// Today's tally (daily_tally.cpp): occupancy, unique cards and hourly
+// entries/exits, updated as each scan commits and served by GET /api/today.
+// A journal of the day's resolved scans rebuilds it after a reboot.
+#define TALLY_FILE "/today.txt"                       // Day, then one line per scan (~14 bytes)
+#define TALLY_STAGE_MAX_AGE_MS 10000      // Staged tally lines are appended after at most this
+#define ROSTER_FILE "/roster.txt"                     // Member names by card tag (roster.cpp)
+#define ROSTER_TEMP_FILE "/roster.tmp"                // Page being applied
 #define CONFIG_FILE "/config.json"
 #define WIFI_CONFIG_FILE "/wifi_config.json"
 #define MIGRATION_FLAG_FILE "/migration_complete.flag"
@@ -182,6 +319,16 @@
 #define DEBUG_HTTP true                 // Debug HTTP requests
 #define DEBUG_RTC true                  // Debug RTC operations
 
+// Leveled logger (LOG_E/LOG_W/LOG_I/LOG_D). Lines above LOG_LEVEL are compiled out.
+#define LOG_LEVEL 4                     // 0=off 1=error 2=warn 3=info 4=debug
+#define LOG_BUFFER_SIZE 2048            // UART output ring (bytes)
+#define LOG_LINE_MAX 160                // Longest formatted line
+
+// Hot-path event tracing (GET /api/trace). When false, TRACE_EVENT() compiles to nothing.
+#define TRACE_ENABLED true              // Record trace points into the RAM ring
+#define TRACE_RING_SIZE 256             // Records kept (8 bytes each)
+#define TRACE_POLLS true                // Also trace every reader poll; at RFID_POLL_IDLE_MS the ring then spans ~25 s
+
 // Debug macros
 #if DEBUG_ENABLED
   #define DEBUG_PRINT(x) Serial.print(x)
@@ -202,16 +349,31 @@
 
 // API timeout settings
 #define HTTP_TIMEOUT 10000              // 10 seconds
+#define SCAN_REQUEST_TIMEOUT_MS 5000    // Live scan POST, shared by failover retries
 #define HTTP_RETRY_COUNT 3              // Number of retries for failed requests
 
 // ========================================
 // POWER MANAGEMENT
 // ========================================
 
-// Enable deep sleep mode (requires hardware modification)
-#define DEEP_SLEEP_ENABLED false
-#define DEEP_SLEEP_DURATION 60          // Minutes between wake-ups
-#define LOW_POWER_MODE_THRESHOLD 10     // Battery percentage for low power mode
+// Low-power mode for battery-powered terminals: WiFi light sleep (modem off
+// between DTIM beacons, CPU suspended in idle delays) and RFID readers in
+// soft power-down between polls. Polls stretch to, but never past, the
+// maximum tap-detect latency.
+#define LOW_POWER_MODE false
+#define LOW_POWER_MAX_DETECT_MS 250     // Longest a presented card may wait to be seen
+#define LOW_POWER_LISTEN_INTERVAL 3     // DTIM periods the modem sleeps through
+#define RFID_FIELD_SETTLE_MS 5          // Field on before the first REQA after power-up (ISO 14443)
+
+// Energy estimate (power_budget.cpp): nominal draw per state, 3.3 V rail
+#define POWER_SUPPLY_MV 3300
+#define POWER_BASE_UA 25000             // LCD backlight, RTC, LEDs, regulator
+#define POWER_MCU_ACTIVE_UA 80000       // ESP8266 running, radio awake
+#define POWER_MCU_IDLE_UA 18000         // In delay(), modem sleep
+#define POWER_MCU_LIGHT_SLEEP_UA 2000   // In delay(), light sleep (average incl. beacons)
+#define POWER_READER_ON_UA 13000        // MFRC522 with the field on
+#define POWER_READER_DOWN_UA 10         // MFRC522 soft power-down
+#define POWER_WINDOW_MS 300000          // Estimate window
 
 // ========================================
 // DISPLAY CONFIGURATION
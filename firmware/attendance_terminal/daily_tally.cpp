@@ -0,0 +1,224 @@
+/*
+ * Running attendance tally for Attendee Attendance Terminal v2.0
+ */
+
+#include "daily_tally.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char OP_CHARS[] = { '-', 'I', 'O', 'S' };
+
+// FNV-1a, low bit cleared for the inside flag; never 0 (the empty slot)
+static uint32_t cardKey(const char* tag) {
+  uint32_t hash = 2166136261u;
+  for (const char* p = tag; *p; p++) {
+    hash = (hash ^ (uint8_t)*p) * 16777619u;
+  }
+  hash &= ~1u;
+  return hash ? hash : 2;
+}
+
+DailyTally::DailyTally(TerminalStorage& storage, const char* path, uint32_t stageAgeMs)
+  : _storage(storage), _path(path), _stageAgeMs(stageAgeMs), _staged(0), _oldestMs(0) {
+  reset(0);
+  _headerWritten = false;
+}
+
+void DailyTally::reset(uint16_t day) {
+  _day = day;
+  _occupancy = 0;
+  _unique = 0;
+  _scans = 0;
+  memset(_entries, 0, sizeof(_entries));
+  memset(_exits, 0, sizeof(_exits));
+  _exact = true;
+  memset(_cards, 0, sizeof(_cards));
+  _staged = 0;
+}
+
+uint32_t* DailyTally::lookup(uint32_t key, bool insert) {
+  uint32_t i = key >> 1;
+  for (uint16_t probe = 0; probe < TALLY_CARD_SLOTS; probe++, i++) {
+    uint32_t* slot = &_cards[i & (TALLY_CARD_SLOTS - 1)];
+    if (*slot == 0) {
+      if (!insert || _unique >= TALLY_CARDS_MAX) {
+        return NULL;
+      }
+      *slot = key;
+      _unique++;
+      return slot;
+    }
+    if ((*slot & ~1u) == key) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+void DailyTally::apply(uint32_t* slot, uint8_t op, uint8_t hour) {
+  _scans++;
+  if (op == TALLY_ENTRY) {
+    if (slot) {
+      *slot |= 1;
+    }
+    _occupancy++;
+    _entries[hour]++;
+  } else if (op == TALLY_EXIT) {
+    if (slot) {
+      *slot &= ~1u;
+    }
+    if (_occupancy > 0) {
+      _occupancy--;
+    }
+    _exits[hour]++;
+  }
+}
+
+// ========================================
+// SCANS
+// ========================================
+
+bool DailyTally::startDay(uint16_t day) {
+  if (day == _day) {
+    return false;
+  }
+  reset(day);
+  _storage.remove(_path);
+  _headerWritten = writeHeader();       // Else written by the next flush
+  return true;
+}
+
+bool DailyTally::add(const char* tag, uint32_t time, uint8_t kind, uint32_t nowMs) {
+  uint16_t day = (uint16_t)(time / 86400);
+  if (day < _day || tag[0] == 0 || kind > TALLY_SEEN) {
+    return false;
+  }
+  startDay(day);
+  uint8_t hour = (uint8_t)(time % 86400 / 3600);
+
+  // Resolve the scan against the card's state: only changes are counted
+  uint32_t key = cardKey(tag);
+  uint32_t* slot = lookup(key, true);
+  if (!slot) {
+    _exact = false;                     // A card the table has no room for
+  }
+  bool inside = slot && (*slot & 1);
+  if (kind == TALLY_TOGGLE && slot) {
+    kind = inside ? TALLY_EXIT : TALLY_ENTRY;
+  }
+  uint8_t op = TALLY_SEEN;
+  if (kind == TALLY_ENTRY && !inside) {
+    op = TALLY_ENTRY;
+  } else if (kind == TALLY_EXIT && (inside || !slot)) {
+    op = TALLY_EXIT;
+  }
+  apply(slot, op, hour);
+
+  if (_staged == TALLY_STAGE_LINES && !flush()) {
+    return true;                        // Counted; lost on reboot
+  }
+  snprintf(_stage + _staged * (TALLY_LINE_LENGTH + 1), TALLY_LINE_LENGTH + 2, "%c %08lX %02u\n",
+           OP_CHARS[op], (unsigned long)key, (unsigned)hour);
+  if (_staged == 0) {
+    _oldestMs = nowMs;
+  }
+  _staged++;
+  if (_staged == TALLY_STAGE_LINES) {
+    flush();                            // Staged either way; retried by flushIfDue()
+  }
+  return true;
+}
+
+uint32_t DailyTally::getTotalEntries() const {
+  uint32_t total = 0;
+  for (uint8_t hour = 0; hour < 24; hour++) {
+    total += _entries[hour];
+  }
+  return total;
+}
+
+uint32_t DailyTally::getTotalExits() const {
+  uint32_t total = 0;
+  for (uint8_t hour = 0; hour < 24; hour++) {
+    total += _exits[hour];
+  }
+  return total;
+}
+
+// ========================================
+// JOURNAL
+// ========================================
+
+bool DailyTally::writeHeader() {
+  char line[16];
+  int length = snprintf(line, sizeof(line), "day %05u", (unsigned)_day);
+  return _storage.appendLine(_path, line, (size_t)length);
+}
+
+bool DailyTally::flush() {
+  if (_staged == 0) {
+    return true;
+  }
+  if (!_headerWritten && !(_headerWritten = writeHeader())) {
+    return false;
+  }
+  if (!_storage.appendLine(_path, _stage, _staged * (TALLY_LINE_LENGTH + 1) - 1)) {
+    return false;
+  }
+  _staged = 0;
+  return true;
+}
+
+bool DailyTally::flushIfDue(uint32_t nowMs) {
+  if (_staged == 0 || nowMs - _oldestMs < _stageAgeMs) {
+    return true;
+  }
+  return flush();
+}
+
+struct ReplayContext {
+  DailyTally* tally;
+  bool header;
+};
+
+// Lines are NUL-terminated by forEachLine()
+bool DailyTally::replayLine(const char* line, size_t len, void* context) {
+  ReplayContext& ctx = *(ReplayContext*)context;
+  DailyTally& tally = *ctx.tally;
+  if (!ctx.header) {
+    unsigned day;
+    if (sscanf(line, "day %u", &day) != 1 || day > 0xFFFF) {
+      return false;                     // Not a journal: start over
+    }
+    tally.reset((uint16_t)day);
+    ctx.header = true;
+    return true;
+  }
+
+  const char* op = (const char*)memchr(OP_CHARS + 1, line[0], sizeof(OP_CHARS) - 1);
+  unsigned long key;
+  unsigned hour;
+  if (len != TALLY_LINE_LENGTH || !op || sscanf(line + 2, "%8lx %2u", &key, &hour) != 2 ||
+      hour > 23 || key == 0 || (key & 1)) {
+    return true;                        // Torn by a power cut
+  }
+  uint32_t* slot = tally.lookup((uint32_t)key, true);
+  if (!slot) {
+    tally._exact = false;
+  }
+  tally.apply(slot, (uint8_t)(op - OP_CHARS), (uint8_t)hour);
+  return true;
+}
+
+void DailyTally::begin() {
+  reset(0);
+  ReplayContext ctx = { this, false };
+  if (_storage.exists(_path)) {
+    _storage.forEachLine(_path, replayLine, &ctx);
+  }
+  if (!ctx.header) {
+    reset(0);
+  }
+  _headerWritten = ctx.header;
+}
@@ -0,0 +1,105 @@
+/*
+ * Running attendance tally for Attendee Attendance Terminal v2.0
+ *
+ * "How many are in right now, how many came today, how many per hour" used
+ * to be a backend query each time. The terminal now keeps the answers
+ * itself, updated as each scan commits (accepted online or stored offline),
+ * so GET /api/today costs the same whatever the day's traffic:
+ *
+ *   occupancy    cards inside now
+ *   unique       cards seen today
+ *   per hour     entries and exits, 24 buckets each
+ *
+ * A scan's kind comes from the reader's fixed role or the backend's answer;
+ * a plain toggle nobody decided flips the card's state here. Only changes
+ * of state are counted, so an entry while inside adds nothing. Cards sit in
+ * an open-addressed table of 31-bit tag hashes with the inside flag in the
+ * low bit (TALLY_CARD_SLOTS x 4 bytes); past TALLY_CARDS_MAX cards, scans of
+ * new cards still count when their kind is known, and the figures are
+ * reported as no longer exact.
+ *
+ * Every scan is resolved once and appended to a journal ("I|O|S hash hour",
+ * staged in RAM like the offline backlog), with the day on its first line.
+ * After a reboot the journal is replayed; a new day (RTC midnight) starts
+ * an empty journal.
+ *
+ * Portable (no Arduino includes); storage comes from the HAL.
+ */
+
+#ifndef DAILY_TALLY_H
+#define DAILY_TALLY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "terminal_hal.h"
+
+#define TALLY_CARD_SLOTS       512      // Hash table size, a power of two
+#define TALLY_CARDS_MAX        384      // Cards tracked per day (75% load)
+#define TALLY_LINE_LENGTH      13       // "I 1A2B3C4D 09"; '\n' follows
+#define TALLY_STAGE_LINES      8        // Journal lines staged in RAM
+
+enum TallyKind {
+  TALLY_TOGGLE,                         // Nobody decided: flip the card's state
+  TALLY_ENTRY,
+  TALLY_EXIT,
+  TALLY_SEEN                            // Counts the card, changes nothing
+};
+
+class DailyTally {
+public:
+  DailyTally(TerminalStorage& storage, const char* path, uint32_t stageAgeMs);
+
+  void begin();                         // Replay the journal after boot
+
+  // Starts day (days since 2000-01-01) unless it is the current one; true
+  // when the tally was reset
+  bool startDay(uint16_t day);
+
+  // One committed scan at time (seconds since 2000-01-01). A scan from an
+  // earlier day than the current one is not counted (false).
+  bool add(const char* tag, uint32_t time, uint8_t kind, uint32_t nowMs);
+
+  bool flush();                         // Append staged journal lines now
+  bool flushIfDue(uint32_t nowMs);      // Once the oldest staged line is stageAgeMs old
+
+  uint16_t getDay() const { return _day; }
+  uint16_t getOccupancy() const { return _occupancy; }
+  uint16_t getUniqueCards() const { return _unique; }
+  uint32_t getScans() const { return _scans; }
+  uint16_t getEntries(uint8_t hour) const { return _entries[hour]; }
+  uint16_t getExits(uint8_t hour) const { return _exits[hour]; }
+  uint32_t getTotalEntries() const;
+  uint32_t getTotalExits() const;
+  bool isExact() const { return _exact; }
+  uint16_t getStaged() const { return _staged; }
+
+private:
+  void reset(uint16_t day);
+  // Applies a resolved scan (TALLY_ENTRY/EXIT/SEEN); slot is the card's
+  // table entry, NULL when the table is full
+  void apply(uint32_t* slot, uint8_t op, uint8_t hour);
+  uint32_t* lookup(uint32_t key, bool insert);
+  bool writeHeader();
+
+  static bool replayLine(const char* line, size_t len, void* context);
+
+  TerminalStorage& _storage;
+  const char* _path;
+  uint32_t _stageAgeMs;
+
+  uint16_t _day;
+  uint16_t _occupancy;
+  uint16_t _unique;
+  uint32_t _scans;
+  uint16_t _entries[24];
+  uint16_t _exits[24];
+  bool _exact;
+  uint32_t _cards[TALLY_CARD_SLOTS];    // 0 empty, else hash | inside
+
+  char _stage[TALLY_STAGE_LINES * (TALLY_LINE_LENGTH + 1) + 1];  // + NUL after the last line
+  uint16_t _staged;
+  uint32_t _oldestMs;
+  bool _headerWritten;
+};
+
+#endif // DAILY_TALLY_H
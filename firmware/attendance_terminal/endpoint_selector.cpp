@@ -0,0 +1,170 @@
+/*
+ * Backend endpoint selection for Attendee Attendance Terminal v2.0
+ */
+
+#include "endpoint_selector.h"
+
+#include <string.h>
+
+bool isEndpointFailure(int httpCode) {
+  return httpCode <= 0 || httpCode == 502 || httpCode == 503 || httpCode == 504;
+}
+
+EndpointSelector::EndpointSelector(uint32_t probeIntervalMs, uint8_t stickyPercent, uint32_t stickyMinMs)
+  : _count(0), _selected(0), _probeIntervalMs(probeIntervalMs), _stickyPercent(stickyPercent),
+    _stickyMinMs(stickyMinMs), _switches(0) {
+}
+
+void EndpointSelector::clear() {
+  _count = 0;
+  _selected = 0;
+}
+
+bool EndpointSelector::add(const char* url) {
+  size_t len = strlen(url);
+  if (_count >= ENDPOINT_MAX || len == 0 || len > ENDPOINT_URL_MAX) {
+    return false;
+  }
+  BackendEndpoint& endpoint = _endpoints[_count++];
+  memset(&endpoint, 0, sizeof(endpoint));
+  memcpy(endpoint.url, url, len + 1);
+  return true;
+}
+
+int EndpointSelector::nextProbe(uint32_t nowMs) {
+  if (_count < 2) {
+    return -1;                          // Nothing to choose between
+  }
+
+  // Most overdue first; never-probed endpoints are due at once
+  int due = -1;
+  uint32_t dueFor = 0;
+  for (uint8_t i = 0; i < _count; i++) {
+    BackendEndpoint& endpoint = _endpoints[i];
+    if (!endpoint.probed) {
+      due = i;
+      break;
+    }
+    uint32_t interval = isHealthy(i) ? _probeIntervalMs : _probeIntervalMs / 4;
+    uint32_t elapsed = nowMs - endpoint.lastProbeMs;
+    if (elapsed >= interval && (due < 0 || elapsed - interval > dueFor)) {
+      due = i;
+      dueFor = elapsed - interval;
+    }
+  }
+  if (due >= 0) {
+    _endpoints[due].lastProbeMs = nowMs;
+    _endpoints[due].probed = true;
+  }
+  return due;
+}
+
+void EndpointSelector::onProbe(uint8_t index, bool ok, uint32_t rttMs) {
+  if (index >= _count) {
+    return;
+  }
+  BackendEndpoint& endpoint = _endpoints[index];
+  endpoint.probeCount++;
+  if (ok) {
+    if (rttMs == 0) {
+      rttMs = 1;                        // 0 means unmeasured
+    }
+    // EWMA with weight 1/4; a recovered endpoint starts over
+    endpoint.rttMs = (endpoint.rttMs == 0 || endpoint.failures > 0)
+      ? rttMs : (endpoint.rttMs * 3 + rttMs) / 4;
+    endpoint.failures = 0;
+  } else {
+    endpoint.errorCount++;
+    if (endpoint.failures < 255) {
+      endpoint.failures++;
+    }
+  }
+  reselect();
+}
+
+void EndpointSelector::onSuccess(uint8_t index, uint32_t nowMs) {
+  if (index >= _count) {
+    return;
+  }
+  BackendEndpoint& endpoint = _endpoints[index];
+  endpoint.failures = 0;
+  if (endpoint.probed) {
+    endpoint.lastProbeMs = nowMs;       // Working: its next probe can wait
+  }
+}
+
+bool EndpointSelector::onFailure(uint8_t index) {
+  if (index >= _count) {
+    return false;
+  }
+  BackendEndpoint& endpoint = _endpoints[index];
+  endpoint.errorCount++;
+  if (endpoint.failures < 255) {
+    endpoint.failures++;
+  }
+  if (index != _selected) {
+    return false;
+  }
+
+  uint8_t before = _selected;
+  reselect();
+  if (_selected == before) {
+    // Nothing healthy: try the next one in configured order anyway
+    if (_count < 2) {
+      return false;
+    }
+    select((uint8_t)((_selected + 1) % _count));
+  }
+  return true;
+}
+
+void EndpointSelector::reselect() {
+  if (_count == 0) {
+    return;
+  }
+
+  // Fastest healthy endpoint; unmeasured ones rank after measured ones, in
+  // configured order
+  int best = -1;
+  for (uint8_t i = 0; i < _count; i++) {
+    if (!isHealthy(i)) {
+      continue;
+    }
+    if (best < 0) {
+      best = i;
+      continue;
+    }
+    uint32_t rtt = _endpoints[i].rttMs;
+    uint32_t bestRtt = _endpoints[best].rttMs;
+    if (rtt != 0 && (bestRtt == 0 || rtt < bestRtt)) {
+      best = i;
+    }
+  }
+  if (best < 0 || best == _selected) {
+    return;
+  }
+
+  if (isHealthy(_selected)) {
+    // Sticky: only move for a clear, measured improvement
+    uint32_t current = _endpoints[_selected].rttMs;
+    uint32_t candidate = _endpoints[best].rttMs;
+    if (current == 0 || candidate == 0) {
+      return;
+    }
+    uint32_t margin = current * _stickyPercent / 100;
+    if (margin < _stickyMinMs) {
+      margin = _stickyMinMs;
+    }
+    if (candidate + margin >= current) {
+      return;
+    }
+  }
+  select((uint8_t)best);
+}
+
+void EndpointSelector::select(uint8_t index) {
+  if (index != _selected) {
+    _selected = index;
+    _switches++;
+  }
+}
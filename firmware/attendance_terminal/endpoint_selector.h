@@ -0,0 +1,79 @@
+/*
+ * Backend endpoint selection for Attendee Attendance Terminal v2.0
+ *
+ * A terminal can be given several backend URLs, e.g. a LAN relay first and
+ * the public API second. Each is probed periodically (GET <url>/health) and
+ * keeps a smoothed round-trip time; requests go to the selected endpoint.
+ *
+ * - Selection is sticky: a healthy endpoint is only left for one that is
+ *   faster by both stickyPercent and stickyMinMs, so jitter does not flap.
+ * - A failed request marks its endpoint unhealthy and fails over at once,
+ *   so the caller can retry on the next endpoint within the same request.
+ * - Unhealthy endpoints are probed more often and come back on success.
+ * - A successful request to an endpoint that has been probed once counts
+ *   as its probe, so the endpoint in use is not probed while it works.
+ * - With a single endpoint nothing is probed.
+ *
+ * Portable (no Arduino includes); the caller does the probing.
+ */
+
+#ifndef ENDPOINT_SELECTOR_H
+#define ENDPOINT_SELECTOR_H
+
+#include <stdint.h>
+
+#define ENDPOINT_MAX 3                  // Configured backend URLs
+#define ENDPOINT_URL_MAX 100            // As MAX_URL_LENGTH
+
+// Results that say more about the endpoint than the request: no answer
+// (transport error or timeout) or a gateway/availability error
+bool isEndpointFailure(int httpCode);
+
+struct BackendEndpoint {
+  char url[ENDPOINT_URL_MAX + 1];
+  uint32_t rttMs;                       // Smoothed probe RTT, 0 until measured
+  uint8_t failures;                     // Consecutive failed probes/requests
+  uint32_t lastProbeMs;
+  bool probed;                          // lastProbeMs is valid
+  uint32_t probeCount;
+  uint32_t errorCount;                  // Failed probes and requests
+};
+
+class EndpointSelector {
+public:
+  EndpointSelector(uint32_t probeIntervalMs, uint8_t stickyPercent, uint32_t stickyMinMs);
+
+  void clear();
+  bool add(const char* url);            // False when full or the URL is too long
+
+  uint8_t getCount() const { return _count; }
+  const BackendEndpoint& getEndpoint(uint8_t index) const { return _endpoints[index]; }
+  uint8_t getSelected() const { return _selected; }
+  const char* getSelectedUrl() const { return _count > 0 ? _endpoints[_selected].url : ""; }
+  bool isHealthy(uint8_t index) const { return _endpoints[index].failures == 0; }
+
+  // Endpoint whose probe is due (its probe time is taken), or -1
+  int nextProbe(uint32_t nowMs);
+  void onProbe(uint8_t index, bool ok, uint32_t rttMs);
+
+  // Outcome of a real request to the selected endpoint. onFailure() moves
+  // the selection and returns true when there is another endpoint to try.
+  void onSuccess(uint8_t index, uint32_t nowMs);
+  bool onFailure(uint8_t index);
+
+  uint32_t getSwitchCount() const { return _switches; }
+
+private:
+  void reselect();
+  void select(uint8_t index);
+
+  BackendEndpoint _endpoints[ENDPOINT_MAX];
+  uint8_t _count;
+  uint8_t _selected;
+  uint32_t _probeIntervalMs;
+  uint8_t _stickyPercent;
+  uint32_t _stickyMinMs;
+  uint32_t _switches;
+};
+
+#endif // ENDPOINT_SELECTOR_H
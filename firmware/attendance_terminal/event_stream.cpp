@@ -0,0 +1,172 @@
+/*
+ * Live device event stream (Server-Sent Events)
+ * Attendee Attendance Terminal v2.0
+ */
+
+#include <ESP8266WiFi.h>
+#include "config.h"
+#include "event_stream.h"
+
+// ========================================
+// SUBSCRIBER STATE
+// ========================================
+
+struct EventStreamClient {
+  WiFiClient client;
+  bool active;
+  char buffer[EVENT_STREAM_CLIENT_BUFFER];  // Pending bytes (ring)
+  uint16_t head;                            // Next byte to send
+  uint16_t used;                            // Bytes waiting in buffer
+  uint32_t dropped;                         // Events dropped for this client
+  unsigned long lastWrite;                  // For keep-alive scheduling
+};
+
+static EventStreamClient streamClients[EVENT_STREAM_MAX_CLIENTS];
+static uint32_t eventsPublished = 0;
+static uint32_t eventsDropped = 0;
+static uint32_t nextEventId = 1;
+
+static const char* eventTypeName(DeviceEventType type) {
+  switch (type) {
+    case EVENT_SCAN:         return "scan";
+    case EVENT_SYNC:         return "sync";
+    case EVENT_CONNECTIVITY: return "connectivity";
+    case EVENT_ERROR:        return "error";
+  }
+  return "message";
+}
+
+// Append raw bytes to a client's ring; all-or-nothing so frames never tear
+static bool enqueueBytes(EventStreamClient& sc, const char* data, size_t len) {
+  if (len > (size_t)(EVENT_STREAM_CLIENT_BUFFER - sc.used)) {
+    return false;
+  }
+  size_t tail = (sc.head + sc.used) % EVENT_STREAM_CLIENT_BUFFER;
+  for (size_t i = 0; i < len; i++) {
+    sc.buffer[tail] = data[i];
+    tail = (tail + 1) % EVENT_STREAM_CLIENT_BUFFER;
+  }
+  sc.used += len;
+  return true;
+}
+
+static void releaseClient(EventStreamClient& sc) {
+  sc.client.stop();
+  sc.client = WiFiClient();
+  sc.active = false;
+  sc.used = 0;
+  sc.head = 0;
+}
+
+// ========================================
+// PUBLIC API
+// ========================================
+
+bool addEventStreamClient(WiFiClient& client) {
+  for (int i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++) {
+    EventStreamClient& sc = streamClients[i];
+    if (sc.active) {
+      continue;
+    }
+
+    sc.client = client;
+    sc.client.setNoDelay(true);
+    sc.active = true;
+    sc.head = 0;
+    sc.used = 0;
+    sc.dropped = 0;
+    sc.lastWrite = millis();
+
+    // Response headers are written directly; the web server does not own this connection
+    static const char headers[] =
+      "HTTP/1.1 200 OK\r\n"
+      "Content-Type: text/event-stream\r\n"
+      "Cache-Control: no-cache\r\n"
+      "Connection: keep-alive\r\n"
+      "Access-Control-Allow-Origin: *\r\n"
+      "\r\n"
+      "retry: 5000\n\n";
+    enqueueBytes(sc, headers, sizeof(headers) - 1);
+    return true;
+  }
+  return false;
+}
+
+void publishEvent(DeviceEventType type, const char* jsonData) {
+  eventsPublished++;
+
+  char frame[EVENT_STREAM_MAX_FRAME];
+  int len = snprintf(frame, sizeof(frame), "id: %lu\nevent: %s\ndata: %s\n\n",
+                     (unsigned long)nextEventId++, eventTypeName(type), jsonData);
+  if (len <= 0 || len >= (int)sizeof(frame)) {
+    eventsDropped++;
+    return;
+  }
+
+  for (int i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++) {
+    EventStreamClient& sc = streamClients[i];
+    if (!sc.active) {
+      continue;
+    }
+    if (!enqueueBytes(sc, frame, len)) {
+      sc.dropped++;
+      eventsDropped++;
+    }
+  }
+}
+
+void serviceEventStream() {
+  unsigned long now = millis();
+
+  for (int i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++) {
+    EventStreamClient& sc = streamClients[i];
+    if (!sc.active) {
+      continue;
+    }
+    if (!sc.client.connected()) {
+      releaseClient(sc);
+      continue;
+    }
+
+    // Keep idle connections alive through proxies; comment lines are ignored by EventSource
+    if (sc.used == 0 && now - sc.lastWrite > EVENT_STREAM_KEEPALIVE_MS) {
+      enqueueBytes(sc, ":\n\n", 3);
+    }
+
+    // Write only what the TCP stack accepts right now
+    while (sc.used > 0) {
+      size_t writable = sc.client.availableForWrite();
+      if (writable == 0) {
+        break;
+      }
+      size_t contiguous = EVENT_STREAM_CLIENT_BUFFER - sc.head;
+      size_t chunk = sc.used;
+      if (chunk > contiguous) chunk = contiguous;
+      if (chunk > writable) chunk = writable;
+
+      size_t written = sc.client.write((const uint8_t*)&sc.buffer[sc.head], chunk);
+      if (written == 0) {
+        break;
+      }
+      sc.head = (sc.head + written) % EVENT_STREAM_CLIENT_BUFFER;
+      sc.used -= written;
+      sc.lastWrite = now;
+    }
+  }
+}
+
+uint8_t getEventStreamClientCount() {
+  uint8_t count = 0;
+  for (int i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++) {
+    if (streamClients[i].active) count++;
+  }
+  return count;
+}
+
+uint32_t getEventStreamPublishedCount() {
+  return eventsPublished;
+}
+
+uint32_t getEventStreamDroppedCount() {
+  return eventsDropped;
+}
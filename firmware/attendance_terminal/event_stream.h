@@ -0,0 +1,41 @@
+/*
+ * Live device event stream (Server-Sent Events)
+ * Attendee Attendance Terminal v2.0
+ *
+ * Clients connect to GET /api/events and receive scan, sync, connectivity
+ * and error events as they happen. Each client owns a bounded byte buffer;
+ * events that do not fit are dropped for that client and counted, so a slow
+ * consumer can never stall the scan loop.
+ */
+
+#ifndef EVENT_STREAM_H
+#define EVENT_STREAM_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+// Event categories published on the stream
+enum DeviceEventType {
+  EVENT_SCAN,
+  EVENT_SYNC,
+  EVENT_CONNECTIVITY,
+  EVENT_ERROR
+};
+
+// Attach an already-accepted HTTP client as a stream subscriber.
+// Returns false when all subscriber slots are taken.
+bool addEventStreamClient(WiFiClient& client);
+
+// Queue an event (data must be a single-line JSON object) for every subscriber
+void publishEvent(DeviceEventType type, const char* jsonData);
+
+// Flush pending bytes without blocking, send keep-alives, drop dead clients.
+// Call once per loop() pass.
+void serviceEventStream();
+
+// Statistics
+uint8_t getEventStreamClientCount();
+uint32_t getEventStreamPublishedCount();
+uint32_t getEventStreamDroppedCount();
+
+#endif // EVENT_STREAM_H
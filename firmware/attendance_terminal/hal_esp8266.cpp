@@ -0,0 +1,256 @@
+/*
+ * ESP8266 implementations of the terminal HAL
+ * Attendee Attendance Terminal v2.0
+ */
+
+#include <LittleFS.h>
+#include <FS.h>
+#include "config.h"
+#include "attendance_core.h"
+#include "hal_esp8266.h"
+#include "sync_pacing.h"
+
+// ========================================
+// LITTLEFS STORAGE
+// ========================================
+
+bool LittleFsStorage::appendLine(const char* path, const char* line, size_t len) {
+  File file = LittleFS.open(path, "a");
+  if (!file) {
+    return false;
+  }
+  size_t written = file.write((const uint8_t*)line, len);
+  written += file.write('\n');
+  file.close();
+  return written == len + 1;
+}
+
+bool LittleFsStorage::forEachLine(const char* path, LineVisitor visitor, void* context) {
+  File file = LittleFS.open(path, "r");
+  if (!file) {
+    return false;
+  }
+
+  char line[ATTENDANCE_RECORD_LINE_MAX];
+  while (file.available()) {
+    size_t len = file.readBytesUntil('\n', line, sizeof(line) - 1);
+    if (len == sizeof(line) - 1) {
+      if (file.peek() == '\n') {
+        file.read();                    // Exactly full: the newline is still unread
+      } else if (file.available()) {
+        // Longer than any record we write: skip the whole line, not pieces of it
+        while (file.available() && file.read() != '\n') {
+        }
+        continue;
+      }
+    }
+    while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' ')) {
+      len--;
+    }
+    line[len] = 0;
+    if (len == 0) {
+      continue;
+    }
+    if (!visitor(line, len, context)) {
+      break;
+    }
+  }
+  file.close();
+  return true;
+}
+
+bool LittleFsStorage::rename(const char* from, const char* to) {
+  return LittleFS.rename(from, to);
+}
+
+bool LittleFsStorage::remove(const char* path) {
+  return LittleFS.remove(path);
+}
+
+bool LittleFsStorage::exists(const char* path) {
+  return LittleFS.exists(path);
+}
+
+int LittleFsStorage::readAt(const char* path, uint32_t offset, char* buffer, size_t len) {
+  File file = LittleFS.open(path, "r");
+  if (!file) {
+    return -1;
+  }
+  int count = -1;
+  if (file.seek(offset, SeekSet)) {
+    count = (int)file.read((uint8_t*)buffer, len);
+  }
+  file.close();
+  return count;
+}
+
+// ========================================
+// HTTPCLIENT TRANSPORT
+// ========================================
+
+HttpClientTransport::HttpClientTransport(HTTPClient& http, WiFiClient& plainClient,
+                                         WiFiClientSecure& secureClient)
+  : _http(http), _plainClient(plainClient), _secureClient(secureClient), _timeoutMs(HTTP_TIMEOUT), _retryAfterMs(0) {
+}
+
+int HttpClientTransport::postJson(const char* url, const char* body, size_t len,
+                                  char* response, size_t responseSize) {
+  if (responseSize > 0) {
+    response[0] = 0;
+  }
+  _retryAfterMs = 0;
+
+  bool began;
+  if (strncmp(url, "https://", 8) == 0) {
+    _secureClient.setInsecure(); // Skip SSL certificate verification
+    began = _http.begin(_secureClient, url);
+  } else {
+    began = _http.begin(_plainClient, url);
+  }
+  if (!began) {
+    return -1;
+  }
+
+  _http.addHeader("Content-Type", "application/json");
+  _http.setTimeout(_timeoutMs);
+  const char* collected[] = { "Retry-After" };
+  _http.collectHeaders(collected, 1);
+
+  int httpResponseCode = _http.POST((uint8_t*)body, len);
+  _retryAfterMs = parseRetryAfterMs(_http.header("Retry-After").c_str());
+  if (httpResponseCode > 0 && responseSize > 0) {
+    String payload = _http.getString();
+    strlcpy(response, payload.c_str(), responseSize);
+  }
+
+  _http.end();
+  return httpResponseCode;
+}
+
+// ========================================
+// CLOCK
+// ========================================
+
+uint32_t RtcClock::millis() {
+  return ::millis();
+}
+
+void RtcClock::now(TerminalDateTime& out) {
+  DateTime now = _rtc.now();
+  out.year = now.year();
+  out.month = now.month();
+  out.day = now.day();
+  out.hour = now.hour();
+  out.minute = now.minute();
+  out.second = now.second();
+}
+
+// ========================================
+// PIPELINED UPLOAD CONNECTIONS
+// ========================================
+
+WiFiConnection::WiFiConnection() : _active(NULL), _timeoutMs(HTTP_TIMEOUT) {
+}
+
+bool WiFiConnection::open(const char* host, uint16_t port, bool secure) {
+  close();
+  if (secure) {
+    // Each TLS session holds its own BearSSL buffers
+    if (ESP.getFreeHeap() < UPLOAD_TLS_MIN_HEAP) {
+      return false;
+    }
+    _secure.setInsecure();
+    _secure.setBufferSizes(512, 512);
+    _active = &_secure;
+  } else {
+    _active = &_plain;
+  }
+  _active->setTimeout(_timeoutMs);
+  _active->setNoDelay(true);
+  _active->setSync(false);
+  if (!_active->connect(host, port)) {
+    _active->stop();
+    _active = NULL;
+    return false;
+  }
+  return true;
+}
+
+bool WiFiConnection::isOpen() {
+  return _active && _active->connected();
+}
+
+int WiFiConnection::write(const char* data, size_t len) {
+  if (!_active || !_active->connected()) {
+    return -1;
+  }
+  size_t room = _active->availableForWrite();
+  if (room == 0) {
+    return 0;
+  }
+  return (int)_active->write((const uint8_t*)data, len < room ? len : room);
+}
+
+int WiFiConnection::read(char* buffer, size_t size) {
+  if (!_active) {
+    return -1;
+  }
+  int available = _active->available();
+  if (available <= 0) {
+    return _active->connected() ? 0 : -1;
+  }
+  return _active->read((uint8_t*)buffer, (size_t)available < size ? (size_t)available : size);
+}
+
+void WiFiConnection::close() {
+  if (_active) {
+    _active->stop();
+    _active = NULL;
+  }
+}
+
+// ========================================
+// UDP (COAP TRANSPORT)
+// ========================================
+
+WiFiDatagram::WiFiDatagram() : _port(0), _bound(false) {
+}
+
+bool WiFiDatagram::open(const char* host, uint16_t port) {
+  if (!WiFi.hostByName(host, _address)) {
+    return false;
+  }
+  _port = port;
+  if (!_bound) {
+    _bound = _udp.begin(0) != 0;      // Ephemeral local port
+  }
+  return _bound;
+}
+
+bool WiFiDatagram::send(const uint8_t* data, size_t len) {
+  if (!_bound || !_udp.beginPacket(_address, _port)) {
+    return false;
+  }
+  _udp.write(data, len);
+  return _udp.endPacket() != 0;
+}
+
+int WiFiDatagram::receive(uint8_t* buffer, size_t size, uint32_t timeoutMs) {
+  if (!_bound) {
+    return -1;
+  }
+  uint32_t started = ::millis();
+  do {
+    int length = _udp.parsePacket();
+    if (length > 0) {
+      // Only the backend may answer
+      if (_udp.remoteIP() != _address || _udp.remotePort() != _port) {
+        _udp.flush();
+        continue;
+      }
+      return _udp.read(buffer, size);
+    }
+    delay(1);
+  } while (::millis() - started < timeoutMs);
+  return 0;
+}
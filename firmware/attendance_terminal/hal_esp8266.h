@@ -0,0 +1,96 @@
+/*
+ * ESP8266 implementations of the terminal HAL
+ * Attendee Attendance Terminal v2.0
+ */
+
+#ifndef HAL_ESP8266_H
+#define HAL_ESP8266_H
+
+#include <ESP8266HTTPClient.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+#include <WiFiUdp.h>
+#include <RTClib.h>
+#include "terminal_hal.h"
+
+// Line storage on LittleFS
+class LittleFsStorage : public TerminalStorage {
+public:
+  bool appendLine(const char* path, const char* line, size_t len) override;
+  bool forEachLine(const char* path, LineVisitor visitor, void* context) override;
+  bool rename(const char* from, const char* to) override;
+  bool remove(const char* path) override;
+  bool exists(const char* path) override;
+  int readAt(const char* path, uint32_t offset, char* buffer, size_t len) override;
+};
+
+// Backend transport on the shared HTTPClient; picks HTTP or HTTPS from the URL
+class HttpClientTransport : public TerminalTransport {
+public:
+  HttpClientTransport(HTTPClient& http, WiFiClient& plainClient, WiFiClientSecure& secureClient);
+
+  void setTimeout(uint16_t timeoutMs) { _timeoutMs = timeoutMs; }
+
+  int postJson(const char* url, const char* body, size_t len,
+               char* response, size_t responseSize) override;
+  uint32_t getLastRetryAfterMs() const override { return _retryAfterMs; }
+
+private:
+  HTTPClient& _http;
+  WiFiClient& _plainClient;
+  WiFiClientSecure& _secureClient;
+  uint16_t _timeoutMs;
+  uint32_t _retryAfterMs;
+};
+
+// millis() and the DS3231 wall clock
+class RtcClock : public TerminalClock {
+public:
+  explicit RtcClock(RTC_DS3231& rtc) : _rtc(rtc) {}
+
+  uint32_t millis() override;
+  void now(TerminalDateTime& out) override;
+
+private:
+  RTC_DS3231& _rtc;
+};
+
+// Pipelined upload slot on its own WiFiClient (or BearSSL client for https).
+// Writes go out unsynced so they return once lwIP has buffered the data.
+class WiFiConnection : public TerminalConnection {
+public:
+  WiFiConnection();
+
+  void setTimeout(uint16_t timeoutMs) { _timeoutMs = timeoutMs; }
+
+  bool open(const char* host, uint16_t port, bool secure) override;
+  bool isOpen() override;
+  int write(const char* data, size_t len) override;
+  int read(char* buffer, size_t size) override;
+  void close() override;
+
+private:
+  WiFiClient _plain;
+  BearSSL::WiFiClientSecure _secure;
+  WiFiClient* _active;
+  uint16_t _timeoutMs;
+};
+
+// Datagram socket for the CoAP transport. receive() polls with delay(1),
+// so the WiFi stack keeps running while a request is outstanding.
+class WiFiDatagram : public TerminalDatagram {
+public:
+  WiFiDatagram();
+
+  bool open(const char* host, uint16_t port) override;
+  bool send(const uint8_t* data, size_t len) override;
+  int receive(uint8_t* buffer, size_t size, uint32_t timeoutMs) override;
+
+private:
+  WiFiUDP _udp;
+  IPAddress _address;
+  uint16_t _port;
+  bool _bound;
+};
+
+#endif // HAL_ESP8266_H
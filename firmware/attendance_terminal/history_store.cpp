@@ -0,0 +1,475 @@
+/*
+ * On-device attendance history for Attendee Attendance Terminal v2.0
+ */
+
+#include "history_store.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char KIND_CHARS[] = { '-', 'I', 'O' };
+
+// ========================================
+// LINES
+// ========================================
+
+static bool parseTwoDigits(const char* s, uint32_t& value) {
+  if (s[0] < '0' || s[0] > '9' || s[1] < '0' || s[1] > '9') {
+    return false;
+  }
+  value = (uint32_t)(s[0] - '0') * 10 + (uint32_t)(s[1] - '0');
+  return true;
+}
+
+bool parseHistoryLine(const char* line, size_t length, uint16_t day, HistoryEntry& entry) {
+  uint32_t hour, minute, second;
+  if (length < HISTORY_LINE_LENGTH || line[2] != ':' || line[5] != ':' || line[8] != ' ' ||
+      line[10] != ' ' || !parseTwoDigits(line, hour) || !parseTwoDigits(line + 3, minute) ||
+      !parseTwoDigits(line + 6, second) || hour > 23 || minute > 59 || second > 59) {
+    return false;
+  }
+  const char* kind = (const char*)memchr(KIND_CHARS, line[9], sizeof(KIND_CHARS));
+  if (!kind) {
+    return false;
+  }
+  size_t tagLength = 0;
+  while (11 + tagLength < HISTORY_LINE_LENGTH && line[11 + tagLength] != ' ') {
+    tagLength++;
+  }
+  if (tagLength == 0) {
+    return false;
+  }
+  memcpy(entry.tag, line + 11, tagLength);
+  entry.tag[tagLength] = 0;
+  entry.kind = (uint8_t)(kind - KIND_CHARS);
+  entry.time = (uint32_t)day * 86400 + hour * 3600 + minute * 60 + second;
+  return true;
+}
+
+// "min max" seconds of the day, fixed width, as written by indexBlocks()
+static bool parseIndexLine(const char* line, size_t length, uint32_t& low, uint32_t& high) {
+  uint32_t* field = &low;
+  low = high = 0;
+  bool digits = false;
+  for (size_t i = 0; i < length; i++) {
+    if (line[i] >= '0' && line[i] <= '9') {
+      *field = *field * 10 + (uint32_t)(line[i] - '0');
+      digits = true;
+    } else if (line[i] == ' ' && field == &low && digits) {
+      field = &high;
+      digits = false;
+    } else {
+      return false;
+    }
+  }
+  return field == &high && digits && low <= high;
+}
+
+// ========================================
+// PARTITIONS
+// ========================================
+
+HistoryStore::HistoryStore(TerminalStorage& storage, const char* prefix, const char* manifestPath,
+                           const char* manifestTempPath, uint8_t maxDays, uint16_t dayRecords,
+                           uint32_t stageAgeMs)
+  : _storage(storage), _prefix(prefix), _manifestPath(manifestPath), _manifestTempPath(manifestTempPath),
+    _maxDays(maxDays < 1 ? 1 : maxDays > HISTORY_PARTITIONS_MAX ? HISTORY_PARTITIONS_MAX : maxDays),
+    _dayRecords(dayRecords), _stageAgeMs(stageAgeMs), _count(0), _staged(0), _stagedDay(0),
+    _oldestMs(0), _dropped(0) {
+}
+
+const char* HistoryStore::path(uint16_t day, const char* extension, char* out, size_t outSize) const {
+  snprintf(out, outSize, "%s%05u.%s", _prefix, (unsigned)day, extension);
+  return out;
+}
+
+HistoryStore::Partition* HistoryStore::find(uint16_t day) {
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_days[i].day == day) {
+      return &_days[i];
+    }
+  }
+  return NULL;
+}
+
+struct ManifestContext {
+  uint16_t days[HISTORY_PARTITIONS_MAX];
+  uint8_t count;
+};
+
+// Day numbers in ascending order; anything else is skipped
+static bool manifestLine(const char* line, size_t len, void* context) {
+  ManifestContext& ctx = *(ManifestContext*)context;
+  uint32_t value = 0;
+  bool digits = false;
+  for (size_t i = 0; i <= len; i++) {
+    if (i < len && line[i] >= '0' && line[i] <= '9') {
+      value = value * 10 + (uint32_t)(line[i] - '0');
+      digits = true;
+      continue;
+    }
+    if (digits && value <= 0xFFFF && ctx.count < HISTORY_PARTITIONS_MAX &&
+        (ctx.count == 0 || value > ctx.days[ctx.count - 1])) {
+      ctx.days[ctx.count++] = (uint16_t)value;
+    }
+    value = 0;
+    digits = false;
+  }
+  return false;
+}
+
+static bool countLine(const char*, size_t, void* context) {
+  (*(uint16_t*)context)++;
+  return true;
+}
+
+void HistoryStore::begin() {
+  ManifestContext manifest;
+  manifest.count = 0;
+  // A crash inside writeManifest() can leave only the temp file
+  const char* manifestPath = _storage.exists(_manifestPath) ? _manifestPath : _manifestTempPath;
+  if (_storage.exists(manifestPath)) {
+    _storage.forEachLine(manifestPath, manifestLine, &manifest);
+  }
+
+  _count = 0;
+  _staged = 0;
+  for (uint8_t i = 0; i < manifest.count; i++) {
+    Partition& partition = _days[_count++];
+    partition.day = manifest.days[i];
+    partition.records = countLines(partition.day, partition.closed);
+
+    char index[HISTORY_PATH_MAX];
+    path(partition.day, "idx", index, sizeof(index));
+    partition.indexed = 0;
+    if (_storage.exists(index)) {
+      _storage.forEachLine(index, countLine, &partition.indexed);
+    }
+    if (partition.indexed != partition.records / HISTORY_BLOCK_LINES) {
+      // Interrupted or not this partition's: rebuild it from the lines
+      _storage.remove(index);
+      partition.indexed = 0;
+    }
+    indexBlocks(partition);
+  }
+}
+
+// Complete lines in a partition, by binary search over fixed-width lines. A
+// torn last line (a crash inside an append) closes the day: appending after
+// it would shift every later line.
+uint16_t HistoryStore::countLines(uint16_t day, bool& closed) {
+  char file[HISTORY_PATH_MAX];
+  path(day, "txt", file, sizeof(file));
+  closed = false;
+  if (!_storage.exists(file)) {
+    return 0;
+  }
+  uint16_t low = 0;
+  uint16_t high = _dayRecords;
+  while (low < high) {
+    uint16_t mid = (uint16_t)((low + high + 1) / 2);
+    char end;
+    if (_storage.readAt(file, (uint32_t)mid * HISTORY_LINE_BYTES - 1, &end, 1) == 1 && end == '\n') {
+      low = mid;
+    } else {
+      high = mid - 1;
+    }
+  }
+  char next;
+  closed = low < _dayRecords && _storage.readAt(file, (uint32_t)low * HISTORY_LINE_BYTES, &next, 1) > 0;
+  return low;
+}
+
+HistoryStore::Partition* HistoryStore::create(uint16_t day) {
+  if (_count >= _maxDays) {
+    if (day < _days[0].day) {
+      return NULL;                      // Older than anything kept
+    }
+    removePartition(0);
+  }
+  uint8_t position = _count;
+  while (position > 0 && _days[position - 1].day > day) {
+    position--;
+  }
+  memmove(&_days[position + 1], &_days[position], (_count - position) * sizeof(Partition));
+  _count++;
+  Partition& partition = _days[position];
+  partition.day = day;
+  partition.records = 0;
+  partition.indexed = 0;
+  partition.closed = false;
+
+  // Leftovers of a day dropped before its manifest update
+  char file[HISTORY_PATH_MAX];
+  _storage.remove(path(day, "txt", file, sizeof(file)));
+  _storage.remove(path(day, "idx", file, sizeof(file)));
+  writeManifest();
+  return &partition;
+}
+
+bool HistoryStore::removePartition(uint8_t position) {
+  uint16_t day = _days[position].day;
+  if (_staged > 0 && _stagedDay == day) {
+    _staged = 0;
+  }
+  char file[HISTORY_PATH_MAX];
+  bool removed = _storage.remove(path(day, "txt", file, sizeof(file)));
+  _storage.remove(path(day, "idx", file, sizeof(file)));
+  memmove(&_days[position], &_days[position + 1], (_count - position - 1) * sizeof(Partition));
+  _count--;
+  return removed;
+}
+
+bool HistoryStore::writeManifest() {
+  char line[HISTORY_PARTITIONS_MAX * 6 + 1];
+  size_t length = 0;
+  for (uint8_t i = 0; i < _count; i++) {
+    length += (size_t)snprintf(line + length, sizeof(line) - length, i ? " %u" : "%u", (unsigned)_days[i].day);
+  }
+  _storage.remove(_manifestTempPath);
+  if (!_storage.appendLine(_manifestTempPath, line, length)) {
+    return false;
+  }
+  if (!_storage.rename(_manifestTempPath, _manifestPath)) {
+    // Filesystems that refuse to rename over an existing file
+    _storage.remove(_manifestPath);
+    if (!_storage.rename(_manifestTempPath, _manifestPath)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Writes the index lines for every complete block that has none yet
+bool HistoryStore::indexBlocks(Partition& partition) {
+  char file[HISTORY_PATH_MAX];
+  char index[HISTORY_PATH_MAX];
+  path(partition.day, "txt", file, sizeof(file));
+  path(partition.day, "idx", index, sizeof(index));
+  while (partition.indexed < partition.records / HISTORY_BLOCK_LINES) {
+    uint32_t low = 86400;
+    uint32_t high = 0;
+    uint32_t first = (uint32_t)partition.indexed * HISTORY_BLOCK_LINES;
+    for (uint32_t line = 0; line < HISTORY_BLOCK_LINES; line += HISTORY_READ_LINES) {
+      char buffer[HISTORY_READ_LINES * HISTORY_LINE_BYTES];
+      int count = _storage.readAt(file, (first + line) * HISTORY_LINE_BYTES, buffer, sizeof(buffer));
+      for (int i = 0; i + HISTORY_LINE_BYTES <= count; i += HISTORY_LINE_BYTES) {
+        HistoryEntry entry;
+        if (parseHistoryLine(buffer + i, HISTORY_LINE_LENGTH, partition.day, entry)) {
+          uint32_t second = entry.time % 86400;
+          low = second < low ? second : low;
+          high = second > high ? second : high;
+        }
+      }
+    }
+    if (low > high) {
+      low = high = 0;                   // Nothing readable: an entry no range can match
+    }
+    char entry[16];
+    int length = snprintf(entry, sizeof(entry), "%05lu %05lu", (unsigned long)low, (unsigned long)high);
+    if (!_storage.appendLine(index, entry, (size_t)length)) {
+      return false;
+    }
+    partition.indexed++;
+  }
+  return true;
+}
+
+// ========================================
+// WRITING
+// ========================================
+
+bool HistoryStore::add(const char* tag, uint32_t time, uint8_t kind, uint32_t nowMs) {
+  uint16_t day = (uint16_t)(time / 86400);
+  if (tag[0] == 0 || kind > HISTORY_EXIT || (_staged > 0 && _stagedDay != day && !flush())) {
+    _dropped++;
+    return false;
+  }
+  Partition* partition = find(day);
+  if (!partition) {
+    partition = create(day);
+  }
+  if (!partition || partition->closed || partition->records + _staged >= _dayRecords ||
+      (_staged == HISTORY_STAGE_LINES && !flush())) {
+    _dropped++;
+    return false;
+  }
+
+  uint32_t second = time % 86400;
+  snprintf(_stage + _staged * HISTORY_LINE_BYTES, HISTORY_LINE_BYTES + 1, "%02lu:%02lu:%02lu %c %-20.20s\n",
+           (unsigned long)(second / 3600), (unsigned long)(second / 60 % 60), (unsigned long)(second % 60),
+           KIND_CHARS[kind], tag);
+  if (_staged == 0) {
+    _stagedDay = day;
+    _oldestMs = nowMs;
+  }
+  _staged++;
+  if (_staged == HISTORY_STAGE_LINES) {
+    flush();                            // Staged either way; retried by flushIfDue()
+  }
+  return true;
+}
+
+bool HistoryStore::addRecord(const char* record, size_t length, uint32_t nowMs) {
+  char tag[ATTENDANCE_UID_HEX_SIZE];
+  char timestamp[ATTENDANCE_TIMESTAMP_SIZE + 1];
+  char direction[8];
+  uint32_t time;
+  if (!findJsonScalar(record, length, "rfidTag", tag, sizeof(tag)) ||
+      !findJsonScalar(record, length, "timestamp", timestamp, sizeof(timestamp)) ||
+      !parseIsoTimestamp(timestamp, time)) {
+    _dropped++;
+    return false;
+  }
+  uint8_t kind = HISTORY_TOGGLE;
+  if (findJsonScalar(record, length, "direction", direction, sizeof(direction))) {
+    kind = strcmp(direction, "entry") == 0 ? HISTORY_ENTRY
+         : strcmp(direction, "exit") == 0 ? HISTORY_EXIT : HISTORY_TOGGLE;
+  }
+  return add(tag, time, kind, nowMs);
+}
+
+bool HistoryStore::flush() {
+  if (_staged == 0) {
+    return true;
+  }
+  Partition* partition = find(_stagedDay);
+  if (!partition) {
+    _staged = 0;                        // Day dropped meanwhile
+    return true;
+  }
+  char file[HISTORY_PATH_MAX];
+  if (!_storage.appendLine(path(_stagedDay, "txt", file, sizeof(file)), _stage,
+                           _staged * HISTORY_LINE_BYTES - 1)) {
+    return false;
+  }
+  partition->records += _staged;
+  _staged = 0;
+  indexBlocks(*partition);              // A failure is caught up by the next flush or boot
+  return true;
+}
+
+bool HistoryStore::flushIfDue(uint32_t nowMs) {
+  if (_staged == 0 || nowMs - _oldestMs < _stageAgeMs) {
+    return true;
+  }
+  return flush();
+}
+
+uint8_t HistoryStore::dropExpired(uint16_t today) {
+  uint16_t oldest = today >= _maxDays - 1 ? (uint16_t)(today - (_maxDays - 1)) : 0;
+  uint8_t dropped = 0;
+  for (uint8_t i = 0; i < _count;) {
+    if (_days[i].day < oldest || _days[i].day > today + 1) {
+      removePartition(i);
+      dropped++;
+    } else {
+      i++;
+    }
+  }
+  if (dropped > 0) {
+    writeManifest();
+  }
+  return dropped;
+}
+
+uint32_t HistoryStore::getRecordCount() const {
+  uint32_t total = _staged;
+  for (uint8_t i = 0; i < _count; i++) {
+    total += _days[i].records;
+  }
+  return total;
+}
+
+// ========================================
+// QUERIES
+// ========================================
+
+bool HistoryStore::scanLines(uint16_t day, uint32_t first, uint32_t count, uint32_t from, uint32_t to,
+                             HistoryVisitor visitor, void* context, HistoryQueryStats& stats) {
+  char file[HISTORY_PATH_MAX];
+  path(day, "txt", file, sizeof(file));
+  while (count > 0) {
+    char buffer[HISTORY_READ_LINES * HISTORY_LINE_BYTES];
+    uint32_t lines = count < HISTORY_READ_LINES ? count : HISTORY_READ_LINES;
+    int read = _storage.readAt(file, first * HISTORY_LINE_BYTES, buffer, lines * HISTORY_LINE_BYTES);
+    if (read < HISTORY_LINE_BYTES) {
+      return true;
+    }
+    lines = (uint32_t)read / HISTORY_LINE_BYTES;
+    for (uint32_t i = 0; i < lines; i++) {
+      HistoryEntry entry;
+      if (parseHistoryLine(buffer + i * HISTORY_LINE_BYTES, HISTORY_LINE_LENGTH, day, entry) &&
+          entry.time >= from && entry.time <= to) {
+        stats.matched++;
+        if (!visitor(entry, context)) {
+          return false;
+        }
+      }
+    }
+    first += lines;
+    count -= lines;
+  }
+  return true;
+}
+
+HistoryQueryStats HistoryStore::query(uint32_t from, uint32_t to, HistoryVisitor visitor, void* context) {
+  HistoryQueryStats stats = { 0, 0, 0, 0 };
+  for (uint8_t i = 0; i < _count && from <= to; i++) {
+    const Partition& partition = _days[i];
+    uint32_t dayStart = (uint32_t)partition.day * 86400;
+    if (dayStart + 86399 < from || dayStart > to) {
+      continue;
+    }
+    stats.partitions++;
+    uint32_t low = from > dayStart ? from - dayStart : 0;
+    uint32_t high = to - dayStart < 86399 ? to - dayStart : 86399;
+
+    // Indexed blocks: only those whose time span overlaps the range
+    char index[HISTORY_PATH_MAX];
+    path(partition.day, "idx", index, sizeof(index));
+    uint16_t block = 0;
+    while (block < partition.indexed) {
+      char entries[HISTORY_READ_LINES * HISTORY_INDEX_BYTES];
+      uint16_t want = partition.indexed - block < HISTORY_READ_LINES ? partition.indexed - block : HISTORY_READ_LINES;
+      int read = _storage.readAt(index, (uint32_t)block * HISTORY_INDEX_BYTES, entries, want * HISTORY_INDEX_BYTES);
+      if (read < HISTORY_INDEX_BYTES) {
+        break;                          // The tail scan below covers the rest
+      }
+      for (int j = 0; j + HISTORY_INDEX_BYTES <= read; j += HISTORY_INDEX_BYTES, block++) {
+        uint32_t blockLow, blockHigh;
+        if (parseIndexLine(entries + j, HISTORY_INDEX_BYTES - 1, blockLow, blockHigh) &&
+            (blockHigh < low || blockLow > high)) {
+          stats.blocksSkipped++;
+          continue;
+        }
+        stats.blocksRead++;
+        if (!scanLines(partition.day, (uint32_t)block * HISTORY_BLOCK_LINES, HISTORY_BLOCK_LINES,
+                       from, to, visitor, context, stats)) {
+          return stats;
+        }
+      }
+    }
+
+    // Lines past the last indexed block
+    uint32_t first = (uint32_t)block * HISTORY_BLOCK_LINES;
+    if (first < partition.records &&
+        !scanLines(partition.day, first, partition.records - first, from, to, visitor, context, stats)) {
+      return stats;
+    }
+
+    if (_staged > 0 && _stagedDay == partition.day) {
+      for (uint16_t line = 0; line < _staged; line++) {
+        HistoryEntry entry;
+        if (parseHistoryLine(_stage + line * HISTORY_LINE_BYTES, HISTORY_LINE_LENGTH, partition.day, entry) &&
+            entry.time >= from && entry.time <= to) {
+          stats.matched++;
+          if (!visitor(entry, context)) {
+            return stats;
+          }
+        }
+      }
+    }
+  }
+  return stats;
+}
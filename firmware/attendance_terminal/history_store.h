@@ -0,0 +1,142 @@
+/*
+ * On-device attendance history for Attendee Attendance Terminal v2.0
+ *
+ * Synced records used to leave the terminal for good, so with the backend
+ * unreachable nobody could ask it who tapped this morning. The history keeps
+ * every scan the backend accepted, online or from the backlog, for the last
+ * few days:
+ *
+ *   /hist_DDDDD.txt  one partition per day (days since 2000-01-01, by the
+ *                    scan's own timestamp), fixed-width lines in the order
+ *                    they were synced:  "HH:MM:SS K TAG" padded to 31 + '\n'
+ *                    (K: '-' toggle, 'I' entry, 'O' exit)
+ *   /hist_DDDDD.idx  sparse time index: one fixed-width "min max" line
+ *                    (seconds of the day) per HISTORY_BLOCK_LINES lines
+ *   /history.txt     the partition days, oldest first
+ *
+ * A range query reads the index of each day it covers and only the blocks
+ * whose [min, max] overlaps the range, plus the unindexed tail (less than a
+ * block), so answering it costs a few small reads whatever the history
+ * holds. Backlog uploads can arrive out of time order; min/max per block
+ * keeps the index exact for them.
+ *
+ * Lines are staged in RAM and appended together, like offline group commit;
+ * staged lines are included in queries. Losing them in a crash loses history
+ * only, the backend already has the records. Retention drops whole
+ * partitions: more than maxDays days, or days outside the retention window,
+ * remove both files of the oldest day. A day holds at most dayRecords lines;
+ * later ones are counted as dropped.
+ *
+ * Portable (no Arduino includes); storage comes from the HAL.
+ */
+
+#ifndef HISTORY_STORE_H
+#define HISTORY_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "attendance_core.h"
+#include "terminal_hal.h"
+
+#define HISTORY_LINE_LENGTH    31       // "HH:MM:SS K " + tag, space padded; '\n' follows
+#define HISTORY_LINE_BYTES     (HISTORY_LINE_LENGTH + 1)
+#define HISTORY_BLOCK_LINES    32       // Partition lines per index entry (1 KB)
+#define HISTORY_INDEX_BYTES    12       // "SSSSS SSSSS" + '\n'
+#define HISTORY_STAGE_LINES    16       // Lines staged in RAM between appends
+#define HISTORY_READ_LINES     8        // Lines per storage read while scanning a block
+#define HISTORY_PARTITIONS_MAX 16       // Days tracked, whatever maxDays asks for
+#define HISTORY_PATH_MAX       24
+
+enum HistoryKind {
+  HISTORY_TOGGLE,                       // Entry or exit decided by the backend
+  HISTORY_ENTRY,
+  HISTORY_EXIT
+};
+
+struct HistoryEntry {
+  uint32_t time;                        // Seconds since 2000-01-01
+  uint8_t kind;                         // HistoryKind
+  char tag[ATTENDANCE_UID_HEX_SIZE];
+};
+
+// Called for each entry in the queried range; return false to stop
+typedef bool (*HistoryVisitor)(const HistoryEntry& entry, void* context);
+
+struct HistoryQueryStats {
+  uint16_t partitions;                  // Days looked at
+  uint16_t blocksRead;                  // Indexed blocks that overlapped the range
+  uint16_t blocksSkipped;               // Indexed blocks the index ruled out
+  uint32_t matched;                     // Entries handed to the visitor
+};
+
+class HistoryStore {
+public:
+  HistoryStore(TerminalStorage& storage, const char* prefix, const char* manifestPath,
+               const char* manifestTempPath, uint8_t maxDays, uint16_t dayRecords,
+               uint32_t stageAgeMs);
+
+  void begin();                         // Find the partitions after boot, finish their indexes
+
+  // Stages one accepted scan; false when it was dropped (day full, or older
+  // than every partition kept)
+  bool add(const char* tag, uint32_t time, uint8_t kind, uint32_t nowMs);
+  // The same for a record as built by buildAttendancePayload()
+  bool addRecord(const char* record, size_t length, uint32_t nowMs);
+
+  bool flush();                         // Append staged lines now
+  bool flushIfDue(uint32_t nowMs);      // Once the oldest staged line is stageAgeMs old
+
+  // Drops partitions outside [today - maxDays + 1, today + 1] (days since
+  // 2000-01-01); a later day means the clock was wrong when they were written.
+  // Returns the partitions removed.
+  uint8_t dropExpired(uint16_t today);
+
+  // Entries with from <= time <= to, day by day, each day in stored order
+  HistoryQueryStats query(uint32_t from, uint32_t to, HistoryVisitor visitor, void* context);
+
+  uint8_t getPartitionCount() const { return _count; }
+  uint32_t getRecordCount() const;      // Stored and staged
+  uint16_t getStaged() const { return _staged; }
+  uint32_t getDropped() const { return _dropped; }
+  uint16_t getOldestDay() const { return _count ? _days[0].day : 0; }
+
+private:
+  struct Partition {
+    uint16_t day;
+    uint16_t records;                   // Lines on storage
+    uint16_t indexed;                   // Blocks with an index line
+    bool closed;                        // Torn last line: no more appends
+  };
+
+  const char* path(uint16_t day, const char* extension, char* out, size_t outSize) const;
+  Partition* find(uint16_t day);
+  Partition* create(uint16_t day);
+  bool removePartition(uint8_t position);
+  bool writeManifest();
+  uint16_t countLines(uint16_t day, bool& closed);
+  bool indexBlocks(Partition& partition);
+  bool scanLines(uint16_t day, uint32_t first, uint32_t count, uint32_t from, uint32_t to,
+                 HistoryVisitor visitor, void* context, HistoryQueryStats& stats);
+
+  TerminalStorage& _storage;
+  const char* _prefix;
+  const char* _manifestPath;
+  const char* _manifestTempPath;
+  uint8_t _maxDays;
+  uint16_t _dayRecords;
+  uint32_t _stageAgeMs;
+
+  Partition _days[HISTORY_PARTITIONS_MAX];  // Oldest first
+  uint8_t _count;
+
+  char _stage[HISTORY_STAGE_LINES * HISTORY_LINE_BYTES + 1];  // + NUL after the last line
+  uint16_t _staged;
+  uint16_t _stagedDay;
+  uint32_t _oldestMs;
+  uint32_t _dropped;
+};
+
+// Parses one partition line; false when malformed
+bool parseHistoryLine(const char* line, size_t length, uint16_t day, HistoryEntry& entry);
+
+#endif // HISTORY_STORE_H
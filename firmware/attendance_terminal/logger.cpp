@@ -0,0 +1,102 @@
+/*
+ * Leveled, non-blocking logger for Attendee Attendance Terminal v2.0
+ */
+
+#include "logger.h"
+
+static char logRing[LOG_BUFFER_SIZE];
+static uint16_t logHead = 0;          // Next byte to send
+static uint16_t logUsed = 0;          // Bytes waiting in ring
+static uint32_t logDropped = 0;       // Lines dropped since boot
+static uint32_t logDroppedReported = 0;
+
+static const char* levelPrefix(uint8_t level) {
+  switch (level) {
+    case LOG_LEVEL_ERROR: return "[ERROR] ";
+    case LOG_LEVEL_WARN:  return "[WARN] ";
+    case LOG_LEVEL_INFO:  return "[INFO] ";
+    case LOG_LEVEL_DEBUG: return "[DEBUG] ";
+  }
+  return "";
+}
+
+// Whole lines only, so a full ring never emits a truncated line
+static bool enqueueLine(const char* data, size_t len) {
+  if (len > (size_t)(LOG_BUFFER_SIZE - logUsed)) {
+    return false;
+  }
+  size_t tail = (logHead + logUsed) % LOG_BUFFER_SIZE;
+  for (size_t i = 0; i < len; i++) {
+    logRing[tail] = data[i];
+    tail = (tail + 1) % LOG_BUFFER_SIZE;
+  }
+  logUsed += len;
+  return true;
+}
+
+void logWrite(uint8_t level, PGM_P format, ...) {
+  char line[LOG_LINE_MAX];
+
+  // Report drops once there is room again so gaps in the output are visible
+  if (logDropped != logDroppedReported) {
+    int n = snprintf(line, sizeof(line), "[WARN] %lu log lines dropped\r\n",
+                     (unsigned long)(logDropped - logDroppedReported));
+    if (n > 0 && enqueueLine(line, n)) {
+      logDroppedReported = logDropped;
+    }
+  }
+
+  const char* prefix = levelPrefix(level);
+  size_t len = strlen(prefix);
+  memcpy(line, prefix, len);
+
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf_P(&line[len], sizeof(line) - len - 2, format, args);
+  va_end(args);
+  if (n < 0) {
+    n = 0;
+  }
+  len += (size_t)n < sizeof(line) - len - 2 ? (size_t)n : sizeof(line) - len - 3;
+  line[len++] = '\r';
+  line[len++] = '\n';
+
+  if (!enqueueLine(line, len)) {
+    logDropped++;
+  }
+
+  // Opportunistic drain keeps latency low when the UART is idle
+  serviceLogOutput();
+}
+
+void serviceLogOutput() {
+  while (logUsed > 0) {
+    size_t writable = Serial.availableForWrite();
+    if (writable == 0) {
+      return;
+    }
+    size_t contiguous = LOG_BUFFER_SIZE - logHead;
+    size_t chunk = logUsed;
+    if (chunk > contiguous) chunk = contiguous;
+    if (chunk > writable) chunk = writable;
+
+    size_t written = Serial.write((const uint8_t*)&logRing[logHead], chunk);
+    if (written == 0) {
+      return;
+    }
+    logHead = (logHead + written) % LOG_BUFFER_SIZE;
+    logUsed -= written;
+  }
+}
+
+void flushLogOutput() {
+  while (logUsed > 0) {
+    serviceLogOutput();
+    yield();
+  }
+  Serial.flush();
+}
+
+uint32_t getLogDroppedCount() {
+  return logDropped;
+}
@@ -0,0 +1,64 @@
+/*
+ * Leveled, non-blocking logger for Attendee Attendance Terminal v2.0
+ *
+ * LOG_E/LOG_W/LOG_I/LOG_D take printf-style format strings that stay in
+ * flash (PSTR). Lines below LOG_LEVEL are removed at compile time. Each
+ * line is formatted on the stack into a fixed RAM ring and drained to the
+ * UART only as fast as its TX FIFO accepts, so logging never blocks the
+ * scan path. Lines that do not fit in the ring are counted and dropped.
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#if DEBUG_ENABLED
+  #define LOG_ACTIVE_LEVEL LOG_LEVEL
+#else
+  #define LOG_ACTIVE_LEVEL LOG_LEVEL_NONE
+#endif
+
+#if LOG_ACTIVE_LEVEL >= LOG_LEVEL_ERROR
+  #define LOG_E(format, ...) logWrite(LOG_LEVEL_ERROR, PSTR(format), ##__VA_ARGS__)
+#else
+  #define LOG_E(format, ...) do {} while (0)
+#endif
+
+#if LOG_ACTIVE_LEVEL >= LOG_LEVEL_WARN
+  #define LOG_W(format, ...) logWrite(LOG_LEVEL_WARN, PSTR(format), ##__VA_ARGS__)
+#else
+  #define LOG_W(format, ...) do {} while (0)
+#endif
+
+#if LOG_ACTIVE_LEVEL >= LOG_LEVEL_INFO
+  #define LOG_I(format, ...) logWrite(LOG_LEVEL_INFO, PSTR(format), ##__VA_ARGS__)
+#else
+  #define LOG_I(format, ...) do {} while (0)
+#endif
+
+#if LOG_ACTIVE_LEVEL >= LOG_LEVEL_DEBUG
+  #define LOG_D(format, ...) logWrite(LOG_LEVEL_DEBUG, PSTR(format), ##__VA_ARGS__)
+#else
+  #define LOG_D(format, ...) do {} while (0)
+#endif
+
+// Format one line (format string in flash) into the output ring
+void logWrite(uint8_t level, PGM_P format, ...);
+
+// Move buffered bytes to the UART without blocking; call once per loop() pass
+void serviceLogOutput();
+
+// Blocking drain, for use right before a restart
+void flushLogOutput();
+
+uint32_t getLogDroppedCount();
+
+#endif // LOGGER_H
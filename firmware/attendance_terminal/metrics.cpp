@@ -0,0 +1,286 @@
+/*
+ * Prometheus-style metrics for Attendee Attendance Terminal v2.0
+ */
+
+#include "config.h"
+#include "metrics.h"
+#include "power_budget.h"
+
+// External references from main file
+extern int offlineLogsCount;
+extern bool isOnline;
+extern EnergyMeter energyMeter;
+
+// ========================================
+// BUCKET LAYOUTS
+// ========================================
+
+#define METRIC_MAX_BUCKETS 10
+
+static const uint32_t latencyBucketsMs[METRIC_MAX_BUCKETS] = {
+  10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000
+};
+static const uint32_t loopBucketsUs[METRIC_MAX_BUCKETS] = {
+  500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000
+};
+static const uint32_t busBucketsUs[METRIC_MAX_BUCKETS] = {
+  50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000
+};
+static const uint32_t appendBucketsUs[METRIC_MAX_BUCKETS] = {
+  25, 50, 100, 250, 1000, 2500, 5000, 10000, 25000, 100000
+};
+
+struct HistogramInfo {
+  const char* name;
+  const char* help;
+  const uint32_t* bounds;
+};
+
+// Order must match enum MetricHistogram
+static const HistogramInfo histogramInfo[HIST_COUNT] = {
+  { "attendee_scan_feedback_latency_ms", "Card detect to first user feedback", latencyBucketsMs },
+  { "attendee_scan_result_latency_ms",   "Card detect to final result shown", latencyBucketsMs },
+  { "attendee_http_dns_ms",              "Backend host name resolution time", latencyBucketsMs },
+  { "attendee_http_connect_ms",          "TCP connect time (HTTP)", latencyBucketsMs },
+  { "attendee_http_tls_ms",              "TCP connect plus TLS handshake time (HTTPS)", latencyBucketsMs },
+  { "attendee_http_ttfb_ms",             "Connected to response headers received", latencyBucketsMs },
+  { "attendee_http_request_ms",          "Backend request total time", latencyBucketsMs },
+  { "attendee_sync_duration_ms",         "Offline log sync pass duration", latencyBucketsMs },
+  { "attendee_loop_iteration_us",        "Main loop iteration time excluding idle delay", loopBucketsUs },
+  { "attendee_i2c_bus_us",               "I2C transaction time (LCD/RTC)", busBucketsUs },
+  { "attendee_spi_bus_us",               "SPI transaction time (RFID reader)", busBucketsUs },
+  { "attendee_backend_probe_ms",         "Backend endpoint /health round trip", latencyBucketsMs },
+  { "attendee_rfid_detect_latency_ms",   "Card arrival to detect, upper bound from the poll gap", latencyBucketsMs },
+  { "attendee_offline_append_us",        "Offline record append, including any flash write it triggers", appendBucketsUs }
+};
+
+struct CounterInfo {
+  const char* name;
+  const char* help;
+};
+
+// Order must match enum MetricCounter
+static const CounterInfo counterInfo[CTR_COUNT] = {
+  { "attendee_scans_total",               "Cards read successfully" },
+  { "attendee_scan_read_failures_total",  "Card detected but UID read failed" },
+  { "attendee_http_requests_total",       "Backend requests issued" },
+  { "attendee_http_errors_total",         "Backend requests without a 2xx response" },
+  { "attendee_tls_handshakes_total",      "TLS handshakes performed" },
+  { "attendee_sync_records_total",        "Offline records uploaded" },
+  { "attendee_sync_bytes_total",          "Offline record bytes uploaded" },
+  { "attendee_offline_stored_total",      "Records written to the offline backlog" },
+  { "attendee_sync_throttled_total",      "Sync passes cut short by a 429/503" },
+  { "attendee_coap_retransmits_total",    "CoAP requests resent after an ACK timeout" },
+  { "attendee_mqtt_connects_total",       "MQTT sessions established (first connect and reconnects)" },
+  { "attendee_backend_commands_total",    "Instructions pushed by the backend over MQTT" },
+  { "attendee_roster_changes_total",      "Roster entries received (delta changes and snapshot members)" },
+  { "attendee_roster_not_modified_total", "Roster checks answered 304 Not Modified" },
+  { "attendee_backend_failovers_total",   "Requests moved to another backend endpoint after a failure" },
+  { "attendee_backend_probe_errors_total", "Backend endpoint health probes that failed" },
+  { "attendee_rfid_gain_changes_total",   "Antenna gain steps taken by the adaptive tuner" },
+  { "attendee_rfid_probes_total",         "RFID reader liveness probes run" },
+  { "attendee_rfid_resets_no_response_total", "RFID reader resets after a bad version register read" },
+  { "attendee_rfid_resets_config_lost_total", "RFID reader resets after its init registers were lost" },
+  { "attendee_rfid_resets_read_failures_total", "RFID reader resets after consecutive failed UID reads" },
+  { "attendee_rfid_polls_total",          "Card detect polls (REQA sent, or armed in IRQ mode)" },
+  { "attendee_offline_flash_writes_total", "Offline backlog file writes (one per group commit)" },
+  { "attendee_offline_segments_sealed_total", "Compressed offline segments written" },
+  { "attendee_offline_segments_uploaded_total", "Compressed offline segments accepted by the backend" },
+  { "attendee_offline_compacted_total",   "Redundant offline records dropped before upload" },
+  { "attendee_sync_rejected_total",       "Offline records the backend refused for good (unknown card, bad record), dropped" }
+};
+
+// ========================================
+// STORAGE
+// ========================================
+
+struct HistogramData {
+  uint32_t buckets[METRIC_MAX_BUCKETS + 1];  // Last slot is +Inf
+  uint32_t count;
+  uint64_t sum;
+};
+
+static HistogramData histograms[HIST_COUNT];
+static uint32_t counters[CTR_COUNT];
+static uint32_t heapMinFree = 0xFFFFFFFF;
+static uint32_t lastConnectMicros = 0;
+
+void observeMetric(MetricHistogram id, uint32_t value) {
+  HistogramData& h = histograms[id];
+  const uint32_t* bounds = histogramInfo[id].bounds;
+
+  // Buckets are stored non-cumulative and summed at scrape time
+  uint8_t i = 0;
+  while (i < METRIC_MAX_BUCKETS && value > bounds[i]) {
+    i++;
+  }
+  h.buckets[i]++;
+  h.count++;
+  h.sum += value;
+}
+
+void incrementMetric(MetricCounter id, uint32_t amount) {
+  counters[id] += amount;
+}
+
+uint32_t getMetricCount(MetricCounter id) {
+  return counters[id];
+}
+
+uint32_t getMetricPercentile(MetricHistogram id, uint8_t percent) {
+  const HistogramData& h = histograms[id];
+  if (h.count == 0) {
+    return 0;
+  }
+  const uint32_t* bounds = histogramInfo[id].bounds;
+  uint32_t rank = (uint32_t)(((uint64_t)h.count * percent + 99) / 100);
+  uint32_t cumulative = 0;
+  for (uint8_t i = 0; i < METRIC_MAX_BUCKETS; i++) {
+    cumulative += h.buckets[i];
+    if (cumulative >= rank) {
+      return bounds[i];
+    }
+  }
+  return bounds[METRIC_MAX_BUCKETS - 1];
+}
+
+void sampleHeapMetrics() {
+  uint32_t freeHeap = ESP.getFreeHeap();
+  if (freeHeap < heapMinFree) {
+    heapMinFree = freeHeap;
+  }
+}
+
+uint32_t getLastConnectMicros() {
+  return lastConnectMicros;
+}
+
+// ========================================
+// EXPOSITION
+// ========================================
+
+// Batches small writes into one chunk per flush
+class ChunkedMetricsWriter {
+public:
+  explicit ChunkedMetricsWriter(ESP8266WebServer& server) : _server(server), _len(0) {}
+
+  void printf(const char* format, ...) {
+    char line[160];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (n <= 0) return;
+    if (n >= (int)sizeof(line)) n = sizeof(line) - 1;
+
+    if (_len + n > sizeof(_buf)) {
+      flush();
+    }
+    memcpy(&_buf[_len], line, n);
+    _len += n;
+  }
+
+  void flush() {
+    if (_len > 0) {
+      _server.sendContent(_buf, _len);
+      _len = 0;
+    }
+  }
+
+private:
+  ESP8266WebServer& _server;
+  char _buf[512];
+  size_t _len;
+};
+
+static void writeGauge(ChunkedMetricsWriter& out, const char* name, const char* help, uint32_t value) {
+  out.printf("# HELP %s %s\n# TYPE %s gauge\n%s %lu\n", name, help, name, name, (unsigned long)value);
+}
+
+void sendMetrics(ESP8266WebServer& server) {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; version=0.0.4", "");
+
+  ChunkedMetricsWriter out(server);
+
+  for (int id = 0; id < HIST_COUNT; id++) {
+    const HistogramInfo& info = histogramInfo[id];
+    const HistogramData& h = histograms[id];
+
+    out.printf("# HELP %s %s\n# TYPE %s histogram\n", info.name, info.help, info.name);
+    uint32_t cumulative = 0;
+    for (int b = 0; b < METRIC_MAX_BUCKETS; b++) {
+      cumulative += h.buckets[b];
+      out.printf("%s_bucket{le=\"%lu\"} %lu\n", info.name,
+                 (unsigned long)info.bounds[b], (unsigned long)cumulative);
+    }
+    cumulative += h.buckets[METRIC_MAX_BUCKETS];
+    out.printf("%s_bucket{le=\"+Inf\"} %lu\n", info.name, (unsigned long)cumulative);
+    out.printf("%s_sum %llu\n%s_count %lu\n", info.name, (unsigned long long)h.sum,
+               info.name, (unsigned long)h.count);
+  }
+
+  for (int id = 0; id < CTR_COUNT; id++) {
+    const CounterInfo& info = counterInfo[id];
+    out.printf("# HELP %s %s\n# TYPE %s counter\n%s %lu\n",
+               info.name, info.help, info.name, info.name, (unsigned long)counters[id]);
+  }
+
+  writeGauge(out, "attendee_offline_queue_depth", "Records waiting in the offline backlog", offlineLogsCount);
+  writeGauge(out, "attendee_heap_free_bytes", "Free heap", ESP.getFreeHeap());
+  writeGauge(out, "attendee_heap_min_free_bytes", "Lowest free heap observed", heapMinFree);
+  writeGauge(out, "attendee_heap_max_block_bytes", "Largest allocatable heap block", ESP.getMaxFreeBlockSize());
+  writeGauge(out, "attendee_heap_fragmentation_percent", "Heap fragmentation", ESP.getHeapFragmentation());
+  writeGauge(out, "attendee_online", "Backend connectivity (1 = online)", isOnline ? 1 : 0);
+  writeGauge(out, "attendee_uptime_seconds", "Seconds since boot", millis() / 1000);
+  writeGauge(out, "attendee_energy_mwh_per_hour_x10", "Estimated energy per hour, tenths of mWh",
+             energyMeter.getMwhPerHourX10());
+
+  out.flush();
+  server.sendContent("");
+}
+
+// ========================================
+// INSTRUMENTED NETWORK CLIENTS
+// ========================================
+
+static bool resolveTimed(const char* host) {
+  IPAddress ip;
+  unsigned long start = millis();
+  bool resolved = WiFi.hostByName(host, ip);
+  observeMetric(HIST_HTTP_DNS_MS, millis() - start);
+  return resolved;
+}
+
+int TimedWiFiClient::connect(const char* host, uint16_t port) {
+  if (!resolveTimed(host)) {
+    return 0;
+  }
+  unsigned long start = millis();
+  int result = WiFiClient::connect(host, port);
+  observeMetric(HIST_HTTP_CONNECT_MS, millis() - start);
+  lastConnectMicros = micros();
+  return result;
+}
+
+std::unique_ptr<WiFiClient> TimedWiFiClient::clone() const {
+  return std::unique_ptr<WiFiClient>(new TimedWiFiClient(*this));
+}
+
+int TimedWiFiClientSecure::connect(const char* host, uint16_t port) {
+  if (!resolveTimed(host)) {
+    return 0;
+  }
+  unsigned long start = millis();
+  int result = BearSSL::WiFiClientSecure::connect(host, port);
+  observeMetric(HIST_HTTP_TLS_MS, millis() - start);
+  if (result) {
+    incrementMetric(CTR_TLS_HANDSHAKES);
+  }
+  lastConnectMicros = micros();
+  return result;
+}
+
+std::unique_ptr<WiFiClient> TimedWiFiClientSecure::clone() const {
+  return std::unique_ptr<WiFiClient>(new TimedWiFiClientSecure(*this));
+}
@@ -0,0 +1,108 @@
+/*
+ * Prometheus-style metrics for Attendee Attendance Terminal v2.0
+ *
+ * Fixed-bucket histograms and monotonic counters kept in static RAM.
+ * Observing a value is a short bucket scan with no allocation, so the
+ * instrumentation stays enabled in production builds. GET /metrics renders
+ * the text exposition format for a local Prometheus scraper.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+#include <ESP8266WebServer.h>
+
+// Histograms (unit is part of the exported metric name)
+enum MetricHistogram {
+  HIST_SCAN_FEEDBACK_MS,    // Card detected -> first beep/LED feedback
+  HIST_SCAN_RESULT_MS,      // Card detected -> final result shown
+  HIST_HTTP_DNS_MS,         // Host name resolution
+  HIST_HTTP_CONNECT_MS,     // TCP connect (plain HTTP)
+  HIST_HTTP_TLS_MS,         // TCP connect + TLS handshake (HTTPS)
+  HIST_HTTP_TTFB_MS,        // Connected -> response headers received
+  HIST_HTTP_TOTAL_MS,       // Whole request including body read
+  HIST_SYNC_DURATION_MS,    // One syncOfflineLogs() pass
+  HIST_LOOP_US,             // One loop() iteration, excluding the idle delay
+  HIST_I2C_US,              // LCD/RTC bus transactions
+  HIST_SPI_US,              // RFID reader bus transactions
+  HIST_BACKEND_PROBE_MS,    // Backend endpoint /health round trip
+  HIST_RFID_DETECT_MS,      // Card arrival -> detect, upper bound (gap before the finding poll)
+  HIST_OFFLINE_APPEND_US,   // Offline record append (staging, or the flash write it triggers)
+  HIST_COUNT
+};
+
+// Monotonic counters
+enum MetricCounter {
+  CTR_SCANS,                // Cards read successfully
+  CTR_SCAN_READ_FAILURES,   // Card detected but serial read failed
+  CTR_HTTP_REQUESTS,        // Backend requests issued
+  CTR_HTTP_ERRORS,          // Backend requests without a 2xx response
+  CTR_TLS_HANDSHAKES,       // New TLS sessions negotiated
+  CTR_SYNC_RECORDS,         // Offline records uploaded
+  CTR_SYNC_BYTES,           // Offline record payload bytes uploaded
+  CTR_OFFLINE_STORED,       // Records written to the offline backlog
+  CTR_SYNC_THROTTLED,       // Sync passes cut short by a 429/503
+  CTR_COAP_RETRANSMITS,     // CoAP requests resent after an ACK timeout
+  CTR_MQTT_CONNECTS,        // MQTT sessions established (first connect and reconnects)
+  CTR_BACKEND_COMMANDS,     // Instructions pushed by the backend over MQTT
+  CTR_ROSTER_CHANGES,       // Roster entries received (delta changes and snapshot members)
+  CTR_ROSTER_NOT_MODIFIED,  // Roster checks answered 304 Not Modified
+  CTR_BACKEND_FAILOVERS,    // Requests moved to another backend endpoint after a failure
+  CTR_BACKEND_PROBE_ERRORS, // Backend endpoint health probes that failed
+  CTR_RFID_GAIN_CHANGES,    // Antenna gain steps taken by the adaptive tuner
+  CTR_RFID_PROBES,          // Reader liveness probes run
+  CTR_RFID_RESETS_NO_RESPONSE, // Resets after the reader stopped answering (bad version register)
+  CTR_RFID_RESETS_CONFIG_LOST, // Resets after the reader lost its init registers (brown-out)
+  CTR_RFID_RESETS_READ_FAILURES, // Resets after consecutive failed UID reads
+  CTR_RFID_POLLS,           // Card detect polls (REQA sent, or armed in IRQ mode)
+  CTR_OFFLINE_FLASH_WRITES, // Offline backlog file writes (one per group commit)
+  CTR_SEGMENTS_SEALED,      // Compressed offline segments written
+  CTR_SEGMENTS_UPLOADED,    // Compressed offline segments accepted by the backend
+  CTR_OFFLINE_COMPACTED,    // Redundant offline records dropped before upload
+  CTR_SYNC_REJECTED,        // Offline records the backend refused for good, dropped
+  CTR_COUNT
+};
+
+void observeMetric(MetricHistogram id, uint32_t value);
+void incrementMetric(MetricCounter id, uint32_t amount = 1);
+uint32_t getMetricCount(MetricCounter id);
+
+// Upper bound of the bucket holding the given percentile; 0 before the
+// first sample, the last finite bound when it falls in +Inf
+uint32_t getMetricPercentile(MetricHistogram id, uint8_t percent);
+
+// Track heap low-water mark; call once per loop() pass
+void sampleHeapMetrics();
+
+// Stream the text exposition format as a chunked response
+void sendMetrics(ESP8266WebServer& server);
+
+// Timestamp (micros) at which the most recent instrumented connect completed
+uint32_t getLastConnectMicros();
+
+// ========================================
+// INSTRUMENTED NETWORK CLIENTS
+// ========================================
+// HTTPClient gives no visibility into its connection phases, so the clients
+// it clones record DNS and connect/TLS time themselves. DNS is resolved
+// up-front; the connect that follows hits the lwIP cache.
+
+class TimedWiFiClient : public WiFiClient {
+public:
+  using WiFiClient::connect;
+  int connect(const char* host, uint16_t port) override;
+  std::unique_ptr<WiFiClient> clone() const override;
+};
+
+class TimedWiFiClientSecure : public BearSSL::WiFiClientSecure {
+public:
+  using BearSSL::WiFiClientSecure::connect;
+  int connect(const char* host, uint16_t port) override;
+  std::unique_ptr<WiFiClient> clone() const override;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,641 @@
+/*
+ * MQTT transport for Attendee Attendance Terminal v2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mqtt_transport.h"
+#include "attendance_core.h"
+
+#define MQTT_CONNECT      0x10
+#define MQTT_CONNACK      0x20
+#define MQTT_PUBLISH      0x30
+#define MQTT_PUBACK       0x40
+#define MQTT_SUBSCRIBE    0x82
+#define MQTT_SUBACK       0x90
+#define MQTT_PINGREQ      0xc0
+#define MQTT_PINGRESP     0xd0
+#define MQTT_DISCONNECT   0xe0
+
+bool isMqttUrl(const char* url) {
+  return url && (strncmp(url, "mqtt://", 7) == 0 || strncmp(url, "mqtts://", 8) == 0);
+}
+
+// ========================================
+// PACKET ENCODING
+// ========================================
+
+static bool putString(uint8_t* out, size_t outSize, size_t& pos, const char* value, size_t length) {
+  if (pos + 2 + length > outSize) {
+    return false;
+  }
+  out[pos++] = (uint8_t)(length >> 8);
+  out[pos++] = (uint8_t)length;
+  memcpy(out + pos, value, length);
+  pos += length;
+  return true;
+}
+
+static bool putString(uint8_t* out, size_t outSize, size_t& pos, const char* value) {
+  return putString(out, outSize, pos, value, strlen(value));
+}
+
+static bool putShort(uint8_t* out, size_t outSize, size_t& pos, uint16_t value) {
+  if (pos + 2 > outSize) {
+    return false;
+  }
+  out[pos++] = (uint8_t)(value >> 8);
+  out[pos++] = (uint8_t)value;
+  return true;
+}
+
+// ========================================
+// CLIENT
+// ========================================
+
+MqttClient::MqttClient(TerminalConnection& connection, TerminalClock& clock)
+  : _connection(connection), _clock(clock), _handler(NULL), _context(NULL), _timeoutMs(5000),
+    _connected(false), _sessionPresent(false), _keepAliveMs(0), _nextPacketId(0),
+    _lastSend(0), _lastReceive(0), _pingOutstanding(false), _ackType(0), _ackPacketId(0),
+    _ackCode(0), _rxLength(0), _publishes(0) {
+}
+
+bool MqttClient::sendPacket(uint8_t header, const uint8_t* body, size_t length) {
+  uint8_t fixed[5];
+  size_t fixedLength = 1;
+  fixed[0] = header;
+  size_t remaining = length;
+  do {
+    uint8_t digit = remaining % 128;
+    remaining /= 128;
+    fixed[fixedLength++] = digit | (remaining > 0 ? 0x80 : 0);
+  } while (remaining > 0 && fixedLength < sizeof(fixed));
+
+  // The connection never blocks; spin (with idle) until lwIP takes it all
+  const uint8_t* parts[2] = { fixed, body };
+  size_t sizes[2] = { fixedLength, length };
+  uint32_t started = _clock.millis();
+  for (int i = 0; i < 2; i++) {
+    size_t sent = 0;
+    while (sent < sizes[i]) {
+      int n = _connection.write((const char*)parts[i] + sent, sizes[i] - sent);
+      if (n < 0) {
+        drop();
+        return false;
+      }
+      if (n == 0) {
+        if (_clock.millis() - started > _timeoutMs) {
+          drop();
+          return false;
+        }
+        idle();
+      }
+      sent += (size_t)n;
+    }
+  }
+  _lastSend = _clock.millis();
+  return true;
+}
+
+bool MqttClient::connect(const char* host, uint16_t port, bool secure, const MqttConnectOptions& options) {
+  drop();
+  if (!_connection.open(host, port, secure)) {
+    return false;
+  }
+
+  uint8_t body[MQTT_MAX_PACKET];
+  size_t pos = 0;
+  uint8_t flags = options.cleanSession ? 0x02 : 0x00;
+  bool hasUser = options.username && options.username[0];
+  bool hasPassword = hasUser && options.password && options.password[0];
+  if (options.willTopic) flags |= 0x04 | 0x08 | 0x20;   // Will, QoS 1, retained
+  if (hasUser) flags |= 0x80;
+  if (hasPassword) flags |= 0x40;
+
+  bool ok = putString(body, sizeof(body), pos, "MQTT");
+  if (ok && pos + 2 <= sizeof(body)) {
+    body[pos++] = 4;                    // Protocol level 3.1.1
+    body[pos++] = flags;
+  } else {
+    ok = false;
+  }
+  ok = ok && putShort(body, sizeof(body), pos, options.keepAliveSec);
+  ok = ok && putString(body, sizeof(body), pos, options.clientId);
+  if (options.willTopic) {
+    ok = ok && putString(body, sizeof(body), pos, options.willTopic);
+    ok = ok && putString(body, sizeof(body), pos, options.willMessage ? options.willMessage : "");
+  }
+  if (hasUser) ok = ok && putString(body, sizeof(body), pos, options.username);
+  if (hasPassword) ok = ok && putString(body, sizeof(body), pos, options.password);
+  if (!ok) {
+    _connection.close();
+    return false;
+  }
+
+  _rxLength = 0;
+  _keepAliveMs = options.keepAliveSec * 1000UL;
+  _pingOutstanding = false;
+  _lastReceive = _clock.millis();
+  _connected = true;                    // Lets sendPacket/readPackets run; reset on failure
+  if (!sendPacket(MQTT_CONNECT, body, pos) || !waitForAck(MQTT_CONNACK, 0) || _ackCode != 0) {
+    drop();
+    return false;
+  }
+  return true;
+}
+
+void MqttClient::disconnect() {
+  if (_connected) {
+    sendPacket(MQTT_DISCONNECT, NULL, 0);
+  }
+  drop();
+}
+
+void MqttClient::drop() {
+  if (_connected || _connection.isOpen()) {
+    _connection.close();
+  }
+  _connected = false;
+  _rxLength = 0;
+}
+
+bool MqttClient::subscribe(const char* filter, uint8_t qos) {
+  if (!_connected) {
+    return false;
+  }
+  uint8_t body[MQTT_TOPIC_MAX + 8];
+  size_t pos = 0;
+  uint16_t packetId = ++_nextPacketId ? _nextPacketId : ++_nextPacketId;
+  if (!putShort(body, sizeof(body), pos, packetId) || !putString(body, sizeof(body), pos, filter) ||
+      pos >= sizeof(body)) {
+    return false;
+  }
+  body[pos++] = qos;
+  return sendPacket(MQTT_SUBSCRIBE, body, pos) && waitForAck(MQTT_SUBACK, packetId) && _ackCode != 0x80;
+}
+
+bool MqttClient::publish(const char* topic, const char* payload, size_t len, uint8_t qos, bool retain) {
+  if (!_connected) {
+    return false;
+  }
+  uint8_t body[MQTT_MAX_PACKET];
+  size_t pos = 0;
+  uint16_t packetId = 0;
+  if (!putString(body, sizeof(body), pos, topic)) {
+    return false;
+  }
+  if (qos > 0) {
+    packetId = ++_nextPacketId ? _nextPacketId : ++_nextPacketId;
+    putShort(body, sizeof(body), pos, packetId);
+  }
+  if (pos + len > sizeof(body)) {
+    return false;
+  }
+  memcpy(body + pos, payload, len);
+  pos += len;
+
+  uint8_t header = MQTT_PUBLISH | (qos > 0 ? 0x02 : 0x00) | (retain ? 0x01 : 0x00);
+  if (!sendPacket(header, body, pos)) {
+    return false;
+  }
+  _publishes++;
+  if (qos == 0) {
+    return true;
+  }
+  if (!waitForAck(MQTT_PUBACK, packetId)) {
+    // Without the PUBACK the broker's state is unknown; start over on a new
+    // connection. The caller keeps the record and resends it later.
+    drop();
+    return false;
+  }
+  return true;
+}
+
+bool MqttClient::waitForAck(uint8_t type, uint16_t packetId) {
+  _ackType = 0;
+  uint32_t started = _clock.millis();
+  while (_connected) {
+    if (!readPackets()) {
+      return false;
+    }
+    if (_ackType == type && _ackPacketId == packetId) {
+      return true;
+    }
+    if (_clock.millis() - started > _timeoutMs) {
+      return false;
+    }
+    idle();
+  }
+  return false;
+}
+
+bool MqttClient::loop() {
+  if (!_connected) {
+    return false;
+  }
+  if (!readPackets()) {
+    return false;
+  }
+
+  // Keep-alive: ping when quiet, give up after 1.5x keep-alive without traffic
+  uint32_t now = _clock.millis();
+  if (_keepAliveMs > 0) {
+    if (now - _lastReceive > _keepAliveMs + _keepAliveMs / 2) {
+      drop();
+      return false;
+    }
+    if (!_pingOutstanding && now - _lastSend > _keepAliveMs / 2) {
+      _pingOutstanding = true;
+      if (!sendPacket(MQTT_PINGREQ, NULL, 0)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool MqttClient::readPackets() {
+  while (true) {
+    if (_rxLength < sizeof(_rx)) {
+      int n = _connection.read((char*)_rx + _rxLength, sizeof(_rx) - _rxLength);
+      if (n < 0) {
+        drop();
+        return false;
+      }
+      _rxLength += (size_t)n;
+      if (n > 0) {
+        _lastReceive = _clock.millis();
+      }
+    }
+
+    // Decode the fixed header
+    if (_rxLength < 2) {
+      return true;
+    }
+    size_t remaining = 0;
+    size_t multiplier = 1;
+    size_t pos = 1;
+    bool complete = false;
+    while (pos < _rxLength && pos < 5) {
+      uint8_t digit = _rx[pos++];
+      remaining += (digit & 0x7f) * multiplier;
+      multiplier *= 128;
+      if (!(digit & 0x80)) {
+        complete = true;
+        break;
+      }
+    }
+    if (!complete) {
+      if (pos >= 5) {
+        drop();                           // Malformed length
+        return false;
+      }
+      return true;
+    }
+    if (pos + remaining > sizeof(_rx)) {
+      drop();                             // Larger than we accept
+      return false;
+    }
+    if (_rxLength < pos + remaining) {
+      if (_rxLength == sizeof(_rx)) {
+        drop();
+        return false;
+      }
+      return true;                        // Wait for the rest
+    }
+
+    handlePacket(_rx[0], _rx + pos, remaining);
+    if (!_connected) {
+      return false;
+    }
+    size_t consumed = pos + remaining;
+    memmove(_rx, _rx + consumed, _rxLength - consumed);
+    _rxLength -= consumed;
+  }
+}
+
+void MqttClient::handlePacket(uint8_t header, const uint8_t* body, size_t length) {
+  uint8_t type = header & 0xf0;
+  switch (type) {
+    case MQTT_CONNACK:
+      if (length >= 2) {
+        _sessionPresent = (body[0] & 0x01) != 0;
+        _ackType = MQTT_CONNACK;
+        _ackPacketId = 0;
+        _ackCode = body[1];
+      }
+      break;
+
+    case MQTT_PUBACK:
+    case MQTT_SUBACK:
+      if (length >= 2) {
+        _ackType = type == MQTT_PUBACK ? MQTT_PUBACK : MQTT_SUBACK;
+        _ackPacketId = (uint16_t)((body[0] << 8) | body[1]);
+        _ackCode = length >= 3 ? body[2] : 0;
+      }
+      break;
+
+    case MQTT_PINGRESP:
+      _pingOutstanding = false;
+      break;
+
+    case MQTT_PUBLISH: {
+      uint8_t qos = (header >> 1) & 0x03;
+      if (length < 2) {
+        break;
+      }
+      size_t topicLength = (size_t)((body[0] << 8) | body[1]);
+      size_t pos = 2 + topicLength;
+      uint16_t packetId = 0;
+      if (qos > 0) {
+        if (pos + 2 > length) break;
+        packetId = (uint16_t)((body[pos] << 8) | body[pos + 1]);
+        pos += 2;
+      }
+      if (pos > length) {
+        break;
+      }
+      if (_handler) {
+        _handler((const char*)body + 2, topicLength, (const char*)body + pos, length - pos, _context);
+      }
+      if (qos == 1) {
+        uint8_t ack[2] = { (uint8_t)(packetId >> 8), (uint8_t)packetId };
+        sendPacket(MQTT_PUBACK, ack, sizeof(ack));
+      }
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+// ========================================
+// TRANSPORT
+// ========================================
+
+MqttTransport::MqttTransport(MqttClient& client, TerminalClock& clock,
+                             const char* username, const char* password)
+  : _client(client), _clock(clock), _username(username), _password(password),
+    _port(0), _secure(false), _hasBroker(false), _keepAliveSec(60), _replyTimeoutMs(1500),
+    _backoffMinMs(2000), _backoffMaxMs(60000), _backoffMs(0), _lastAttempt(0), _attempted(false),
+    _connects(0), _commandPending(false), _reply(NULL), _replySize(0), _replyReady(false) {
+  _clientId[0] = 0;
+  _host[0] = 0;
+  _prefix[0] = 0;
+  _command[0] = 0;
+  _replyTopic[0] = 0;
+  _replySeq[0] = 0;
+  _client.setMessageHandler(onMessage, this);
+}
+
+void MqttTransport::setReconnectBackoff(uint32_t minMs, uint32_t maxMs) {
+  _backoffMinMs = minMs;
+  _backoffMaxMs = maxMs;
+}
+
+bool MqttTransport::setBroker(const char* url, const char* clientId) {
+  size_t clientIdLength = strlen(clientId);
+  if (clientIdLength == 0 || clientIdLength >= sizeof(_clientId)) {
+    return false;
+  }
+
+  bool secure;
+  const char* hostStart;
+  uint16_t port;
+  if (strncmp(url, "mqtt://", 7) == 0) {
+    secure = false;
+    port = 1883;
+    hostStart = url + 7;
+  } else if (strncmp(url, "mqtts://", 8) == 0) {
+    secure = true;
+    port = 8883;
+    hostStart = url + 8;
+  } else {
+    return false;
+  }
+
+  const char* pathStart = strchr(hostStart, '/');
+  const char* authorityEnd = pathStart ? pathStart : hostStart + strlen(hostStart);
+  const char* colon = (const char*)memchr(hostStart, ':', authorityEnd - hostStart);
+  const char* hostEnd = colon ? colon : authorityEnd;
+  size_t hostLength = hostEnd - hostStart;
+  if (hostLength == 0 || hostLength >= sizeof(_host)) {
+    return false;
+  }
+  if (colon) {
+    unsigned long parsed = strtoul(colon + 1, NULL, 10);
+    if (parsed == 0 || parsed > 65535) {
+      return false;
+    }
+    port = (uint16_t)parsed;
+  }
+
+  // Prefix: the URL path without surrounding slashes
+  const char* prefix = pathStart ? pathStart : "";
+  while (*prefix == '/') prefix++;
+  size_t prefixLength = strlen(prefix);
+  while (prefixLength > 0 && prefix[prefixLength - 1] == '/') prefixLength--;
+  if (prefixLength >= sizeof(_prefix)) {
+    return false;
+  }
+
+  bool same = _hasBroker && secure == _secure && port == _port &&
+              strlen(_host) == hostLength && memcmp(_host, hostStart, hostLength) == 0 &&
+              strlen(_prefix) == prefixLength && memcmp(_prefix, prefix, prefixLength) == 0 &&
+              strcmp(_clientId, clientId) == 0;
+  if (same) {
+    return true;
+  }
+
+  _client.disconnect();
+  memcpy(_host, hostStart, hostLength);
+  _host[hostLength] = 0;
+  memcpy(_prefix, prefix, prefixLength);
+  _prefix[prefixLength] = 0;
+  memcpy(_clientId, clientId, clientIdLength + 1);
+  _port = port;
+  _secure = secure;
+  _hasBroker = true;
+  _attempted = false;
+  _backoffMs = 0;
+  return true;
+}
+
+bool MqttTransport::ensureConnected() {
+  if (_client.isConnected()) {
+    return true;
+  }
+  if (!_hasBroker) {
+    return false;
+  }
+  uint32_t now = _clock.millis();
+  if (_attempted && now - _lastAttempt < _backoffMs) {
+    return false;
+  }
+  _attempted = true;
+  _lastAttempt = now;
+
+  char statusTopic[MQTT_TOPIC_MAX];
+  char filter[MQTT_TOPIC_MAX];
+  const char* separator = _prefix[0] ? "/" : "";
+  snprintf(statusTopic, sizeof(statusTopic), "%s%s%s/status", _prefix, separator, _clientId);
+
+  MqttConnectOptions options;
+  options.clientId = _clientId;
+  options.username = _username;
+  options.password = _password;
+  options.willTopic = statusTopic;
+  options.willMessage = "offline";
+  options.keepAliveSec = _keepAliveSec;
+  options.cleanSession = false;
+
+  bool ok = _client.connect(_host, _port, _secure, options);
+  // A resumed session keeps its subscriptions
+  if (ok && !_client.isSessionPresent()) {
+    snprintf(filter, sizeof(filter), "%s%s%s/commands", _prefix, separator, _clientId);
+    ok = _client.subscribe(filter, 1);
+    snprintf(filter, sizeof(filter), "%s%s%s/reply/#", _prefix, separator, _clientId);
+    ok = ok && _client.subscribe(filter, 1);
+  }
+  ok = ok && _client.publish(statusTopic, "online", 6, 1, true);
+
+  if (!ok) {
+    _client.disconnect();
+    _backoffMs = _backoffMs ? _backoffMs * 2 : _backoffMinMs;
+    if (_backoffMs > _backoffMaxMs) _backoffMs = _backoffMaxMs;
+    return false;
+  }
+  _backoffMs = 0;
+  _connects++;
+  return true;
+}
+
+bool MqttTransport::topicFor(const char* url, char* topic, size_t topicSize, const char** endpoint) {
+  // Endpoint: the URL path after the prefix, e.g. "attendance" or "device/heartbeat"
+  const char* scheme = strstr(url, "://");
+  if (!scheme) {
+    return false;
+  }
+  const char* path = strchr(scheme + 3, '/');
+  if (!path) {
+    return false;
+  }
+  while (*path == '/') path++;
+  size_t prefixLength = strlen(_prefix);
+  if (prefixLength > 0) {
+    if (strncmp(path, _prefix, prefixLength) != 0 || path[prefixLength] != '/') {
+      return false;
+    }
+    path += prefixLength + 1;
+  }
+  if (!*path) {
+    return false;
+  }
+  *endpoint = path;
+  int written = snprintf(topic, topicSize, "%s%s%s/%s", _prefix, prefixLength ? "/" : "", _clientId, path);
+  return written > 0 && (size_t)written < topicSize;
+}
+
+int MqttTransport::postJson(const char* url, const char* body, size_t len,
+                            char* response, size_t responseSize) {
+  if (response && responseSize > 0) {
+    response[0] = 0;
+  }
+
+  char topic[MQTT_TOPIC_MAX];
+  const char* endpoint;
+  if (!topicFor(url, topic, sizeof(topic), &endpoint)) {
+    return MQTT_ERROR_CONNECT;
+  }
+  if (!ensureConnected()) {
+    return MQTT_ERROR_CONNECT;
+  }
+
+  // Replies are matched on the record's sequence number
+  bool wantReply = response && responseSize > 1 &&
+                   findJsonScalar(body, len, "seq", _replySeq, sizeof(_replySeq));
+  if (wantReply) {
+    const char* separator = _prefix[0] ? "/" : "";
+    snprintf(_replyTopic, sizeof(_replyTopic), "%s%s%s/reply/%s", _prefix, separator, _clientId, endpoint);
+    _reply = response;
+    _replySize = responseSize;
+    _replyReady = false;
+  }
+
+  if (!_client.publish(topic, body, len, 1, false)) {
+    _reply = NULL;
+    return _client.isConnected() ? MQTT_ERROR_SEND : MQTT_ERROR_TIMEOUT;
+  }
+  if (!wantReply) {
+    return MQTT_ACCEPTED;
+  }
+
+  uint32_t started = _clock.millis();
+  while (!_replyReady && _client.loop() && _clock.millis() - started < _replyTimeoutMs) {
+    if (!_replyReady) {
+      _client.idle();
+    }
+  }
+  _reply = NULL;
+  if (!_replyReady) {
+    response[0] = 0;
+    return MQTT_ACCEPTED;               // Delivered; the backend result comes later
+  }
+
+  char status[8];
+  if (!findJsonScalar(response, strlen(response), "status", status, sizeof(status))) {
+    return 200;
+  }
+  return atoi(status);
+}
+
+bool MqttTransport::pollCommand(char* command, size_t commandSize) {
+  if (!_client.isConnected()) {
+    ensureConnected();
+  } else {
+    _client.loop();
+  }
+
+  if (!_commandPending || commandSize == 0) {
+    return false;
+  }
+  size_t length = strlen(_command);
+  if (length >= commandSize) {
+    length = commandSize - 1;
+  }
+  memcpy(command, _command, length);
+  command[length] = 0;
+  _commandPending = false;
+  return true;
+}
+
+void MqttTransport::onMessage(const char* topic, size_t topicLength,
+                              const char* payload, size_t payloadLength, void* context) {
+  MqttTransport* self = (MqttTransport*)context;
+
+  if (self->_reply && strlen(self->_replyTopic) == topicLength &&
+      memcmp(topic, self->_replyTopic, topicLength) == 0) {
+    // Stale replies (an earlier request that timed out) carry another seq
+    char seq[12];
+    if (!findJsonScalar(payload, payloadLength, "seq", seq, sizeof(seq)) || strcmp(seq, self->_replySeq) != 0) {
+      return;
+    }
+    size_t copy = payloadLength < self->_replySize - 1 ? payloadLength : self->_replySize - 1;
+    memcpy(self->_reply, payload, copy);
+    self->_reply[copy] = 0;
+    self->_replyReady = true;
+    return;
+  }
+
+  static const char suffix[] = "/commands";
+  size_t suffixLength = sizeof(suffix) - 1;
+  if (topicLength >= suffixLength && memcmp(topic + topicLength - suffixLength, suffix, suffixLength) == 0) {
+    // Commands are idempotent flags; a newer one replaces an unread one
+    size_t copy = payloadLength < sizeof(self->_command) - 1 ? payloadLength : sizeof(self->_command) - 1;
+    memcpy(self->_command, payload, copy);
+    self->_command[copy] = 0;
+    self->_commandPending = true;
+  }
+}
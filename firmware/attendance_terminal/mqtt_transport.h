@@ -0,0 +1,173 @@
+/*
+ * MQTT transport for Attendee Attendance Terminal v2.0
+ *
+ * One long-lived MQTT 3.1.1 connection carries scans, backlog records and
+ * heartbeats as QoS 1 publishes, behind the same TerminalTransport
+ * interface as the HTTP client. The session is persistent (clean session
+ * off, client id = device id), so the broker queues commands published
+ * while the terminal was away and the TLS handshake is paid once per
+ * connection rather than once per request.
+ *
+ * Backend URLs of the form mqtt://host[:1883]/prefix or mqtts://host[:8883]/prefix
+ * select it. Topics, for device D:
+ *   prefix/D/attendance            scan and backlog records (QoS 1)
+ *   prefix/D/device/heartbeat      heartbeat payload (QoS 1)
+ *   prefix/D/reply/<endpoint>      backend reply to a request, matched on "seq"
+ *   prefix/D/commands              backend instructions, e.g. {"syncLogs":true}
+ *   prefix/D/status                "online"/"offline" (retained; offline is the will)
+ * backend/mqtt-bridge.js connects these to the HTTP API.
+ *
+ * Portable (no Arduino includes); the stream connection comes from the HAL.
+ */
+
+#ifndef MQTT_TRANSPORT_H
+#define MQTT_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "terminal_hal.h"
+
+#define MQTT_MAX_PACKET     512         // Largest packet sent or accepted
+#define MQTT_TOPIC_MAX      96
+#define MQTT_COMMAND_MAX    192         // Pending backend command (JSON)
+
+// postJson() results besides the replied status
+#define MQTT_ACCEPTED        202        // PUBACK received, no reply (or none requested)
+#define MQTT_ERROR_CONNECT   -1
+#define MQTT_ERROR_SEND      -2
+#define MQTT_ERROR_TIMEOUT   -11        // No PUBACK in time; the connection is dropped
+
+bool isMqttUrl(const char* url);
+
+struct MqttConnectOptions {
+  const char* clientId;
+  const char* username;                 // NULL or "" for none
+  const char* password;
+  const char* willTopic;                // NULL for no will
+  const char* willMessage;
+  uint16_t keepAliveSec;
+  bool cleanSession;
+};
+
+// Called for each inbound PUBLISH; topic and payload are not NUL-terminated
+typedef void (*MqttMessageHandler)(const char* topic, size_t topicLength,
+                                   const char* payload, size_t payloadLength, void* context);
+
+// Minimal MQTT 3.1.1 client: QoS 0/1 publish and subscribe, keep-alive.
+// connect(), subscribe() and QoS 1 publish() wait for their acknowledgement
+// up to the timeout, calling idle() between reads.
+class MqttClient {
+public:
+  MqttClient(TerminalConnection& connection, TerminalClock& clock);
+  virtual ~MqttClient() {}
+
+  void setTimeout(uint32_t timeoutMs) { _timeoutMs = timeoutMs; }
+  void setMessageHandler(MqttMessageHandler handler, void* context) { _handler = handler; _context = context; }
+
+  bool connect(const char* host, uint16_t port, bool secure, const MqttConnectOptions& options);
+  void disconnect();
+  bool isConnected() const { return _connected; }
+  bool isSessionPresent() const { return _sessionPresent; }
+
+  bool subscribe(const char* filter, uint8_t qos);
+  bool publish(const char* topic, const char* payload, size_t len, uint8_t qos, bool retain);
+
+  // Reads inbound packets and keeps the connection alive; never blocks on
+  // the network. Returns false once the connection is lost.
+  bool loop();
+
+  uint32_t getPublishCount() const { return _publishes; }
+
+  // Called between reads while waiting for an acknowledgement or reply
+  virtual void idle() {}
+
+private:
+  bool sendPacket(uint8_t header, const uint8_t* body, size_t length);
+  bool readPackets();
+  void handlePacket(uint8_t header, const uint8_t* body, size_t length);
+  bool waitForAck(uint8_t type, uint16_t packetId);
+  void drop();
+
+  TerminalConnection& _connection;
+  TerminalClock& _clock;
+  MqttMessageHandler _handler;
+  void* _context;
+  uint32_t _timeoutMs;
+  bool _connected;
+  bool _sessionPresent;
+  uint32_t _keepAliveMs;
+  uint16_t _nextPacketId;
+  uint32_t _lastSend;
+  uint32_t _lastReceive;
+  bool _pingOutstanding;
+  uint8_t _ackType;                     // Last CONNACK/PUBACK/SUBACK seen
+  uint16_t _ackPacketId;
+  uint8_t _ackCode;
+  uint8_t _rx[MQTT_MAX_PACKET];
+  size_t _rxLength;
+  uint32_t _publishes;
+};
+
+class MqttTransport : public TerminalTransport {
+public:
+  // The login strings must outlive the transport
+  MqttTransport(MqttClient& client, TerminalClock& clock,
+                const char* username, const char* password);
+
+  void setKeepAlive(uint16_t seconds) { _keepAliveSec = seconds; }
+  void setReplyTimeout(uint32_t timeoutMs) { _replyTimeoutMs = timeoutMs; }
+  void setReconnectBackoff(uint32_t minMs, uint32_t maxMs);
+
+  // Backend base URL and device id (the client id and topic level); a
+  // change of either reconnects
+  bool setBroker(const char* url, const char* clientId);
+
+  // Publishes to the topic for the URL's endpoint. When a response buffer
+  // is given and the body carries "seq", waits up to the reply timeout for
+  // the backend's reply and returns its "status"; otherwise 202 on PUBACK.
+  int postJson(const char* url, const char* body, size_t len,
+               char* response, size_t responseSize) override;
+
+  // Keeps the session up (reconnecting with backoff) and hands out commands
+  bool pollCommand(char* command, size_t commandSize) override;
+
+  bool isConnected() const { return _client.isConnected(); }
+  uint32_t getConnectCount() const { return _connects; }
+
+private:
+  static void onMessage(const char* topic, size_t topicLength,
+                        const char* payload, size_t payloadLength, void* context);
+  bool ensureConnected();
+  bool topicFor(const char* url, char* topic, size_t topicSize, const char** endpoint);
+
+  MqttClient& _client;
+  TerminalClock& _clock;
+  char _clientId[32];
+  const char* _username;
+  const char* _password;
+  char _host[64];
+  uint16_t _port;
+  bool _secure;
+  char _prefix[48];
+  bool _hasBroker;
+  uint16_t _keepAliveSec;
+  uint32_t _replyTimeoutMs;
+  uint32_t _backoffMinMs;
+  uint32_t _backoffMaxMs;
+  uint32_t _backoffMs;
+  uint32_t _lastAttempt;
+  bool _attempted;
+  uint32_t _connects;
+
+  char _command[MQTT_COMMAND_MAX];
+  bool _commandPending;
+
+  // Reply being waited for inside postJson()
+  char _replyTopic[MQTT_TOPIC_MAX];
+  char _replySeq[12];
+  char* _reply;
+  size_t _replySize;
+  bool _replyReady;
+};
+
+#endif // MQTT_TRANSPORT_H
@@ -0,0 +1,683 @@
+/*
+ * Compressed offline log segments for Attendee Attendance Terminal v2.0
+ */
+
+#include "offline_segments.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SEGMENT_MAGIC "ASG1"
+#define SEGMENT_KIND_RAW 3
+
+// ========================================
+// PRIMITIVES
+// ========================================
+
+uint32_t segmentCrc32(const uint8_t* data, size_t length) {
+  uint32_t crc = 0xFFFFFFFFUL;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+size_t encodeBase64(const uint8_t* data, size_t length, char* out, size_t outSize) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t needed = (length + 2) / 3 * 4;
+  if (needed + 1 > outSize) {
+    return 0;
+  }
+  size_t o = 0;
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t triple = (uint32_t)data[i] << 16;
+    if (i + 1 < length) triple |= (uint32_t)data[i + 1] << 8;
+    if (i + 2 < length) triple |= data[i + 2];
+    out[o++] = alphabet[(triple >> 18) & 0x3F];
+    out[o++] = alphabet[(triple >> 12) & 0x3F];
+    out[o++] = i + 1 < length ? alphabet[(triple >> 6) & 0x3F] : '=';
+    out[o++] = i + 2 < length ? alphabet[triple & 0x3F] : '=';
+  }
+  out[o] = 0;
+  return o;
+}
+
+// Returns bytes written, 0 when it does not fit
+static size_t putVarint(uint8_t* out, size_t room, uint64_t value) {
+  size_t n = 0;
+  do {
+    if (n >= room) {
+      return 0;
+    }
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    out[n++] = value ? (byte | 0x80) : byte;
+  } while (value);
+  return n;
+}
+
+static bool getVarint(const uint8_t* data, size_t end, size_t& pos, uint64_t& value) {
+  value = 0;
+  for (uint8_t shift = 0; shift < 64 && pos < end; shift += 7) {
+    uint8_t byte = data[pos++];
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint64_t zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;                            // Lowercase would not round-trip
+}
+
+static bool parseUidHex(const char* hex, uint8_t* uid, uint8_t& uidLength) {
+  size_t len = strlen(hex);
+  if (len == 0 || len % 2 != 0 || len / 2 > ATTENDANCE_UID_MAX_BYTES) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i += 2) {
+    int high = hexValue(hex[i]);
+    int low = hexValue(hex[i + 1]);
+    if (high < 0 || low < 0) return false;
+    uid[i / 2] = (uint8_t)(high << 4 | low);
+  }
+  uidLength = (uint8_t)(len / 2);
+  return true;
+}
+
+// ========================================
+// ENCODER
+// ========================================
+
+SegmentEncoder::SegmentEncoder() {
+  reset();
+}
+
+void SegmentEncoder::reset() {
+  _deviceId[0] = 0;
+  _firmware[0] = 0;
+  _hasBase = false;
+  _baseTime = _baseSeq = _lastTime = _lastSeq = 0;
+  _dictLength = _dictCount = 0;
+  _bodyLength = 0;
+  _count = _rawCount = 0;
+}
+
+// Header with every varint at its widest
+size_t SegmentEncoder::headerBound() const {
+  return 4 + 2 + 3 + 5 + 5 + 1 + strlen(_deviceId) + 1 + strlen(_firmware) + 3;
+}
+
+int SegmentEncoder::uidIndex(const uint8_t* uid, uint8_t uidLength) {
+  uint16_t pos = 0;
+  for (uint16_t i = 0; i < _dictCount; i++) {
+    uint8_t len = _dict[pos];
+    if (len == uidLength && memcmp(_dict + pos + 1, uid, len) == 0) {
+      return i;
+    }
+    pos += 1 + len;
+  }
+  if (_dictLength + 1 + uidLength > SEGMENT_DICT_BYTES) {
+    return -1;
+  }
+  _dict[_dictLength] = uidLength;
+  memcpy(_dict + _dictLength + 1, uid, uidLength);
+  _dictLength += 1 + uidLength;
+  return _dictCount++;
+}
+
+bool SegmentEncoder::addRaw(const char* record, size_t length) {
+  uint8_t packed[8];
+  size_t n = putVarint(packed, sizeof(packed), SEGMENT_KIND_RAW);
+  n += putVarint(packed + n, sizeof(packed) - n, length);
+  if (headerBound() + _dictLength + _bodyLength + n + length + 4 > SEGMENT_MAX_BYTES ||
+      _bodyLength + n + length > SEGMENT_BODY_BYTES) {
+    return false;
+  }
+  memcpy(_body + _bodyLength, packed, n);
+  memcpy(_body + _bodyLength + n, record, length);
+  _bodyLength += n + length;
+  _count++;
+  _rawCount++;
+  return true;
+}
+
+bool SegmentEncoder::add(const char* record, size_t length) {
+  if (_count >= SEGMENT_RECORDS_MAX) {
+    return false;
+  }
+
+  // Fields as buildAttendancePayload() writes them
+  char tag[ATTENDANCE_UID_HEX_SIZE];
+  char timestamp[ATTENDANCE_TIMESTAMP_SIZE + 1];
+  char deviceId[SEGMENT_FIELD_MAX + 1];
+  char firmware[SEGMENT_FIELD_MAX + 1];
+  char seqText[12];
+  char direction[8];
+  uint8_t uid[ATTENDANCE_UID_MAX_BYTES];
+  uint8_t uidLength = 0;
+  uint32_t seconds = 0;
+  bool parsed =
+    findJsonScalar(record, length, "rfidTag", tag, sizeof(tag)) &&
+    findJsonScalar(record, length, "timestamp", timestamp, sizeof(timestamp)) &&
+    findJsonScalar(record, length, "deviceId", deviceId, sizeof(deviceId)) &&
+    findJsonScalar(record, length, "firmware", firmware, sizeof(firmware)) &&
+    parseUidHex(tag, uid, uidLength) && parseIsoTimestamp(timestamp, seconds);
+  uint32_t seq = 0;
+  if (parsed && findJsonScalar(record, length, "seq", seqText, sizeof(seqText))) {
+    for (const char* c = seqText; *c; c++) {
+      if (*c < '0' || *c > '9') parsed = false;
+      seq = seq * 10 + (uint32_t)(*c - '0');
+    }
+  }
+  uint8_t kind = 0;
+  if (parsed && findJsonScalar(record, length, "direction", direction, sizeof(direction))) {
+    kind = strcmp(direction, "entry") == 0 ? 1 : strcmp(direction, "exit") == 0 ? 2 : SEGMENT_KIND_RAW;
+  }
+  if (parsed && _hasBase && (strcmp(deviceId, _deviceId) != 0 || strcmp(firmware, _firmware) != 0)) {
+    parsed = false;                     // Only one device/firmware per segment header
+  }
+
+  // Packed only when decoding gives back the stored line exactly
+  if (parsed && kind != SEGMENT_KIND_RAW) {
+    char rebuilt[ATTENDANCE_PAYLOAD_SIZE];
+    size_t rebuiltLength = buildAttendancePayload(tag, timestamp, deviceId, firmware, seq,
+                                                  kind == 1 ? "entry" : kind == 2 ? "exit" : NULL,
+                                                  rebuilt, sizeof(rebuilt));
+    parsed = rebuiltLength == length && memcmp(rebuilt, record, length) == 0;
+  }
+  if (!parsed || kind == SEGMENT_KIND_RAW) {
+    return addRaw(record, length);
+  }
+
+  if (!_hasBase) {
+    strcpy(_deviceId, deviceId);
+    strcpy(_firmware, firmware);
+    _baseTime = _lastTime = seconds;
+    _baseSeq = seq;
+    _lastSeq = seq - 1;
+    _hasBase = true;
+  }
+
+  uint16_t dictBefore = _dictLength;
+  uint16_t countBefore = _dictCount;
+  int index = uidIndex(uid, uidLength);
+  if (index < 0) {
+    return false;
+  }
+  uint8_t packed[24];
+  size_t n = putVarint(packed, sizeof(packed), ((uint64_t)index << 2) | kind);
+  n += putVarint(packed + n, sizeof(packed) - n, zigzag((int64_t)seconds - (int64_t)_lastTime));
+  // Mod 2^32, so a base of 0 (last seq 0xFFFFFFFF) still gives small deltas
+  n += putVarint(packed + n, sizeof(packed) - n, zigzag((int32_t)(seq - _lastSeq - 1)));
+  if (headerBound() + _dictLength + _bodyLength + n + 4 > SEGMENT_MAX_BYTES ||
+      _bodyLength + n > SEGMENT_BODY_BYTES) {
+    _dictLength = dictBefore;           // Undo a UID added for this record
+    _dictCount = countBefore;
+    return false;
+  }
+  memcpy(_body + _bodyLength, packed, n);
+  _bodyLength += n;
+  _lastTime = seconds;
+  _lastSeq = seq;
+  _count++;
+  return true;
+}
+
+size_t SegmentEncoder::finish(uint8_t* out, size_t outSize) {
+  if (_count == 0) {
+    return 0;
+  }
+  size_t idLength = strlen(_deviceId);
+  size_t fwLength = strlen(_firmware);
+  size_t n = 0;
+  if (outSize < headerBound() + _dictLength + _bodyLength + 4) {
+    return 0;
+  }
+  memcpy(out, SEGMENT_MAGIC, 4);
+  n = 6;                                // Length filled in below
+  n += putVarint(out + n, outSize - n, _count);
+  n += putVarint(out + n, outSize - n, _baseTime);
+  n += putVarint(out + n, outSize - n, _baseSeq);
+  out[n++] = (uint8_t)idLength;
+  memcpy(out + n, _deviceId, idLength);
+  n += idLength;
+  out[n++] = (uint8_t)fwLength;
+  memcpy(out + n, _firmware, fwLength);
+  n += fwLength;
+  n += putVarint(out + n, outSize - n, _dictCount);
+  memcpy(out + n, _dict, _dictLength);
+  n += _dictLength;
+  memcpy(out + n, _body, _bodyLength);
+  n += _bodyLength;
+  out[4] = (n + 4) & 0xFF;
+  out[5] = ((n + 4) >> 8) & 0xFF;
+
+  uint32_t crc = segmentCrc32(out, n);
+  out[n++] = crc & 0xFF;
+  out[n++] = (crc >> 8) & 0xFF;
+  out[n++] = (crc >> 16) & 0xFF;
+  out[n++] = (crc >> 24) & 0xFF;
+  return n;
+}
+
+// ========================================
+// DECODER
+// ========================================
+
+SegmentDecoder::SegmentDecoder()
+  : _data(NULL), _end(0), _pos(0), _count(0), _decoded(0), _lastTime(0), _lastSeq(0), _dictCount(0) {
+  _deviceId[0] = 0;
+  _firmware[0] = 0;
+}
+
+static bool getString(const uint8_t* data, size_t end, size_t& pos, char* out, size_t outSize) {
+  if (pos >= end) return false;
+  size_t len = data[pos++];
+  if (len >= outSize || pos + len > end) return false;
+  memcpy(out, data + pos, len);
+  out[len] = 0;
+  pos += len;
+  return true;
+}
+
+uint16_t segmentLength(const uint8_t* data, size_t length) {
+  if (length < 6 || memcmp(data, SEGMENT_MAGIC, 4) != 0) {
+    return 0;
+  }
+  uint16_t total = (uint16_t)(data[4] | data[5] << 8);
+  return total >= 10 && total <= SEGMENT_MAX_BYTES ? total : 0;
+}
+
+uint16_t segmentRecordCount(const uint8_t* data, size_t length) {
+  size_t pos = 6;
+  uint64_t count = 0;
+  if (length < 7 || memcmp(data, SEGMENT_MAGIC, 4) != 0 || !getVarint(data, length, pos, count) ||
+      count > SEGMENT_RECORDS_MAX) {
+    return 0;
+  }
+  return (uint16_t)count;
+}
+
+bool SegmentDecoder::open(const uint8_t* data, size_t length) {
+  _data = NULL;
+  if (segmentLength(data, length) != length) {
+    return false;
+  }
+  size_t end = length - 4;
+  uint32_t stored = (uint32_t)data[end] | (uint32_t)data[end + 1] << 8 |
+                    (uint32_t)data[end + 2] << 16 | (uint32_t)data[end + 3] << 24;
+  if (segmentCrc32(data, end) != stored) {
+    return false;
+  }
+
+  size_t pos = 6;
+  uint64_t count, baseTime, baseSeq, dictCount;
+  if (!getVarint(data, end, pos, count) || count > SEGMENT_RECORDS_MAX ||
+      !getVarint(data, end, pos, baseTime) || !getVarint(data, end, pos, baseSeq) ||
+      !getString(data, end, pos, _deviceId, sizeof(_deviceId)) ||
+      !getString(data, end, pos, _firmware, sizeof(_firmware)) ||
+      !getVarint(data, end, pos, dictCount) || dictCount > SEGMENT_RECORDS_MAX) {
+    return false;
+  }
+  for (uint16_t i = 0; i < dictCount; i++) {
+    if (pos >= end || data[pos] == 0 || data[pos] > ATTENDANCE_UID_MAX_BYTES || pos + 1 + data[pos] > end) {
+      return false;
+    }
+    _dictOffsets[i] = (uint16_t)pos;
+    pos += 1 + data[pos];
+  }
+
+  _data = data;
+  _end = end;
+  _pos = pos;
+  _count = (uint16_t)count;
+  _decoded = 0;
+  _dictCount = (uint16_t)dictCount;
+  _lastTime = (uint32_t)baseTime;
+  _lastSeq = (uint32_t)baseSeq - 1;
+  return true;
+}
+
+size_t SegmentDecoder::next(char* out, size_t outSize) {
+  uint64_t head;
+  if (!_data || _decoded >= _count || !getVarint(_data, _end, _pos, head)) {
+    return 0;
+  }
+  uint8_t kind = head & 3;
+  if (kind == SEGMENT_KIND_RAW) {
+    uint64_t length;
+    if (!getVarint(_data, _end, _pos, length) || _pos + length > _end || length >= outSize) {
+      return 0;
+    }
+    memcpy(out, _data + _pos, (size_t)length);
+    out[length] = 0;
+    _pos += (size_t)length;
+    _decoded++;
+    return (size_t)length;
+  }
+
+  uint64_t index = head >> 2;
+  uint64_t timeDelta, seqDelta;
+  if (index >= _dictCount || !getVarint(_data, _end, _pos, timeDelta) ||
+      !getVarint(_data, _end, _pos, seqDelta)) {
+    return 0;
+  }
+  _lastTime = (uint32_t)((int64_t)_lastTime + unzigzag(timeDelta));
+  _lastSeq = (uint32_t)((int64_t)_lastSeq + unzigzag(seqDelta) + 1);
+
+  const uint8_t* entry = _data + _dictOffsets[index];
+  char tag[ATTENDANCE_UID_HEX_SIZE];
+  formatUidHex(entry + 1, entry[0], tag, sizeof(tag));
+  char timestamp[ATTENDANCE_TIMESTAMP_SIZE];
+  formatIsoSeconds(_lastTime, timestamp, sizeof(timestamp));
+  _decoded++;
+  return buildAttendancePayload(tag, timestamp, _deviceId, _firmware, _lastSeq,
+                                kind == 1 ? "entry" : kind == 2 ? "exit" : NULL, out, outSize);
+}
+
+bool parseSegmentRejections(const char* reply, uint8_t* rejected) {
+  memset(rejected, 0, SEGMENT_REJECTED_BYTES);
+  size_t length = strlen(reply);
+  char records[12], recorded[12];
+  if (!findJsonScalar(reply, length, "records", records, sizeof(records)) ||
+      !findJsonScalar(reply, length, "recorded", recorded, sizeof(recorded))) {
+    return false;
+  }
+  long expected = atol(records) - atol(recorded);
+  if (expected < 0) {
+    return false;
+  }
+
+  // Card tags are hex and seqs are numbers, so only the entries' own
+  // "index" keys can match
+  long found = 0;
+  const char* list = strstr(reply, "\"rejected\":[");
+  for (const char* p = list ? strstr(list, "\"index\":") : NULL; p; p = strstr(p, "\"index\":")) {
+    p += 8;
+    char* end;
+    unsigned long index = strtoul(p, &end, 10);
+    if (end == p || (*end != ',' && *end != '}')) {
+      break;                            // Cut off inside the entry
+    }
+    if (index >= SEGMENT_RECORDS_MAX) {
+      return false;
+    }
+    if (!(rejected[index / 8] & (1 << (index % 8)))) {
+      rejected[index / 8] |= (uint8_t)(1 << (index % 8));
+      found++;
+    }
+  }
+  return found == expected;
+}
+
+// ========================================
+// STORE
+// ========================================
+
+SegmentStore::SegmentStore(TerminalStorage& storage, const char* prefix, const char* manifestPath,
+                           const char* manifestTempPath, uint32_t fileBytes, uint16_t maxSegments)
+  : _storage(storage), _prefix(prefix), _manifestPath(manifestPath), _manifestTempPath(manifestTempPath),
+    _fileBytes(fileBytes), _maxSegments(maxSegments), _firstFile(1), _firstOffset(0), _nextFile(1),
+    _tailBytes(0), _segments(0), _records(0) {
+}
+
+const char* SegmentStore::path(uint32_t number, char* out, size_t outSize) const {
+  snprintf(out, outSize, "%s%05lu.bin", _prefix, (unsigned long)number);
+  return out;
+}
+
+static bool readManifestLine(const char* line, size_t len, void* context) {
+  uint32_t* values = (uint32_t*)context;
+  uint8_t field = 0;
+  for (size_t i = 0; i < len && field < 2; i++) {
+    if (line[i] >= '0' && line[i] <= '9') {
+      values[field] = values[field] * 10 + (uint32_t)(line[i] - '0');
+    } else if (line[i] == ' ') {
+      field++;
+    } else {
+      break;
+    }
+  }
+  return false;
+}
+
+bool SegmentStore::readFrame(const SegmentCursor& cursor, uint16_t& length, uint16_t& records) {
+  char file[SEGMENT_PATH_MAX];
+  uint8_t header[10];
+  int count = _storage.readAt(path(cursor.file, file, sizeof(file)), cursor.offset, (char*)header, sizeof(header));
+  if (count <= 0) {
+    return false;
+  }
+  length = segmentLength(header, (size_t)count);
+  records = segmentRecordCount(header, (size_t)count);
+  return length > 0;
+}
+
+void SegmentStore::begin() {
+  uint32_t manifest[2] = { 0, 0 };
+  if (_storage.exists(_manifestPath)) {
+    _storage.forEachLine(_manifestPath, readManifestLine, manifest);
+  }
+  if (manifest[0] == 0 && _storage.exists(_manifestTempPath)) {
+    manifest[0] = manifest[1] = 0;
+    _storage.forEachLine(_manifestTempPath, readManifestLine, manifest);
+  }
+  _firstFile = manifest[0] ? manifest[0] : 1;
+  _firstOffset = manifest[0] ? manifest[1] : 0;
+
+  // The oldest file may already be gone if a crash came before the manifest update
+  char file[SEGMENT_PATH_MAX];
+  if (!_storage.exists(path(_firstFile, file, sizeof(file))) &&
+      _storage.exists(path(_firstFile + 1, file, sizeof(file)))) {
+    _firstFile++;
+    _firstOffset = 0;
+  }
+
+  // Walk the frame headers; a torn frame at the end of a file ends it
+  _segments = 0;
+  _records = 0;
+  _tailBytes = 0;
+  _nextFile = _firstFile;
+  while (_storage.exists(path(_nextFile, file, sizeof(file)))) {
+    SegmentCursor cursor = { _nextFile, _nextFile == _firstFile ? _firstOffset : 0 };
+    uint16_t length, records;
+    char end;
+    while (readFrame(cursor, length, records) &&
+           _storage.readAt(file, cursor.offset + length, &end, 1) == 1 && end == '\n') {
+      cursor.offset += (uint32_t)length + 1;
+      _segments++;
+      _records += records;
+    }
+    // Never append behind a torn segment: readers would stop at it
+    _tailBytes = _storage.readAt(file, cursor.offset, &end, 1) > 0 ? _fileBytes : cursor.offset;
+    _nextFile++;
+  }
+}
+
+bool SegmentStore::writeManifest(uint32_t file, uint32_t offset) {
+  char line[24];
+  int len = snprintf(line, sizeof(line), "%lu %lu", (unsigned long)file, (unsigned long)offset);
+
+  _storage.remove(_manifestTempPath);
+  if (!_storage.appendLine(_manifestTempPath, line, (size_t)len)) {
+    return false;
+  }
+  if (!_storage.rename(_manifestTempPath, _manifestPath)) {
+    // Filesystems that refuse to rename over an existing file
+    _storage.remove(_manifestPath);
+    if (!_storage.rename(_manifestTempPath, _manifestPath)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SegmentStore::append(const uint8_t* data, size_t length) {
+  if (isFull() || segmentLength(data, length) != length) {
+    return false;
+  }
+  if (_segments == 0 && _firstFile != 1) {
+    // Empty: restart the numbering so file names stay short
+    char file[SEGMENT_PATH_MAX];
+    for (uint32_t n = _firstFile; n < _nextFile; n++) {
+      _storage.remove(path(n, file, sizeof(file)));
+    }
+    if (!writeManifest(1, 0)) {
+      return false;
+    }
+    _firstFile = _nextFile = 1;
+    _firstOffset = 0;
+    _tailBytes = 0;
+  }
+
+  // Start a new file when the newest one would spill into another block
+  char file[SEGMENT_PATH_MAX];
+  bool fresh = _nextFile == _firstFile || _tailBytes + length + 1 > _fileBytes;
+  uint32_t number = fresh ? _nextFile : _nextFile - 1;
+  path(number, file, sizeof(file));
+  if (fresh) {
+    _storage.remove(file);
+  }
+  // appendLine() adds a newline after the segment; readers go by its length
+  if (!_storage.appendLine(file, (const char*)data, length)) {
+    if (fresh) {
+      _storage.remove(file);
+    }
+    return false;
+  }
+  if (fresh) {
+    _nextFile++;
+    _tailBytes = 0;
+  }
+  _tailBytes += (uint32_t)length + 1;
+  _segments++;
+  _records += segmentRecordCount(data, length);
+  return true;
+}
+
+SegmentCursor SegmentStore::first() const {
+  SegmentCursor cursor = { _firstFile, _firstOffset };
+  return cursor;
+}
+
+int SegmentStore::next(SegmentCursor& cursor, uint8_t* buffer, size_t size) {
+  char file[SEGMENT_PATH_MAX];
+  while (cursor.file < _nextFile) {
+    uint16_t length, records;
+    if (readFrame(cursor, length, records)) {
+      if (length > size) {
+        return -1;
+      }
+      int count = _storage.readAt(path(cursor.file, file, sizeof(file)), cursor.offset, (char*)buffer, length);
+      if (count != (int)length) {
+        return -1;
+      }
+      cursor.offset += (uint32_t)length + 1;
+      return count;
+    }
+    cursor.file++;
+    cursor.offset = 0;
+  }
+  return 0;
+}
+
+int SegmentStore::readOldest(uint8_t* buffer, size_t size) {
+  if (_segments == 0) {
+    return 0;
+  }
+  SegmentCursor cursor = first();
+  return next(cursor, buffer, size);
+}
+
+bool SegmentStore::removeOldest() {
+  if (_segments == 0) {
+    return false;
+  }
+  SegmentCursor cursor = first();
+  uint16_t length = 0, records = 0;
+  while (cursor.file < _nextFile && !readFrame(cursor, length, records)) {
+    cursor.file++;
+    cursor.offset = 0;
+  }
+  if (cursor.file >= _nextFile) {
+    // Headers no longer readable: nothing left to consume
+    _segments = 0;
+    _records = 0;
+    return false;
+  }
+
+  char file[SEGMENT_PATH_MAX];
+  for (uint32_t n = _firstFile; n < cursor.file; n++) {
+    _storage.remove(path(n, file, sizeof(file)));
+  }
+  cursor.offset += (uint32_t)length + 1;
+  uint16_t following;
+  if (cursor.file + 1 < _nextFile && !readFrame(cursor, length, following)) {
+    // That was the last frame of a file that is no longer written to
+    _storage.remove(path(cursor.file, file, sizeof(file)));
+    cursor.file++;
+    cursor.offset = 0;
+  }
+  _firstFile = cursor.file;
+  _firstOffset = cursor.offset;
+  _segments--;
+  _records = _records > records ? _records - records : 0;
+  writeManifest(_firstFile, _firstOffset);
+  return true;
+}
+
+bool SegmentStore::clear() {
+  char file[SEGMENT_PATH_MAX];
+  for (uint32_t n = _firstFile; n < _nextFile; n++) {
+    _storage.remove(path(n, file, sizeof(file)));
+  }
+  _firstFile = _nextFile = 1;
+  _firstOffset = 0;
+  _tailBytes = 0;
+  _segments = 0;
+  _records = 0;
+  return writeManifest(1, 0);
+}
+
+// ========================================
+// SEALER
+// ========================================
+
+SegmentSealer::SegmentSealer(SegmentEncoder& encoder, SegmentStore& store, uint8_t* buffer, size_t bufferSize)
+  : _encoder(encoder), _store(store), _buffer(buffer), _bufferSize(bufferSize), _full(false), _sealedBytes(0) {
+  _encoder.reset();
+}
+
+bool SegmentSealer::upload(const char* record, size_t length) {
+  if (!_encoder.add(record, length)) {
+    _full = true;
+    return false;
+  }
+  return true;
+}
+
+bool SegmentSealer::commit() {
+  size_t length = _encoder.finish(_buffer, _bufferSize);
+  if (length == 0 || !_store.append(_buffer, length)) {
+    return false;
+  }
+  _sealedBytes = length;
+  return true;
+}
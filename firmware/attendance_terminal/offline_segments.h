@@ -0,0 +1,208 @@
+/*
+ * Compressed offline log segments for Attendee Attendance Terminal v2.0
+ *
+ * An outage backlog is highly repetitive: the same few hundred cards, the
+ * same device and firmware on every line, timestamps seconds apart and
+ * sequence numbers counting up by one. Once the JSON backlog holds enough
+ * records they are sealed into a binary segment of about 1 KB:
+ *
+ *   "ASG1"  u16 LE segment length  varint records  varint base time  varint base seq
+ *   u8 len + device ID  u8 len + firmware
+ *   varint UIDs, each u8 len + UID bytes          (per-segment dictionary)
+ *   per record: varint (UID index << 2 | kind), then
+ *     kind 0-2 (toggle/entry/exit): varint zigzag time delta (s),
+ *                                   varint zigzag seq delta - 1 (int32, seq
+ *                                   arithmetic mod 2^32: a record without a
+ *                                   seq has 0, and the base may be 0)
+ *     kind 3 (raw):                 varint length + the JSON line as stored
+ *   u32 LE CRC-32 of everything before it
+ *
+ * A typical record takes 3-4 bytes plus its share of the dictionary, about
+ * 7 in all, instead of ~120 as JSON. A record is only packed when decoding
+ * rebuilds it byte for byte; anything else (a foreign device ID, an
+ * unparsable timestamp) is kept raw, so sealing never reorders or alters
+ * records. Times are seconds since 2000-01-01 in the terminal's local
+ * time, like the stored timestamps.
+ *
+ * LittleFS gives every file at least one block (8 KB on the ESP8266), so
+ * SegmentStore appends segments back to back, each followed by a newline,
+ * to files of up to fileBytes. Uploads consume segments from the oldest
+ * file; a one-line manifest ("<oldest file> <offset>") records how far, and
+ * a file is removed once all its segments are gone. The newest file is found by
+ * probing, so a crash between writing a segment and updating the manifest
+ * loses nothing.
+ *
+ * Portable (no Arduino includes); written against terminal_hal.h only.
+ */
+
+#ifndef OFFLINE_SEGMENTS_H
+#define OFFLINE_SEGMENTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "attendance_core.h"
+#include "terminal_hal.h"
+
+#define SEGMENT_MAX_BYTES      1024     // Sealed segment, CRC included
+#define SEGMENT_RECORDS_MAX    160      // Records per segment
+#define SEGMENT_DICT_BYTES     512      // UID dictionary while encoding
+#define SEGMENT_BODY_BYTES     768      // Packed records while encoding
+#define SEGMENT_FIELD_MAX      32       // Device ID / firmware version
+#define SEGMENT_PATH_MAX       32
+#define SEGMENT_REJECTED_BYTES ((SEGMENT_RECORDS_MAX + 7) / 8)  // One bit per record
+
+// CRC-32 (IEEE 802.3, as zlib)
+uint32_t segmentCrc32(const uint8_t* data, size_t length);
+
+// Standard base64 with padding; returns the length written (NUL-terminated),
+// 0 when it does not fit
+size_t encodeBase64(const uint8_t* data, size_t length, char* out, size_t outSize);
+
+class SegmentEncoder {
+public:
+  SegmentEncoder();
+
+  void reset();
+
+  // Adds a record as stored in the backlog. False when the segment is full;
+  // the record is then not part of it.
+  bool add(const char* record, size_t length);
+
+  uint16_t getCount() const { return _count; }
+  uint16_t getRawCount() const { return _rawCount; }
+
+  // Writes the segment; returns its length, 0 when empty or it does not fit
+  size_t finish(uint8_t* out, size_t outSize);
+
+private:
+  int uidIndex(const uint8_t* uid, uint8_t uidLength);
+  bool addRaw(const char* record, size_t length);
+  size_t headerBound() const;
+
+  char _deviceId[SEGMENT_FIELD_MAX + 1];
+  char _firmware[SEGMENT_FIELD_MAX + 1];
+  bool _hasBase;
+  uint32_t _baseTime;
+  uint32_t _baseSeq;
+  uint32_t _lastTime;
+  uint32_t _lastSeq;
+
+  uint8_t _dict[SEGMENT_DICT_BYTES];
+  uint16_t _dictLength;
+  uint16_t _dictCount;
+  uint8_t _body[SEGMENT_BODY_BYTES];
+  uint16_t _bodyLength;
+  uint16_t _count;
+  uint16_t _rawCount;
+};
+
+class SegmentDecoder {
+public:
+  SegmentDecoder();
+
+  // Checks magic, CRC and dictionary; false for a corrupt segment
+  bool open(const uint8_t* data, size_t length);
+
+  uint16_t getCount() const { return _count; }
+
+  // Next record, rebuilt as the JSON line it was stored as. Returns its
+  // length; 0 after the last record or on a format error.
+  size_t next(char* out, size_t outSize);
+
+private:
+  const uint8_t* _data;
+  size_t _end;                          // Start of the CRC
+  size_t _pos;
+  uint16_t _count;
+  uint16_t _decoded;
+  char _deviceId[SEGMENT_FIELD_MAX + 1];
+  char _firmware[SEGMENT_FIELD_MAX + 1];
+  uint32_t _lastTime;
+  uint32_t _lastSeq;
+  uint16_t _dictCount;
+  uint16_t _dictOffsets[SEGMENT_RECORDS_MAX];
+};
+
+// Records of an uploaded segment the backend refused, from its 200 reply
+// {"records":N,"recorded":M,"rejected":[{"index":I,...},...]}: sets bit I
+// of rejected (SEGMENT_REJECTED_BYTES) for each. False when the reply does
+// not list all N - M of them (cut off to fit, or an older backend).
+bool parseSegmentRejections(const char* reply, uint8_t* rejected);
+
+// From a segment header without checking the rest; 0 if invalid
+uint16_t segmentLength(const uint8_t* data, size_t length);
+uint16_t segmentRecordCount(const uint8_t* data, size_t length);
+
+// Position of a segment in the store
+struct SegmentCursor {
+  uint32_t file;
+  uint32_t offset;
+};
+
+// Sealed segments on storage, oldest first
+class SegmentStore {
+public:
+  SegmentStore(TerminalStorage& storage, const char* prefix, const char* manifestPath,
+               const char* manifestTempPath, uint32_t fileBytes, uint16_t maxSegments);
+
+  void begin();                         // Find the segments after boot
+
+  bool isFull() const { return _segments >= _maxSegments; }
+  bool append(const uint8_t* data, size_t length);
+
+  // Iteration, oldest first: next() reads the segment at the cursor into
+  // buffer (SEGMENT_MAX_BYTES) and advances. Returns its length, 0 at the
+  // end, -1 when the frame is unreadable.
+  SegmentCursor first() const;
+  int next(SegmentCursor& cursor, uint8_t* buffer, size_t size);
+
+  int readOldest(uint8_t* buffer, size_t size);
+  bool removeOldest();
+  bool clear();
+
+  uint16_t getSegmentCount() const { return _segments; }
+  uint32_t getRecordCount() const { return _records; }
+
+private:
+  const char* path(uint32_t number, char* out, size_t outSize) const;
+  bool writeManifest(uint32_t file, uint32_t offset);
+  // Segment at the cursor: length and record count; false past the end
+  bool readFrame(const SegmentCursor& cursor, uint16_t& length, uint16_t& records);
+
+  TerminalStorage& _storage;
+  const char* _prefix;
+  const char* _manifestPath;
+  const char* _manifestTempPath;
+  uint32_t _fileBytes;
+  uint16_t _maxSegments;
+  uint32_t _firstFile;                  // Oldest file number
+  uint32_t _firstOffset;                // Oldest unconsumed frame in it
+  uint32_t _nextFile;                   // One past the newest file
+  uint32_t _tailBytes;                  // Size of the newest file
+  uint16_t _segments;
+  uint32_t _records;
+};
+
+// Seals backlog records through OfflineQueue::drain(): each record offered
+// is packed until the segment is full, and commit() stores the segment
+// before the drain rewrites the backlog without those records
+class SegmentSealer : public RecordUploader {
+public:
+  SegmentSealer(SegmentEncoder& encoder, SegmentStore& store, uint8_t* buffer, size_t bufferSize);
+
+  bool upload(const char* record, size_t length) override;
+  bool shouldContinue() override { return !_full; }
+  bool commit() override;
+
+  size_t getSealedBytes() const { return _sealedBytes; }
+
+private:
+  SegmentEncoder& _encoder;
+  SegmentStore& _store;
+  uint8_t* _buffer;
+  size_t _bufferSize;
+  bool _full;
+  size_t _sealedBytes;
+};
+
+#endif // OFFLINE_SEGMENTS_H
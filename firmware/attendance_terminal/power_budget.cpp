@@ -0,0 +1,80 @@
+/*
+ * Energy estimate for Attendee Attendance Terminal v2.0
+ */
+
+#include "power_budget.h"
+
+#include <string.h>
+
+EnergyMeter::EnergyMeter(uint32_t windowMs, uint32_t baseUa, uint16_t supplyMv)
+  : _windowMs(windowMs > 0 ? windowMs : 1), _baseUa(baseUa), _supplyMv(supplyMv), _count(0),
+    _started(false), _windowStartMs(0), _windowCharge(0), _totalCharge(0), _totalMs(0),
+    _lastMwhPerHourX10(0) {
+  memset(_activeUa, 0, sizeof(_activeUa));
+  memset(_idleUa, 0, sizeof(_idleUa));
+  memset(_active, 0, sizeof(_active));
+  memset(_sinceMs, 0, sizeof(_sinceMs));
+  memset(_activeMs, 0, sizeof(_activeMs));
+  memset(_lastActivePercent, 0, sizeof(_lastActivePercent));
+}
+
+int EnergyMeter::addComponent(uint32_t activeUa, uint32_t idleUa, bool active, uint32_t nowMs) {
+  if (_count >= ENERGY_COMPONENTS_MAX) {
+    return -1;
+  }
+  if (!_started) {
+    _started = true;
+    _windowStartMs = nowMs;
+  }
+  uint8_t id = _count++;
+  _activeUa[id] = activeUa;
+  _idleUa[id] = idleUa;
+  _active[id] = active;
+  _sinceMs[id] = nowMs;
+  return id;
+}
+
+void EnergyMeter::accumulate(uint8_t component, uint32_t nowMs) {
+  uint32_t elapsed = nowMs - _sinceMs[component];
+  _windowCharge += (uint64_t)elapsed * (_active[component] ? _activeUa[component] : _idleUa[component]);
+  if (_active[component]) {
+    _activeMs[component] += elapsed;
+  }
+  _sinceMs[component] = nowMs;
+}
+
+void EnergyMeter::setActive(uint8_t component, bool active, uint32_t nowMs) {
+  if (component >= _count || _active[component] == active) {
+    return;
+  }
+  accumulate(component, nowMs);
+  _active[component] = active;
+}
+
+void EnergyMeter::update(uint32_t nowMs) {
+  uint32_t span = nowMs - _windowStartMs;
+  if (!_started || span < _windowMs) {
+    return;
+  }
+  for (uint8_t i = 0; i < _count; i++) {
+    accumulate(i, nowMs);
+    _lastActivePercent[i] = (uint8_t)(((uint64_t)_activeMs[i] * 100) / span);
+    _activeMs[i] = 0;
+  }
+  uint64_t charge = _windowCharge + (uint64_t)_baseUa * span;
+  // Average uA x mV = nW; tenths of mW
+  _lastMwhPerHourX10 = (uint32_t)((charge * _supplyMv) / ((uint64_t)span * 100000));
+  _totalCharge += charge;
+  _totalMs += span;
+  _windowCharge = 0;
+  _windowStartMs = nowMs;
+}
+
+uint8_t EnergyMeter::getActivePercent(uint8_t component) const {
+  return component < _count ? _lastActivePercent[component] : 0;
+}
+
+uint32_t EnergyMeter::getTotalMwhX10() const {
+  // uA x ms x mV = 1e-12 J; 0.1 mWh = 0.36 J
+  return (uint32_t)((_totalCharge * _supplyMv) / 360000000000ULL);
+}
@@ -0,0 +1,65 @@
+/*
+ * Energy estimate for Attendee Attendance Terminal v2.0
+ *
+ * The terminal has no current sensor, so energy is estimated from time spent
+ * in each power state. Every component (MCU with WiFi, each RFID reader) has
+ * a nominal draw when active and when idle; the caller reports state changes
+ * and the meter integrates charge (uA x ms). A constant base draw covers the
+ * parts that never sleep (LCD, RTC, regulator).
+ *
+ * Charge is summed over fixed windows. Each closed window gives an average
+ * power, which is also the energy per hour at that rate (mWh/h == mW).
+ * It is reported in tenths so a battery budget can be read off telemetry.
+ *
+ * Portable (no Arduino includes); the draw figures come from config.h.
+ */
+
+#ifndef POWER_BUDGET_H
+#define POWER_BUDGET_H
+
+#include <stdint.h>
+
+#define ENERGY_COMPONENTS_MAX 4         // MCU plus up to RFID_READERS_MAX readers
+
+class EnergyMeter {
+public:
+  EnergyMeter(uint32_t windowMs, uint32_t baseUa, uint16_t supplyMv);
+
+  // Returns the component id, or -1 when the table is full
+  int addComponent(uint32_t activeUa, uint32_t idleUa, bool active, uint32_t nowMs);
+  void setActive(uint8_t component, bool active, uint32_t nowMs);
+
+  // Closes the window once it is due; call every loop pass
+  void update(uint32_t nowMs);
+
+  // Last closed window (0 before the first one), tenths of mWh per hour
+  uint32_t getMwhPerHourX10() const { return _lastMwhPerHourX10; }
+  // Share of the last window the component spent active
+  uint8_t getActivePercent(uint8_t component) const;
+  // Whole run so far, tenths of mWh
+  uint32_t getTotalMwhX10() const;
+
+private:
+  void accumulate(uint8_t component, uint32_t nowMs);
+
+  uint32_t _windowMs;
+  uint32_t _baseUa;
+  uint16_t _supplyMv;
+
+  uint8_t _count;
+  uint32_t _activeUa[ENERGY_COMPONENTS_MAX];
+  uint32_t _idleUa[ENERGY_COMPONENTS_MAX];
+  bool _active[ENERGY_COMPONENTS_MAX];
+  uint32_t _sinceMs[ENERGY_COMPONENTS_MAX];
+  uint32_t _activeMs[ENERGY_COMPONENTS_MAX];      // Current window
+  uint8_t _lastActivePercent[ENERGY_COMPONENTS_MAX];
+
+  bool _started;
+  uint32_t _windowStartMs;
+  uint64_t _windowCharge;               // uA x ms, components only
+  uint64_t _totalCharge;                // uA x ms, base included, closed windows
+  uint32_t _totalMs;
+  uint32_t _lastMwhPerHourX10;
+};
+
+#endif // POWER_BUDGET_H
@@ -0,0 +1,72 @@
+/*
+ * Adaptive RFID poll cadence for Attendee Attendance Terminal v2.0
+ */
+
+#include "rfid_poller.h"
+
+RfidPollScheduler::RfidPollScheduler()
+  : _lastPollMs(0), _previousPollMs(0), _lastActivityMs(0), _polled(false), _active(false),
+    _polls(0), _windowStartMs(0), _windowPolls(0), _rateX10(0) {
+  configure(25, 200, 15000);
+}
+
+RfidPollScheduler::RfidPollScheduler(uint32_t fastMs, uint32_t idleMs, uint32_t fastWindowMs)
+  : RfidPollScheduler() {
+  configure(fastMs, idleMs, fastWindowMs);
+}
+
+void RfidPollScheduler::configure(uint32_t fastMs, uint32_t idleMs, uint32_t fastWindowMs) {
+  _fastMs = fastMs > 0 ? fastMs : 1;
+  _idleMs = idleMs > _fastMs ? idleMs : _fastMs;
+  _fastWindowMs = fastWindowMs > 0 ? fastWindowMs : 1;
+}
+
+uint32_t RfidPollScheduler::getInterval(uint32_t nowMs) const {
+  if (!_active) {
+    return _idleMs;
+  }
+  uint32_t quiet = nowMs - _lastActivityMs;
+  if (quiet < _fastWindowMs) {
+    return _fastMs;
+  }
+  // One doubling per further fast window, capped at the idle interval
+  uint32_t steps = quiet / _fastWindowMs;
+  uint32_t interval = _fastMs;
+  while (steps-- > 0 && interval < _idleMs) {
+    interval <<= 1;
+  }
+  return interval < _idleMs ? interval : _idleMs;
+}
+
+uint32_t RfidPollScheduler::msUntilDue(uint32_t nowMs) const {
+  if (!_polled) {
+    return 0;
+  }
+  uint32_t elapsed = nowMs - _lastPollMs;
+  uint32_t interval = getInterval(nowMs);
+  return elapsed >= interval ? 0 : interval - elapsed;
+}
+
+void RfidPollScheduler::onPoll(uint32_t nowMs) {
+  _previousPollMs = _polled ? _lastPollMs : nowMs;
+  _lastPollMs = nowMs;
+  _polled = true;
+  _polls++;
+
+  if (_polls == 1) {
+    _windowStartMs = nowMs;
+  }
+  _windowPolls++;
+  uint32_t span = nowMs - _windowStartMs;
+  if (span >= RFID_POLL_RATE_WINDOW_MS) {
+    _rateX10 = (uint32_t)(((uint64_t)_windowPolls * 10000) / span);
+    _windowStartMs = nowMs;
+    _windowPolls = 0;
+  }
+}
+
+uint32_t RfidPollScheduler::onDetect(uint32_t nowMs) {
+  _lastActivityMs = nowMs;
+  _active = true;
+  return _polled ? nowMs - _previousPollMs : 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * Adaptive RFID poll cadence for Attendee Attendance Terminal v2.0
+ *
+ * Each poll sends a REQA and, with no card in the field, the reader spends
+ * its receive timeout waiting for an answer, so polling flat out keeps the
+ * SPI bus and the RF field busy for nothing. Right after card activity the
+ * schedule polls every fastMs, since the next person in a queue is seconds
+ * away. Once fastWindowMs has passed without activity the interval doubles
+ * every further fastWindowMs, up to idleMs.
+ *
+ * In interrupt mode a poll only arms the reader (REQA, then return) and the
+ * IRQ line reports an answering card, so the same schedule sets how often
+ * the request is re-sent without any busy waiting.
+ *
+ * Detect latency cannot be measured directly: the card arrived somewhere in
+ * the gap before the poll that found it. onDetect() reports that gap (plus
+ * the IRQ service delay in interrupt mode) as an upper bound.
+ *
+ * Portable (no Arduino includes); the caller does the polling.
+ */
+
+#ifndef RFID_POLLER_H
+#define RFID_POLLER_H
+
+#include <stdint.h>
+
+#define RFID_POLL_RATE_WINDOW_MS 10000  // Span over which polls per second are averaged
+
+class RfidPollScheduler {
+public:
+  RfidPollScheduler();
+  RfidPollScheduler(uint32_t fastMs, uint32_t idleMs, uint32_t fastWindowMs);
+
+  void configure(uint32_t fastMs, uint32_t idleMs, uint32_t fastWindowMs);
+
+  bool isDue(uint32_t nowMs) const { return msUntilDue(nowMs) == 0; }
+  uint32_t msUntilDue(uint32_t nowMs) const;
+
+  void onPoll(uint32_t nowMs);
+
+  // Card activity: back to the fast cadence. Returns the detect latency bound.
+  uint32_t onDetect(uint32_t nowMs);
+
+  uint32_t getInterval(uint32_t nowMs) const;
+  uint32_t getPollCount() const { return _polls; }
+  uint32_t getPollsPerSecondX10() const { return _rateX10; }
+
+private:
+  uint32_t _fastMs;
+  uint32_t _idleMs;
+  uint32_t _fastWindowMs;
+
+  uint32_t _lastPollMs;
+  uint32_t _previousPollMs;             // The poll before the last one
+  uint32_t _lastActivityMs;
+  bool _polled;
+  bool _active;
+
+  uint32_t _polls;
+  uint32_t _windowStartMs;
+  uint32_t _windowPolls;
+  uint32_t _rateX10;
+};
+
+#endif // RFID_POLLER_H
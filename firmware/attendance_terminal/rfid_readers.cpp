@@ -0,0 +1,124 @@
+/*
+ * Multiple RFID readers for Attendee Attendance Terminal v2.0
+ */
+
+#include "rfid_readers.h"
+
+#include <string.h>
+
+const char* rfidRoleDirection(RfidReaderRole role) {
+  switch (role) {
+    case RFID_ROLE_ENTRY: return "entry";
+    case RFID_ROLE_EXIT:  return "exit";
+    default:              return NULL;
+  }
+}
+
+RfidReaderSet::RfidReaderSet(uint32_t fastMs, uint32_t idleMs, uint32_t fastWindowMs)
+  : _count(0), _nextPoll(0), _nextProbe(0) {
+  memset(_health, 0, sizeof(_health));
+  memset(_lastTag, 0, sizeof(_lastTag));
+  memset(_lastTagMs, 0, sizeof(_lastTagMs));
+  for (uint8_t i = 0; i < RFID_READERS_MAX; i++) {
+    _roles[i] = RFID_ROLE_TOGGLE;
+    _pollers[i].configure(fastMs, idleMs, fastWindowMs);
+    _health[i].lastResetReason = "";
+  }
+}
+
+bool RfidReaderSet::add(RfidReaderRole role) {
+  if (_count >= RFID_READERS_MAX) {
+    return false;
+  }
+  _roles[_count++] = role;
+  return true;
+}
+
+int RfidReaderSet::nextDue(uint32_t nowMs) {
+  for (uint8_t n = 0; n < _count; n++) {
+    uint8_t reader = (_nextPoll + n) % _count;
+    if (_pollers[reader].isDue(nowMs)) {
+      _nextPoll = (reader + 1) % _count;
+      return reader;
+    }
+  }
+  return -1;
+}
+
+uint32_t RfidReaderSet::msUntilDue(uint32_t nowMs) const {
+  uint32_t soonest = 0xFFFFFFFF;
+  for (uint8_t i = 0; i < _count; i++) {
+    uint32_t wait = _pollers[i].msUntilDue(nowMs);
+    if (wait < soonest) {
+      soonest = wait;
+    }
+  }
+  return _count > 0 ? soonest : 0;
+}
+
+uint32_t RfidReaderSet::onDetect(uint8_t reader, uint32_t nowMs) {
+  _health[reader].lastActivityMs = nowMs;
+  return _pollers[reader].onDetect(nowMs);
+}
+
+bool RfidReaderSet::onRead(uint8_t reader, bool ok, uint32_t nowMs, uint16_t resetAfter) {
+  RfidReaderHealth& h = _health[reader];
+  h.lastActivityMs = nowMs;
+  if (ok) {
+    h.scans++;
+    h.consecutiveFailures = 0;
+    return false;
+  }
+  h.readFailures++;
+  h.consecutiveFailures++;
+  return h.consecutiveFailures >= resetAfter;
+}
+
+void RfidReaderSet::onReset(uint8_t reader, const char* reason, uint32_t nowMs) {
+  RfidReaderHealth& h = _health[reader];
+  h.resets++;
+  h.consecutiveFailures = 0;
+  h.lastResetMs = nowMs;
+  h.lastResetReason = reason;
+}
+
+bool RfidReaderSet::isRepeat(uint8_t reader, const char* tag, uint32_t nowMs, uint32_t windowMs) {
+  if (_lastTag[reader][0] && nowMs - _lastTagMs[reader] < windowMs &&
+      strcmp(_lastTag[reader], tag) == 0) {
+    return true;
+  }
+  strncpy(_lastTag[reader], tag, RFID_READER_TAG_MAX);
+  _lastTag[reader][RFID_READER_TAG_MAX] = 0;
+  _lastTagMs[reader] = nowMs;
+  return false;
+}
+
+int RfidReaderSet::nextProbe(uint32_t nowMs, uint32_t intervalMs, uint32_t quietMs) {
+  for (uint8_t n = 0; n < _count; n++) {
+    uint8_t reader = (_nextProbe + n) % _count;
+    RfidReaderHealth& h = _health[reader];
+    if (nowMs - h.lastProbeMs >= intervalMs && nowMs - h.lastActivityMs >= quietMs) {
+      h.lastProbeMs = nowMs;
+      _nextProbe = (reader + 1) % _count;
+      return reader;
+    }
+  }
+  return -1;
+}
+
+bool RfidReaderSet::isQuiet(uint32_t nowMs, uint32_t quietMs) const {
+  for (uint8_t i = 0; i < _count; i++) {
+    if (nowMs - _health[i].lastActivityMs < quietMs) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint32_t RfidReaderSet::getTotalResets() const {
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < _count; i++) {
+    total += _health[i].resets;
+  }
+  return total;
+}
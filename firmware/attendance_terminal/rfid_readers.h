@@ -0,0 +1,97 @@
+/*
+ * Multiple RFID readers for Attendee Attendance Terminal v2.0
+ *
+ * Several MFRC522 readers share one SPI bus, each behind its own chip
+ * select. A door can then have an entry and an exit reader on one
+ * controller. A reader's role decides the direction sent with its scans;
+ * a toggle reader leaves entry/exit to the backend, as a single reader
+ * always has.
+ *
+ * The bus is time-sliced. Each reader keeps its own poll cadence, and a
+ * loop pass polls at most one of them: the due reader that follows the
+ * last one polled, so a busy reader cannot starve the others. Dedupe is
+ * per reader and per tag, so a second person at the other reader, or
+ * right behind the first one, is not held back. Read failures, resets and
+ * probe timing are kept per reader as well, so one flaky reader is reset
+ * on its own.
+ *
+ * Portable (no Arduino includes); the caller drives the readers.
+ */
+
+#ifndef RFID_READERS_H
+#define RFID_READERS_H
+
+#include <stdint.h>
+#include "rfid_poller.h"
+
+#define RFID_READERS_MAX 2              // Chip selects wired in the sketch
+#define RFID_READER_TAG_MAX 20          // UID hex, as formatUidHex()
+
+enum RfidReaderRole {
+  RFID_ROLE_TOGGLE,                     // Backend alternates entry/exit
+  RFID_ROLE_ENTRY,
+  RFID_ROLE_EXIT
+};
+
+// "entry"/"exit" for the attendance payload; NULL for a toggle reader
+const char* rfidRoleDirection(RfidReaderRole role);
+
+struct RfidReaderHealth {
+  uint32_t scans;                       // Serial numbers read
+  uint32_t readFailures;
+  uint16_t consecutiveFailures;
+  uint32_t resets;
+  uint32_t lastResetMs;
+  const char* lastResetReason;          // Static string, "" before the first reset
+  uint32_t lastProbeMs;
+  uint32_t lastActivityMs;
+};
+
+class RfidReaderSet {
+public:
+  RfidReaderSet(uint32_t fastMs, uint32_t idleMs, uint32_t fastWindowMs);
+
+  bool add(RfidReaderRole role);
+  uint8_t getCount() const { return _count; }
+  RfidReaderRole getRole(uint8_t reader) const { return _roles[reader]; }
+
+  // Time slicing: the reader to poll now, round robin; -1 when none is due
+  int nextDue(uint32_t nowMs);
+  uint32_t msUntilDue(uint32_t nowMs) const;
+  RfidPollScheduler& getPoller(uint8_t reader) { return _pollers[reader]; }
+  const RfidPollScheduler& getPoller(uint8_t reader) const { return _pollers[reader]; }
+
+  // Card seen by a reader; returns the detect latency bound
+  uint32_t onDetect(uint8_t reader, uint32_t nowMs);
+
+  // Read outcome; true once resetAfter reads in a row have failed
+  bool onRead(uint8_t reader, bool ok, uint32_t nowMs, uint16_t resetAfter);
+  void onReset(uint8_t reader, const char* reason, uint32_t nowMs);
+
+  // True when this reader already reported the tag within windowMs.
+  // Otherwise the tag is remembered as the reader's latest scan.
+  bool isRepeat(uint8_t reader, const char* tag, uint32_t nowMs, uint32_t windowMs);
+
+  // Reader whose liveness probe is due: not probed for intervalMs and no
+  // card activity for quietMs; -1 when none. Marks it probed.
+  int nextProbe(uint32_t nowMs, uint32_t intervalMs, uint32_t quietMs);
+
+  // No card activity on any reader for quietMs
+  bool isQuiet(uint32_t nowMs, uint32_t quietMs) const;
+
+  const RfidReaderHealth& getHealth(uint8_t reader) const { return _health[reader]; }
+  uint32_t getTotalResets() const;
+
+private:
+  uint8_t _count;
+  uint8_t _nextPoll;
+  uint8_t _nextProbe;
+  RfidReaderRole _roles[RFID_READERS_MAX];
+  RfidPollScheduler _pollers[RFID_READERS_MAX];
+  RfidReaderHealth _health[RFID_READERS_MAX];
+
+  char _lastTag[RFID_READERS_MAX][RFID_READER_TAG_MAX + 1];
+  uint32_t _lastTagMs[RFID_READERS_MAX];
+};
+
+#endif // RFID_READERS_H
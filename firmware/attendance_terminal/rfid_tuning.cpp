@@ -0,0 +1,140 @@
+/*
+ * Adaptive RFID antenna gain for Attendee Attendance Terminal v2.0
+ */
+
+#include "rfid_tuning.h"
+
+#include <string.h>
+
+#define RFID_TUNE_FORGET_WINDOWS 8      // Settled windows before neighbours are retried
+
+RfidGainTuner::RfidGainTuner(uint8_t minGain, uint8_t maxGain, uint8_t initialGain)
+  : _minGain(minGain), _maxGain(maxGain < RFID_GAIN_LEVELS ? maxGain : RFID_GAIN_LEVELS - 1),
+    _gain(initialGain), _windowMs(600000), _minTaps(20), _targetPercent(95), _tapGapMs(1500),
+    _inTap(false), _tapDetects(0), _lastEventMs(0), _windowStartMs(0), _windowStarted(false),
+    _lastPercent(0), _settledWindows(0), _gainChanges(0), _windows(0) {
+  if (_minGain > _maxGain) {
+    _minGain = _maxGain;
+  }
+  if (_gain < _minGain) _gain = _minGain;
+  if (_gain > _maxGain) _gain = _maxGain;
+  memset(&_window, 0, sizeof(_window));
+  memset(&_lastWindow, 0, sizeof(_lastWindow));
+  for (uint8_t i = 0; i < RFID_GAIN_LEVELS; i++) {
+    _score[i] = -1;
+  }
+}
+
+void RfidGainTuner::configure(uint32_t windowMs, uint16_t minTaps, uint8_t targetPercent, uint32_t tapGapMs) {
+  _windowMs = windowMs;
+  _minTaps = minTaps > 0 ? minTaps : 1;
+  _targetPercent = targetPercent <= 100 ? targetPercent : 100;
+  _tapGapMs = tapGapMs;
+}
+
+void RfidGainTuner::onDetect(uint32_t nowMs) {
+  if (!_windowStarted) {
+    _windowStartMs = nowMs;
+    _windowStarted = true;
+  }
+  if (_inTap && nowMs - _lastEventMs > _tapGapMs) {
+    closeTap();                         // The last tap was given up
+  }
+  if (!_inTap) {
+    _inTap = true;
+    _tapDetects = 0;
+    _window.taps++;
+  }
+  _tapDetects++;
+  _window.detects++;
+  _lastEventMs = nowMs;
+}
+
+void RfidGainTuner::onRead(bool ok, uint32_t nowMs) {
+  _lastEventMs = nowMs;
+  if (!ok) {
+    _window.readFailures++;
+    return;
+  }
+  _window.reads++;
+  if (_inTap) {
+    if (_tapDetects == 1) {
+      _window.firstTapReads++;
+    }
+    closeTap();
+  }
+}
+
+void RfidGainTuner::closeTap() {
+  if (_tapDetects > 1) {
+    _window.retries += _tapDetects - 1;
+  }
+  _inTap = false;
+  _tapDetects = 0;
+}
+
+bool RfidGainTuner::evaluate(uint32_t nowMs) {
+  if (!_windowStarted || nowMs - _windowStartMs < _windowMs) {
+    return false;
+  }
+  if (_inTap) {
+    if (nowMs - _lastEventMs <= _tapGapMs) {
+      return false;                     // Let the member finish
+    }
+    closeTap();
+  }
+  if (_window.taps < _minTaps) {
+    return false;                       // Too quiet to judge; keep counting
+  }
+
+  uint8_t percent = (uint8_t)(_window.firstTapReads * 100 / _window.taps);
+  _lastPercent = percent;
+  _lastWindow = _window;
+  memset(&_window, 0, sizeof(_window));
+  _windowStarted = false;
+  _windows++;
+
+  // Halfway to the new window's rate; a first measurement is taken as is
+  _score[_gain] = _score[_gain] < 0 ? percent : (int16_t)((_score[_gain] + percent + 1) / 2);
+
+  uint8_t next = percent >= _targetPercent ? _gain : chooseGain();
+  if (next == _gain) {
+    if (percent < _targetPercent && ++_settledWindows >= RFID_TUNE_FORGET_WINDOWS) {
+      // Stuck below target: let the neighbours be measured again
+      if (_gain > _minGain) _score[_gain - 1] = -1;
+      if (_gain < _maxGain) _score[_gain + 1] = -1;
+      _settledWindows = 0;
+    }
+    return false;
+  }
+  _settledWindows = 0;
+  _gain = next;
+  _gainChanges++;
+  return true;
+}
+
+uint8_t RfidGainTuner::chooseGain() const {
+  bool hasUp = _gain < _maxGain;
+  bool hasDown = _gain > _minGain;
+
+  // A measured neighbour that did better wins; exploring only starts from
+  // the best gain known, so a bad region is not wandered into
+  uint8_t best = _gain;
+  if (hasUp && _score[_gain + 1] > _score[best]) {
+    best = _gain + 1;
+  }
+  if (hasDown && _score[_gain - 1] > _score[best]) {
+    best = _gain - 1;
+  }
+  if (best != _gain) {
+    return best;
+  }
+
+  if (hasUp && _score[_gain + 1] < 0) {
+    return _gain + 1;
+  }
+  if (hasDown && _score[_gain - 1] < 0) {
+    return _gain - 1;
+  }
+  return _gain;
+}
@@ -0,0 +1,84 @@
+/*
+ * Adaptive RFID antenna gain for Attendee Attendance Terminal v2.0
+ *
+ * A tap is one card presentation: the first detect opens it, a successful
+ * read closes it, and detects within tapGapMs of the last event belong to
+ * the same tap (the member lifting and re-presenting the card). A tap read
+ * on its first detect is a first-tap success; every further detect is a
+ * retry the member had to make.
+ *
+ * Statistics are kept per time window. When a window has seen enough taps
+ * its first-tap success rate is folded into a per-gain score, and below the
+ * target rate the gain is hill-climbed one step at a time between the
+ * configured limits: to a neighbour that scored better, else to an untried
+ * neighbour (upwards first), else the gain stays. Neighbour scores are
+ * forgotten after a few windows stuck below target, so changes in cards,
+ * enclosure or interference are picked up.
+ *
+ * Portable (no Arduino includes); the caller applies the gain to the reader.
+ */
+
+#ifndef RFID_TUNING_H
+#define RFID_TUNING_H
+
+#include <stdint.h>
+
+#define RFID_GAIN_LEVELS 8              // MFRC522 RxGain field: 18 dB .. 48 dB
+
+struct RfidTapWindow {
+  uint32_t detects;                     // PICC_IsNewCardPresent() hits
+  uint32_t reads;                       // Serial numbers read
+  uint32_t readFailures;                // Detects whose serial read failed
+  uint32_t taps;
+  uint32_t firstTapReads;               // Taps read on their first detect
+  uint32_t retries;                     // Extra detects needed within taps
+};
+
+class RfidGainTuner {
+public:
+  RfidGainTuner(uint8_t minGain, uint8_t maxGain, uint8_t initialGain);
+
+  void configure(uint32_t windowMs, uint16_t minTaps, uint8_t targetPercent, uint32_t tapGapMs);
+
+  void onDetect(uint32_t nowMs);
+  void onRead(bool ok, uint32_t nowMs);
+
+  // Closes the window when it is due; true when the gain changed
+  bool evaluate(uint32_t nowMs);
+
+  uint8_t getGain() const { return _gain; }
+  const RfidTapWindow& getWindow() const { return _window; }
+  const RfidTapWindow& getLastWindow() const { return _lastWindow; }
+  uint8_t getLastFirstTapPercent() const { return _lastPercent; }
+  int16_t getScore(uint8_t gain) const { return gain < RFID_GAIN_LEVELS ? _score[gain] : -1; }
+  uint32_t getGainChanges() const { return _gainChanges; }
+  uint32_t getWindowCount() const { return _windows; }
+
+private:
+  void closeTap();
+  uint8_t chooseGain() const;
+
+  uint8_t _minGain;
+  uint8_t _maxGain;
+  uint8_t _gain;
+  uint32_t _windowMs;
+  uint16_t _minTaps;
+  uint8_t _targetPercent;
+  uint32_t _tapGapMs;
+
+  bool _inTap;
+  uint16_t _tapDetects;
+  uint32_t _lastEventMs;
+  uint32_t _windowStartMs;
+  bool _windowStarted;
+  RfidTapWindow _window;
+  RfidTapWindow _lastWindow;
+  uint8_t _lastPercent;
+
+  int16_t _score[RFID_GAIN_LEVELS];     // Smoothed first-tap percent, -1 untried
+  uint8_t _settledWindows;
+  uint32_t _gainChanges;
+  uint32_t _windows;
+};
+
+#endif // RFID_TUNING_H
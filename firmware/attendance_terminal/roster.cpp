@@ -0,0 +1,477 @@
+/*
+ * Local card roster for Attendee Attendance Terminal v2.0
+ */
+
+#include "roster.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROSTER_TRAILER "#roster"
+
+// ========================================
+// PAGE PARSING
+// ========================================
+
+static bool validTag(const char* tag, size_t len) {
+  if (len == 0 || len > ROSTER_TAG_MAX) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    char c = tag[i];
+    if (!((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Printable ASCII only (the LCD has no other glyphs), trimmed to fit
+static void copyName(const char* src, size_t len, char* out) {
+  size_t n = 0;
+  for (size_t i = 0; i < len && n < ROSTER_NAME_MAX; i++) {
+    char c = src[i];
+    out[n++] = (c >= 0x20 && c < 0x7f) ? c : '?';
+  }
+  while (n > 0 && out[n - 1] == ' ') n--;
+  out[n] = 0;
+}
+
+// "+TAG Name" or "-TAG"
+static bool parseChangeLine(const char* line, size_t len, RosterChange& change) {
+  if (len < 2 || (line[0] != '+' && line[0] != '-')) {
+    return false;
+  }
+  change.remove = line[0] == '-';
+  const char* tag = line + 1;
+  const char* space = (const char*)memchr(tag, ' ', len - 1);
+  size_t tagLength = space ? (size_t)(space - tag) : len - 1;
+  if (!validTag(tag, tagLength)) {
+    return false;
+  }
+  memcpy(change.tag, tag, tagLength);
+  change.tag[tagLength] = 0;
+  change.name[0] = 0;
+  if (space && !change.remove) {
+    copyName(space + 1, len - 1 - tagLength - 1, change.name);
+  }
+  return true;
+}
+
+bool parseRosterPage(const char* body, size_t len, RosterPage& page) {
+  page.version = 0;
+  page.full = false;
+  page.more = false;
+  page.count = 0;
+
+  bool header = false;
+  const char* p = body;
+  const char* end = body + len;
+  while (p < end) {
+    const char* newline = (const char*)memchr(p, '\n', end - p);
+    const char* lineEnd = newline ? newline : end;
+    size_t lineLength = lineEnd - p;
+    while (lineLength > 0 && (p[lineLength - 1] == '\r' || p[lineLength - 1] == ' ')) {
+      lineLength--;
+    }
+
+    if (lineLength > 0) {
+      if (!header) {
+        // "roster <version> <full|delta> <more|end>"
+        char line[48];
+        char kind[8];
+        char more[8];
+        unsigned long version;
+        size_t copy = lineLength < sizeof(line) - 1 ? lineLength : sizeof(line) - 1;
+        memcpy(line, p, copy);
+        line[copy] = 0;
+        if (sscanf(line, "roster %lu %7s %7s", &version, kind, more) != 3) {
+          return false;
+        }
+        if ((strcmp(kind, "full") != 0 && strcmp(kind, "delta") != 0) ||
+            (strcmp(more, "more") != 0 && strcmp(more, "end") != 0)) {
+          return false;
+        }
+        page.version = (uint32_t)version;
+        page.full = strcmp(kind, "full") == 0;
+        page.more = strcmp(more, "more") == 0;
+        header = true;
+      } else {
+        if (page.count >= ROSTER_PAGE_MAX || !parseChangeLine(p, lineLength, page.changes[page.count])) {
+          return false;
+        }
+        page.count++;
+      }
+    }
+    p = newline ? newline + 1 : end;
+  }
+  return header;
+}
+
+// ========================================
+// ROSTER FILE
+// ========================================
+
+// Tag field of a stored line (up to the first space)
+static void recordTag(const char* line, size_t len, char* tag) {
+  size_t n = 0;
+  while (n < len && n < ROSTER_TAG_MAX && line[n] != ' ') {
+    tag[n] = line[n];
+    n++;
+  }
+  tag[n] = 0;
+}
+
+// Name field of a stored line, padding removed
+static void recordName(const char* line, size_t len, char* name, size_t nameSize) {
+  if (nameSize == 0) {
+    return;
+  }
+  size_t start = ROSTER_TAG_MAX + 1;
+  size_t n = 0;
+  if (len > start) {
+    n = len - start;
+    while (n > 0 && line[start + n - 1] == ' ') n--;
+    if (n > nameSize - 1) n = nameSize - 1;
+    memcpy(name, line + start, n);
+  }
+  name[n] = 0;
+}
+
+Roster::Roster(TerminalStorage& storage, const char* path, const char* tempPath)
+  : _storage(storage), _path(path), _tempPath(tempPath), _version(0), _count(0), _commits(0),
+    _snapshotting(false), _snapshotVersion(0), _snapshotCount(0), _batchLength(0), _writeFailed(false) {
+  _cursor[0] = 0;
+}
+
+struct RosterCheck {
+  uint32_t count;
+  uint32_t version;
+  uint32_t trailerCount;
+  bool trailer;
+  bool valid;
+  char previous[ROSTER_TAG_MAX + 1];
+};
+
+// Sorted, unique records followed by exactly one trailer
+static bool checkLine(const char* line, size_t len, void* context) {
+  RosterCheck& check = *(RosterCheck*)context;
+  if (check.trailer) {
+    check.valid = false;
+    return false;
+  }
+  if (len >= sizeof(ROSTER_TRAILER) - 1 && memcmp(line, ROSTER_TRAILER, sizeof(ROSTER_TRAILER) - 1) == 0) {
+    unsigned long version, count;
+    if (sscanf(line, ROSTER_TRAILER " %lu %lu", &version, &count) != 2) {
+      check.valid = false;
+      return false;
+    }
+    check.version = (uint32_t)version;
+    check.trailerCount = (uint32_t)count;
+    check.trailer = true;
+    return true;
+  }
+  char tag[ROSTER_TAG_MAX + 1];
+  recordTag(line, len, tag);
+  if (!validTag(tag, strlen(tag)) || strcmp(tag, check.previous) <= 0) {
+    check.valid = false;
+    return false;
+  }
+  strcpy(check.previous, tag);
+  check.count++;
+  return true;
+}
+
+static bool checkRosterFile(TerminalStorage& storage, const char* path, RosterCheck& check) {
+  memset(&check, 0, sizeof(check));
+  check.valid = true;
+  if (!storage.exists(path) || !storage.forEachLine(path, checkLine, &check)) {
+    return false;
+  }
+  return check.valid && check.trailer && check.count == check.trailerCount;
+}
+
+void Roster::begin() {
+  _snapshotting = false;
+  _version = 0;
+  _count = 0;
+
+  RosterCheck check;
+  if (checkRosterFile(_storage, _path, check)) {
+    _storage.remove(_tempPath);         // Unfinished page or snapshot
+  } else if (checkRosterFile(_storage, _tempPath, check)) {
+    // Power lost between removing the old file and the rename in commit()
+    _storage.remove(_path);
+    if (!_storage.rename(_tempPath, _path)) {
+      return;
+    }
+  } else {
+    _storage.remove(_path);
+    _storage.remove(_tempPath);
+    return;
+  }
+  _version = check.version;
+  _count = check.count;
+}
+
+bool Roster::lookup(const char* tag, char* name, size_t nameSize) {
+  if (_count == 0 || !validTag(tag, strlen(tag))) {
+    return false;
+  }
+
+  char line[ROSTER_LINE_LENGTH + 1];
+  uint32_t low = 0;
+  uint32_t high = _count;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    int n = _storage.readAt(_path, mid * (ROSTER_LINE_LENGTH + 1), line, ROSTER_LINE_LENGTH);
+    if (n < 0 && low == 0 && high == _count) {
+      return lookupLinear(tag, name, nameSize);   // No random access on this storage
+    }
+    if (n != ROSTER_LINE_LENGTH) {
+      return false;
+    }
+    line[n] = 0;
+
+    char found[ROSTER_TAG_MAX + 1];
+    recordTag(line, n, found);
+    int cmp = strcmp(tag, found);
+    if (cmp == 0) {
+      recordName(line, n, name, nameSize);
+      return true;
+    }
+    if (cmp < 0) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  return false;
+}
+
+struct RosterSearch {
+  const char* tag;
+  char* name;
+  size_t nameSize;
+  bool found;
+};
+
+static bool searchLine(const char* line, size_t len, void* context) {
+  RosterSearch& search = *(RosterSearch*)context;
+  if (line[0] == '#') {
+    return false;
+  }
+  char tag[ROSTER_TAG_MAX + 1];
+  recordTag(line, len, tag);
+  int cmp = strcmp(search.tag, tag);
+  if (cmp == 0) {
+    recordName(line, len, search.name, search.nameSize);
+    search.found = true;
+  }
+  return cmp > 0;                       // Sorted: past the tag means absent
+}
+
+bool Roster::lookupLinear(const char* tag, char* name, size_t nameSize) {
+  RosterSearch search = { tag, name, nameSize, false };
+  _storage.forEachLine(_path, searchLine, &search);
+  return search.found;
+}
+
+// ========================================
+// APPLYING PAGES
+// ========================================
+
+bool Roster::apply(RosterPage& page) {
+  if (page.more && page.count == 0) {
+    abortSnapshot();                    // Would never finish
+    return false;
+  }
+  if (page.full) {
+    return applySnapshot(page);
+  }
+  if (_snapshotting) {
+    abortSnapshot();                    // The backend went back to deltas
+  }
+  return applyDelta(page);
+}
+
+struct RosterMerge {
+  Roster* roster;
+  const RosterChange* changes;
+  uint8_t count;
+  uint8_t next;
+  uint32_t written;
+};
+
+// Copies the committed file into the temp file, splicing in the changes
+bool Roster::mergeLine(const char* line, size_t len, void* context) {
+  RosterMerge& merge = *(RosterMerge*)context;
+  Roster& roster = *merge.roster;
+  if (line[0] == '#') {
+    return true;                        // Old trailer; commit() writes the new one
+  }
+
+  char tag[ROSTER_TAG_MAX + 1];
+  recordTag(line, len, tag);
+  while (merge.next < merge.count && strcmp(merge.changes[merge.next].tag, tag) < 0) {
+    const RosterChange& change = merge.changes[merge.next++];
+    if (!change.remove && roster.writeRecord(change.tag, change.name)) {
+      merge.written++;
+    }
+  }
+  if (merge.next < merge.count && strcmp(merge.changes[merge.next].tag, tag) == 0) {
+    const RosterChange& change = merge.changes[merge.next++];
+    if (!change.remove && roster.writeRecord(change.tag, change.name)) {
+      merge.written++;
+    }
+  } else {
+    char name[ROSTER_NAME_MAX + 1];
+    recordName(line, len, name, sizeof(name));
+    if (roster.writeRecord(tag, name)) {
+      merge.written++;
+    }
+  }
+  return !roster._writeFailed;
+}
+
+bool Roster::applyDelta(RosterPage& page) {
+  if (page.count == 0) {
+    return true;
+  }
+
+  // Stable sort by tag, then keep the newest change per tag
+  for (uint8_t i = 1; i < page.count; i++) {
+    RosterChange moving = page.changes[i];
+    uint8_t j = i;
+    while (j > 0 && strcmp(page.changes[j - 1].tag, moving.tag) > 0) {
+      page.changes[j] = page.changes[j - 1];
+      j--;
+    }
+    page.changes[j] = moving;
+  }
+  uint8_t unique = 0;
+  for (uint8_t i = 0; i < page.count; i++) {
+    if (i + 1 < page.count && strcmp(page.changes[i].tag, page.changes[i + 1].tag) == 0) {
+      continue;
+    }
+    page.changes[unique++] = page.changes[i];
+  }
+  page.count = unique;
+
+  _storage.remove(_tempPath);
+  _batchLength = 0;
+  _writeFailed = false;
+
+  RosterMerge merge = { this, page.changes, page.count, 0, 0 };
+  if (_storage.exists(_path)) {
+    _storage.forEachLine(_path, mergeLine, &merge);
+  }
+  while (merge.next < merge.count && !_writeFailed) {
+    const RosterChange& change = page.changes[merge.next++];
+    if (!change.remove && writeRecord(change.tag, change.name)) {
+      merge.written++;
+    }
+  }
+  if (_writeFailed) {
+    _storage.remove(_tempPath);
+    return false;
+  }
+  return commit(page.version, merge.written);
+}
+
+bool Roster::applySnapshot(const RosterPage& page) {
+  if (!_snapshotting) {
+    _storage.remove(_tempPath);
+    _snapshotting = true;
+    _snapshotVersion = page.version;    // Later pages may report newer versions
+    _snapshotCount = 0;
+    _cursor[0] = 0;
+    _batchLength = 0;
+    _writeFailed = false;
+  }
+
+  for (uint8_t i = 0; i < page.count; i++) {
+    const RosterChange& change = page.changes[i];
+    if (change.remove || strcmp(change.tag, _cursor) <= 0 || !writeRecord(change.tag, change.name)) {
+      abortSnapshot();
+      return false;
+    }
+    strcpy(_cursor, change.tag);
+    _snapshotCount++;
+  }
+  if (!flushBatch()) {
+    abortSnapshot();
+    return false;
+  }
+  if (page.more) {
+    return true;
+  }
+
+  _snapshotting = false;
+  return commit(_snapshotVersion, _snapshotCount);
+}
+
+void Roster::abortSnapshot() {
+  if (_snapshotting) {
+    _storage.remove(_tempPath);
+  }
+  _snapshotting = false;
+  _cursor[0] = 0;
+  _batchLength = 0;
+}
+
+bool Roster::commit(uint32_t version, uint32_t count) {
+  char trailer[ROSTER_LINE_LENGTH + 1];
+  char text[32];
+  snprintf(text, sizeof(text), ROSTER_TRAILER " %lu %lu", (unsigned long)version, (unsigned long)count);
+  snprintf(trailer, sizeof(trailer), "%-*s", ROSTER_LINE_LENGTH, text);
+  if (!writeLine(trailer) || !flushBatch()) {
+    _storage.remove(_tempPath);
+    return false;
+  }
+
+  if (!_storage.rename(_tempPath, _path)) {
+    // Filesystems that refuse to rename over an existing file; begin()
+    // recovers the temp file if power is lost in between
+    _storage.remove(_path);
+    if (!_storage.rename(_tempPath, _path)) {
+      return false;
+    }
+  }
+  _version = version;
+  _count = count;
+  _commits++;
+  return true;
+}
+
+bool Roster::writeRecord(const char* tag, const char* name) {
+  char line[ROSTER_LINE_LENGTH + 1];
+  snprintf(line, sizeof(line), "%-*s %-*s", ROSTER_TAG_MAX, tag, ROSTER_NAME_MAX, name);
+  return writeLine(line);
+}
+
+bool Roster::writeLine(const char* line) {
+  if (_writeFailed) {
+    return false;
+  }
+  memcpy(_batch + _batchLength, line, ROSTER_LINE_LENGTH);
+  _batch[_batchLength + ROSTER_LINE_LENGTH] = '\n';
+  _batchLength += ROSTER_LINE_LENGTH + 1;
+  if (_batchLength == sizeof(_batch)) {
+    return flushBatch();
+  }
+  return true;
+}
+
+// appendLine() adds the final newline itself, so a batch of lines costs one
+// file open instead of one per member
+bool Roster::flushBatch() {
+  if (_batchLength > 0 && !_writeFailed) {
+    if (!_storage.appendLine(_tempPath, _batch, _batchLength - 1)) {
+      _writeFailed = true;
+    }
+  }
+  _batchLength = 0;
+  return !_writeFailed;
+}
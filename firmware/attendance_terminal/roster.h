@@ -0,0 +1,109 @@
+/*
+ * Local card roster for Attendee Attendance Terminal v2.0
+ *
+ * The member list (card tag -> display name) kept on flash so scans can be
+ * named and checked without the backend. It is synchronized in pages of
+ * versioned deltas instead of being downloaded whole:
+ *
+ *   GET <backend>/device/roster?since=V&limit=N   (If-None-Match: "V")
+ *     304                   nothing changed since V
+ *     roster 57 delta more  changes after V, oldest first; "more" asks for
+ *     +04A1B2C3 Ada Lovelace  the next page, "end" completes the sync
+ *     -04DEADBE
+ *   GET ...?since=0&after=TAG&limit=N
+ *     roster 57 full more   snapshot of active members, sorted by tag, for a
+ *     +...                  new terminal or one older than the change log
+ *
+ * File format: one fixed-width line per member, sorted by tag (binary
+ * searched through TerminalStorage::readAt()), then a trailer line with the
+ * version and count. A file without its trailer is incomplete. Every page is
+ * written to the temp file and renamed over the roster, so a lookup only
+ * ever sees the last committed version, even halfway through a snapshot.
+ *
+ * Portable (no Arduino includes); storage comes from the HAL.
+ */
+
+#ifndef ROSTER_H
+#define ROSTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "terminal_hal.h"
+
+#define ROSTER_TAG_MAX      20          // UID hex, as formatUidHex()
+#define ROSTER_NAME_MAX     26          // Stored bytes; the LCD shows 16
+#define ROSTER_LINE_LENGTH  47          // Tag and name, space padded; '\n' follows
+#define ROSTER_PAGE_MAX     32          // Changes per fetched page
+#define ROSTER_BATCH_LINES  8           // Lines per storage append while rewriting
+
+struct RosterChange {
+  char tag[ROSTER_TAG_MAX + 1];
+  char name[ROSTER_NAME_MAX + 1];
+  bool remove;
+};
+
+struct RosterPage {
+  uint32_t version;                     // Delta: last change included; full: snapshot version
+  bool full;
+  bool more;
+  uint8_t count;
+  RosterChange changes[ROSTER_PAGE_MAX];
+};
+
+// Parses a response body in the format above; false when malformed
+bool parseRosterPage(const char* body, size_t len, RosterPage& page);
+
+class Roster {
+public:
+  Roster(TerminalStorage& storage, const char* path, const char* tempPath);
+
+  void begin();                         // Validate the file, finish an interrupted commit
+
+  uint32_t getVersion() const { return _version; }
+  uint32_t getCount() const { return _count; }
+  bool isLoaded() const { return _version > 0; }
+
+  // Name for a card tag; false when the card is not on the roster
+  bool lookup(const char* tag, char* name, size_t nameSize);
+
+  // Applies one page. Deltas are committed at once; snapshot pages are
+  // staged and committed with the last one. Deltas are sorted in place.
+  bool apply(RosterPage& page);
+
+  // Snapshot in progress: the next request continues after this tag
+  bool isSnapshotting() const { return _snapshotting; }
+  const char* getSnapshotCursor() const { return _cursor; }
+  void abortSnapshot();
+
+  uint32_t getCommitCount() const { return _commits; }
+
+private:
+  bool applyDelta(RosterPage& page);
+  bool applySnapshot(const RosterPage& page);
+  bool commit(uint32_t version, uint32_t count);
+  bool lookupLinear(const char* tag, char* name, size_t nameSize);
+  static bool mergeLine(const char* line, size_t len, void* context);
+
+  // Batched appends to the temp file
+  bool writeRecord(const char* tag, const char* name);
+  bool writeLine(const char* line);
+  bool flushBatch();
+
+  TerminalStorage& _storage;
+  const char* _path;
+  const char* _tempPath;
+  uint32_t _version;
+  uint32_t _count;
+  uint32_t _commits;
+
+  bool _snapshotting;
+  uint32_t _snapshotVersion;
+  uint32_t _snapshotCount;
+  char _cursor[ROSTER_TAG_MAX + 1];
+
+  char _batch[ROSTER_BATCH_LINES * (ROSTER_LINE_LENGTH + 1)];
+  size_t _batchLength;
+  bool _writeFailed;
+};
+
+#endif // ROSTER_H
@@ -0,0 +1,85 @@
+/*
+ * Fleet-friendly scheduling for Attendee Attendance Terminal v2.0
+ */
+
+#include "sync_pacing.h"
+
+uint32_t randomPhase(uint32_t intervalMs, uint32_t randomValue) {
+  return intervalMs ? randomValue % intervalMs : 0;
+}
+
+uint32_t jitterInterval(uint32_t baseMs, uint8_t jitterPercent, uint32_t randomValue) {
+  uint32_t spread = (uint32_t)((uint64_t)baseMs * jitterPercent / 100);
+  if (spread == 0) {
+    return baseMs;
+  }
+  return baseMs - spread + (uint32_t)((uint64_t)randomValue % (2ULL * spread + 1));
+}
+
+uint32_t parseRetryAfterMs(const char* value) {
+  if (!value) {
+    return 0;
+  }
+  while (*value == ' ') value++;
+
+  uint32_t seconds = 0;
+  const char* p = value;
+  while (*p >= '0' && *p <= '9') {
+    if (seconds > 86400) {
+      return 86400000UL;             // Cap absurd values at a day
+    }
+    seconds = seconds * 10 + (uint32_t)(*p - '0');
+    p++;
+  }
+  while (*p == ' ') p++;
+  if (p == value || *p) {
+    return 0;
+  }
+  return seconds * 1000UL;
+}
+
+SyncPacer::SyncPacer(uint16_t initialBatch, uint16_t maxBatch, uint16_t batchIncrease,
+                     uint32_t minBackoffMs, uint32_t maxBackoffMs)
+  : _batch(initialBatch ? initialBatch : 1), _maxBatch(maxBatch), _batchIncrease(batchIncrease),
+    _minBackoffMs(minBackoffMs), _maxBackoffMs(maxBackoffMs), _backoffMs(0),
+    _attempted(0), _throttled(false), _throttleCount(0) {
+}
+
+void SyncPacer::beginPass() {
+  _attempted = 0;
+  _throttled = false;
+}
+
+void SyncPacer::onResult(int httpCode, uint32_t retryAfterMs) {
+  _attempted++;
+  if (httpCode != 429 && httpCode != 503) {
+    return;
+  }
+
+  // Multiplicative decrease
+  _throttled = true;
+  _throttleCount++;
+  _batch = _batch > 1 ? _batch / 2 : 1;
+
+  uint32_t backoff = _backoffMs ? _backoffMs * 2 : _minBackoffMs;
+  if (backoff < retryAfterMs) backoff = retryAfterMs;
+  if (backoff > _maxBackoffMs) backoff = _maxBackoffMs;
+  _backoffMs = backoff;
+}
+
+uint32_t SyncPacer::endPass(bool backlogLeft, uint32_t continueMs) {
+  if (_throttled) {
+    return _backoffMs;
+  }
+
+  // Additive increase, only when the whole budget went through cleanly
+  if (_attempted >= _batch) {
+    uint32_t grown = (uint32_t)_batch + _batchIncrease;
+    _batch = grown > _maxBatch ? _maxBatch : (uint16_t)grown;
+  }
+  _backoffMs /= 2;
+  if (_backoffMs < _minBackoffMs) {
+    _backoffMs = 0;
+  }
+  return backlogLeft ? continueMs : 0;
+}
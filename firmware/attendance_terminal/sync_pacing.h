@@ -0,0 +1,60 @@
+/*
+ * Fleet-friendly scheduling for Attendee Attendance Terminal v2.0
+ *
+ * Randomized phase offsets and jitter for periodic backend traffic, and an
+ * AIMD pacer for offline backlog drains. After a site-wide power cut every
+ * terminal boots together; without this they heartbeat and sync in
+ * lockstep for as long as they stay up.
+ *
+ * Portable (no Arduino includes); the caller supplies random numbers.
+ */
+
+#ifndef SYNC_PACING_H
+#define SYNC_PACING_H
+
+#include <stdint.h>
+
+// Uniform in [0, intervalMs): first run after boot/reconnect
+uint32_t randomPhase(uint32_t intervalMs, uint32_t randomValue);
+
+// baseMs spread by +/- jitterPercent
+uint32_t jitterInterval(uint32_t baseMs, uint8_t jitterPercent, uint32_t randomValue);
+
+// Retry-After header value in milliseconds. Only delta-seconds is
+// understood; HTTP-dates and garbage give 0.
+uint32_t parseRetryAfterMs(const char* value);
+
+// Additive-increase / multiplicative-decrease limit on records per drain
+// pass. A 429/503 halves the batch, ends the pass and backs off (at least
+// Retry-After); a clean full pass grows the batch and relaxes the backoff.
+class SyncPacer {
+public:
+  SyncPacer(uint16_t initialBatch, uint16_t maxBatch, uint16_t batchIncrease,
+            uint32_t minBackoffMs, uint32_t maxBackoffMs);
+
+  void beginPass();
+  bool allowUpload() const { return !_throttled && _attempted < _batch; }
+  void onResult(int httpCode, uint32_t retryAfterMs);
+
+  // Delay before the next pass: the backoff after throttling, continueMs
+  // while backlog remains, or 0 to fall back to the regular interval
+  uint32_t endPass(bool backlogLeft, uint32_t continueMs);
+
+  uint16_t getBatch() const { return _batch; }
+  uint32_t getBackoffMs() const { return _backoffMs; }
+  uint32_t getThrottleCount() const { return _throttleCount; }
+  bool wasThrottled() const { return _throttled; }
+
+private:
+  uint16_t _batch;
+  uint16_t _maxBatch;
+  uint16_t _batchIncrease;
+  uint32_t _minBackoffMs;
+  uint32_t _maxBackoffMs;
+  uint32_t _backoffMs;
+  uint16_t _attempted;
+  bool _throttled;
+  uint32_t _throttleCount;
+};
+
+#endif // SYNC_PACING_H
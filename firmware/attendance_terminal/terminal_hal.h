@@ -0,0 +1,109 @@
+/*
+ * Hardware abstraction layer for Attendee Attendance Terminal v2.0
+ *
+ * Narrow interfaces between the portable attendance core and the platform.
+ * The firmware implements them on LittleFS/HTTPClient/WiFiClient
+ * (hal_esp8266.cpp); the Linux host build (firmware/host) implements them on
+ * a directory, POSIX sockets and a scripted card-tap source.
+ *
+ * This header must stay free of Arduino includes so it compiles on the host.
+ */
+
+#ifndef TERMINAL_HAL_H
+#define TERMINAL_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Line-oriented persistent storage (offline backlog, roster, ...)
+class TerminalStorage {
+public:
+  virtual ~TerminalStorage() {}
+
+  // Called for each non-empty line (without the newline); return false to stop
+  typedef bool (*LineVisitor)(const char* line, size_t len, void* context);
+
+  virtual bool appendLine(const char* path, const char* line, size_t len) = 0;
+  virtual bool forEachLine(const char* path, LineVisitor visitor, void* context) = 0;
+  virtual bool rename(const char* from, const char* to) = 0;
+  virtual bool remove(const char* path) = 0;
+  virtual bool exists(const char* path) = 0;
+
+  // Reads up to len bytes at offset (fixed-width record files); returns the
+  // count read, -1 on error or when random access is unsupported
+  virtual int readAt(const char* path, uint32_t offset, char* buffer, size_t len) {
+    (void)path; (void)offset; (void)buffer; (void)len;
+    return -1;
+  }
+};
+
+// Request/response transport to the backend
+class TerminalTransport {
+public:
+  virtual ~TerminalTransport() {}
+
+  // POST a JSON body. Returns the HTTP status code, or <= 0 on connection
+  // failure/timeout. The response body is NUL-terminated and truncated to fit.
+  virtual int postJson(const char* url, const char* body, size_t len,
+                       char* response, size_t responseSize) = 0;
+
+  // Retry-After of the last response in ms, 0 when absent
+  virtual uint32_t getLastRetryAfterMs() const { return 0; }
+
+  // Services a long-lived connection (keep-alive, reconnect) and returns
+  // true with a backend instruction (JSON, as in a heartbeat response)
+  // when one was pushed. Request/response transports never have any.
+  virtual bool pollCommand(char* command, size_t commandSize) { (void)command; (void)commandSize; return false; }
+};
+
+// Stream connection for pipelined uploads; one per in-flight request slot.
+// Only open() may block (TCP/TLS handshake); reads and writes never do.
+class TerminalConnection {
+public:
+  virtual ~TerminalConnection() {}
+
+  virtual bool open(const char* host, uint16_t port, bool secure) = 0;
+  virtual bool isOpen() = 0;
+
+  // Bytes written/read, 0 when it would block, -1 on error or peer close
+  virtual int write(const char* data, size_t len) = 0;
+  virtual int read(char* buffer, size_t size) = 0;
+  virtual void close() = 0;
+};
+
+// Connected UDP socket (CoAP transport)
+class TerminalDatagram {
+public:
+  virtual ~TerminalDatagram() {}
+
+  virtual bool open(const char* host, uint16_t port) = 0;
+  virtual bool send(const uint8_t* data, size_t len) = 0;
+
+  // Waits up to timeoutMs for a datagram from the peer; returns its
+  // length, 0 on timeout, -1 on error
+  virtual int receive(uint8_t* buffer, size_t size, uint32_t timeoutMs) = 0;
+};
+
+// Card reader: non-blocking poll for a newly presented card
+class TerminalCardReader {
+public:
+  virtual ~TerminalCardReader() {}
+
+  // Returns true and fills uid/uidLength when a new card was read
+  virtual bool pollCard(uint8_t* uid, uint8_t* uidLength, uint8_t maxLength) = 0;
+};
+
+// Wall clock and monotonic time
+struct TerminalDateTime {
+  int year, month, day, hour, minute, second;
+};
+
+class TerminalClock {
+public:
+  virtual ~TerminalClock() {}
+
+  virtual uint32_t millis() = 0;
+  virtual void now(TerminalDateTime& out) = 0;
+};
+
+#endif // TERMINAL_HAL_H
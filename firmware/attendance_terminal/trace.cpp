@@ -0,0 +1,85 @@
+/*
+ * Hot-path event tracing for Attendee Attendance Terminal v2.0
+ */
+
+#include "trace.h"
+
+#if TRACE_ENABLED
+
+struct TraceEventInfo {
+  const char* name;
+  char phase;
+};
+
+// Order must match enum TraceEventId. Begin/end pairs share a name.
+static const TraceEventInfo traceEventInfo[TRACE_EVENT_COUNT] = {
+  { "scan",          'B' },
+  { "scan",          'E' },
+  { "uid_read",      'i' },
+  { "feedback",      'i' },
+  { "http",          'B' },
+  { "http",          'E' },
+  { "post_start",    'i' },
+  { "response",      'i' },
+  { "body_read",     'i' },
+  { "offline_store", 'B' },
+  { "offline_store", 'E' },
+  { "sync",          'B' },
+  { "sync",          'E' },
+  { "sync_record",   'i' },
+  { "heartbeat",     'B' },
+  { "heartbeat",     'E' },
+  { "display",       'B' },
+  { "display",       'E' },
+  { "poll",          'B' },
+  { "poll",          'E' }
+};
+
+static TraceRecord traceRing[TRACE_RING_SIZE];
+static uint16_t traceHead = 0;       // Next slot to write
+static uint16_t traceCount = 0;      // Valid records in ring
+static uint32_t traceOverwritten = 0;
+
+void traceRecord(TraceEventId id, int16_t arg) {
+  TraceRecord& record = traceRing[traceHead];
+  record.micros = micros();
+  record.id = id;
+  record.reserved = 0;
+  record.arg = arg;
+
+  traceHead = (traceHead + 1) % TRACE_RING_SIZE;
+  if (traceCount < TRACE_RING_SIZE) {
+    traceCount++;
+  } else {
+    traceOverwritten++;
+  }
+}
+
+uint16_t getTraceRecordCount() {
+  return traceCount;
+}
+
+const TraceRecord& getTraceRecord(uint16_t index) {
+  uint16_t oldest = (traceHead + TRACE_RING_SIZE - traceCount) % TRACE_RING_SIZE;
+  return traceRing[(oldest + index) % TRACE_RING_SIZE];
+}
+
+uint32_t getTraceOverwrittenCount() {
+  return traceOverwritten;
+}
+
+const char* getTraceEventName(uint8_t id) {
+  return id < TRACE_EVENT_COUNT ? traceEventInfo[id].name : "unknown";
+}
+
+char getTraceEventPhase(uint8_t id) {
+  return id < TRACE_EVENT_COUNT ? traceEventInfo[id].phase : 'i';
+}
+
+void clearTrace() {
+  traceHead = 0;
+  traceCount = 0;
+  traceOverwritten = 0;
+}
+
+#endif // TRACE_ENABLED
@@ -0,0 +1,67 @@
+/*
+ * Hot-path event tracing for Attendee Attendance Terminal v2.0
+ *
+ * TRACE_EVENT(id, arg) appends a compact (micros, event, arg) record to a
+ * fixed-size RAM ring. When TRACE_ENABLED is false the macro compiles to
+ * nothing and the ring is not allocated. GET /api/trace dumps the ring;
+ * firmware/tools/trace_to_chrome.js converts the dump to Chrome trace /
+ * Perfetto JSON.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Trace points. Keep in sync with the name table in trace.cpp.
+enum TraceEventId : uint8_t {
+  TRACE_SCAN_BEGIN,         // Card present after poll
+  TRACE_SCAN_END,
+  TRACE_UID_READ,           // arg: UID size in bytes
+  TRACE_FEEDBACK,           // First beep/LED feedback issued
+  TRACE_HTTP_BEGIN,         // arg: 1 for HTTPS, 2 for CoAP, 3 for MQTT
+  TRACE_HTTP_END,           // arg: HTTP status code
+  TRACE_POST_START,         // Payload handed to HTTPClient
+  TRACE_RESPONSE,           // Response headers received, arg: HTTP status code
+  TRACE_BODY_READ,          // Response body read, arg: body length
+  TRACE_OFFLINE_STORE_BEGIN,
+  TRACE_OFFLINE_STORE_END,
+  TRACE_SYNC_BEGIN,         // arg: queued record count
+  TRACE_SYNC_END,           // arg: records synced
+  TRACE_SYNC_RECORD,        // arg: HTTP status code
+  TRACE_HEARTBEAT_BEGIN,
+  TRACE_HEARTBEAT_END,      // arg: HTTP status code
+  TRACE_DISPLAY_BEGIN,      // arg: LCD state
+  TRACE_DISPLAY_END,
+  TRACE_POLL_BEGIN,         // Reader polled for a card (TRACE_POLLS), arg: reader
+  TRACE_POLL_END,           // arg: 1 when a card is present
+  TRACE_EVENT_COUNT
+};
+
+struct TraceRecord {
+  uint32_t micros;
+  uint8_t id;
+  uint8_t reserved;
+  int16_t arg;
+};
+
+#if TRACE_ENABLED
+  #define TRACE_EVENT(id, arg) traceRecord((id), (int16_t)(arg))
+#else
+  #define TRACE_EVENT(id, arg) do {} while (0)
+#endif
+
+#if TRACE_ENABLED
+void traceRecord(TraceEventId id, int16_t arg);
+
+// Ring accessors for the dump endpoint (oldest first)
+uint16_t getTraceRecordCount();
+const TraceRecord& getTraceRecord(uint16_t index);
+uint32_t getTraceOverwrittenCount();
+const char* getTraceEventName(uint8_t id);
+char getTraceEventPhase(uint8_t id);      // 'B', 'E' or 'i' as in Chrome trace
+void clearTrace();
+#endif
+
+#endif // TRACE_H
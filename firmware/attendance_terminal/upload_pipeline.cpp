@@ -0,0 +1,290 @@
+/*
+ * Pipelined backlog upload for Attendee Attendance Terminal v2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "upload_pipeline.h"
+#include "sync_pacing.h"
+
+bool parseUploadTarget(const char* url, UploadTarget& out) {
+  const char* hostStart;
+  if (strncmp(url, "http://", 7) == 0) {
+    out.secure = false;
+    out.port = 80;
+    hostStart = url + 7;
+  } else if (strncmp(url, "https://", 8) == 0) {
+    out.secure = true;
+    out.port = 443;
+    hostStart = url + 8;
+  } else {
+    return false;
+  }
+
+  const char* pathStart = strchr(hostStart, '/');
+  const char* authorityEnd = pathStart ? pathStart : hostStart + strlen(hostStart);
+  const char* colon = (const char*)memchr(hostStart, ':', authorityEnd - hostStart);
+  const char* hostEnd = colon ? colon : authorityEnd;
+
+  size_t hostLength = hostEnd - hostStart;
+  if (hostLength == 0 || hostLength >= sizeof(out.host)) {
+    return false;
+  }
+  memcpy(out.host, hostStart, hostLength);
+  out.host[hostLength] = 0;
+
+  if (colon) {
+    unsigned long port = strtoul(colon + 1, NULL, 10);
+    if (port == 0 || port > 65535) {
+      return false;
+    }
+    out.port = (uint16_t)port;
+  }
+
+  const char* path = pathStart ? pathStart : "/";
+  if (strlen(path) >= sizeof(out.path)) {
+    return false;
+  }
+  strcpy(out.path, path);
+  return true;
+}
+
+HttpPipelineUploader::HttpPipelineUploader(TerminalConnection* const* connections, uint8_t count,
+                                           TerminalClock& clock)
+  : _count(count > UPLOAD_WINDOW_MAX ? UPLOAD_WINDOW_MAX : count), _clock(clock), _hasTarget(false),
+    _window(1), _timeoutMs(3000), _connects(0) {
+  for (uint8_t i = 0; i < _count; i++) {
+    _connections[i] = connections[i];
+  }
+  memset(_slots, 0, sizeof(_slots));
+}
+
+bool HttpPipelineUploader::setTarget(const char* url) {
+  UploadTarget target;
+  if (!parseUploadTarget(url, target)) {
+    _hasTarget = false;
+    return false;
+  }
+  if (_hasTarget && (strcmp(target.host, _target.host) != 0 || target.port != _target.port ||
+                     target.secure != _target.secure)) {
+    closeAll();                       // Kept-alive connections point at the old backend
+  }
+  _target = target;
+  _hasTarget = true;
+  return true;
+}
+
+uint8_t HttpPipelineUploader::getWindow() {
+  return _window < 1 ? 1 : (_window > _count ? _count : _window);
+}
+
+void HttpPipelineUploader::closeAll() {
+  for (uint8_t i = 0; i < _count; i++) {
+    if (!_slots[i].busy) {
+      _connections[i]->close();
+    }
+  }
+}
+
+bool HttpPipelineUploader::start(uint8_t slot, const char* record, size_t length) {
+  if (!_hasTarget || slot >= _count || _slots[slot].busy) {
+    return false;
+  }
+  Slot& s = _slots[slot];
+  TerminalConnection& connection = *_connections[slot];
+  uint32_t startedMs = _clock.millis();
+
+  char hostHeader[UPLOAD_URL_HOST_MAX + 8];
+  if (_target.port == (_target.secure ? 443 : 80)) {
+    snprintf(hostHeader, sizeof(hostHeader), "%s", _target.host);
+  } else {
+    snprintf(hostHeader, sizeof(hostHeader), "%s:%u", _target.host, (unsigned)_target.port);
+  }
+  int headLength = snprintf(s.head, sizeof(s.head),
+                            "POST %s HTTP/1.1\r\n"
+                            "Host: %s\r\n"
+                            "User-Agent: ESP8266-Attendance-Terminal/2.0\r\n"
+                            "Connection: keep-alive\r\n"
+                            "Content-Type: application/json\r\n"
+                            "Content-Length: %u\r\n\r\n",
+                            _target.path, hostHeader, (unsigned)length);
+  if (headLength <= 0 || headLength >= (int)sizeof(s.head)) {
+    onResult(UPLOAD_ERROR_SEND, 0, 0);
+    return false;
+  }
+
+  s.reused = connection.isOpen();
+  if (!s.reused) {
+    if (!connection.open(_target.host, _target.port, _target.secure)) {
+      onResult(UPLOAD_ERROR_CONNECT, 0, _clock.millis() - startedMs);
+      return false;
+    }
+    _connects++;
+  }
+
+  s.headLength = (uint16_t)headLength;
+  s.body = record;
+  s.bodyLength = (uint16_t)length;
+  s.sent = 0;
+  s.startedMs = startedMs;
+  s.busy = true;
+  s.lineLength = 0;
+  s.inBody = false;
+  s.status = 0;
+  s.contentLength = -1;
+  s.closeAfter = false;
+  s.jsonReply = false;
+  s.result = 0;
+  s.retryAfterMs = 0;
+  s.received = 0;
+
+  send(slot);
+  return true;
+}
+
+bool HttpPipelineUploader::send(uint8_t slot) {
+  Slot& s = _slots[slot];
+  TerminalConnection& connection = *_connections[slot];
+  uint32_t total = (uint32_t)s.headLength + s.bodyLength;
+  while (s.sent < total) {
+    int n = s.sent < s.headLength
+      ? connection.write(s.head + s.sent, s.headLength - s.sent)
+      : connection.write(s.body + (s.sent - s.headLength), total - s.sent);
+    if (n < 0) {
+      return false;
+    }
+    if (n == 0) {
+      break;                          // Send buffer full; continue on the next poll
+    }
+    s.sent += n;
+  }
+  return true;
+}
+
+static bool startsWithIgnoreCase(const char* text, const char* prefix) {
+  for (; *prefix; text++, prefix++) {
+    char c = *text;
+    if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+    if (c != *prefix) return false;
+  }
+  return true;
+}
+
+void HttpPipelineUploader::parseHeaderLine(Slot& s) {
+  s.line[s.lineLength] = 0;
+  if (s.status == 0) {
+    int minor = 1;
+    if (sscanf(s.line, "HTTP/1.%d %d", &minor, &s.status) != 2) {
+      s.status = -1;
+    }
+    s.closeAfter = (minor == 0);
+    return;
+  }
+
+  const char* value = strchr(s.line, ':');
+  if (!value) {
+    return;
+  }
+  value++;
+  while (*value == ' ') value++;
+
+  if (startsWithIgnoreCase(s.line, "content-length:")) {
+    s.contentLength = strtol(value, NULL, 10);
+  } else if (startsWithIgnoreCase(s.line, "retry-after:")) {
+    s.retryAfterMs = parseRetryAfterMs(value);
+  } else if (startsWithIgnoreCase(s.line, "content-type:")) {
+    s.jsonReply = startsWithIgnoreCase(value, "application/json");
+  } else if (startsWithIgnoreCase(s.line, "connection:")) {
+    s.closeAfter = startsWithIgnoreCase(value, "close");
+  } else if (startsWithIgnoreCase(s.line, "transfer-encoding:")) {
+    s.contentLength = -1;             // Body is not needed; drop the connection instead
+  }
+}
+
+void HttpPipelineUploader::finish(uint8_t slot, int code, bool& accepted) {
+  Slot& s = _slots[slot];
+  s.busy = false;
+  // Unknown body length: the connection cannot carry another request
+  if (code <= 0 || s.closeAfter || s.contentLength != 0) {
+    _connections[slot]->close();
+  }
+  s.result = code;
+  accepted = (code == 200 || code == 201) || isPermanentRejection(code, s.jsonReply);
+  onResult(code, s.retryAfterMs, _clock.millis() - s.startedMs);
+}
+
+bool HttpPipelineUploader::poll(uint8_t slot, bool& accepted) {
+  accepted = false;
+  if (slot >= _count || !_slots[slot].busy) {
+    return true;
+  }
+  Slot& s = _slots[slot];
+  TerminalConnection& connection = *_connections[slot];
+
+  bool failed = !send(slot);
+  char buffer[128];
+  while (!failed) {
+    int n = connection.read(buffer, sizeof(buffer));
+    if (n < 0) {
+      failed = true;
+      break;
+    }
+    if (n == 0) {
+      break;
+    }
+    s.received += n;
+    for (int i = 0; i < n; i++) {
+      if (s.inBody) {
+        // Skip the body so the connection can be reused
+        long take = n - i;
+        if (take > s.contentLength) take = s.contentLength;
+        s.contentLength -= take;
+        i += take - 1;
+      } else if (buffer[i] == '\n') {
+        if (s.lineLength > 0 && s.line[s.lineLength - 1] == '\r') s.lineLength--;
+        if (s.lineLength == 0 && s.status != 0) {
+          s.inBody = true;
+        } else {
+          parseHeaderLine(s);
+        }
+        s.lineLength = 0;
+        if (s.status < 0) {
+          finish(slot, UPLOAD_ERROR_MALFORMED, accepted);
+          return true;
+        }
+      } else if (s.lineLength < sizeof(s.line) - 1) {
+        s.line[s.lineLength++] = buffer[i];
+      }
+
+      if (s.inBody && s.contentLength <= 0) {
+        finish(slot, s.status, accepted);
+        return true;
+      }
+    }
+  }
+
+  if (failed) {
+    if (s.reused && s.received == 0) {
+      // The server dropped the idle kept-alive connection; resend once on
+      // a fresh one (the record carries its idempotency key)
+      connection.close();
+      if (connection.open(_target.host, _target.port, _target.secure)) {
+        _connects++;
+        s.reused = false;
+        s.sent = 0;
+        return false;
+      }
+      finish(slot, UPLOAD_ERROR_CONNECT, accepted);
+      return true;
+    }
+    finish(slot, s.received ? UPLOAD_ERROR_MALFORMED : UPLOAD_ERROR_SEND, accepted);
+    return true;
+  }
+
+  if (_clock.millis() - s.startedMs > _timeoutMs) {
+    finish(slot, UPLOAD_ERROR_TIMEOUT, accepted);
+    return true;
+  }
+  return false;
+}
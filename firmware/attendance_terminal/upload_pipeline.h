@@ -0,0 +1,100 @@
+/*
+ * Pipelined backlog upload for Attendee Attendance Terminal v2.0
+ *
+ * HTTP/1.1 POSTs on a small pool of keep-alive connections, driven without
+ * blocking so several offline records can be in flight at once. Feeds
+ * OfflineQueue::drainPipelined(); over a high-latency uplink the drain rate
+ * grows with the window instead of being one record per round trip.
+ *
+ * Portable (no Arduino includes); connections come from the platform HAL.
+ */
+
+#ifndef UPLOAD_PIPELINE_H
+#define UPLOAD_PIPELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "attendance_core.h"
+#include "terminal_hal.h"
+
+#define UPLOAD_URL_HOST_MAX 64
+#define UPLOAD_URL_PATH_MAX 96
+
+// Transport failures reported through onResult(), as SocketTransport does
+#define UPLOAD_ERROR_CONNECT   -1
+#define UPLOAD_ERROR_SEND      -2
+#define UPLOAD_ERROR_MALFORMED -3
+#define UPLOAD_ERROR_TIMEOUT   -11
+
+struct UploadTarget {
+  char host[UPLOAD_URL_HOST_MAX];
+  char path[UPLOAD_URL_PATH_MAX];
+  uint16_t port;
+  bool secure;
+};
+
+// "http[s]://host[:port]/path"; false when malformed or too long
+bool parseUploadTarget(const char* url, UploadTarget& out);
+
+class HttpPipelineUploader : public PipelinedUploader {
+public:
+  // connections[0..count) are the slots; count is capped at UPLOAD_WINDOW_MAX
+  HttpPipelineUploader(TerminalConnection* const* connections, uint8_t count, TerminalClock& clock);
+
+  bool setTarget(const char* url);
+  void setWindow(uint8_t window) { _window = window; }
+  void setTimeout(uint32_t timeoutMs) { _timeoutMs = timeoutMs; }
+
+  uint8_t getWindow() override;
+  bool start(uint8_t slot, const char* record, size_t length) override;
+  // accepted is also set for a permanent rejection (isPermanentRejection()):
+  // the record is done with either way. getResult() tells them apart.
+  bool poll(uint8_t slot, bool& accepted) override;
+  int getResult(uint8_t slot) const { return _slots[slot].result; }
+
+  void closeAll();                    // Drop idle keep-alive connections after a pass
+  uint32_t getConnectCount() const { return _connects; }
+
+protected:
+  // Every finished request; code is the HTTP status or an UPLOAD_ERROR_*
+  virtual void onResult(int /*code*/, uint32_t /*retryAfterMs*/, uint32_t /*elapsedMs*/) {}
+
+private:
+  struct Slot {
+    char head[UPLOAD_URL_PATH_MAX + UPLOAD_URL_HOST_MAX + 160];
+    uint16_t headLength;
+    const char* body;
+    uint16_t bodyLength;
+    uint16_t sent;                    // Bytes of head + body written
+    uint32_t startedMs;
+    bool busy;
+    bool reused;                      // Request went out on a kept-alive connection
+    // Response
+    char line[96];
+    uint8_t lineLength;
+    bool inBody;
+    int status;
+    long contentLength;               // -1 when unknown (chunked or close-delimited)
+    bool closeAfter;
+    bool jsonReply;                   // Content-Type: application/json
+    int result;                       // Code passed to onResult() when it finished
+    uint32_t retryAfterMs;
+    uint32_t received;
+  };
+
+  bool send(uint8_t slot);
+  void parseHeaderLine(Slot& s);
+  void finish(uint8_t slot, int code, bool& accepted);
+
+  TerminalConnection* _connections[UPLOAD_WINDOW_MAX];
+  uint8_t _count;
+  TerminalClock& _clock;
+  UploadTarget _target;
+  bool _hasTarget;
+  uint8_t _window;
+  uint32_t _timeoutMs;
+  uint32_t _connects;
+  Slot _slots[UPLOAD_WINDOW_MAX];
+};
+
+#endif // UPLOAD_PIPELINE_H
@@ -19,20 +19,38 @@
 #include <MFRC522Debug.h>
 #include "config.h"
 #include "utils.h"
+#include "metrics.h"
+#include "logger.h"
+#include "attendance_core.h"
+#include "offline_segments.h"
+#include "history_store.h"
+#include "daily_tally.h"
+#include "endpoint_selector.h"
+#include "rfid_tuning.h"
+#include "rfid_readers.h"
 
 // External references from main file
 extern LiquidCrystal_I2C lcd;
-extern WiFiClient wifiClient;
+extern TimedWiFiClient wifiClient;
 extern HTTPClient http;
 extern String backendUrl;
 extern String deviceId;
 extern bool isOnline;
 extern int offlineLogsCount;
-extern MFRC522 mfrc522;
+extern MFRC522DriverSPI driver;
+extern MFRC522* rfidReaders[];
+extern MFRC522DriverSPI* rfidDrivers[];
+extern RfidReaderSet rfidReaderSet;
 extern RTC_DS3231 rtc;
+extern OfflineQueue offlineQueue;
+extern SegmentStore offlineSegments;
+extern HistoryStore attendanceHistory;
+extern DailyTally dailyTally;
+extern EndpointSelector backendEndpoints;
+extern RfidGainTuner rfidGainTuner;
 
 // Function declarations from main file
-extern bool syncSingleLog(String logEntry);
+extern bool syncSingleLog(const char* record, size_t length);
 
 // Static variables for uptime tracking
 static unsigned long bootTime = 0;
@@ -96,7 +114,8 @@ bool isValidUrl(String url) {
     return false;
   }
   
-  if (!url.startsWith("http://") && !url.startsWith("https://")) {
+  if (!url.startsWith("http://") && !url.startsWith("https://") && !url.startsWith("coap://") &&
+      !url.startsWith("mqtt://") && !url.startsWith("mqtts://")) {
     return false;
   }
   
@@ -122,9 +141,30 @@ bool isValidRfidTag(String tag) {
 // CONFIGURATION MANAGEMENT
 // ========================================
 
+// Replaces the backend endpoint list (most preferred first). backendUrl
+// follows the first entry; the list is never left empty.
+void setBackendEndpoints(const String* urls, uint8_t count) {
+  backendEndpoints.clear();
+  for (uint8_t i = 0; i < count; i++) {
+    if (urls[i].length() > 0 && !backendEndpoints.add(urls[i].c_str())) {
+      DEBUG_PRINTLN("Backend URL not added: " + urls[i]);
+    }
+  }
+  if (backendEndpoints.getCount() == 0) {
+    backendEndpoints.add(DEFAULT_BACKEND_URL);
+  }
+  backendUrl = backendEndpoints.getEndpoint(0).url;
+}
+
 bool saveConfiguration() {
-  StaticJsonDocument<512> config;
+  StaticJsonDocument<768> config;
   config["backendUrl"] = backendUrl;
+  if (backendEndpoints.getCount() > 1) {
+    JsonArray urls = config.createNestedArray("backendUrls");
+    for (uint8_t i = 0; i < backendEndpoints.getCount(); i++) {
+      urls.add(backendEndpoints.getEndpoint(i).url);
+    }
+  }
   config["deviceId"] = deviceId;
   config["firmware"] = FIRMWARE_VERSION;
   config["lastUpdate"] = millis();
@@ -154,10 +194,11 @@ bool loadJsonConfiguration() {
     if (deviceId.length() == 0) {
       deviceId = "ESP_" + formatMacAddress(WiFi.macAddress());
     }
+    setBackendEndpoints(&backendUrl, 1);
     return false;
   }
   
-  StaticJsonDocument<512> config;
+  StaticJsonDocument<768> config;
   DeserializationError error = deserializeJson(config, file);
   file.close();
   
@@ -171,6 +212,7 @@ bool loadJsonConfiguration() {
     if (deviceId.length() == 0) {
       deviceId = "ESP_" + formatMacAddress(WiFi.macAddress());
     }
+    setBackendEndpoints(&backendUrl, 1);
     return false;
   }
   
@@ -187,6 +229,25 @@ bool loadJsonConfiguration() {
     backendUrl = DEFAULT_BACKEND_URL;
   }
   
+  // Optional endpoint list, most preferred first; backendUrl alone otherwise
+  String urls[ENDPOINT_MAX];
+  uint8_t urlCount = 0;
+  if (config.containsKey("backendUrls")) {
+    for (JsonVariant url : config["backendUrls"].as<JsonArray>()) {
+      String candidate = url.as<String>();
+      if (urlCount < ENDPOINT_MAX && isValidUrl(candidate)) {
+        urls[urlCount++] = candidate;
+      } else {
+        DEBUG_PRINTLN("Skipping backend URL in config: " + candidate);
+      }
+    }
+  }
+  if (urlCount > 0) {
+    setBackendEndpoints(urls, urlCount);
+  } else {
+    setBackendEndpoints(&backendUrl, 1);
+  }
+  
   if (config.containsKey("deviceId") && config["deviceId"].as<String>().length() > 0) {
     deviceId = config["deviceId"].as<String>();
   } else {
@@ -200,8 +261,8 @@ bool loadJsonConfiguration() {
 }
 
 bool clearOfflineLogs() {
-  if (LittleFS.remove(OFFLINE_LOGS_FILE)) {
-    offlineLogsCount = 0;
+  if (offlineQueue.clear() && offlineSegments.clear()) {
+    offlineLogsCount = offlineQueue.recoverCount();
     DEBUG_PRINTLN("Offline logs cleared");
     return true;
   }
@@ -259,36 +320,154 @@ String getMACAddress() {
 // RFID UTILITY FUNCTIONS (MFRC522v2)
 // ========================================
 
-void initializeRFID() {
-  mfrc522.PCD_Init();
+// Version register read at init; later probes must see the same value
+static byte rfidVersion[RFID_READERS_MAX] = { 0 };
+
+// Interrupt mode state (single reader); RxIRq also fires for our own
+// transceives, so an IRQ only counts while a REQA is armed
+static int rfidIrqPin = -1;
+static volatile bool rfidIrqPending = false;
+static bool rfidIrqArmed = false;
+
+// Readers in soft power-down between low-power polls
+static bool rfidAsleep[RFID_READERS_MAX] = { false };
+
+static byte readRFIDVersion(uint8_t reader) {
+  return rfidDrivers[reader]->PCD_ReadRegister(MFRC522Constants::PCD_Register::VersionReg);
+}
+
+void initializeRFID(uint8_t reader) {
+  MFRC522& rfid = *rfidReaders[reader];
+  rfid.PCD_Init();
   // Ensure antenna is on and set gain
-  mfrc522.PCD_AntennaOn();
-  setRFIDGain(RFID_DEFAULT_GAIN);
+  rfid.PCD_AntennaOn();
+  rfid.PCD_SetAntennaGain((byte)((rfidGainTuner.getGain() & 0x07) << 4));
+  rfidVersion[reader] = readRFIDVersion(reader);
 }
 
-void softResetRFID() {
+void softResetRFID(uint8_t reader) {
+  MFRC522& rfid = *rfidReaders[reader];
   // Try graceful halt and soft reset
-  mfrc522.PICC_HaltA();
+  rfid.PICC_HaltA();
   delay(5);
-  mfrc522.PCD_SoftPowerDown();
+  rfid.PCD_SoftPowerDown();
   delay(10);
-  mfrc522.PCD_SoftPowerUp();
+  rfid.PCD_SoftPowerUp();
   delay(25);
-  mfrc522.PCD_Init();
-  mfrc522.PCD_AntennaOn();
-  setRFIDGain(RFID_DEFAULT_GAIN);
+  rfid.PCD_Init();
+  rfid.PCD_AntennaOn();
+  rfid.PCD_SetAntennaGain((byte)((rfidGainTuner.getGain() & 0x07) << 4));  // Keep the tuned gain across resets
+  if (rfidVersion[reader] == 0x00 || rfidVersion[reader] == 0xFF) {
+    // Reader was absent at boot; adopt it once it answers
+    rfidVersion[reader] = readRFIDVersion(reader);
+  }
+  if (reader == 0 && rfidIrqPin >= 0) {
+    enableRFIDIrq(rfidIrqPin);  // Soft reset clears ComIEnReg
+  }
+  rfidAsleep[reader] = false;
 }
 
+// Soft power-down keeps every register, so waking needs no PCD_Init(): the
+// oscillator restarts and the field must be up RFID_FIELD_SETTLE_MS before a
+// card can answer
+void sleepRFIDReader(uint8_t reader) {
+  if (!rfidAsleep[reader]) {
+    rfidReaders[reader]->PCD_SoftPowerDown();
+    rfidAsleep[reader] = true;
+  }
+}
+
+void wakeRFIDReader(uint8_t reader) {
+  if (rfidAsleep[reader]) {
+    rfidReaders[reader]->PCD_SoftPowerUp();
+    rfidAsleep[reader] = false;
+    delay(RFID_FIELD_SETTLE_MS);
+  }
+}
+
+bool isRFIDReaderAsleep(uint8_t reader) {
+  return rfidAsleep[reader];
+}
+
+// Five register reads (~10 us of SPI), no delays and no RF activity, so it
+// can run between polls without costing a tap. A stalled bus reads 0x00 or
+// 0xFF; a chip that browned out and restarted answers normally but has lost
+// what PCD_Init() programmed: timer auto-start, forced 100% ASK, antenna
+// drivers and the tuned gain.
+RfidProbeResult probeRFIDReader(uint8_t reader) {
+  MFRC522DriverSPI& bus = *rfidDrivers[reader];
+  byte version = readRFIDVersion(reader);
+  if (version == 0x00 || version == 0xFF || version != rfidVersion[reader]) {
+    return RFID_PROBE_NO_RESPONSE;
+  }
+  byte tMode = bus.PCD_ReadRegister(MFRC522Constants::PCD_Register::TModeReg);
+  byte txAsk = bus.PCD_ReadRegister(MFRC522Constants::PCD_Register::TxASKReg);
+  byte txControl = bus.PCD_ReadRegister(MFRC522Constants::PCD_Register::TxControlReg);
+  if (tMode != 0x80 || txAsk != 0x40 || (txControl & 0x03) != 0x03 ||
+      getRFIDGain(reader) != (rfidGainTuner.getGain() & 0x07)) {
+    return RFID_PROBE_CONFIG_LOST;
+  }
+  return RFID_PROBE_OK;
+}
+
+byte getRFIDVersion(uint8_t reader) {
+  return rfidVersion[reader];
+}
+
+static void IRAM_ATTR onRFIDIrq() {
+  rfidIrqPending = true;
+}
+
+void enableRFIDIrq(int pin) {
+  rfidIrqPin = pin;
+  rfidIrqArmed = false;
+  pinMode(pin, INPUT_PULLUP);
+  // IRQ pin active low (IRqInv), raised only by RxIRq: a PICC answered
+  driver.PCD_WriteRegister(MFRC522Constants::PCD_Register::ComIEnReg, 0xA0);
+  driver.PCD_WriteRegister(MFRC522Constants::PCD_Register::ComIrqReg, 0x7F);
+  attachInterrupt(digitalPinToInterrupt(pin), onRFIDIrq, FALLING);
+}
+
+bool isRFIDIrqEnabled() {
+  return rfidIrqPin >= 0;
+}
+
+void armRFIDIrq() {
+  driver.PCD_WriteRegister(MFRC522Constants::PCD_Register::CommandReg, MFRC522Constants::PCD_Command::PCD_Idle);
+  driver.PCD_WriteRegister(MFRC522Constants::PCD_Register::ComIrqReg, 0x7F);   // Clear, releases the IRQ line
+  rfidIrqPending = false;
+  driver.PCD_WriteRegister(MFRC522Constants::PCD_Register::FIFOLevelReg, 0x80); // Flush FIFO
+  driver.PCD_WriteRegister(MFRC522Constants::PCD_Register::FIFODataReg, MFRC522Constants::PICC_Command::PICC_CMD_REQA);
+  driver.PCD_WriteRegister(MFRC522Constants::PCD_Register::CommandReg, MFRC522Constants::PCD_Command::PCD_Transceive);
+  driver.PCD_WriteRegister(MFRC522Constants::PCD_Register::BitFramingReg, 0x87); // StartSend, 7-bit short frame
+  rfidIrqArmed = true;
+}
+
+bool takeRFIDIrq() {
+  if (!rfidIrqArmed || !rfidIrqPending) {
+    return false;
+  }
+  rfidIrqArmed = false;
+  rfidIrqPending = false;
+  driver.PCD_WriteRegister(MFRC522Constants::PCD_Register::ComIrqReg, 0x7F);
+  driver.PCD_WriteRegister(MFRC522Constants::PCD_Register::BitFramingReg, 0x00);
+  return true;
+}
+
+// Gain level 0-7 (18-48 dB); the reader keeps it in bits 6:4 of RFCfgReg.
+// One tuned gain is applied to every reader.
 void setRFIDGain(byte gain) {
-  mfrc522.PCD_SetAntennaGain(gain);
+  for (uint8_t reader = 0; reader < rfidReaderSet.getCount(); reader++) {
+    rfidReaders[reader]->PCD_SetAntennaGain((byte)((gain & 0x07) << 4));
+  }
 }
 
-byte getRFIDGain() {
-  return mfrc522.PCD_GetAntennaGain();
+byte getRFIDGain(uint8_t reader) {
+  return rfidReaders[reader]->PCD_GetAntennaGain() >> 4;
 }
 
-bool isRFIDCardPresent() {
-  return mfrc522.PICC_IsNewCardPresent();
+bool isRFIDCardPresent(uint8_t reader) {
+  return rfidReaders[reader]->PICC_IsNewCardPresent();
 }
 
 // ========================================
@@ -406,9 +585,23 @@ size_t getFileSystemTotal() {
   return 0;
 }
 
+// Day rollover: whole history days older than HISTORY_RETENTION_DAYS are
+// dropped and today's tally starts empty at RTC midnight. Skipped while the
+// RTC has no valid time, which would make every kept day look like it is in
+// the future.
 bool cleanupOldLogs() {
-  // Implementation to clean up old log files if needed
-  // This is a placeholder for future enhancement
+  uint32_t now;
+  if (!isTimeValid() || !parseIsoTimestamp(getCurrentTimestamp().c_str(), now)) {
+    return false;
+  }
+  uint16_t today = (uint16_t)(now / 86400);
+  uint8_t dropped = attendanceHistory.dropExpired(today);
+  if (dropped > 0) {
+    LOG_I("History: dropped %u expired days, %u kept", dropped, attendanceHistory.getPartitionCount());
+  }
+  if (dailyTally.startDay(today)) {
+    LOG_I("Tally: new day %u", today);
+  }
   return true;
 }
 
@@ -416,25 +609,18 @@ bool cleanupOldLogs() {
 // ERROR HANDLING AND LOGGING
 // ========================================
 
-void logError(String error) {
-  #if DEBUG_ENABLED
-  Serial.print("[ERROR] ");
-  Serial.println(error);
-  #endif
+// String-based wrappers kept for cold paths; hot paths use LOG_E/LOG_I/LOG_D directly
+
+void logError(const String& error) {
+  LOG_E("%s", error.c_str());
 }
 
-void logInfo(String info) {
-  #if DEBUG_ENABLED
-  Serial.print("[INFO] ");
-  Serial.println(info);
-  #endif
+void logInfo(const String& info) {
+  LOG_I("%s", info.c_str());
 }
 
-void logDebug(String debug) {
-  #if DEBUG_ENABLED
-  Serial.print("[DEBUG] ");
-  Serial.println(debug);
-  #endif
+void logDebug(const String& debug) {
+  LOG_D("%s", debug.c_str());
 }
 
 // ========================================
@@ -443,10 +629,9 @@ void logDebug(String debug) {
 
 String getCurrentTimestamp() {
   DateTime now = rtc.now();
-  char buffer[25];
-  sprintf(buffer, "%04d-%02d-%02dT%02d:%02d:%02d", 
-          now.year(), now.month(), now.day(),
-          now.hour(), now.minute(), now.second());
+  TerminalDateTime dt = { now.year(), now.month(), now.day(), now.hour(), now.minute(), now.second() };
+  char buffer[ATTENDANCE_TIMESTAMP_SIZE];
+  formatIsoTimestamp(dt, buffer, sizeof(buffer));
   return String(buffer);
 }
 
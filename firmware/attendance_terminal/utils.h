@@ -30,6 +30,7 @@ bool isValidUrl(String url);
 bool isValidRfidTag(String tag);
 
 // Configuration management
+void setBackendEndpoints(const String* urls, uint8_t count);
 bool saveConfiguration();
 bool loadJsonConfiguration();
 bool clearOfflineLogs();
@@ -39,11 +40,34 @@ bool validateBackendConnection();
 bool testInternetConnection();
 
 // RFID utility functions (MFRC522v2 specific)
-void initializeRFID();
-void softResetRFID();
-byte getRFIDGain();
-void setRFIDGain(byte gain);
-bool isRFIDCardPresent();
+// Reader index into the sketch's reader table (0 = RFID_SS_PIN)
+void initializeRFID(uint8_t reader = 0);
+void softResetRFID(uint8_t reader = 0);
+
+// Liveness probe: version register plus the registers PCD_Init() programs
+enum RfidProbeResult {
+  RFID_PROBE_OK,
+  RFID_PROBE_NO_RESPONSE,   // Version register unreadable or changed (SPI/chip stalled)
+  RFID_PROBE_CONFIG_LOST    // Chip answers but came back with power-on defaults
+};
+RfidProbeResult probeRFIDReader(uint8_t reader = 0);
+byte getRFIDVersion(uint8_t reader = 0);
+
+// Low-power mode: soft power-down between polls
+void sleepRFIDReader(uint8_t reader);
+void wakeRFIDReader(uint8_t reader);
+bool isRFIDReaderAsleep(uint8_t reader);
+
+// Interrupt-driven detection (RFID_IRQ_PIN, single reader only):
+// armRFIDIrq() sends a REQA and returns; takeRFIDIrq() is true once a card
+// answered it (card left READY for PICC_ReadCardSerial())
+void enableRFIDIrq(int pin);
+bool isRFIDIrqEnabled();
+void armRFIDIrq();
+bool takeRFIDIrq();
+byte getRFIDGain(uint8_t reader = 0);
+void setRFIDGain(byte gain);     // All readers
+bool isRFIDCardPresent(uint8_t reader = 0);
 
 // System monitoring
 float getCpuTemperature();
@@ -120,6 +144,6 @@ size_t getFileSystemTotal();
 bool cleanupOldLogs();
 
 // Error handling
-void logError(String error);
-void logInfo(String info);
-void logDebug(String debug);
+void logError(const String& error);
+void logInfo(const String& info);
+void logDebug(const String& debug);
@@ -0,0 +1,337 @@
+/*
+ * Micro-benchmarks for the attendance terminal hot paths
+ * Attendee Attendance Terminal v2.0 - host build
+ *
+ * Times the storage and encoding routines the firmware runs per scan and
+ * per sync, on the same attendance core, and counts heap allocations per
+ * iteration ("allocs" counter) through a global operator new hook.
+ *
+ * Inputs are fixed, so runs are comparable across commits:
+ *   core_bench --benchmark_repetitions=5 --benchmark_out=bench.json --benchmark_out_format=json
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+#include <string>
+
+#include "attendance_core.h"
+#include "config.h"
+#include "hal_host.h"
+#include "history_store.h"
+#include "offline_segments.h"
+
+// ========================================
+// ALLOCATION COUNTING
+// ========================================
+
+static std::atomic<uint64_t> allocationCount(0);
+
+void* operator new(size_t size) {
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+// Reports heap allocations per iteration for the enclosing benchmark.
+// pause()/resume() bracket untimed setup alongside State::PauseTiming().
+class AllocationCounter {
+public:
+  explicit AllocationCounter(benchmark::State& state)
+    : _state(state), _counted(0), _start(allocationCount.load()) {}
+
+  ~AllocationCounter() {
+    _counted += allocationCount.load() - _start;
+    _state.counters["allocs"] = benchmark::Counter((double)_counted, benchmark::Counter::kAvgIterations);
+  }
+
+  void pause() {
+    _state.PauseTiming();
+    _counted += allocationCount.load() - _start;
+  }
+
+  void resume() {
+    _start = allocationCount.load();
+    _state.ResumeTiming();
+  }
+
+private:
+  benchmark::State& _state;
+  uint64_t _counted;
+  uint64_t _start;
+};
+
+// ========================================
+// FIXTURES
+// ========================================
+
+static const uint8_t sampleUid[ATTENDANCE_UID_MAX_BYTES] = {
+  0x04, 0xA1, 0xB2, 0xC3, 0x5D, 0x6E, 0x7F, 0x80, 0x91, 0x0A
+};
+
+static const char sampleRecord[] =
+  "{\"rfidTag\":\"04A1B2C3\",\"timestamp\":\"2025-08-16T09:30:00\","
+  "\"deviceId\":\"ESP_AABBCCDDEEFF\",\"firmware\":\"" FIRMWARE_VERSION "\",\"seq\":1234}";
+
+// 201 body from POST /api/attendance (backend/routes/attendanceRoutes.js)
+static const char sampleResponse[] =
+  "{\"message\":\"Entry time recorded successfully\",\"type\":\"entry\",\"sessionNumber\":1,"
+  "\"attendance\":{\"id\":\"66bf0c2e9a1d4f0012345678\",\"userId\":\"66bf0c2e9a1d4f0012345679\","
+  "\"userName\":\"Priya Sharma\",\"userRole\":\"member\",\"date\":\"2025-08-16T00:00:00.000Z\","
+  "\"sessions\":[{\"entryTime\":\"2025-08-16T09:30:00.000Z\",\"exitTime\":null,\"duration\":0,"
+  "\"_id\":\"66bf0c2e9a1d4f001234567a\"}],\"currentSession\":{\"entryTime\":\"2025-08-16T09:30:00.000Z\","
+  "\"exitTime\":null,\"duration\":0,\"_id\":\"66bf0c2e9a1d4f001234567a\"}}}";
+
+// Scratch directory standing in for the LittleFS root
+static std::string benchDirectory() {
+  static std::string dir;
+  if (dir.empty()) {
+    char pattern[] = "/tmp/core_bench.XXXXXX";
+    const char* created = mkdtemp(pattern);
+    dir = created ? created : "/tmp";
+  }
+  return dir;
+}
+
+static void writeBacklog(DirectoryStorage& storage, int records) {
+  storage.remove(OFFLINE_LOGS_FILE);
+  storage.remove(OFFLINE_LOGS_TEMP_FILE);
+  for (int i = 0; i < records; i++) {
+    storage.appendLine(OFFLINE_LOGS_FILE, sampleRecord, sizeof(sampleRecord) - 1);
+  }
+}
+
+// Accepts every record except each failEvery-th one (0 = accept all)
+class CountingUploader : public RecordUploader {
+public:
+  explicit CountingUploader(int failEvery) : _failEvery(failEvery), _calls(0) {}
+
+  bool upload(const char* record, size_t length) override {
+    benchmark::DoNotOptimize(record);
+    benchmark::DoNotOptimize(length);
+    _calls++;
+    return _failEvery == 0 || _calls % _failEvery != 0;
+  }
+
+private:
+  int _failEvery;
+  int _calls;
+};
+
+// ========================================
+// ENCODING
+// ========================================
+
+// handleRFIDScan(): UID bytes -> uppercase hex tag
+static void BM_FormatUidHex(benchmark::State& state) {
+  size_t uidLength = (size_t)state.range(0);
+  char out[ATTENDANCE_UID_HEX_SIZE];
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(formatUidHex(sampleUid, uidLength, out, sizeof(out)));
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_FormatUidHex)->Arg(4)->Arg(7)->Arg(10);
+
+// getCurrentTimestamp()
+static void BM_FormatIsoTimestamp(benchmark::State& state) {
+  TerminalDateTime dt = { 2025, 8, 16, 9, 30, 0 };
+  char out[ATTENDANCE_TIMESTAMP_SIZE];
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    dt.second = (dt.second + 1) % 60;
+    benchmark::DoNotOptimize(formatIsoTimestamp(dt, out, sizeof(out)));
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_FormatIsoTimestamp);
+
+// processOnlineAttendance() / processOfflineAttendance() payload
+static void BM_BuildAttendancePayload(benchmark::State& state) {
+  char payload[ATTENDANCE_PAYLOAD_SIZE];
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    size_t length = buildAttendancePayload("04A1B2C3", "2025-08-16T09:30:00", "ESP_AABBCCDDEEFF",
+                                           FIRMWARE_VERSION, 1234, NULL, payload, sizeof(payload));
+    benchmark::DoNotOptimize(length);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * (sizeof(sampleRecord) - 1));
+}
+BENCHMARK(BM_BuildAttendancePayload);
+
+// ========================================
+// RESPONSE PARSING
+// ========================================
+
+// handleSuccessfulAttendance()
+static void BM_ParseAttendanceResponse(benchmark::State& state) {
+  AttendanceResponse parsed;
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(parseAttendanceResponse(sampleResponse, sizeof(sampleResponse) - 1, parsed));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * (sizeof(sampleResponse) - 1));
+}
+BENCHMARK(BM_ParseAttendanceResponse);
+
+// ========================================
+// OFFLINE STORAGE
+// ========================================
+
+// processOfflineAttendance(): one record appended to the backlog; range(0)
+// is the group commit size (0 = a file write per record). "writes" is
+// storage writes per append.
+static void BM_OfflineAppend(benchmark::State& state) {
+  DirectoryStorage storage(benchDirectory());
+  OfflineQueue queue(storage, OFFLINE_LOGS_FILE, OFFLINE_LOGS_TEMP_FILE);
+  writeBacklog(storage, 0);
+  queue.setGroupCommit((uint16_t)state.range(0), OFFLINE_COMMIT_MAX_AGE_MS);
+  uint32_t writesBefore = storage.getWriteCount();
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    if (queue.count() >= MAX_OFFLINE_LOGS) {
+      allocations.pause();
+      writeBacklog(storage, 0);
+      queue.recoverCount();
+      allocations.resume();
+    }
+    benchmark::DoNotOptimize(queue.append(sampleRecord, sizeof(sampleRecord) - 1, 0));
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["writes"] = benchmark::Counter((double)(storage.getWriteCount() - writesBefore),
+                                                benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_OfflineAppend)->Arg(0)->Arg(OFFLINE_COMMIT_MAX_BYTES);
+
+// loadOfflineLogsCount(): recount the backlog after boot
+static void BM_RecoverCount(benchmark::State& state) {
+  DirectoryStorage storage(benchDirectory());
+  OfflineQueue queue(storage, OFFLINE_LOGS_FILE, OFFLINE_LOGS_TEMP_FILE);
+  int records = (int)state.range(0);
+  writeBacklog(storage, records);
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(queue.recoverCount());
+  }
+  state.SetItemsProcessed(state.iterations() * records);
+}
+BENCHMARK(BM_RecoverCount)->Arg(100)->Arg(MAX_OFFLINE_LOGS);
+
+// syncOfflineLogs(): stream the backlog through an uploader; range(1) makes
+// every Nth upload fail so those records are rewritten to the side file
+static void BM_DrainBacklog(benchmark::State& state) {
+  DirectoryStorage storage(benchDirectory());
+  OfflineQueue queue(storage, OFFLINE_LOGS_FILE, OFFLINE_LOGS_TEMP_FILE);
+  int records = (int)state.range(0);
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    allocations.pause();
+    writeBacklog(storage, records);
+    queue.recoverCount();
+    CountingUploader uploader((int)state.range(1));
+    allocations.resume();
+
+    benchmark::DoNotOptimize(queue.drain(uploader));
+  }
+  state.SetItemsProcessed(state.iterations() * records);
+}
+BENCHMARK(BM_DrainBacklog)
+  ->Args({100, 0})->Args({MAX_OFFLINE_LOGS, 0})->Args({MAX_OFFLINE_LOGS, 10})
+  ->Unit(benchmark::kMicrosecond);
+
+// sealOfflineLogs(): pack one segment's worth of backlog records, 40
+// distinct cards a few seconds apart. "bytesPerRecord" is the sealed size.
+static void BM_SealSegment(benchmark::State& state) {
+  static char records[OFFLINE_SEGMENT_SEAL_RECORDS][ATTENDANCE_PAYLOAD_SIZE];
+  size_t lengths[OFFLINE_SEGMENT_SEAL_RECORDS];
+  for (int i = 0; i < OFFLINE_SEGMENT_SEAL_RECORDS; i++) {
+    char tag[ATTENDANCE_UID_HEX_SIZE];
+    char timestamp[ATTENDANCE_TIMESTAMP_SIZE];
+    snprintf(tag, sizeof(tag), "04A1%04X", (i * 7) % 40);
+    snprintf(timestamp, sizeof(timestamp), "2025-08-16T09:%02d:%02d", (i * 9) / 60, (i * 9) % 60);
+    lengths[i] = buildAttendancePayload(tag, timestamp, "ESP_AABBCCDDEEFF", FIRMWARE_VERSION, 1234 + i,
+                                        i % 5 == 0 ? "exit" : NULL, records[i], sizeof(records[i]));
+  }
+  static SegmentEncoder encoder;
+  uint8_t segment[SEGMENT_MAX_BYTES];
+  size_t sealed = 0;
+  int packed = 0;
+
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    encoder.reset();
+    packed = 0;
+    while (packed < OFFLINE_SEGMENT_SEAL_RECORDS && encoder.add(records[packed], lengths[packed])) {
+      packed++;
+    }
+    sealed = encoder.finish(segment, sizeof(segment));
+    benchmark::DoNotOptimize(sealed);
+  }
+  state.SetItemsProcessed(state.iterations() * packed);
+  state.counters["bytesPerRecord"] = packed ? (double)sealed / packed : 0;
+}
+BENCHMARK(BM_SealSegment);
+
+// GET /api/history: one hour of one day out of HISTORY_RETENTION_DAYS days
+// of range(0) scans each. "blocksRead" is the indexed blocks scanned.
+static void BM_HistoryQuery(benchmark::State& state) {
+  DirectoryStorage storage(benchDirectory());
+  HistoryStore history(storage, HISTORY_PREFIX, HISTORY_FILE, HISTORY_TEMP_FILE,
+                       HISTORY_RETENTION_DAYS, HISTORY_DAY_RECORDS, 0);
+  const uint32_t firstDay = 9358;       // 2025-08-16
+  int scans = (int)state.range(0);
+  for (int day = 0; day < HISTORY_RETENTION_DAYS; day++) {
+    for (int i = 0; i < scans; i++) {
+      char tag[ATTENDANCE_UID_HEX_SIZE];
+      snprintf(tag, sizeof(tag), "04A1%04X", (i * 7) % 300);
+      history.add(tag, (firstDay + day) * 86400 + 8 * 3600 + i * 36000 / scans, i % 3, 0);
+    }
+  }
+  history.flush();
+  history.begin();
+
+  uint32_t from = (firstDay + 3) * 86400 + 12 * 3600;
+  HistoryQueryStats stats = { 0, 0, 0, 0 };
+  AllocationCounter allocations(state);
+  for (auto _ : state) {
+    stats = history.query(from, from + 3599, [](const HistoryEntry& entry, void*) {
+      benchmark::DoNotOptimize(entry.time);
+      return true;
+    }, NULL);
+  }
+  state.SetItemsProcessed(state.iterations() * stats.matched);
+  state.counters["blocksRead"] = stats.blocksRead;
+
+  for (int day = 0; day < HISTORY_RETENTION_DAYS; day++) {
+    char path[HISTORY_PATH_MAX];
+    snprintf(path, sizeof(path), "%s%05u.txt", HISTORY_PREFIX, (unsigned)(firstDay + day));
+    storage.remove(path);
+    snprintf(path, sizeof(path), "%s%05u.idx", HISTORY_PREFIX, (unsigned)(firstDay + day));
+    storage.remove(path);
+  }
+  storage.remove(HISTORY_FILE);
+}
+BENCHMARK(BM_HistoryQuery)->Arg(500)->Arg(HISTORY_DAY_RECORDS)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
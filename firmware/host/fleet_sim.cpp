@@ -0,0 +1,238 @@
+/*
+ * Fleet simulator for Attendee Attendance Terminal v2.0
+ *
+ * Runs N virtual terminals (one thread each) against a real backend using
+ * the firmware's own attendance core. Taps come from a script or from a
+ * synthetic Poisson load; connectivity drops can be scripted to exercise
+ * the offline backlog and the sync that follows reconnection.
+ *
+ * Usage:
+ *   fleet_sim --backend http://127.0.0.1:5000/api|coap://127.0.0.1:5683/api|mqtt://127.0.0.1:1883/api
+ *             [--terminals 20]
+ *             [--duration 60] [--script taps.txt | --rate 30 --cards 500]
+ *             [--sync-interval 5000] [--heartbeat-interval 60000]
+ *             [--loop-ms 100] [--window 4] [--commit-bytes 768]
+ *             [--workdir /tmp/fleet] [--seed 1]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "hal_host.h"
+#include "virtual_terminal.h"
+
+struct FleetOptions {
+  std::string backendUrl;
+  std::string scriptPath;
+  std::string workdir;
+  int terminals;
+  uint32_t durationMs;
+  double ratePerMinute;
+  int cardPool;
+  uint32_t syncIntervalMs;
+  uint32_t heartbeatIntervalMs;
+  uint32_t loopMs;
+  int window;
+  int commitBytes;
+  uint32_t seed;
+};
+
+static void printUsage() {
+  fprintf(stderr,
+          "usage: fleet_sim --backend URL [--terminals N] [--duration SEC]\n"
+          "                 [--script FILE | --rate TAPS_PER_MIN --cards N]\n"
+          "                 [--sync-interval MS] [--heartbeat-interval MS]\n"
+          "                 [--loop-ms MS] [--window 0-%d] [--commit-bytes 0-%d]\n"
+          "                 [--workdir DIR] [--seed N]\n",
+          UPLOAD_WINDOW_MAX, OFFLINE_COMMIT_BUFFER_SIZE);
+}
+
+static bool parseOptions(int argc, char** argv, FleetOptions& options) {
+  options.terminals = 10;
+  options.durationMs = 60000;
+  options.ratePerMinute = 20;
+  options.cardPool = 500;
+  options.syncIntervalMs = SYNC_RETRY_INTERVAL;
+  options.heartbeatIntervalMs = HEARTBEAT_INTERVAL;
+  options.loopMs = 100;             // delay(100) at the end of loop()
+  options.window = UPLOAD_WINDOW;
+  options.commitBytes = OFFLINE_COMMIT_MAX_BYTES;
+  options.workdir = "fleet_state";
+  options.seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (!value) {
+      return false;
+    }
+    if (strcmp(arg, "--backend") == 0) options.backendUrl = value;
+    else if (strcmp(arg, "--script") == 0) options.scriptPath = value;
+    else if (strcmp(arg, "--workdir") == 0) options.workdir = value;
+    else if (strcmp(arg, "--terminals") == 0) options.terminals = atoi(value);
+    else if (strcmp(arg, "--duration") == 0) options.durationMs = (uint32_t)(atof(value) * 1000);
+    else if (strcmp(arg, "--rate") == 0) options.ratePerMinute = atof(value);
+    else if (strcmp(arg, "--cards") == 0) options.cardPool = atoi(value);
+    else if (strcmp(arg, "--sync-interval") == 0) options.syncIntervalMs = strtoul(value, NULL, 10);
+    else if (strcmp(arg, "--heartbeat-interval") == 0) options.heartbeatIntervalMs = strtoul(value, NULL, 10);
+    else if (strcmp(arg, "--loop-ms") == 0) options.loopMs = strtoul(value, NULL, 10);
+    else if (strcmp(arg, "--window") == 0) options.window = atoi(value);
+    else if (strcmp(arg, "--commit-bytes") == 0) options.commitBytes = atoi(value);
+    else if (strcmp(arg, "--seed") == 0) options.seed = strtoul(value, NULL, 10);
+    else return false;
+    i++;
+  }
+  return !options.backendUrl.empty() && options.terminals > 0 &&
+         options.window >= 0 && options.window <= UPLOAD_WINDOW_MAX &&
+         options.commitBytes >= 0 && options.commitBytes <= OFFLINE_COMMIT_BUFFER_SIZE;
+}
+
+static uint32_t percentile(std::vector<uint32_t>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+struct TerminalSlot {
+  std::unique_ptr<DirectoryStorage> storage;
+  std::unique_ptr<TerminalTransport> transport;
+  std::unique_ptr<ScriptedCardReader> reader;
+  std::unique_ptr<VirtualTerminal> terminal;
+};
+
+int main(int argc, char** argv) {
+  FleetOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage();
+    return 2;
+  }
+
+  HostClock clock;
+  if (!std::unique_ptr<TerminalTransport>(createBackendTransport(options.backendUrl, "FLEET_CHECK", clock, HTTP_TIMEOUT))) {
+    fprintf(stderr, "fleet_sim: only http://, coap:// and mqtt:// backends are supported on the host\n");
+    return 2;
+  }
+
+  std::vector<std::vector<TapEvent> > taps(options.terminals);
+  if (!options.scriptPath.empty()) {
+    std::string error;
+    if (!loadTapScript(options.scriptPath.c_str(), options.terminals, taps, error)) {
+      fprintf(stderr, "fleet_sim: %s\n", error.c_str());
+      return 2;
+    }
+  } else {
+    for (int i = 0; i < options.terminals; i++) {
+      generateTapLoad(options.seed + i, options.durationMs, options.ratePerMinute, options.cardPool, taps[i]);
+    }
+  }
+
+  mkdir(options.workdir.c_str(), 0755);
+  std::vector<TerminalSlot> slots(options.terminals);
+  for (int i = 0; i < options.terminals; i++) {
+    char name[32];
+    snprintf(name, sizeof(name), "SIM_%03d", i);
+
+    VirtualTerminalConfig config;
+    config.deviceId = name;
+    config.backendUrl = options.backendUrl;
+    config.syncIntervalMs = options.syncIntervalMs;
+    config.heartbeatIntervalMs = options.heartbeatIntervalMs;
+    config.uploadWindow = (uint8_t)options.window;
+    config.commitBytes = (uint16_t)options.commitBytes;
+    config.seed = options.seed * 7919 + i;
+
+    TerminalSlot& slot = slots[i];
+    slot.storage.reset(new DirectoryStorage(options.workdir + "/" + name));
+    slot.transport.reset(createBackendTransport(options.backendUrl, name, clock, HTTP_TIMEOUT));
+    slot.reader.reset(new ScriptedCardReader(clock, taps[i]));
+    slot.terminal.reset(new VirtualTerminal(config, *slot.storage, *slot.transport, *slot.reader, clock));
+    slot.terminal->begin();
+  }
+
+  printf("fleet_sim: %d terminals -> %s for %.1fs\n",
+         options.terminals, options.backendUrl.c_str(), options.durationMs / 1000.0);
+
+  std::atomic<bool> running(true);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < options.terminals; i++) {
+    VirtualTerminal* terminal = slots[i].terminal.get();
+    uint32_t loopMs = options.loopMs;
+    threads.push_back(std::thread([terminal, loopMs, &running]() {
+      while (running.load()) {
+        terminal->loop();
+        std::this_thread::sleep_for(std::chrono::milliseconds(loopMs));
+      }
+    }));
+  }
+
+  while (clock.millis() < options.durationMs) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  running = false;
+  for (size_t i = 0; i < threads.size(); i++) {
+    threads[i].join();
+  }
+
+  // ===== REPORT =====
+  VirtualTerminalStats total = VirtualTerminalStats();
+  int backlog = 0;
+  uint32_t sequenceWrites = 0;
+  uint32_t offlineWrites = 0;
+  for (int i = 0; i < options.terminals; i++) {
+    const VirtualTerminalStats& s = slots[i].terminal->getStats();
+    total.scans += s.scans;
+    total.debounced += s.debounced;
+    total.onlineAccepted += s.onlineAccepted;
+    total.rejected += s.rejected;
+    total.storedOffline += s.storedOffline;
+    total.droppedFull += s.droppedFull;
+    total.backendRequests += s.backendRequests;
+    total.backendErrors += s.backendErrors;
+    total.syncPasses += s.syncPasses;
+    total.syncThrottled += s.syncThrottled;
+    total.syncUploaded += s.syncUploaded;
+    total.syncMs += s.syncMs;
+    total.heartbeats += s.heartbeats;
+    total.commands += s.commands;
+    total.scanLatencyUs.insert(total.scanLatencyUs.end(), s.scanLatencyUs.begin(), s.scanLatencyUs.end());
+    total.appendLatencyUs.insert(total.appendLatencyUs.end(), s.appendLatencyUs.begin(), s.appendLatencyUs.end());
+    backlog += slots[i].terminal->getOfflineLogsCount();
+    sequenceWrites += slots[i].terminal->getSequenceWrites();
+    offlineWrites += slots[i].terminal->getOfflineWrites();
+  }
+  std::sort(total.scanLatencyUs.begin(), total.scanLatencyUs.end());
+  std::sort(total.appendLatencyUs.begin(), total.appendLatencyUs.end());
+
+  printf("scans:            %u (debounced %u)\n", total.scans, total.debounced);
+  printf("online accepted:  %u, rejected (400): %u\n", total.onlineAccepted, total.rejected);
+  printf("stored offline:   %u, dropped (queue full): %u\n", total.storedOffline, total.droppedFull);
+  printf("scan latency:     p50 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+         percentile(total.scanLatencyUs, 0.50) / 1000.0,
+         percentile(total.scanLatencyUs, 0.99) / 1000.0,
+         (total.scanLatencyUs.empty() ? 0 : total.scanLatencyUs.back()) / 1000.0);
+  printf("backend requests: %u, errors: %u (%.2f%%)\n", total.backendRequests, total.backendErrors,
+         total.backendRequests ? 100.0 * total.backendErrors / total.backendRequests : 0.0);
+  printf("backlog sync:     %u records in %u passes (%u throttled), %.1f records/s, %d still queued\n",
+         total.syncUploaded, total.syncPasses, total.syncThrottled,
+         total.syncMs ? total.syncUploaded * 1000.0 / total.syncMs : 0.0, backlog);
+  printf("heartbeats:       %u (backend commands %u)\n", total.heartbeats, total.commands);
+  printf("sequence writes:  %u (%.1f scans per flash write)\n", sequenceWrites,
+         sequenceWrites ? (double)total.scans / sequenceWrites : 0.0);
+  printf("offline appends:  %u flash writes (%.2f per stored scan), p99 %u us, max %u us\n",
+         offlineWrites, total.storedOffline ? (double)offlineWrites / total.storedOffline : 0.0,
+         percentile(total.appendLatencyUs, 0.99),
+         total.appendLatencyUs.empty() ? 0 : total.appendLatencyUs.back());
+  return 0;
+}
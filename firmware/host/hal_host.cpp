@@ -0,0 +1,655 @@
+/*
+ * Linux implementations of the terminal HAL
+ * Attendee Attendance Terminal v2.0 - host build
+ */
+
+#include "hal_host.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+#include "attendance_core.h"
+#include "config.h"
+#include "sync_pacing.h"
+
+// ========================================
+// DIRECTORY STORAGE
+// ========================================
+
+DirectoryStorage::DirectoryStorage(const std::string& root)
+  : _root(root), _writeCount(0) {
+  mkdir(_root.c_str(), 0755);
+}
+
+const char* DirectoryStorage::resolve(const char* path, char* out, size_t outSize) const {
+  snprintf(out, outSize, "%s%s%s", _root.c_str(), path[0] == '/' ? "" : "/", path);
+  return out;
+}
+
+bool DirectoryStorage::appendLine(const char* path, const char* line, size_t len) {
+  char fullPath[PATH_MAX];
+  FILE* file = fopen(resolve(path, fullPath, sizeof(fullPath)), "ab");
+  if (!file) {
+    return false;
+  }
+  size_t written = fwrite(line, 1, len, file);
+  written += fwrite("\n", 1, 1, file);
+  bool ok = fclose(file) == 0 && written == len + 1;
+  _writeCount++;
+  return ok;
+}
+
+bool DirectoryStorage::forEachLine(const char* path, LineVisitor visitor, void* context) {
+  char fullPath[PATH_MAX];
+  FILE* file = fopen(resolve(path, fullPath, sizeof(fullPath)), "rb");
+  if (!file) {
+    return false;
+  }
+
+  char line[ATTENDANCE_RECORD_LINE_MAX];
+  while (fgets(line, sizeof(line), file)) {
+    size_t len = strlen(line);
+    if (len == sizeof(line) - 1 && line[len - 1] != '\n') {
+      int c = fgetc(file);
+      if (c != EOF && c != '\n') {
+        // Longer than any record we write: skip the whole line, as the firmware does
+        while ((c = fgetc(file)) != EOF && c != '\n') {}
+        continue;
+      }
+    }
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' || line[len - 1] == ' ')) {
+      len--;
+    }
+    line[len] = 0;
+    if (len == 0) {
+      continue;
+    }
+    if (!visitor(line, len, context)) {
+      break;
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+bool DirectoryStorage::rename(const char* from, const char* to) {
+  _writeCount++;
+  char fromPath[PATH_MAX], toPath[PATH_MAX];
+  return ::rename(resolve(from, fromPath, sizeof(fromPath)), resolve(to, toPath, sizeof(toPath))) == 0;
+}
+
+bool DirectoryStorage::remove(const char* path) {
+  _writeCount++;
+  char fullPath[PATH_MAX];
+  return ::remove(resolve(path, fullPath, sizeof(fullPath))) == 0;
+}
+
+bool DirectoryStorage::exists(const char* path) {
+  struct stat st;
+  char fullPath[PATH_MAX];
+  return stat(resolve(path, fullPath, sizeof(fullPath)), &st) == 0;
+}
+
+int DirectoryStorage::readAt(const char* path, uint32_t offset, char* buffer, size_t len) {
+  char fullPath[PATH_MAX];
+  FILE* file = fopen(resolve(path, fullPath, sizeof(fullPath)), "rb");
+  if (!file) {
+    return -1;
+  }
+  int count = -1;
+  if (fseek(file, (long)offset, SEEK_SET) == 0) {
+    count = (int)fread(buffer, 1, len, file);
+  }
+  fclose(file);
+  return count;
+}
+
+// ========================================
+// SOCKET TRANSPORT
+// ========================================
+
+bool parseHttpUrl(const char* url, HttpUrl& out) {
+  if (strncmp(url, "http://", 7) != 0) {
+    return false;
+  }
+  const char* hostStart = url + 7;
+  const char* pathStart = strchr(hostStart, '/');
+  std::string authority = pathStart ? std::string(hostStart, pathStart - hostStart) : hostStart;
+  out.path = pathStart ? pathStart : "/";
+
+  size_t colon = authority.rfind(':');
+  if (colon != std::string::npos) {
+    out.host = authority.substr(0, colon);
+    out.port = authority.substr(colon + 1);
+  } else {
+    out.host = authority;
+    out.port = "80";
+  }
+  return !out.host.empty();
+}
+
+SocketTransport::SocketTransport() : _timeoutMs(10000), _retryAfterMs(0) {
+}
+
+static int connectTo(const HttpUrl& url, uint32_t timeoutMs) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  struct addrinfo* results = NULL;
+  if (getaddrinfo(url.host.c_str(), url.port.c_str(), &hints, &results) != 0) {
+    return -1;
+  }
+
+  int fd = -1;
+  for (struct addrinfo* ai = results; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    struct timeval tv;
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(results);
+  return fd;
+}
+
+static bool sendAll(int fd, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+// Decodes a chunked body in place; returns the decoded length or -1
+static long decodeChunked(std::string& body) {
+  std::string decoded;
+  size_t pos = 0;
+  for (;;) {
+    size_t lineEnd = body.find("\r\n", pos);
+    if (lineEnd == std::string::npos) {
+      return -1;
+    }
+    unsigned long size = strtoul(body.c_str() + pos, NULL, 16);
+    pos = lineEnd + 2;
+    if (size == 0) {
+      break;
+    }
+    if (pos + size > body.size()) {
+      return -1;
+    }
+    decoded.append(body, pos, size);
+    pos += size + 2;
+  }
+  body.swap(decoded);
+  return (long)body.size();
+}
+
+int SocketTransport::postJson(const char* url, const char* body, size_t len,
+                              char* response, size_t responseSize) {
+  if (responseSize > 0) {
+    response[0] = 0;
+  }
+  _retryAfterMs = 0;
+
+  HttpUrl target;
+  if (!parseHttpUrl(url, target)) {
+    return -1;
+  }
+
+  int fd = connectTo(target, _timeoutMs);
+  if (fd < 0) {
+    return -1;
+  }
+
+  char header[512];
+  int headerLength = snprintf(header, sizeof(header),
+                              "POST %s HTTP/1.1\r\n"
+                              "Host: %s\r\n"
+                              "User-Agent: ESP8266HTTPClient\r\n"
+                              "Connection: close\r\n"
+                              "Content-Type: application/json\r\n"
+                              "Content-Length: %zu\r\n\r\n",
+                              target.path.c_str(), target.host.c_str(), len);
+  if (headerLength <= 0 || headerLength >= (int)sizeof(header) ||
+      !sendAll(fd, header, headerLength) || !sendAll(fd, body, len)) {
+    close(fd);
+    return -2;
+  }
+
+  std::string raw;
+  char buffer[2048];
+  bool timedOut = false;
+  for (;;) {
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n > 0) {
+      raw.append(buffer, n);
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      timedOut = true;
+    }
+    break;
+  }
+  close(fd);
+
+  size_t headerEnd = raw.find("\r\n\r\n");
+  if (headerEnd == std::string::npos) {
+    return timedOut || raw.empty() ? -11 : -3;
+  }
+
+  int status = 0;
+  if (sscanf(raw.c_str(), "HTTP/%*d.%*d %d", &status) != 1) {
+    return -3;
+  }
+
+  std::string headers = raw.substr(0, headerEnd);
+  std::string payload = raw.substr(headerEnd + 4);
+  std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+  size_t retryPos = headers.find("\r\nretry-after:");
+  if (retryPos != std::string::npos) {
+    size_t valueStart = retryPos + 14;
+    size_t valueEnd = headers.find("\r\n", valueStart);
+    _retryAfterMs = parseRetryAfterMs(headers.substr(valueStart, valueEnd - valueStart).c_str());
+  }
+  if (headers.find("transfer-encoding: chunked") != std::string::npos) {
+    if (decodeChunked(payload) < 0) {
+      return -3;
+    }
+  } else {
+    size_t lengthPos = headers.find("content-length:");
+    if (lengthPos != std::string::npos) {
+      size_t declared = strtoul(headers.c_str() + lengthPos + 15, NULL, 10);
+      if (payload.size() < declared) {
+        return -11;
+      }
+      payload.resize(declared);
+    }
+  }
+
+  if (responseSize > 0) {
+    size_t copy = std::min(payload.size(), responseSize - 1);
+    memcpy(response, payload.data(), copy);
+    response[copy] = 0;
+  }
+  return status;
+}
+
+SocketConnection::SocketConnection() : _fd(-1), _timeoutMs(10000) {
+}
+
+SocketConnection::~SocketConnection() {
+  close();
+}
+
+bool SocketConnection::open(const char* host, uint16_t port, bool secure) {
+  close();
+  if (secure) {
+    return false;
+  }
+  HttpUrl target;
+  target.host = host;
+  target.port = std::to_string(port);
+  _fd = connectTo(target, _timeoutMs);
+  if (_fd < 0) {
+    return false;
+  }
+  fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL, 0) | O_NONBLOCK);
+  int noDelay = 1;                    // As setNoDelay(true) on the terminal
+  setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  return true;
+}
+
+int SocketConnection::write(const char* data, size_t len) {
+  if (_fd < 0) {
+    return -1;
+  }
+  ssize_t n = send(_fd, data, len, MSG_NOSIGNAL);
+  if (n < 0) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+  }
+  return (int)n;
+}
+
+int SocketConnection::read(char* buffer, size_t size) {
+  if (_fd < 0) {
+    return -1;
+  }
+  ssize_t n = recv(_fd, buffer, size, 0);
+  if (n < 0) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+  }
+  return n == 0 ? -1 : (int)n;
+}
+
+void SocketConnection::close() {
+  if (_fd >= 0) {
+    ::close(_fd);
+    _fd = -1;
+  }
+}
+
+// ========================================
+// UDP
+// ========================================
+
+UdpDatagram::UdpDatagram() : _fd(-1) {
+}
+
+UdpDatagram::~UdpDatagram() {
+  if (_fd >= 0) {
+    ::close(_fd);
+  }
+}
+
+bool UdpDatagram::open(const char* host, uint16_t port) {
+  if (_fd >= 0) {
+    ::close(_fd);
+    _fd = -1;
+  }
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  struct addrinfo* result = NULL;
+  std::string service = std::to_string(port);
+  if (getaddrinfo(host, service.c_str(), &hints, &result) != 0) {
+    return false;
+  }
+  for (struct addrinfo* ai = result; ai; ai = ai->ai_next) {
+    int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    // Connected, so the kernel filters out datagrams from other peers
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+      _fd = fd;
+      break;
+    }
+    ::close(fd);
+  }
+  freeaddrinfo(result);
+  return _fd >= 0;
+}
+
+bool UdpDatagram::send(const uint8_t* data, size_t len) {
+  return _fd >= 0 && ::send(_fd, data, len, MSG_NOSIGNAL) == (ssize_t)len;
+}
+
+int UdpDatagram::receive(uint8_t* buffer, size_t size, uint32_t timeoutMs) {
+  if (_fd < 0) {
+    return -1;
+  }
+  struct pollfd pfd;
+  pfd.fd = _fd;
+  pfd.events = POLLIN;
+  int ready = poll(&pfd, 1, (int)timeoutMs);
+  if (ready < 0) {
+    return errno == EINTR ? 0 : -1;
+  }
+  if (ready == 0) {
+    return 0;
+  }
+  ssize_t n = recv(_fd, buffer, size, 0);
+  if (n < 0) {
+    return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+  }
+  return (int)n;
+}
+
+UdpCoapTransport::UdpCoapTransport(TerminalClock& clock, uint32_t timeoutMs)
+  : _coap(_socket, clock, COAP_PSK) {
+  _coap.setRetransmission(COAP_ACK_TIMEOUT_MS, COAP_MAX_RETRANSMIT, timeoutMs);
+  _coap.setSeed(std::random_device()());
+}
+
+int UdpCoapTransport::postJson(const char* url, const char* body, size_t len,
+                               char* response, size_t responseSize) {
+  return _coap.postJson(url, body, len, response, responseSize);
+}
+
+void SleepingMqttClient::idle() {
+  usleep(1000);
+}
+
+SocketMqttTransport::SocketMqttTransport(const std::string& backendUrl, const std::string& clientId,
+                                         TerminalClock& clock, uint32_t timeoutMs)
+  : _client(_connection, clock), _mqtt(_client, clock, MQTT_USERNAME, MQTT_PASSWORD) {
+  _connection.setTimeout(timeoutMs);
+  _client.setTimeout(timeoutMs);
+  _mqtt.setKeepAlive(MQTT_KEEPALIVE_S);
+  _mqtt.setReplyTimeout(MQTT_REPLY_TIMEOUT_MS);
+  _mqtt.setReconnectBackoff(MQTT_RECONNECT_MIN_MS, MQTT_RECONNECT_MAX_MS);
+  _mqtt.setBroker(backendUrl.c_str(), clientId.c_str());
+}
+
+int SocketMqttTransport::postJson(const char* url, const char* body, size_t len,
+                                  char* response, size_t responseSize) {
+  return _mqtt.postJson(url, body, len, response, responseSize);
+}
+
+bool SocketMqttTransport::pollCommand(char* command, size_t commandSize) {
+  return _mqtt.pollCommand(command, commandSize);
+}
+
+TerminalTransport* createBackendTransport(const std::string& backendUrl, const std::string& deviceId,
+                                          TerminalClock& clock, uint32_t timeoutMs) {
+  if (isCoapUrl(backendUrl.c_str())) {
+    return new UdpCoapTransport(clock, timeoutMs);
+  }
+  if (isMqttUrl(backendUrl.c_str())) {
+    // mqtts:// would need TLS, which SocketConnection does not do
+    if (strncmp(backendUrl.c_str(), "mqtt://", 7) != 0 || deviceId.empty()) {
+      return NULL;
+    }
+    return new SocketMqttTransport(backendUrl, deviceId, clock, timeoutMs);
+  }
+  HttpUrl check;
+  if (!parseHttpUrl((backendUrl + "/").c_str(), check)) {
+    return NULL;
+  }
+  SocketTransport* transport = new SocketTransport();
+  transport->setTimeout(timeoutMs);
+  return transport;
+}
+
+// ========================================
+// CLOCK
+// ========================================
+
+static int64_t monotonicMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+HostClock::HostClock() : _startMicros(monotonicMicros()) {
+}
+
+uint32_t HostClock::millis() {
+  return (uint32_t)((monotonicMicros() - _startMicros) / 1000);
+}
+
+void HostClock::now(TerminalDateTime& out) {
+  time_t t = time(NULL);
+  struct tm local;
+  localtime_r(&t, &local);
+  out.year = local.tm_year + 1900;
+  out.month = local.tm_mon + 1;
+  out.day = local.tm_mday;
+  out.hour = local.tm_hour;
+  out.minute = local.tm_min;
+  out.second = local.tm_sec;
+}
+
+// ========================================
+// SCRIPTED CARD READER
+// ========================================
+
+static bool parseUidHex(const char* hex, TapEvent& event) {
+  size_t len = strlen(hex);
+  if (len == 0 || len % 2 != 0 || len / 2 > sizeof(event.uid)) {
+    return false;
+  }
+  for (size_t i = 0; i < len / 2; i++) {
+    char byteText[3] = { hex[i * 2], hex[i * 2 + 1], 0 };
+    char* end;
+    event.uid[i] = (uint8_t)strtoul(byteText, &end, 16);
+    if (*end) {
+      return false;
+    }
+  }
+  event.uidLength = (uint8_t)(len / 2);
+  return true;
+}
+
+static bool tapBefore(const TapEvent& a, const TapEvent& b) {
+  return a.atMs < b.atMs;
+}
+
+bool loadTapScript(const char* path, int terminalCount,
+                   std::vector<std::vector<TapEvent> >& perTerminal, std::string& error) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    error = std::string("cannot open ") + path;
+    return false;
+  }
+  perTerminal.resize(terminalCount);
+
+  char line[256];
+  int lineNumber = 0;
+  while (fgets(line, sizeof(line), file)) {
+    lineNumber++;
+    char* hash = strchr(line, '#');
+    if (hash) *hash = 0;
+
+    unsigned long atMs;
+    char target[32], what[32];
+    int fields = sscanf(line, "%lu %31s %31s", &atMs, target, what);
+    if (fields <= 0) {
+      continue;
+    }
+    if (fields != 3) {
+      error = "line " + std::to_string(lineNumber) + ": expected <ms> <terminal|*> <uid|OFFLINE|ONLINE>";
+      fclose(file);
+      return false;
+    }
+
+    TapEvent event;
+    memset(&event, 0, sizeof(event));
+    event.atMs = (uint32_t)atMs;
+    if (strcmp(what, "OFFLINE") == 0) {
+      event.action = TAP_LINK_DOWN;
+    } else if (strcmp(what, "ONLINE") == 0) {
+      event.action = TAP_LINK_UP;
+    } else if (parseUidHex(what, event)) {
+      event.action = TAP_CARD;
+    } else {
+      error = "line " + std::to_string(lineNumber) + ": bad uid '" + what + "'";
+      fclose(file);
+      return false;
+    }
+
+    if (strcmp(target, "*") == 0) {
+      for (int i = 0; i < terminalCount; i++) {
+        perTerminal[i].push_back(event);
+      }
+    } else {
+      int index = atoi(target);
+      if (index >= 0 && index < terminalCount) {
+        perTerminal[index].push_back(event);
+      }
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+void generateTapLoad(uint32_t seed, uint32_t durationMs, double ratePerMinute, int cardPool,
+                     std::vector<TapEvent>& out) {
+  if (ratePerMinute <= 0 || cardPool <= 0) {
+    return;
+  }
+  std::mt19937 rng(seed);
+  std::exponential_distribution<double> gap(ratePerMinute / 60000.0);
+  std::uniform_int_distribution<int> card(0, cardPool - 1);
+
+  double at = gap(rng);
+  while (at < durationMs) {
+    TapEvent event;
+    memset(&event, 0, sizeof(event));
+    event.atMs = (uint32_t)at;
+    event.action = TAP_CARD;
+    uint32_t id = 0x04000000u | (uint32_t)card(rng);
+    event.uid[0] = (uint8_t)(id >> 24);
+    event.uid[1] = (uint8_t)(id >> 16);
+    event.uid[2] = (uint8_t)(id >> 8);
+    event.uid[3] = (uint8_t)id;
+    event.uidLength = 4;
+    out.push_back(event);
+    at += gap(rng);
+  }
+}
+
+ScriptedCardReader::ScriptedCardReader(TerminalClock& clock, const std::vector<TapEvent>& events)
+  : _clock(clock), _nextTap(0), _nextLink(0), _lastDueMs(0) {
+  for (size_t i = 0; i < events.size(); i++) {
+    (events[i].action == TAP_CARD ? _taps : _links).push_back(events[i]);
+  }
+  std::stable_sort(_taps.begin(), _taps.end(), tapBefore);
+  std::stable_sort(_links.begin(), _links.end(), tapBefore);
+}
+
+bool ScriptedCardReader::pollCard(uint8_t* uid, uint8_t* uidLength, uint8_t maxLength) {
+  if (_nextTap >= _taps.size() || _taps[_nextTap].atMs > _clock.millis()) {
+    return false;
+  }
+  const TapEvent& event = _taps[_nextTap++];
+  uint8_t length = std::min(event.uidLength, maxLength);
+  memcpy(uid, event.uid, length);
+  *uidLength = length;
+  _lastDueMs = event.atMs;
+  return true;
+}
+
+bool ScriptedCardReader::pollLinkChange(bool& online) {
+  if (_nextLink >= _links.size() || _links[_nextLink].atMs > _clock.millis()) {
+    return false;
+  }
+  online = _links[_nextLink++].action == TAP_LINK_UP;
+  return true;
+}
+
+bool ScriptedCardReader::finished() const {
+  return _nextTap >= _taps.size() && _nextLink >= _links.size();
+}
@@ -0,0 +1,221 @@
+/*
+ * Linux implementations of the terminal HAL
+ * Attendee Attendance Terminal v2.0 - host build
+ *
+ * Storage on a plain directory, HTTP/1.1 over POSIX sockets (plain http
+ * only, blocking or non-blocking), a steady/system clock and a card reader
+ * fed from a tap script.
+ */
+
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "coap_transport.h"
+#include "mqtt_transport.h"
+#include "terminal_hal.h"
+
+// ========================================
+// DIRECTORY STORAGE
+// ========================================
+
+// Maps firmware paths ("/offline_logs.txt") under a per-terminal root directory
+class DirectoryStorage : public TerminalStorage {
+public:
+  explicit DirectoryStorage(const std::string& root);
+
+  bool appendLine(const char* path, const char* line, size_t len) override;
+  bool forEachLine(const char* path, LineVisitor visitor, void* context) override;
+  bool rename(const char* from, const char* to) override;
+  bool remove(const char* path) override;
+  bool exists(const char* path) override;
+  int readAt(const char* path, uint32_t offset, char* buffer, size_t len) override;
+
+  uint32_t getWriteCount() const { return _writeCount; }
+
+private:
+  // Into a fixed buffer so the storage itself never touches the heap
+  const char* resolve(const char* path, char* out, size_t outSize) const;
+
+  std::string _root;
+  uint32_t _writeCount;
+};
+
+// ========================================
+// SOCKET TRANSPORT
+// ========================================
+
+struct HttpUrl {
+  std::string host;
+  std::string port;
+  std::string path;
+};
+
+// "http://host[:port]/path"; https is rejected
+bool parseHttpUrl(const char* url, HttpUrl& out);
+
+// One connection per request (Connection: close), as HTTPClient does by default
+class SocketTransport : public TerminalTransport {
+public:
+  SocketTransport();
+
+  void setTimeout(uint32_t timeoutMs) { _timeoutMs = timeoutMs; }
+
+  // -1 connect failure, -2 send failure, -11 read timeout, -3 malformed response
+  int postJson(const char* url, const char* body, size_t len,
+               char* response, size_t responseSize) override;
+  uint32_t getLastRetryAfterMs() const override { return _retryAfterMs; }
+
+private:
+  uint32_t _timeoutMs;
+  uint32_t _retryAfterMs;
+};
+
+// Non-blocking socket for pipelined uploads; connect itself blocks up to
+// the timeout, as WiFiClient::connect() does. Plain http only.
+class SocketConnection : public TerminalConnection {
+public:
+  SocketConnection();
+  ~SocketConnection();
+
+  void setTimeout(uint32_t timeoutMs) { _timeoutMs = timeoutMs; }
+
+  bool open(const char* host, uint16_t port, bool secure) override;
+  bool isOpen() override { return _fd >= 0; }
+  int write(const char* data, size_t len) override;
+  int read(char* buffer, size_t size) override;
+  void close() override;
+
+private:
+  int _fd;
+  uint32_t _timeoutMs;
+};
+
+// Connected UDP socket for the CoAP transport
+class UdpDatagram : public TerminalDatagram {
+public:
+  UdpDatagram();
+  ~UdpDatagram();
+
+  bool open(const char* host, uint16_t port) override;
+  bool send(const uint8_t* data, size_t len) override;
+  int receive(uint8_t* buffer, size_t size, uint32_t timeoutMs) override;
+
+private:
+  int _fd;
+};
+
+// CoapTransport bundled with its own socket, one per simulated terminal
+class UdpCoapTransport : public TerminalTransport {
+public:
+  UdpCoapTransport(TerminalClock& clock, uint32_t timeoutMs);
+
+  int postJson(const char* url, const char* body, size_t len,
+               char* response, size_t responseSize) override;
+  uint32_t getLastRetryAfterMs() const override { return _coap.getLastRetryAfterMs(); }
+  uint32_t getRetransmitCount() const { return _coap.getRetransmitCount(); }
+
+private:
+  UdpDatagram _socket;
+  CoapTransport _coap;
+};
+
+// MqttClient whose waits sleep instead of spinning
+class SleepingMqttClient : public MqttClient {
+public:
+  SleepingMqttClient(TerminalConnection& connection, TerminalClock& clock) : MqttClient(connection, clock) {}
+
+  void idle() override;
+};
+
+// MqttTransport bundled with its own connection and client, one per
+// simulated terminal; the session stays open between requests
+class SocketMqttTransport : public TerminalTransport {
+public:
+  SocketMqttTransport(const std::string& backendUrl, const std::string& clientId,
+                      TerminalClock& clock, uint32_t timeoutMs);
+
+  int postJson(const char* url, const char* body, size_t len,
+               char* response, size_t responseSize) override;
+  bool pollCommand(char* command, size_t commandSize) override;
+  uint32_t getConnectCount() const { return _mqtt.getConnectCount(); }
+
+private:
+  SocketConnection _connection;
+  SleepingMqttClient _client;
+  MqttTransport _mqtt;
+};
+
+// SocketTransport for http:// backends, UdpCoapTransport for coap://,
+// SocketMqttTransport for mqtt:// (deviceId is its client id); NULL for
+// anything else. backendUrl is the base URL. The caller owns the result.
+TerminalTransport* createBackendTransport(const std::string& backendUrl, const std::string& deviceId,
+                                          TerminalClock& clock, uint32_t timeoutMs);
+
+// ========================================
+// CLOCK
+// ========================================
+
+// millis() counts from construction; now() is local wall time
+class HostClock : public TerminalClock {
+public:
+  HostClock();
+
+  uint32_t millis() override;
+  void now(TerminalDateTime& out) override;
+
+private:
+  int64_t _startMicros;
+};
+
+// ========================================
+// SCRIPTED CARD READER
+// ========================================
+
+enum TapAction {
+  TAP_CARD,          // Present uid to the reader
+  TAP_LINK_DOWN,     // Terminal loses its uplink
+  TAP_LINK_UP        // Uplink restored
+};
+
+struct TapEvent {
+  uint32_t atMs;
+  TapAction action;
+  uint8_t uid[10];
+  uint8_t uidLength;
+};
+
+// Script lines: "<ms> <terminal|*> <uid-hex|OFFLINE|ONLINE>", '#' comments.
+// Events are appended to perTerminal[index]; returns false on a bad line.
+bool loadTapScript(const char* path, int terminalCount,
+                   std::vector<std::vector<TapEvent> >& perTerminal, std::string& error);
+
+// Poisson arrivals at ratePerMinute from a pool of cardPool distinct UIDs
+void generateTapLoad(uint32_t seed, uint32_t durationMs, double ratePerMinute, int cardPool,
+                     std::vector<TapEvent>& out);
+
+// Plays TAP_CARD events once their time has come; link events are handed
+// out through pollLinkChange() so the terminal can switch online state.
+class ScriptedCardReader : public TerminalCardReader {
+public:
+  ScriptedCardReader(TerminalClock& clock, const std::vector<TapEvent>& events);
+
+  bool pollCard(uint8_t* uid, uint8_t* uidLength, uint8_t maxLength) override;
+  bool pollLinkChange(bool& online);
+
+  // Time the card at the head of the queue became due (for detect latency)
+  uint32_t getLastDueMs() const { return _lastDueMs; }
+  bool finished() const;
+
+private:
+  TerminalClock& _clock;
+  std::vector<TapEvent> _taps;
+  std::vector<TapEvent> _links;
+  size_t _nextTap;
+  size_t _nextLink;
+  uint32_t _lastDueMs;
+};
+
+#endif // HAL_HOST_H
@@ -0,0 +1,568 @@
+/*
+ * Rush-hour trace replayer and backend load generator
+ * Attendee Attendance Terminal v2.0 - host build
+ *
+ * Drives a backend with exactly the requests a fleet of terminals sends:
+ * the payload built by processOnlineAttendance()/syncSingleLog() (shared
+ * attendance core) over one connection per request.
+ *
+ * Two phases, run in order:
+ *   rush       Replays a tap trace open-loop, one sender per terminal.
+ *              CARD_READ_DELAY is applied as on the terminal: repeat
+ *              taps are lost, other cards wait and tap again. Latency is
+ *              measured from the original tap time, so a slow backend
+ *              and a busy gate both show up as queueing.
+ *   reconnect  Every terminal comes back from an outage at once and
+ *              drains an OFFLINE_LOGS_FILE backlog through OfflineQueue,
+ *              as syncOfflineLogs() does: up to --window records in flight
+ *              on keep-alive connections (drainPipelined), or with
+ *              --window 0 one request per connection, stop-and-wait.
+ *
+ * A coap:// backend sends the same payloads as confirmable CoAP requests
+ * (one datagram exchange each); an mqtt:// backend publishes them at QoS 1
+ * over one persistent session per terminal. The reconnect phase is then
+ * always stop-and-wait, as on the terminal.
+ *
+ * Usage:
+ *   load_gen --backend http://127.0.0.1:5000/api|coap://127.0.0.1:5683/api|mqtt://127.0.0.1:1883/api
+ *            [--terminals 40]
+ *            [--mode rush|reconnect|both] [--duration 120] [--cards 800]
+ *            [--trace taps.txt] [--write-trace out.txt] [--backlog 200]
+ *            [--window 4] [--workdir load_state] [--seed 1]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "attendance_core.h"
+#include "config.h"
+#include "hal_host.h"
+#include "upload_pipeline.h"
+
+struct LoadOptions {
+  std::string backendUrl;
+  std::string mode;
+  std::string tracePath;
+  std::string writeTracePath;
+  std::string workdir;
+  int terminals;
+  uint32_t durationMs;
+  int cards;
+  int backlog;
+  int window;
+  uint32_t seed;
+};
+
+static void printUsage() {
+  fprintf(stderr,
+          "usage: load_gen --backend URL [--terminals N] [--mode rush|reconnect|both]\n"
+          "                [--duration SEC] [--cards N] [--trace FILE] [--write-trace FILE]\n"
+          "                [--backlog RECORDS_PER_TERMINAL] [--window 0-%d] [--workdir DIR] [--seed N]\n",
+          UPLOAD_WINDOW_MAX);
+}
+
+static bool parseOptions(int argc, char** argv, LoadOptions& options) {
+  options.mode = "both";
+  options.workdir = "load_state";
+  options.terminals = 40;
+  options.durationMs = 120000;
+  options.cards = 800;
+  options.backlog = 200;
+  options.window = UPLOAD_WINDOW;
+  options.seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (!value) {
+      return false;
+    }
+    if (strcmp(arg, "--backend") == 0) options.backendUrl = value;
+    else if (strcmp(arg, "--mode") == 0) options.mode = value;
+    else if (strcmp(arg, "--trace") == 0) options.tracePath = value;
+    else if (strcmp(arg, "--write-trace") == 0) options.writeTracePath = value;
+    else if (strcmp(arg, "--workdir") == 0) options.workdir = value;
+    else if (strcmp(arg, "--terminals") == 0) options.terminals = atoi(value);
+    else if (strcmp(arg, "--duration") == 0) options.durationMs = (uint32_t)(atof(value) * 1000);
+    else if (strcmp(arg, "--cards") == 0) options.cards = atoi(value);
+    else if (strcmp(arg, "--backlog") == 0) options.backlog = atoi(value);
+    else if (strcmp(arg, "--window") == 0) options.window = atoi(value);
+    else if (strcmp(arg, "--seed") == 0) options.seed = strtoul(value, NULL, 10);
+    else return false;
+    i++;
+  }
+  bool validMode = options.mode == "rush" || options.mode == "reconnect" || options.mode == "both";
+  bool validWindow = options.window >= 0 && options.window <= UPLOAD_WINDOW_MAX;
+  return !options.backendUrl.empty() && options.terminals > 0 && options.cards > 0 && validMode && validWindow;
+}
+
+static int64_t steadyMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void formatLocalTimestamp(time_t t, char* out, size_t outSize) {
+  struct tm local;
+  localtime_r(&t, &local);
+  TerminalDateTime dt = { local.tm_year + 1900, local.tm_mon + 1, local.tm_mday,
+                          local.tm_hour, local.tm_min, local.tm_sec };
+  formatIsoTimestamp(dt, out, outSize);
+}
+
+// ========================================
+// REQUEST STATISTICS
+// ========================================
+
+struct RequestStats {
+  std::vector<uint32_t> latencyUs;   // Scheduled (or sent) -> response
+  std::vector<uint32_t> serviceUs;   // Sent -> response
+  uint32_t ok;                       // 2xx (202: accepted by the MQTT broker)
+  uint32_t rejected;                 // 4xx (duplicates, unknown cards, validation)
+  uint32_t serverErrors;             // 5xx
+  uint32_t transportErrors;          // Connect/send/timeout (<= 0)
+
+  RequestStats() : ok(0), rejected(0), serverErrors(0), transportErrors(0) {}
+
+  void record(int code, uint32_t latency, uint32_t service) {
+    latencyUs.push_back(latency);
+    serviceUs.push_back(service);
+    if (code >= 200 && code < 300) ok++;
+    else if (code >= 400 && code < 500) rejected++;
+    else if (code >= 500) serverErrors++;
+    else transportErrors++;
+  }
+
+  void merge(const RequestStats& other) {
+    latencyUs.insert(latencyUs.end(), other.latencyUs.begin(), other.latencyUs.end());
+    serviceUs.insert(serviceUs.end(), other.serviceUs.begin(), other.serviceUs.end());
+    ok += other.ok;
+    rejected += other.rejected;
+    serverErrors += other.serverErrors;
+    transportErrors += other.transportErrors;
+  }
+};
+
+static double percentileMs(std::vector<uint32_t>& values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+  return values[std::min(index, values.size() - 1)] / 1000.0;
+}
+
+static void printStats(const char* phase, RequestStats& stats, double elapsedSeconds) {
+  size_t total = stats.latencyUs.size();
+  uint32_t failed = stats.serverErrors + stats.transportErrors;
+  printf("[%s] %zu requests in %.1fs (%.1f req/s)\n", phase, total, elapsedSeconds,
+         elapsedSeconds > 0 ? total / elapsedSeconds : 0.0);
+  printf("[%s]   2xx %u, 4xx %u, 5xx %u, transport %u -> error rate %.2f%%\n", phase,
+         stats.ok, stats.rejected, stats.serverErrors, stats.transportErrors,
+         total ? 100.0 * failed / total : 0.0);
+  printf("[%s]   end-to-end p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms\n", phase,
+         percentileMs(stats.latencyUs, 0.50), percentileMs(stats.latencyUs, 0.90),
+         percentileMs(stats.latencyUs, 0.99), percentileMs(stats.latencyUs, 1.0));
+  printf("[%s]   backend    p50 %.1f ms, p99 %.1f ms\n", phase,
+         percentileMs(stats.serviceUs, 0.50), percentileMs(stats.serviceUs, 0.99));
+}
+
+// ========================================
+// RUSH-HOUR TRACE MODEL
+// ========================================
+
+static void addTap(std::vector<std::vector<TapEvent> >& perTerminal, int terminal,
+                   uint32_t atMs, uint32_t cardId) {
+  TapEvent event;
+  memset(&event, 0, sizeof(event));
+  event.atMs = atMs;
+  event.action = TAP_CARD;
+  event.uid[0] = 0x04;
+  event.uid[1] = (uint8_t)(cardId >> 16);
+  event.uid[2] = (uint8_t)(cardId >> 8);
+  event.uid[3] = (uint8_t)cardId;
+  event.uidLength = 4;
+  perTerminal[terminal].push_back(event);
+}
+
+// Arrivals peak around 40% of the window. About a third of people arrive in
+// small groups queueing at the same gate (each waits for the previous beep);
+// one in ten taps again a few seconds later, some inside the debounce; half
+// leave again before the window ends (entry/exit pair).
+static void generateRushHourTrace(const LoadOptions& options,
+                                  std::vector<std::vector<TapEvent> >& perTerminal) {
+  std::mt19937 rng(options.seed);
+  std::normal_distribution<double> arrival(options.durationMs * 0.4, options.durationMs * 0.15);
+  std::uniform_int_distribution<int> gate(0, options.terminals - 1);
+  std::uniform_int_distribution<int> groupSize(2, 5);
+  std::uniform_int_distribution<uint32_t> groupGapMs(CARD_READ_DELAY + 200, CARD_READ_DELAY + 2500);
+  std::uniform_int_distribution<uint32_t> repeatGapMs(CARD_READ_DELAY / 2, CARD_READ_DELAY * 4);
+  std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+  perTerminal.assign(options.terminals, std::vector<TapEvent>());
+
+  int card = 0;
+  while (card < options.cards) {
+    double leader = arrival(rng);
+    if (leader < 0 || leader >= options.durationMs) {
+      continue;
+    }
+    int terminal = gate(rng);
+    int members = chance(rng) < 0.33 ? std::min(groupSize(rng), options.cards - card) : 1;
+
+    uint32_t at = (uint32_t)leader;
+    for (int m = 0; m < members; m++, card++) {
+      if (at >= options.durationMs) {
+        break;
+      }
+      addTap(perTerminal, terminal, at, (uint32_t)card);
+
+      if (chance(rng) < 0.10) {
+        uint32_t repeat = at + repeatGapMs(rng);
+        if (repeat < options.durationMs) {
+          addTap(perTerminal, terminal, repeat, (uint32_t)card);
+        }
+      }
+
+      if (chance(rng) < 0.5) {
+        uint32_t remaining = options.durationMs - at;
+        uint32_t exitAt = at + (uint32_t)(remaining * (0.3 + 0.6 * chance(rng)));
+        if (exitAt < options.durationMs) {
+          addTap(perTerminal, gate(rng), exitAt, (uint32_t)card);
+        }
+      }
+      at += groupGapMs(rng);
+    }
+  }
+
+  for (size_t i = 0; i < perTerminal.size(); i++) {
+    std::sort(perTerminal[i].begin(), perTerminal[i].end(),
+              [](const TapEvent& a, const TapEvent& b) { return a.atMs < b.atMs; });
+  }
+}
+
+// Same format loadTapScript() reads, so fleet_sim can replay it too
+static bool writeTrace(const char* path, const std::vector<std::vector<TapEvent> >& perTerminal) {
+  std::vector<std::pair<uint32_t, std::string> > lines;
+  for (size_t t = 0; t < perTerminal.size(); t++) {
+    for (size_t i = 0; i < perTerminal[t].size(); i++) {
+      const TapEvent& event = perTerminal[t][i];
+      char uid[ATTENDANCE_UID_HEX_SIZE];
+      formatUidHex(event.uid, event.uidLength, uid, sizeof(uid));
+      char line[64];
+      snprintf(line, sizeof(line), "%u %zu %s\n", event.atMs, t, uid);
+      lines.push_back(std::make_pair(event.atMs, std::string(line)));
+    }
+  }
+  std::stable_sort(lines.begin(), lines.end(),
+                   [](const std::pair<uint32_t, std::string>& a, const std::pair<uint32_t, std::string>& b) {
+                     return a.first < b.first;
+                   });
+
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    return false;
+  }
+  fprintf(file, "# load_gen rush-hour trace: <ms> <terminal> <uid>\n");
+  for (size_t i = 0; i < lines.size(); i++) {
+    fputs(lines[i].second.c_str(), file);
+  }
+  return fclose(file) == 0;
+}
+
+// ========================================
+// RUSH PHASE
+// ========================================
+
+static void runRushTerminal(const std::string& backendUrl, const std::string& attendanceUrl, int index,
+                            const std::vector<TapEvent>& taps, int64_t startMicros,
+                            RequestStats& stats, uint32_t& debounced, uint32_t& deferred) {
+  char deviceId[32];
+  snprintf(deviceId, sizeof(deviceId), "LOAD_%03d", index);
+
+  HostClock clock;
+  std::unique_ptr<TerminalTransport> transport(createBackendTransport(backendUrl, deviceId, clock, HTTP_TIMEOUT));
+
+  bool hasScanned = false;
+  uint32_t lastCardScan = 0;
+  uint32_t seq = 0;
+  const TapEvent* lastTap = NULL;
+  for (size_t i = 0; i < taps.size(); i++) {
+    const TapEvent& tap = taps[i];
+    if (tap.action != TAP_CARD) {
+      continue;
+    }
+
+    // handleRFIDScan() debounce: a repeat of the same card is lost, anyone
+    // else ignored by the terminal taps again once it is ready
+    uint32_t tapMs = tap.atMs;
+    if (hasScanned && tapMs - lastCardScan < CARD_READ_DELAY) {
+      if (tap.uidLength == lastTap->uidLength && memcmp(tap.uid, lastTap->uid, tap.uidLength) == 0) {
+        debounced++;
+        continue;
+      }
+      deferred++;
+      tapMs = lastCardScan + CARD_READ_DELAY;
+    }
+    hasScanned = true;
+    lastCardScan = tapMs;
+    lastTap = &tap;
+
+    // Latency counts from the original tap, so waiting at the gate is included
+    int64_t scheduled = startMicros + (int64_t)tap.atMs * 1000;
+    int64_t wait = startMicros + (int64_t)tapMs * 1000 - steadyMicros();
+    if (wait > 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(wait));
+    }
+
+    char rfidTag[ATTENDANCE_UID_HEX_SIZE];
+    formatUidHex(tap.uid, tap.uidLength, rfidTag, sizeof(rfidTag));
+    char timestamp[ATTENDANCE_TIMESTAMP_SIZE];
+    formatLocalTimestamp(time(NULL), timestamp, sizeof(timestamp));
+    char payload[ATTENDANCE_PAYLOAD_SIZE];
+    size_t length = buildAttendancePayload(rfidTag, timestamp, deviceId, FIRMWARE_VERSION, ++seq,
+                                           NULL, payload, sizeof(payload));
+
+    char response[512];
+    int64_t sent = steadyMicros();
+    int code = transport->postJson(attendanceUrl.c_str(), payload, length, response, sizeof(response));
+    int64_t done = steadyMicros();
+    stats.record(code, (uint32_t)(done - std::min(scheduled, sent)), (uint32_t)(done - sent));
+  }
+}
+
+static void runRushPhase(const LoadOptions& options, const std::string& attendanceUrl,
+                         const std::vector<std::vector<TapEvent> >& perTerminal) {
+  size_t taps = 0;
+  for (size_t i = 0; i < perTerminal.size(); i++) {
+    taps += perTerminal[i].size();
+  }
+  printf("[rush] replaying %zu taps on %d terminals\n", taps, options.terminals);
+
+  std::vector<RequestStats> stats(options.terminals);
+  std::vector<uint32_t> debounced(options.terminals, 0);
+  std::vector<uint32_t> deferred(options.terminals, 0);
+  std::vector<std::thread> threads;
+  int64_t startMicros = steadyMicros() + 100000;
+  for (int i = 0; i < options.terminals; i++) {
+    threads.push_back(std::thread(runRushTerminal, std::cref(options.backendUrl), std::cref(attendanceUrl), i,
+                                  std::cref(perTerminal[i]), startMicros,
+                                  std::ref(stats[i]), std::ref(debounced[i]), std::ref(deferred[i])));
+  }
+  for (size_t i = 0; i < threads.size(); i++) {
+    threads[i].join();
+  }
+  double elapsed = (steadyMicros() - startMicros) / 1e6;
+
+  RequestStats total;
+  uint32_t totalDebounced = 0;
+  uint32_t totalDeferred = 0;
+  for (int i = 0; i < options.terminals; i++) {
+    total.merge(stats[i]);
+    totalDebounced += debounced[i];
+    totalDeferred += deferred[i];
+  }
+  printf("[rush] %u repeat taps lost to the terminal debounce, %u taps retried after it\n",
+         totalDebounced, totalDeferred);
+  printStats("rush", total, elapsed);
+}
+
+// ========================================
+// RECONNECT PHASE
+// ========================================
+
+// syncSingleLog(): 3 s timeout, 2xx accepted
+class TimedUploader : public RecordUploader {
+public:
+  TimedUploader(TerminalTransport& transport, const std::string& url, RequestStats& stats)
+    : _transport(transport), _url(url), _stats(stats) {}
+
+  bool upload(const char* record, size_t length) override {
+    int64_t sent = steadyMicros();
+    int code = _transport.postJson(_url.c_str(), record, length, NULL, 0);
+    uint32_t elapsed = (uint32_t)(steadyMicros() - sent);
+    _stats.record(code, elapsed, elapsed);
+    return code >= 200 && code < 300;
+  }
+
+private:
+  TerminalTransport& _transport;
+  const std::string& _url;
+  RequestStats& _stats;
+};
+
+// BackendPipelineUploader: same timeout, one stats entry per finished request
+class TimedPipelineUploader : public HttpPipelineUploader {
+public:
+  TimedPipelineUploader(TerminalConnection* const* connections, TerminalClock& clock, RequestStats& stats)
+    : HttpPipelineUploader(connections, UPLOAD_WINDOW_MAX, clock), _stats(stats) {}
+
+  void idle() override {
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+
+protected:
+  void onResult(int code, uint32_t, uint32_t elapsedMs) override {
+    _stats.record(code, elapsedMs * 1000, elapsedMs * 1000);
+  }
+
+private:
+  RequestStats& _stats;
+};
+
+struct DrainOutcome {
+  DrainResult result;
+  double seconds;
+};
+
+static void runReconnectPhase(const LoadOptions& options, const std::string& attendanceUrl) {
+  mkdir(options.workdir.c_str(), 0755);
+
+  // Backlog recorded during an outage that ended just now
+  std::mt19937 rng(options.seed ^ 0x5eed);
+  std::uniform_int_distribution<uint32_t> card(0, (uint32_t)options.cards - 1);
+  time_t outageStart = time(NULL) - 3600;
+  std::vector<DirectoryStorage*> storages;
+  for (int t = 0; t < options.terminals; t++) {
+    char deviceId[32];
+    snprintf(deviceId, sizeof(deviceId), "LOAD_%03d", t);
+    DirectoryStorage* storage = new DirectoryStorage(options.workdir + "/" + deviceId);
+    storage->remove(OFFLINE_LOGS_FILE);
+    storage->remove(OFFLINE_LOGS_TEMP_FILE);
+
+    int records = std::min(options.backlog, MAX_OFFLINE_LOGS);
+    for (int r = 0; r < records; r++) {
+      uint8_t uid[4] = { 0x04, 0, 0, 0 };
+      uint32_t id = card(rng);
+      uid[1] = (uint8_t)(id >> 16);
+      uid[2] = (uint8_t)(id >> 8);
+      uid[3] = (uint8_t)id;
+      char rfidTag[ATTENDANCE_UID_HEX_SIZE];
+      formatUidHex(uid, sizeof(uid), rfidTag, sizeof(rfidTag));
+      char timestamp[ATTENDANCE_TIMESTAMP_SIZE];
+      formatLocalTimestamp(outageStart + (time_t)r * 3600 / std::max(records, 1), timestamp, sizeof(timestamp));
+      char record[ATTENDANCE_PAYLOAD_SIZE];
+      size_t length = buildAttendancePayload(rfidTag, timestamp, deviceId, FIRMWARE_VERSION, r + 1,
+                                             NULL, record, sizeof(record));
+      storage->appendLine(OFFLINE_LOGS_FILE, record, length);
+    }
+    storages.push_back(storage);
+  }
+  printf("[reconnect] %d terminals each draining %d offline records at once (window %d)\n",
+         options.terminals, std::min(options.backlog, MAX_OFFLINE_LOGS), options.window);
+
+  std::vector<RequestStats> stats(options.terminals);
+  std::vector<DrainOutcome> outcomes(options.terminals);
+  std::atomic<bool> go(false);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < options.terminals; t++) {
+    threads.push_back(std::thread([&, t]() {
+      OfflineQueue queue(*storages[t], OFFLINE_LOGS_FILE, OFFLINE_LOGS_TEMP_FILE);
+      queue.recoverCount();
+      char deviceId[32];
+      snprintf(deviceId, sizeof(deviceId), "LOAD_%03d", t);
+      HostClock clock;
+      std::unique_ptr<TerminalTransport> transport(createBackendTransport(options.backendUrl, deviceId, clock,
+                                                                         UPLOAD_TIMEOUT_MS));
+      TimedUploader uploader(*transport, attendanceUrl, stats[t]);
+
+      SocketConnection connections[UPLOAD_WINDOW_MAX];
+      TerminalConnection* slots[UPLOAD_WINDOW_MAX];
+      for (int i = 0; i < UPLOAD_WINDOW_MAX; i++) {
+        connections[i].setTimeout(UPLOAD_TIMEOUT_MS);
+        slots[i] = &connections[i];
+      }
+      TimedPipelineUploader pipeline(slots, clock, stats[t]);
+      pipeline.setWindow((uint8_t)options.window);
+      pipeline.setTimeout(UPLOAD_TIMEOUT_MS);
+      std::unique_ptr<UploadWindow> window(new UploadWindow());
+
+      while (!go.load()) {
+        std::this_thread::yield();
+      }
+      int64_t started = steadyMicros();
+      bool pipelined = options.window > 0 && pipeline.setTarget(attendanceUrl.c_str());
+      outcomes[t].result = pipelined ? queue.drainPipelined(pipeline, *window)
+                                              : queue.drain(uploader);
+      outcomes[t].seconds = (steadyMicros() - started) / 1e6;
+    }));
+  }
+
+  int64_t startMicros = steadyMicros();
+  go = true;
+  for (size_t i = 0; i < threads.size(); i++) {
+    threads[i].join();
+  }
+  double elapsed = (steadyMicros() - startMicros) / 1e6;
+
+  RequestStats total;
+  int uploaded = 0;
+  int remaining = 0;
+  std::vector<uint32_t> drainMs;
+  for (int t = 0; t < options.terminals; t++) {
+    total.merge(stats[t]);
+    uploaded += outcomes[t].result.uploaded;
+    remaining += outcomes[t].result.remaining;
+    drainMs.push_back((uint32_t)(outcomes[t].seconds * 1e6));
+    delete storages[t];
+  }
+  printStats("reconnect", total, elapsed);
+  printf("[reconnect]   %d records uploaded, %d left queued; per-terminal drain p50 %.1f s, max %.1f s\n",
+         uploaded, remaining, percentileMs(drainMs, 0.50) / 1000.0, percentileMs(drainMs, 1.0) / 1000.0);
+}
+
+int main(int argc, char** argv) {
+  LoadOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage();
+    return 2;
+  }
+
+  std::string base = options.backendUrl;
+  if (!base.empty() && base[base.size() - 1] == '/') {
+    base.erase(base.size() - 1);
+  }
+  std::string attendanceUrl = base + "/attendance";
+  HostClock clock;
+  if (!std::unique_ptr<TerminalTransport>(createBackendTransport(base, "LOAD_CHECK", clock, HTTP_TIMEOUT))) {
+    fprintf(stderr, "load_gen: only http://, coap:// and mqtt:// backends are supported on the host\n");
+    return 2;
+  }
+
+  if (options.mode == "rush" || options.mode == "both") {
+    std::vector<std::vector<TapEvent> > perTerminal;
+    if (!options.tracePath.empty()) {
+      std::string error;
+      if (!loadTapScript(options.tracePath.c_str(), options.terminals, perTerminal, error)) {
+        fprintf(stderr, "load_gen: %s\n", error.c_str());
+        return 2;
+      }
+      for (size_t i = 0; i < perTerminal.size(); i++) {
+        std::stable_sort(perTerminal[i].begin(), perTerminal[i].end(),
+                         [](const TapEvent& a, const TapEvent& b) { return a.atMs < b.atMs; });
+      }
+    } else {
+      generateRushHourTrace(options, perTerminal);
+    }
+    if (!options.writeTracePath.empty() && !writeTrace(options.writeTracePath.c_str(), perTerminal)) {
+      fprintf(stderr, "load_gen: cannot write %s\n", options.writeTracePath.c_str());
+      return 2;
+    }
+    runRushPhase(options, attendanceUrl, perTerminal);
+  }
+
+  if (options.mode == "reconnect" || options.mode == "both") {
+    runReconnectPhase(options, attendanceUrl);
+  }
+  return 0;
+}
@@ -0,0 +1,318 @@
+/*
+ * Virtual attendance terminal for the host fleet simulator
+ * Attendee Attendance Terminal v2.0 - host build
+ */
+
+#include "virtual_terminal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "config.h"
+#include "mqtt_transport.h"
+
+static int64_t steadyMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::string trimTrailingSlash(const std::string& url) {
+  if (!url.empty() && url[url.size() - 1] == '/') {
+    return url.substr(0, url.size() - 1);
+  }
+  return url;
+}
+
+// Same role as BackendSyncUploader in the firmware
+class TerminalSyncUploader : public RecordUploader {
+public:
+  explicit TerminalSyncUploader(VirtualTerminal& terminal) : _terminal(terminal) {}
+
+  bool upload(const char* record, size_t length) override {
+    int code = _terminal.post(_terminal._attendanceUrl, record, length, NULL, 0);
+    _terminal._pacer.onResult(code, _terminal._transport.getLastRetryAfterMs());
+    return code >= 200 && code < 300;
+  }
+
+  bool shouldContinue() override {
+    return _terminal._pacer.allowUpload();
+  }
+
+private:
+  VirtualTerminal& _terminal;
+};
+
+// Same role as BackendPipelineUploader in the firmware
+class TerminalPipelineUploader : public HttpPipelineUploader {
+public:
+  TerminalPipelineUploader(VirtualTerminal& terminal, TerminalConnection* const* connections)
+    : HttpPipelineUploader(connections, UPLOAD_WINDOW_MAX, terminal._clock), _terminal(terminal) {}
+
+  bool shouldContinue() override {
+    return _terminal._pacer.allowUpload();
+  }
+
+  void idle() override {
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+
+protected:
+  void onResult(int code, uint32_t retryAfterMs, uint32_t) override {
+    _terminal._stats.backendRequests++;
+    if (code != 200 && code != 201) {
+      _terminal._stats.backendErrors++;
+    }
+    _terminal._pacer.onResult(code, retryAfterMs);
+  }
+
+private:
+  VirtualTerminal& _terminal;
+};
+
+VirtualTerminal::VirtualTerminal(const VirtualTerminalConfig& config, TerminalStorage& storage,
+                                 TerminalTransport& transport, ScriptedCardReader& reader,
+                                 TerminalClock& clock)
+  : _config(config), _transport(transport), _reader(reader), _clock(clock),
+    _queue(storage, OFFLINE_LOGS_FILE, OFFLINE_LOGS_TEMP_FILE),
+    _sequence(storage, SCAN_SEQUENCE_FILE, SCAN_SEQUENCE_TEMP_FILE, SCAN_SEQUENCE_BLOCK),
+    _online(true), _hasScanned(false), _lastCardScan(0), _lastSyncAttempt(0),
+    _lastHeartbeat(0), _syncDelay(config.syncIntervalMs), _heartbeatDelay(config.heartbeatIntervalMs),
+    _startMs(0),
+    _pacer(SYNC_BATCH_INITIAL, SYNC_BATCH_MAX, SYNC_BATCH_INCREASE, SYNC_BACKOFF_MIN_MS, SYNC_BACKOFF_MAX_MS),
+    _random(config.seed), _stats() {
+  std::string base = trimTrailingSlash(config.backendUrl);
+  _attendanceUrl = base + "/attendance";
+  _heartbeatUrl = base + "/device/heartbeat";
+
+  TerminalConnection* slots[UPLOAD_WINDOW_MAX];
+  for (int i = 0; i < UPLOAD_WINDOW_MAX; i++) {
+    _connections[i].setTimeout(UPLOAD_TIMEOUT_MS);
+    slots[i] = &_connections[i];
+  }
+  _pipeline.reset(new TerminalPipelineUploader(*this, slots));
+  _pipeline->setWindow(config.uploadWindow);
+  _pipeline->setTimeout(UPLOAD_TIMEOUT_MS);
+  _uploadWindow.reset(new UploadWindow());
+}
+
+VirtualTerminal::~VirtualTerminal() {
+}
+
+void VirtualTerminal::begin() {
+  _queue.setGroupCommit(_config.commitBytes, OFFLINE_COMMIT_MAX_AGE_MS);
+  _queue.recoverCount();
+  _sequence.begin();
+  _startMs = _clock.millis();
+
+  // Random phase offsets, as at the end of setup()
+  scheduleSpreadSync();
+  _lastHeartbeat = _startMs;
+  _heartbeatDelay = randomPhase(_config.heartbeatIntervalMs, _random());
+}
+
+void VirtualTerminal::scheduleSpreadSync() {
+  _lastSyncAttempt = _clock.millis();
+  _syncDelay = randomPhase(SYNC_STARTUP_SPREAD_MS, _random());
+}
+
+void VirtualTerminal::loop() {
+  // Scripted connectivity changes; reconnect schedules a spread sync as
+  // the periodic WiFi reconnect path does
+  bool online;
+  while (_reader.pollLinkChange(online)) {
+    bool reconnected = online && !_online;
+    _online = online;
+    if (reconnected && _queue.count() > 0) {
+      scheduleSpreadSync();
+    }
+  }
+
+  uint8_t uid[ATTENDANCE_UID_MAX_BYTES];
+  uint8_t uidLength = 0;
+  if (_reader.pollCard(uid, &uidLength, sizeof(uid))) {
+    handleScan(uid, uidLength);
+  }
+
+  uint32_t now = _clock.millis();
+  if (_queue.getStaged() > 0) {
+    int64_t started = steadyMicros();
+    uint32_t writesBefore = _queue.getWriteCount();
+    _queue.flushIfDue(now);
+    if (_queue.getWriteCount() != writesBefore) {
+      _stats.appendLatencyUs.push_back((uint32_t)(steadyMicros() - started));
+    }
+  }
+
+  if (_online && _queue.count() > 0 && now - _lastSyncAttempt > _syncDelay) {
+    syncOfflineLogs();
+  }
+
+  if (_online && now - _lastHeartbeat > _heartbeatDelay) {
+    sendHeartbeat();
+  }
+
+  // Persistent backend session (MQTT): keep-alive, reconnect, pushed commands
+  char command[MQTT_COMMAND_MAX];
+  if (_online && _transport.pollCommand(command, sizeof(command))) {
+    _stats.commands++;
+    applyInstructions(command);
+  }
+}
+
+void VirtualTerminal::handleScan(const uint8_t* uid, uint8_t uidLength) {
+  int64_t detectedMicros = steadyMicros();
+  uint32_t detectLagMs = _clock.millis() - _reader.getLastDueMs();
+
+  // Prevent duplicate reads
+  uint32_t currentTime = _clock.millis();
+  if (_hasScanned && currentTime - _lastCardScan < CARD_READ_DELAY) {
+    _stats.debounced++;
+    return;
+  }
+  _hasScanned = true;
+  _lastCardScan = currentTime;
+  _stats.scans++;
+
+  char rfidTag[ATTENDANCE_UID_HEX_SIZE];
+  formatUidHex(uid, uidLength, rfidTag, sizeof(rfidTag));
+
+  TerminalDateTime dt;
+  _clock.now(dt);
+  char timestamp[ATTENDANCE_TIMESTAMP_SIZE];
+  formatIsoTimestamp(dt, timestamp, sizeof(timestamp));
+
+  char payload[ATTENDANCE_PAYLOAD_SIZE];
+  size_t length = buildAttendancePayload(rfidTag, timestamp, _config.deviceId.c_str(),
+                                         FIRMWARE_VERSION, _sequence.allocate(), NULL,
+                                         payload, sizeof(payload));
+
+  if (_online) {
+    processOnlineAttendance(payload, length);
+  } else {
+    processOfflineAttendance(payload, length);
+  }
+
+  _stats.scanLatencyUs.push_back(detectLagMs * 1000 + (uint32_t)(steadyMicros() - detectedMicros));
+}
+
+void VirtualTerminal::processOnlineAttendance(const char* payload, size_t length) {
+  char response[512];
+  int httpResponseCode = post(_attendanceUrl, payload, length, response, sizeof(response));
+
+  if (httpResponseCode == 200 || httpResponseCode == 201) {
+    AttendanceResponse parsed;
+    if (parseAttendanceResponse(response, strlen(response), parsed) && parsed.hasMessage) {
+      _stats.onlineAccepted++;
+    }
+  } else if (httpResponseCode == MQTT_ACCEPTED) {
+    _stats.onlineAccepted++;           // Held by the broker, no reply in time
+  } else if (httpResponseCode == 400) {
+    _stats.rejected++;
+  } else if (httpResponseCode >= 500 || httpResponseCode <= 0) {
+    // Only store offline on network/server errors, not client errors
+    processOfflineAttendance(payload, length);
+  }
+}
+
+void VirtualTerminal::processOfflineAttendance(const char* payload, size_t length) {
+  if (_queue.count() >= MAX_OFFLINE_LOGS) {
+    _stats.droppedFull++;
+    return;
+  }
+  int64_t started = steadyMicros();
+  bool stored = length > 0 && _queue.append(payload, length, _clock.millis());
+  _stats.appendLatencyUs.push_back((uint32_t)(steadyMicros() - started));
+  if (stored) {
+    _stats.storedOffline++;
+  }
+}
+
+bool VirtualTerminal::syncOfflineLogs() {
+  uint32_t started = _clock.millis();
+  _lastSyncAttempt = started;
+
+  _pacer.beginPass();
+  DrainResult result;
+  if (_config.uploadWindow > 0 && _pipeline->setTarget(_attendanceUrl.c_str())) {
+    result = _queue.drainPipelined(*_pipeline, *_uploadWindow);
+    _pipeline->closeAll();
+  } else {
+    TerminalSyncUploader uploader(*this);
+    result = _queue.drain(uploader);
+  }
+
+  bool throttled = _pacer.wasThrottled();
+  uint32_t pacedDelay = _pacer.endPass(_queue.count() > 0, SYNC_CONTINUE_DELAY_MS);
+  _syncDelay = pacedDelay ? pacedDelay : jitterInterval(_config.syncIntervalMs, SCHEDULE_JITTER_PERCENT, _random());
+  if (throttled) {
+    _stats.syncThrottled++;
+  }
+
+  _stats.syncPasses++;
+  _stats.syncUploaded += result.uploaded;
+  _stats.syncMs += _clock.millis() - started;
+  return result.remaining == 0;
+}
+
+void VirtualTerminal::sendHeartbeat() {
+  _lastHeartbeat = _clock.millis();
+
+  TerminalDateTime dt;
+  _clock.now(dt);
+  char timestamp[ATTENDANCE_TIMESTAMP_SIZE];
+  formatIsoTimestamp(dt, timestamp, sizeof(timestamp));
+
+  char payload[256];
+  int length = snprintf(payload, sizeof(payload),
+                        "{\"deviceId\":\"%s\",\"timestamp\":\"%s\",\"firmwareVersion\":\"%s\","
+                        "\"uptime\":%u,\"offlineLogsCount\":%d,"
+                        "\"wifi\":{\"connected\":true},\"system\":{\"isOnline\":true,\"systemInitialized\":true}}",
+                        _config.deviceId.c_str(), timestamp, FIRMWARE_VERSION,
+                        _clock.millis() - _startMs, _queue.count());
+  if (length <= 0 || length >= (int)sizeof(payload)) {
+    return;
+  }
+
+  char response[256];
+  int httpResponseCode = post(_heartbeatUrl, payload, length, response, sizeof(response));
+  _stats.heartbeats++;
+
+  _heartbeatDelay = jitterInterval(_config.heartbeatIntervalMs, SCHEDULE_JITTER_PERCENT, _random());
+  uint32_t retryAfterMs = _transport.getLastRetryAfterMs();
+
+  if (httpResponseCode >= 200 && httpResponseCode < 300) {
+    applyInstructions(response);
+  }
+
+  if (retryAfterMs > 0) {
+    _heartbeatDelay = std::min(std::max(_heartbeatDelay, retryAfterMs), (uint32_t)HEARTBEAT_HINT_MAX_MS);
+  }
+}
+
+// Heartbeat response or pushed command, as applyBackendInstructions()
+void VirtualTerminal::applyInstructions(const char* instructions) {
+  char hint[16];
+  if (findJsonScalar(instructions, strlen(instructions), "nextHeartbeatIn", hint, sizeof(hint))) {
+    uint32_t hintMs = (uint32_t)strtoul(hint, NULL, 10) * 1000;
+    hintMs = std::max((uint32_t)HEARTBEAT_HINT_MIN_MS, std::min(hintMs, (uint32_t)HEARTBEAT_HINT_MAX_MS));
+    _heartbeatDelay = jitterInterval(hintMs, SCHEDULE_JITTER_PERCENT, _random());
+  }
+
+  char syncLogs[8];
+  if (findJsonScalar(instructions, strlen(instructions), "syncLogs", syncLogs, sizeof(syncLogs)) &&
+      strcmp(syncLogs, "true") == 0 && _queue.count() > 0) {
+    syncOfflineLogs();
+  }
+}
+
+int VirtualTerminal::post(const std::string& url, const char* body, size_t length,
+                          char* response, size_t responseSize) {
+  _stats.backendRequests++;
+  int code = _transport.postJson(url.c_str(), body, length, response, responseSize);
+  if (code < 200 || code >= 300) {
+    _stats.backendErrors++;
+  }
+  return code;
+}
@@ -0,0 +1,108 @@
+/*
+ * Virtual attendance terminal for the host fleet simulator
+ * Attendee Attendance Terminal v2.0 - host build
+ *
+ * Runs the same scan -> online POST -> offline fallback -> backlog sync ->
+ * heartbeat cycle as loop()/handleRFIDScan() in the firmware, on the shared
+ * attendance core and the host HAL. Display, LED and buzzer are not modelled.
+ */
+
+#ifndef VIRTUAL_TERMINAL_H
+#define VIRTUAL_TERMINAL_H
+
+#include <stdint.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "attendance_core.h"
+#include "hal_host.h"
+#include "sync_pacing.h"
+#include "upload_pipeline.h"
+
+struct VirtualTerminalConfig {
+  std::string deviceId;
+  std::string backendUrl;            // e.g. "http://127.0.0.1:5000/api"
+  uint32_t syncIntervalMs;           // SYNC_RETRY_INTERVAL by default
+  uint32_t heartbeatIntervalMs;      // HEARTBEAT_INTERVAL by default
+  uint8_t uploadWindow;              // UPLOAD_WINDOW by default; 0 = stop-and-wait drain
+  uint16_t commitBytes;              // OFFLINE_COMMIT_MAX_BYTES by default; 0 = write-through
+  uint32_t seed;                     // Stands in for ESP.random()
+};
+
+struct VirtualTerminalStats {
+  uint32_t scans;                    // Taps accepted after debounce
+  uint32_t debounced;                // Taps inside CARD_READ_DELAY
+  uint32_t onlineAccepted;           // 200/201 on the live path, or 202 from the MQTT broker
+  uint32_t rejected;                 // 400 on the live path
+  uint32_t storedOffline;
+  uint32_t droppedFull;              // Offline queue at MAX_OFFLINE_LOGS
+  uint32_t backendRequests;
+  uint32_t backendErrors;            // Non-2xx or transport failure
+  uint32_t syncPasses;
+  uint32_t syncThrottled;            // Passes cut short by 429/503
+  uint32_t syncUploaded;
+  uint32_t syncMs;                   // Time spent inside drain passes
+  uint32_t heartbeats;
+  uint32_t commands;                 // Instructions pushed over MQTT
+  std::vector<uint32_t> scanLatencyUs;   // Tap due -> result decided
+  std::vector<uint32_t> appendLatencyUs; // Offline appends and the group commits they trigger
+};
+
+class TerminalPipelineUploader;
+
+class VirtualTerminal {
+public:
+  VirtualTerminal(const VirtualTerminalConfig& config, TerminalStorage& storage,
+                  TerminalTransport& transport, ScriptedCardReader& reader,
+                  TerminalClock& clock);
+  ~VirtualTerminal();                // Out of line: TerminalPipelineUploader is private to the .cpp
+
+  void begin();                      // Recover the offline backlog, like setup()
+  void loop();                       // One pass of the firmware main loop
+  bool syncOfflineLogs();            // Returns true when the backlog is empty
+
+  bool isOnline() const { return _online; }
+  int getOfflineLogsCount() const { return _queue.count(); }
+  uint32_t getSequenceWrites() const { return _sequence.getReservationCount(); }
+  uint32_t getOfflineWrites() const { return _queue.getWriteCount(); }
+  const VirtualTerminalStats& getStats() const { return _stats; }
+
+private:
+  friend class TerminalSyncUploader;
+  friend class TerminalPipelineUploader;
+
+  void handleScan(const uint8_t* uid, uint8_t uidLength);
+  void processOnlineAttendance(const char* payload, size_t length);
+  void processOfflineAttendance(const char* payload, size_t length);
+  void sendHeartbeat();
+  void applyInstructions(const char* instructions);
+  void scheduleSpreadSync();
+  int post(const std::string& url, const char* body, size_t length, char* response, size_t responseSize);
+
+  VirtualTerminalConfig _config;
+  TerminalTransport& _transport;
+  ScriptedCardReader& _reader;
+  TerminalClock& _clock;
+  OfflineQueue _queue;
+  SequenceAllocator _sequence;
+  SocketConnection _connections[UPLOAD_WINDOW_MAX];
+  std::unique_ptr<TerminalPipelineUploader> _pipeline;
+  std::unique_ptr<UploadWindow> _uploadWindow;
+  std::string _attendanceUrl;
+  std::string _heartbeatUrl;
+
+  bool _online;
+  bool _hasScanned;
+  uint32_t _lastCardScan;
+  uint32_t _lastSyncAttempt;
+  uint32_t _lastHeartbeat;
+  uint32_t _syncDelay;
+  uint32_t _heartbeatDelay;
+  uint32_t _startMs;
+  SyncPacer _pacer;
+  std::mt19937 _random;
+  VirtualTerminalStats _stats;
+};
+
+#endif // VIRTUAL_TERMINAL_H
@@ -0,0 +1,101 @@
+#!/usr/bin/env node
+/*
+ * Convert an attendance terminal trace dump (GET /api/trace) into
+ * Chrome trace / Perfetto JSON.
+ *
+ * Usage:
+ *   node trace_to_chrome.js http://<device-ip>/api/trace > scan.trace.json
+ *   node trace_to_chrome.js dump.json -o scan.trace.json
+ *
+ * Open the result in chrome://tracing or https://ui.perfetto.dev
+ */
+
+const fs = require('fs');
+
+async function loadDump(source) {
+  if (/^https?:\/\//.test(source)) {
+    const response = await fetch(source);
+    if (!response.ok) {
+      throw new Error(`HTTP ${response.status} fetching ${source}`);
+    }
+    return response.json();
+  }
+  return JSON.parse(fs.readFileSync(source, 'utf8'));
+}
+
+// Device timestamps are a 32-bit micros() counter that wraps every ~71 minutes
+function unwrapTimestamps(events) {
+  let offset = 0;
+  let previous = null;
+  return events.map((event) => {
+    if (previous !== null && event.t < previous) {
+      offset += 0x100000000;
+    }
+    previous = event.t;
+    return event.t + offset;
+  });
+}
+
+function convert(dump) {
+  const events = dump.events || [];
+  const timestamps = unwrapTimestamps(events);
+  const origin = timestamps.length > 0 ? timestamps[0] : 0;
+  const pid = 1;
+  const deviceName = dump.deviceId || 'terminal';
+
+  const traceEvents = [
+    { name: 'process_name', ph: 'M', pid, tid: 1, args: { name: `${deviceName} (fw ${dump.firmware || '?'})` } },
+    { name: 'thread_name', ph: 'M', pid, tid: 1, args: { name: 'loop()' } }
+  ];
+
+  events.forEach((event, index) => {
+    const traceEvent = {
+      name: event.n,
+      ph: event.ph,
+      ts: timestamps[index] - origin,
+      pid,
+      tid: 1,
+      args: { arg: event.a }
+    };
+    if (event.ph === 'i') {
+      traceEvent.s = 't';
+    }
+    traceEvents.push(traceEvent);
+  });
+
+  return {
+    traceEvents,
+    displayTimeUnit: 'ms',
+    metadata: { deviceId: dump.deviceId, firmware: dump.firmware, overwritten: dump.overwritten }
+  };
+}
+
+async function main() {
+  const args = process.argv.slice(2);
+  const outputIndex = args.indexOf('-o');
+  let output = null;
+  if (outputIndex >= 0) {
+    output = args[outputIndex + 1];
+    args.splice(outputIndex, 2);
+  }
+
+  if (args.length !== 1) {
+    console.error('Usage: node trace_to_chrome.js <dump.json | http://device/api/trace> [-o out.json]');
+    process.exit(1);
+  }
+
+  const dump = await loadDump(args[0]);
+  const json = JSON.stringify(convert(dump));
+
+  if (output) {
+    fs.writeFileSync(output, json);
+    console.error(`Wrote ${dump.events.length} events to ${output}`);
+  } else {
+    process.stdout.write(json + '\n');
+  }
+}
+
+main().catch((error) => {
+  console.error('Trace conversion failed:', error.message);
+  process.exit(1);
+});